@@ -15,12 +15,20 @@
 
 ##' Contributions
 ##'
-##' See contributions to a Git repo
+##' See contributions to a Git repo. The history is walked once from
+##' HEAD and the commits are counted in C. The time of a commit is the
+##' time of the author, in the timezone of the author.
 ##' @rdname contributions-methods
 ##' @docType methods
 ##' @param repo The repository.
 ##' @param breaks Default is \code{month}. Change to week or day as necessary.
 ##' @param by Contributions by "commits" or "author". Default is "commits".
+##' @param since Only count commits at or after this time. Default
+##' is \code{NULL} to count all commits.
+##' @param until Only count commits at or before this time. Default
+##' is \code{NULL} to count all commits.
+##' @param path Only count commits that change these paths. Default
+##' is \code{NULL} to count all commits.
 ##' @return A \code{data.frame} with contributions.
 ##' @keywords methods
 ##' @include repository.r
@@ -34,22 +42,32 @@
 ##'
 ##' ## If the path is somewhere else
 ##' contributions("/path/to/repo")
+##'
+##' ## Contributions by author to the R directory during 2014
+##' contributions("/path/to/repo", by = "author",
+##'               since = as.POSIXct("2014-01-01"),
+##'               until = as.POSIXct("2014-12-31 23:59:59"),
+##'               path = "R")
 ##'}
 setGeneric("contributions",
            signature = "repo",
            function(repo,
                     breaks = c("month", "week", "day"),
-                    by = c("commits", "author"))
+                    by = c("commits", "author"),
+                    since = NULL,
+                    until = NULL,
+                    path = NULL)
            standardGeneric("contributions"))
 
 ##' @rdname contributions-methods
 ##' @export
 setMethod("contributions",
           signature(repo = "missing"),
-          function (repo, breaks, by)
+          function (repo, breaks, by, since, until, path)
           {
               ## Try current working directory
-              contributions(getwd(), breaks = breaks, by = by)
+              contributions(getwd(), breaks = breaks, by = by,
+                            since = since, until = until, path = path)
           }
 )
 
@@ -57,9 +75,10 @@ setMethod("contributions",
 ##' @export
 setMethod("contributions",
           signature(repo = "character"),
-          function (repo, breaks, by)
+          function (repo, breaks, by, since, until, path)
           {
-              contributions(repository(repo), breaks = breaks, by = by)
+              contributions(repository(repo), breaks = breaks, by = by,
+                            since = since, until = until, path = path)
           }
 )
 
@@ -67,31 +86,29 @@ setMethod("contributions",
 ##' @export
 setMethod("contributions",
           signature(repo = "git_repository"),
-          function (repo, breaks, by)
+          function (repo, breaks, by, since, until, path)
           {
               breaks <- match.arg(breaks)
               by <- match.arg(by)
 
-              df <- as(repo, "data.frame")
-              df$when <- as.POSIXct(cut(df$when, breaks = breaks))
+              ## Argument checking
+              stopifnot(is.null(since) || identical(length(since), 1L),
+                        is.null(until) || identical(length(until), 1L),
+                        is.null(path) || is.character(path))
 
-              if(identical(by, "commits")) {
-                  df <- as.data.frame(table(df$when))
-                  names(df) <- c("when", "n")
-                  df$when <- as.Date(df$when)
-                  return(df)
-              }
+              since <- if (is.null(since)) NA_real_ else as.numeric(as.POSIXct(since))
+              until <- if (is.null(until)) NA_real_ else as.numeric(as.POSIXct(until))
+              if (is.null(path))
+                  path <- character(0)
 
-              ## Create an index and tabulate
-              df$index <- paste0(df$when, df$author, df$email)
-              count <- as.data.frame(table(df$index),
-                                     stringsAsFactors=FALSE)
-              names(count) <- c("index", "n")
+              df <- .Call("contributions", repo, breaks, by, since, until, path)
+
+              ## Order the authors with the collation of the locale
+              if (identical(by, "author") && nrow(df) > 1) {
+                  df <- df[order(df$when, df$author), ]
+                  rownames(df) <- NULL
+              }
 
-              ## Match counts and clean result
-              df$n <- count$n[match(df$index, count$index)]
-              df <- unique(df[, c("when", "author", "n")])
-              df$when <- as.Date(substr(as.character(df$when), 1, 10))
-              df[order(df$when, df$author),]
+              df
           }
 )
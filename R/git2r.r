@@ -15,6 +15,38 @@
 
 ##' git2r: R bindings to the libgit2 library
 ##'
+##' Run basic git commands on a repository from R, and extract
+##' descriptive statistics from its history, with the libgit2 library
+##' that is bundled with the package.
+##' @section Options:
+##' \describe{
+##'   \item{git2r.pack.threads}{
+##'     The number of threads used to search for deltas when building
+##'     a pack, e.g. when cloning a local repository. \code{0} uses
+##'     one thread per online CPU. The \code{pack.threads} config of
+##'     the repository takes precedence. Default is \code{0}.
+##'   }
+##'   \item{git2r.index.threads}{
+##'     The number of threads used to resolve the deltas when indexing
+##'     a received pack, e.g. when cloning. \code{0} uses one thread
+##'     per online CPU. Default is \code{0}.
+##'   }
+##'   \item{git2r.add.threads}{
+##'     The number of threads used to write the blobs of the files
+##'     added to the index. Files that are stored with filters, e.g.
+##'     line ending conversion, are written on one thread. \code{0}
+##'     uses one thread per online CPU. Default is \code{0}.
+##'   }
+##'   \item{git2r.preload.threads}{
+##'     The maximum number of threads used by \code{status} to lstat
+##'     the files of the index before scanning the working directory,
+##'     with one thread per 500 files. The lstat calls wait on the file
+##'     system, so more threads than CPUs help on network file
+##'     systems. No preload is done when the \code{core.preloadIndex}
+##'     config of the repository is \code{false}. \code{0} uses up to
+##'     20 threads. Default is \code{0}.
+##'   }
+##' }
 ##' @docType package
 ##' @name git2r
 ##' @import methods
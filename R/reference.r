@@ -58,7 +58,10 @@ setClass("git_reference",
 ##' @rdname references-methods
 ##' @docType methods
 ##' @param object The repository \code{object}.
-##' @return Character vector with references
+##' @param prefix Only list the references whose name starts with
+##' \code{prefix}, e.g. 'refs/tags/'. Default is NULL to list all
+##' references.
+##' @return Named list with the references
 ##' @keywords methods
 ##' @examples
 ##' \dontrun{
@@ -67,20 +70,70 @@ setClass("git_reference",
 ##'
 ##' ## List all references in repository
 ##' references(repo)
+##'
+##' ## List the remote branches
+##' references(repo, "refs/remotes/")
 ##' }
 ##'
 setGeneric("references",
            signature = "object",
-           function(object) standardGeneric("references"))
+           function(object, prefix = NULL) standardGeneric("references"))
 
 ##' @rdname references-methods
 ##' @include repository.r
 ##' @export
 setMethod("references",
           signature(object = "git_repository"),
-          function (object)
+          function (object, prefix)
+          {
+              .Call("references", object, prefix)
+          }
+)
+
+##' List the targets of the references of a repository
+##'
+##' The references are listed in one pass, reading only the folders
+##' and the part of the packed-refs file that can hold references
+##' whose name starts with \code{prefix}. The peeled target of an
+##' annotated tag is taken from the packed-refs file, or the
+##' reference tables, when it is stored there.
+##' @rdname reference_targets-methods
+##' @docType methods
+##' @param object The repository \code{object}.
+##' @param prefix Only list the references whose name starts with
+##' \code{prefix}, e.g. 'refs/tags/'. Default is NULL to list all
+##' references.
+##' @return data.frame with the columns:
+##' \describe{
+##'   \item{name}{The full name of the reference}
+##'   \item{symbolic}{TRUE if the reference is symbolic}
+##'   \item{target}{The sha of the target, or the name of the target
+##'   of a symbolic reference}
+##'   \item{peeled}{The sha of the object an annotated tag points to,
+##'   else NA}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## List the targets of the tags
+##' reference_targets(repo, "refs/tags/")
+##' }
+##'
+setGeneric("reference_targets",
+           signature = "object",
+           function(object, prefix = NULL) standardGeneric("reference_targets"))
+
+##' @rdname reference_targets-methods
+##' @include repository.r
+##' @export
+setMethod("reference_targets",
+          signature(object = "git_repository"),
+          function (object, prefix)
           {
-              .Call("references", object)
+              .Call("reference_targets", object, prefix)
           }
 )
 
@@ -48,6 +48,8 @@ setClass("git_repository",
 ##'
 ##' The commits in the repository are coerced to a \code{data.frame}
 ##'
+##' The history is walked once from HEAD and the columns are filled
+##' in the same pass.
 ##'
 ##' The \code{data.frame} have the following columns:
 ##' \describe{
@@ -73,7 +75,20 @@ setClass("git_repository",
 ##'   }
 ##'
 ##'   \item{when}{
-##'     time when the commit happened
+##'     time when the commit happened, the wall-clock time of the
+##'     author in the "GMT" timezone
+##'   }
+##'
+##'   \item{offset}{
+##'     timezone offset of the author in minutes
+##'   }
+##'
+##'   \item{committer}{
+##'     full name of the committer
+##'   }
+##'
+##'   \item{parents}{
+##'     number of parents of the commit
 ##'   }
 ##'
 ##' }
@@ -97,15 +112,7 @@ setAs(from="git_repository",
       to="data.frame",
       def=function(from)
       {
-          do.call("rbind", lapply(commits(from), function(x) {
-              data.frame(hex              = x@hex,
-                         summary          = x@summary,
-                         message          = x@message,
-                         author           = x@author@name,
-                         email            = x@author@email,
-                         when             = as(x@author@when, "POSIXct"),
-                         stringsAsFactors = FALSE)
-          }))
+          .Call("revisions_data_frame", from)
       }
 )
 
@@ -174,6 +181,12 @@ repository <- function(path) {
 ##' is created at the pointed path. If FALSE, provided path will be
 ##' considered as the working directory into which the .git directory
 ##' will be created.
+##' @param ref_storage How to store the references. 'files' stores
+##' each reference in a file and the packed references in the
+##' packed-refs file. 'table' stores the references and the reflogs in
+##' reference tables in the reftable folder, which are updated
+##' atomically and stay fast with many references. Only git2r can read
+##' a repository with reference tables.
 ##' @return A S4 \code{git_repository} object
 ##' @keywords methods
 ##' @export
@@ -181,20 +194,24 @@ repository <- function(path) {
 ##' \dontrun{
 ##' ## Init a repository
 ##' repo <- init("path/to/git2r")
+##'
+##' ## Init a repository that stores the references in tables
+##' repo <- init("path/to/many-refs", ref_storage = "table")
 ##' }
-init <- function(path, bare = FALSE) {
+init <- function(path, bare = FALSE, ref_storage = c("files", "table")) {
     ## Argument checking
     stopifnot(is.character(path),
               identical(length(path), 1L),
               nchar(path) > 0,
               is.logical(bare),
               identical(length(bare), 1L))
+    ref_storage <- match.arg(ref_storage)
 
     path <- normalizePath(path, winslash = "/", mustWork = TRUE)
     if(!file.info(path)$isdir)
         stop("path is not a directory")
 
-    .Call("init", path, bare)
+    .Call("init", path, bare, identical(ref_storage, "table"))
 
     new("git_repository", path=path)
 }
@@ -230,11 +247,20 @@ clone <- function(url, local_path, progress = TRUE) {
 
 ##' Add file(s) to index
 ##'
+##' The paths are matched against the working directory in one pass,
+##' and the index is written once. The blobs of the matched files are
+##' written on several threads, set by the option
+##' \code{git2r.add.threads}. Ignored files are skipped unless
+##' \code{force} is TRUE. An error is raised, and nothing is added, if
+##' a path matches no file.
 ##' @rdname add-methods
 ##' @docType methods
 ##' @param object The repository \code{object}.
-##' @param path character vector with filenames to add. The path must
-##' be relative to the repository's working filder.
+##' @param path character vector with filenames or pathspecs to add,
+##' e.g. \code{"dir/*.txt"}. The paths are globs, so '*', '?' and
+##' '[' match other characters. The path must be relative to the
+##' repository's working folder. A directory adds the files below it.
+##' @param force add ignored files. Default FALSE.
 ##' @return invisible(NULL)
 ##' @keywords methods
 ##' @examples
@@ -244,23 +270,26 @@ clone <- function(url, local_path, progress = TRUE) {
 ##'
 ##' ## Add file repository
 ##' add(repo, "file-to-add")
+##'
+##' ## Add all R files in a folder
+##' add(repo, "R/*.r")
 ##' }
 ##'
 setGeneric("add",
            signature = "object",
-           function(object, path) standardGeneric("add"))
+           function(object, path, force = FALSE) standardGeneric("add"))
 
 ##' @rdname add-methods
 ##' @export
 setMethod("add",
           signature(object = "git_repository"),
-          function (object, path)
+          function (object, path, force)
           {
               ## Argument checking
               stopifnot(is.character(path),
                         all(nchar(path) > 0))
 
-              lapply(path, function(x) .Call("add", object, x))
+              .Call("add", object, path, force)
 
               invisible(NULL)
           }
@@ -443,6 +472,42 @@ setMethod("remote_url",
           }
 )
 
+##' Fetch
+##'
+##' Download the objects and references from a remote and update the
+##' remote-tracking references, e.g. 'refs/remotes/origin/master'. The
+##' references are updated at once, so if one of them can't be
+##' updated, e.g. because it is locked by another process, none of
+##' them are updated and an error is raised.
+##' @rdname fetch-methods
+##' @docType methods
+##' @param object The repository \code{object}.
+##' @param name The name of the remote. Default is 'origin'.
+##' @return invisible NULL
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Fetch from origin
+##' fetch(repo)
+##' }
+##'
+setGeneric("fetch",
+           signature = "object",
+           function(object, name = "origin") standardGeneric("fetch"))
+
+##' @rdname fetch-methods
+##' @export
+setMethod("fetch",
+          signature(object = "git_repository"),
+          function (object, name)
+          {
+              invisible(.Call("fetch", object, name))
+          }
+)
+
 ##' Get the signature
 ##'
 ##' Get the signature according to the repository's configuration
@@ -518,11 +583,11 @@ setMethod("summary",
               cat(sprintf("Tags:          %i\n", n))
 
               ## Commits
-              n <- length(commits(object))
-              cat(sprintf("Commits:       %i\n", n))
+              df <- as(object, "data.frame")
+              cat(sprintf("Commits:       %i\n", nrow(df)))
 
               ## Contributors
-              n <- length(unique(sapply(lapply(commits(object), slot, "author"), slot, "name")))
+              n <- length(unique(df$author))
               cat(sprintf("Contributors:  %i\n", n))
           }
 )
@@ -547,3 +612,543 @@ setMethod("workdir",
               .Call("workdir", object)
           }
 )
+
+##' Write the commit-graph file of a repository
+##'
+##' The commit-graph file \code{objects/info/commit-graph} stores the
+##' parents, commit time and generation number of every commit
+##' reachable from the references. Walking the history and finding
+##' merge bases then reads the commit-graph instead of inflating and
+##' parsing each commit object. The file has the same format as the
+##' one written by \code{git commit-graph write}, and is rewritten
+##' with the new commits each time the method is called.
+##' @rdname write_commit_graph-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return invisible NULL
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Write the commit-graph
+##' write_commit_graph(repo)
+##' }
+##'
+setGeneric("write_commit_graph",
+           signature = "object",
+           function(object) standardGeneric("write_commit_graph"))
+
+##' @rdname write_commit_graph-methods
+##' @export
+setMethod("write_commit_graph",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              invisible(.Call("write_commit_graph", object))
+          }
+)
+
+##' Write the reachability bitmaps of a repository
+##'
+##' The bitmap file next to the largest packfile stores, for the
+##' commits at the tips of the references and for one commit in every
+##' hundred of the history, the set of objects reachable from the
+##' commit as a compressed bitmap with one bit per object of the
+##' pack. Counting the objects reachable from a revision, the commits
+##' ahead and behind, and the objects to send when cloning, fetching
+##' or pushing then combine the bitmaps instead of walking every
+##' commit and tree. The file has the same format as the one written
+##' by \code{git repack -b}, so bitmaps written by git are also used.
+##' @rdname write_bitmap_index-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return invisible NULL
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Write the bitmaps
+##' write_bitmap_index(repo)
+##' }
+##'
+setGeneric("write_bitmap_index",
+           signature = "object",
+           function(object) standardGeneric("write_bitmap_index"))
+
+##' @rdname write_bitmap_index-methods
+##' @export
+setMethod("write_bitmap_index",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              invisible(.Call("write_bitmap_index", object))
+          }
+)
+
+##' Count the commits ahead and behind
+##'
+##' Count the commits reachable from \code{local} but not from
+##' \code{upstream}, and the commits reachable from \code{upstream}
+##' but not from \code{local}. The counts are read from the
+##' reachability bitmaps when the repository has them.
+##' @rdname ahead_behind-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param local The local revision, e.g. a branch name or a sha
+##' @param upstream The upstream revision
+##' @return integer vector with the number of commits ahead and
+##' behind
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ahead_behind(repo, "master", "origin/master")
+##' }
+##'
+setGeneric("ahead_behind",
+           signature = "object",
+           function(object, local, upstream) standardGeneric("ahead_behind"))
+
+##' @rdname ahead_behind-methods
+##' @export
+setMethod("ahead_behind",
+          signature(object = "git_repository"),
+          function (object, local, upstream)
+          {
+              .Call("ahead_behind", object, local, upstream)
+          }
+)
+
+##' Count the objects reachable from revisions
+##'
+##' Count the objects reachable from the revisions in \code{include}
+##' but not from the revisions in \code{exclude}, like \code{git
+##' rev-list --objects --count include --not exclude}. The objects of
+##' the commits that have a reachability bitmap are read from the
+##' bitmap instead of walking their trees.
+##' @rdname count_reachable-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param include The revisions to count the objects of
+##' @param exclude The revisions whose objects are not counted
+##' @return named integer vector with the number of commits, trees,
+##' blobs and tags
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Count the objects to send to update origin/master
+##' count_reachable(repo, "master", "origin/master")
+##' }
+##'
+setGeneric("count_reachable",
+           signature = "object",
+           function(object, include = "HEAD", exclude = character(0))
+           standardGeneric("count_reachable"))
+
+##' @rdname count_reachable-methods
+##' @export
+setMethod("count_reachable",
+          signature(object = "git_repository"),
+          function (object, include, exclude)
+          {
+              .Call("count_reachable", object, include, exclude)
+          }
+)
+
+##' Write the multi-pack-index of a repository
+##'
+##' The multi-pack-index \code{objects/pack/multi-pack-index} is one
+##' sorted table of the objects in all the packfiles of a repository,
+##' with the packfile and offset of each object. An object is then
+##' found with one binary search instead of one search in the index of
+##' each packfile, so a lookup does not get slower as fetches add
+##' packfiles. Packfiles added after the file was written are still
+##' searched one by one until the method is called again. The file has
+##' the same format as the one written by \code{git multi-pack-index
+##' write}.
+##' @rdname write_multi_pack_index-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return invisible NULL
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Write the multi-pack-index and check it
+##' write_multi_pack_index(repo)
+##' verify_multi_pack_index(repo)
+##' }
+##'
+setGeneric("write_multi_pack_index",
+           signature = "object",
+           function(object) standardGeneric("write_multi_pack_index"))
+
+##' @rdname write_multi_pack_index-methods
+##' @export
+setMethod("write_multi_pack_index",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              invisible(.Call("write_multi_pack_index", object))
+          }
+)
+
+##' Verify the multi-pack-index of a repository
+##'
+##' Check the checksum of the multi-pack-index, that its packfiles
+##' exist and that each object is at the recorded offset in the index
+##' of its packfile.
+##' @rdname verify_multi_pack_index-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return TRUE if the multi-pack-index is valid or if the
+##' repository has none, else an error describing the problem.
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' verify_multi_pack_index(repo)
+##' }
+##'
+setGeneric("verify_multi_pack_index",
+           signature = "object",
+           function(object) standardGeneric("verify_multi_pack_index"))
+
+##' @rdname verify_multi_pack_index-methods
+##' @export
+setMethod("verify_multi_pack_index",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              .Call("verify_multi_pack_index", object)
+          }
+)
+
+##' Delta base cache of a repository
+##'
+##' Objects in a pack are often stored as deltas against a base
+##' object. Each packfile keeps the most recently used bases inflated
+##' in a cache, and evicts the least recently used base when the cache
+##' is full. A base larger than 1/16 of the limit is not cached. The
+##' default limit is 16MB per packfile, or the value of the
+##' \code{core.deltaBaseCacheLimit} config of the repository.
+##' @rdname delta_base_cache-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param limit The memory limit in bytes of the cache of each
+##' packfile. Default NULL keeps the current limit.
+##' @return list with the statistics of the caches, summed over the
+##' packfiles:
+##' \describe{
+##'   \item{memory_used}{Bytes of inflated bases in the caches}
+##'   \item{memory_limit}{The memory limit of the cache of each packfile}
+##'   \item{entries}{Number of cached bases}
+##'   \item{hits}{Lookups that found the base in a cache}
+##'   \item{misses}{Lookups that had to inflate the base}
+##'   \item{evictions}{Bases evicted to make room for others}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Use a 64MB cache for each packfile
+##' delta_base_cache(repo, 64 * 1024^2)
+##'
+##' ## Check the hit rate after a walk of the history
+##' commits(repo)
+##' delta_base_cache(repo)
+##' }
+##'
+setGeneric("delta_base_cache",
+           signature = "object",
+           function(object, limit = NULL) standardGeneric("delta_base_cache"))
+
+##' @rdname delta_base_cache-methods
+##' @export
+setMethod("delta_base_cache",
+          signature(object = "git_repository"),
+          function (object, limit)
+          {
+              .Call("delta_base_cache", object, limit)
+          }
+)
+
+##' Object cache of a repository
+##'
+##' Each repository keeps the objects that were looked up in a cache,
+##' up to a size limit that is shared by all repositories. When the
+##' caches are above the limit, the objects of a repository that were
+##' not used since the last sweep of its cache are evicted first. The
+##' limits are set with \code{\link{object_cache_limits}}.
+##' @rdname object_cache-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return list with the statistics of the cache:
+##' \describe{
+##'   \item{entries}{Number of cached objects}
+##'   \item{memory_used}{Bytes of object data in the cache}
+##'   \item{hits}{Lookups that found the object in the cache}
+##'   \item{misses}{Lookups that had to read the object}
+##'   \item{evictions}{Objects evicted to keep the caches under the limit}
+##'   \item{total_memory_used}{Bytes of object data in the caches of
+##'     all repositories}
+##'   \item{max_size}{The limit of the caches of all repositories}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Check the hit rate after a walk of the history
+##' commits(repo)
+##' object_cache(repo)
+##' }
+##'
+setGeneric("object_cache",
+           signature = "object",
+           function(object) standardGeneric("object_cache"))
+
+##' @rdname object_cache-methods
+##' @export
+setMethod("object_cache",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              .Call("object_cache", object)
+          }
+)
+
+##' Size limits of the object caches
+##'
+##' Get, and optionally set, the size limits of the object caches of
+##' the repositories. An object is cached if it is smaller than the
+##' limit for its type, and the caches of all repositories together
+##' hold at most \code{max_size} bytes. A limit of 0 turns off the
+##' caching of a type. The defaults are 256MB in total, 4096 bytes
+##' for commits, trees and tags, and 0 for blobs.
+##' @param max_size The maximum total bytes of cached objects.
+##' Default NULL keeps the current value.
+##' @param commit The maximum size of a cached commit. Default NULL
+##' keeps the current value.
+##' @param tree The maximum size of a cached tree. Default NULL keeps
+##' the current value.
+##' @param blob The maximum size of a cached blob. Default NULL keeps
+##' the current value.
+##' @param tag The maximum size of a cached tag. Default NULL keeps
+##' the current value.
+##' @return list with the limits \code{max_size}, \code{commit},
+##' \code{tree}, \code{blob} and \code{tag} before the call,
+##' invisibly if a limit was set.
+##' @export
+##' @examples
+##' ## Cache blobs up to 64KB, and use at most 512MB
+##' op <- object_cache_limits(max_size = 512 * 1024^2, blob = 65536)
+##'
+##' ## Restore the previous limits
+##' do.call(object_cache_limits, op)
+object_cache_limits <- function(max_size = NULL,
+                                commit = NULL,
+                                tree = NULL,
+                                blob = NULL,
+                                tag = NULL)
+{
+    old <- .Call("object_cache_limits", NULL, NULL, NULL, NULL, NULL)
+    if (is.null(max_size) && is.null(commit) && is.null(tree) &&
+        is.null(blob) && is.null(tag))
+        return(old)
+    .Call("object_cache_limits", max_size, commit, tree, blob, tag)
+    invisible(old)
+}
+
+##' List the objects of a repository
+##'
+##' List every object of the object database with its type and
+##' size. The objects of a packfile are read in pack order from the
+##' pack index and the object headers, without inflating the objects:
+##' only the first bytes of a delta are inflated to read its size. An
+##' object stored in several packfiles, or both loose and packed, is
+##' listed once for each copy.
+##' @rdname odb_objects-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @return data.frame with the columns
+##' \describe{
+##'   \item{hex}{The sha of the object}
+##'   \item{type}{The type of the object}
+##'   \item{size}{The size in bytes of the inflated object}
+##'   \item{pack}{The file name of the packfile of the object, or NA
+##'     for a loose object}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Total size of the objects by type
+##' objects <- odb_objects(repo)
+##' tapply(objects$size, objects$type, sum)
+##' }
+##'
+setGeneric("odb_objects",
+           signature = "object",
+           function(object) standardGeneric("odb_objects"))
+
+##' @rdname odb_objects-methods
+##' @export
+setMethod("odb_objects",
+          signature(object = "git_repository"),
+          function (object)
+          {
+              .Call("odb_objects", object)
+          }
+)
+
+##' Read the type and size of objects
+##'
+##' The headers of the objects are read in one batch: the packed
+##' objects are read pack by pack in the order of the packfile, and a
+##' delta chain shared by several objects is only followed once. The
+##' objects are not inflated.
+##' @rdname odb_headers-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param hex Character vector with the sha of the objects
+##' @return data.frame with the columns
+##' \describe{
+##'   \item{hex}{The sha of the object}
+##'   \item{type}{The type of the object, or NA if the object is not
+##'     in the repository}
+##'   \item{size}{The size in bytes of the inflated object, or NA}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' odb_headers(repo, sapply(commits(repo), function(x) x@@hex))
+##' }
+##'
+setGeneric("odb_headers",
+           signature = "object",
+           function(object, hex) standardGeneric("odb_headers"))
+
+##' @rdname odb_headers-methods
+##' @export
+setMethod("odb_headers",
+          signature(object = "git_repository"),
+          function (object, hex)
+          {
+              .Call("odb_headers", object, hex)
+          }
+)
+
+##' Size of a file in the history
+##'
+##' Walk the history and find the blob at \code{path} in the tree of
+##' each commit. The sizes of the blobs are read from the object
+##' headers in one batch, without inflating the blobs.
+##' @rdname blob_sizes-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param path The path of the file, relative to the root of the
+##' repository.
+##' @param push Revisions to start the walk from. Default is "HEAD".
+##' @return data.frame with one row for each commit that has the file,
+##' most recent first, with the columns
+##' \describe{
+##'   \item{commit}{The sha of the commit}
+##'   \item{blob}{The sha of the blob}
+##'   \item{size}{The size in bytes of the blob}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## The size of each version of the DESCRIPTION file
+##' sizes <- blob_sizes(repo, "DESCRIPTION")
+##' unique(sizes[, c("blob", "size")])
+##' }
+##'
+setGeneric("blob_sizes",
+           signature = "object",
+           function(object, path, push = "HEAD")
+           standardGeneric("blob_sizes"))
+
+##' @rdname blob_sizes-methods
+##' @export
+setMethod("blob_sizes",
+          signature(object = "git_repository"),
+          function (object, path, push)
+          {
+              .Call("blob_sizes", object, path, push)
+          }
+)
+
+##' Memory mapped windows of the packfiles of a repository
+##'
+##' The packfiles are read through windows of the files that are
+##' mapped in memory on demand. When more than the mapped limit is
+##' mapped, the least recently used windows are closed. The limits of
+##' a repository are set with the \code{core.packedGitWindowSize} and
+##' \code{core.packedGitLimit} configs, and default to a window size
+##' of 1GB and a limit of 8GB for all repositories on a 64-bit system.
+##' @rdname pack_windows-methods
+##' @docType methods
+##' @param object The repository \code{object}
+##' @param limit The limit in bytes of the memory mapped from the
+##' packfiles of the repository. Default NULL keeps the current limit.
+##' @param window_size The size in bytes of the windows, rounded up to
+##' a multiple of 128KB. Default NULL keeps the current size.
+##' @return list with the statistics of the windows:
+##' \describe{
+##'   \item{window_size}{The size of the windows}
+##'   \item{mapped_limit}{The limit of the mapped memory}
+##'   \item{mapped}{Bytes mapped from the packfiles}
+##'   \item{peak_mapped}{Highest number of bytes mapped}
+##'   \item{open_windows}{Number of mapped windows}
+##'   \item{mmap_calls}{Number of windows mapped so far}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Map at most 64MB of the packfiles, in windows of 16MB
+##' pack_windows(repo, 64 * 1024^2, 16 * 1024^2)
+##' }
+##'
+setGeneric("pack_windows",
+           signature = "object",
+           function(object, limit = NULL, window_size = NULL)
+           standardGeneric("pack_windows"))
+
+##' @rdname pack_windows-methods
+##' @export
+setMethod("pack_windows",
+          signature(object = "git_repository"),
+          function (object, limit, window_size)
+          {
+              .Call("pack_windows", object, limit, window_size)
+          }
+)
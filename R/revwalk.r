@@ -0,0 +1,137 @@
+## git2r, R bindings to the libgit2 library.
+## Copyright (C) 2013-2014  Stefan Widgren
+##
+## This program is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, version 2 of the License.
+##
+## git2r is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+##' Class \code{"git_revwalk"}
+##'
+##' @title S4 class to iterate over the commits in a repository
+##' @section Slots:
+##' \describe{
+##'   \item{repo}{
+##'     The repository of the walk
+##'   }
+##'   \item{walker}{
+##'     External pointer to the walker
+##'   }
+##' }
+##' @name git_revwalk-class
+##' @docType class
+##' @keywords classes
+##' @section Methods:
+##' \describe{
+##'   \item{next_chunk}{\code{signature(object = "git_revwalk")}}
+##' }
+##' @keywords methods
+##' @include repository.r
+##' @export
+setClass("git_revwalk",
+         slots=c(repo   = "git_repository",
+                 walker = "externalptr"))
+
+##' Create an iterator over the commits in a repository
+##'
+##' The commits are read in chunks with \code{next_chunk}, which
+##' makes it possible to process a history that doesn't fit in
+##' memory, or to stop early.
+##' @param repo The repository
+##' @param sorting The sort mode of the walk. One or more of
+##' "none", "topological", "time" and "reverse". Default is "none".
+##' @param first_parent If TRUE, only the first parent of a merge
+##' commit is followed.
+##' @param push Revisions to start the walk from. Default is "HEAD".
+##' @param hide Revisions to hide from the walk. The ancestors of a
+##' hidden commit are also hidden.
+##' @param range Ranges on the form 'a..b' to walk, where 'a' is
+##' hidden and 'b' is pushed.
+##' @return A S4 \code{git_revwalk} object
+##' @keywords methods
+##' @export
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Walk the history in chunks of 1000 commits
+##' walker <- revwalk(repo, sorting = "time")
+##' repeat {
+##'     chunk <- next_chunk(walker, 1000)
+##'     if (!nrow(chunk))
+##'         break
+##'     str(chunk)
+##' }
+##' }
+revwalk <- function(repo,
+                    sorting = "none",
+                    first_parent = FALSE,
+                    push = if (length(range)) character(0) else "HEAD",
+                    hide = character(0),
+                    range = character(0))
+{
+    ## Argument checking
+    stopifnot(is(repo, "git_repository"),
+              is.logical(first_parent),
+              identical(length(first_parent), 1L),
+              is.character(push),
+              is.character(hide),
+              is.character(range))
+
+    sorting <- match.arg(sorting,
+                         c("none", "topological", "time", "reverse"),
+                         several.ok = TRUE)
+    flags <- c(none = 0L, topological = 1L, time = 2L, reverse = 4L)
+    sorting <- sum(flags[unique(sorting)])
+
+    new("git_revwalk",
+        repo   = repo,
+        walker = .Call("revwalk_new", repo, sorting, first_parent,
+                       push, hide, range))
+}
+
+##' Next chunk of commits
+##'
+##' @rdname next_chunk-methods
+##' @docType methods
+##' @param object The \code{git_revwalk} object
+##' @param n The maximum number of commits in the chunk.
+##' @return A \code{data.frame} with at most \code{n} commits, with
+##' the same columns as when coercing a repository to a
+##' \code{data.frame}. A \code{data.frame} without rows is returned
+##' when the walk is done.
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## The ten most recent commits
+##' next_chunk(revwalk(repo, sorting = "time"), 10)
+##' }
+setGeneric("next_chunk",
+           signature = "object",
+           function(object, n = 1000L) standardGeneric("next_chunk"))
+
+##' @rdname next_chunk-methods
+##' @export
+setMethod("next_chunk",
+          signature(object = "git_revwalk"),
+          function (object, n)
+          {
+              ## Argument checking
+              stopifnot(is.numeric(n),
+                        identical(length(n), 1L),
+                        n >= 0)
+
+              .Call("revwalk_next_chunk", object@walker, as.integer(n))
+          }
+)
@@ -32,6 +32,21 @@ display_status <- function(title, section) {
 ##'
 ##' Display state of the repository working directory and the staging
 ##' area.
+##'
+##' When the repository sets the configuration
+##' \code{libgit2.untrackedCache} to \code{true}, the listing of each
+##' directory is kept in the index and reused as long as the directory
+##' does not change, which makes the scan of a large working directory
+##' faster. The listings are stored in an index extension that git does
+##' not read, and git drops it when it writes the index, so git's own
+##' \code{core.untrackedCache} is not used. The configuration
+##' \code{core.fsmonitor} can give a hook that reports the paths that
+##' changed since a token, e.g. from a file system watcher. The hook is
+##' called in the working directory with the arguments \code{2} and the
+##' last token, which is empty the first time, and prints a new token
+##' followed by the changed paths, each terminated by a NUL
+##' character. The path \code{/} means that anything may have changed.
+##' Directories that the hook does not report are not read at all.
 ##' @rdname status-methods
 ##' @docType methods
 ##' @param repo the \code{git_repository} to get status from.
@@ -88,3 +103,40 @@ setMethod("status",
               invisible(s)
           }
 )
+
+##' Status of many repositories
+##'
+##' Get the state of the working directory and the staging area of
+##' several repositories. The repositories are opened and scanned on
+##' native worker threads.
+##' @param repos list of \code{git_repository} objects.
+##' @param staged include staged files. Default TRUE.
+##' @param unstaged include unstaged files. Default TRUE.
+##' @param untracked include untracked files. Default TRUE.
+##' @param ignored include ignored files. Default FALSE.
+##' @param threads number of threads. Default 0 to use one thread per
+##' online CPU.
+##' @return list with the status of each repository, named by the
+##' path of the repository.
+##' @export
+##' @examples \dontrun{
+##' ## Open existing repositories
+##' repos <- lapply(c("path/to/git2r", "path/to/libgit2"), repository)
+##'
+##' statuses(repos, threads = 4)
+##'}
+statuses <- function(repos,
+                     staged = TRUE,
+                     unstaged = TRUE,
+                     untracked = TRUE,
+                     ignored = FALSE,
+                     threads = 0L)
+{
+    if (is(repos, "git_repository"))
+        repos <- list(repos)
+
+    s <- .Call("statuses", repos, staged, unstaged, untracked,
+               ignored, as.integer(threads))
+    names(s) <- vapply(repos, function(repo) repo@path, character(1))
+    s
+}
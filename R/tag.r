@@ -61,8 +61,63 @@ setClass("git_tag",
          }
 )
 
+##' Tag
+##'
+##' Create a tag of the commit at HEAD. The tag is a lightweight tag
+##' when \code{message} is NULL, else an annotated tag.
+##' @rdname tag-methods
+##' @docType methods
+##' @param object The repository \code{object}.
+##' @param name Name of the tag.
+##' @param message The tag message, or NULL to create a lightweight
+##' tag. Default is NULL.
+##' @param tagger The tagger (author) of an annotated tag.
+##' @return \code{git_tag} object of an annotated tag, NULL for a
+##' lightweight tag
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## Create an annotated tag and a lightweight tag
+##' tag(repo, "v1.0", "Release 1.0")
+##' tag(repo, "wip")
+##' }
+##'
+setGeneric("tag",
+           signature = "object",
+           function(object,
+                    name,
+                    message = NULL,
+                    tagger = default_signature(object))
+           standardGeneric("tag"))
+
+##' @rdname tag-methods
+##' @export
+setMethod("tag",
+          signature(object = "git_repository"),
+          function (object,
+                    name,
+                    message,
+                    tagger)
+          {
+              ## Argument checking
+              stopifnot(is.character(name),
+                        identical(length(name), 1L),
+                        nchar(name[1]) > 0,
+                        is.null(message) || (is.character(message) &&
+                                             identical(length(message), 1L)),
+                        is(tagger, "git_signature"))
+
+              .Call("tag_create", object, name, message, tagger)
+          }
+)
+
 ##' Tags
 ##'
+##' Only the annotated tags are listed, since a lightweight tag has no
+##' tag object. Use \code{tag_targets} to list all tags.
 ##' @rdname tags-methods
 ##' @docType methods
 ##' @param object The repository \code{object}.
@@ -83,6 +138,54 @@ setMethod("tags",
           }
 )
 
+##' List the targets of the tags of a repository
+##'
+##' Both annotated and lightweight tags are listed. The peeled target
+##' of an annotated tag is taken from the packed-refs file, or the
+##' reference tables, when it is stored there, so the tag objects are
+##' only read when \code{tagger} is TRUE.
+##' @rdname tag_targets-methods
+##' @docType methods
+##' @param object The repository \code{object}.
+##' @param tagger Read the tagger and the time of the annotated tags.
+##' Default is FALSE.
+##' @return data.frame with the columns:
+##' \describe{
+##'   \item{name}{The name of the tag}
+##'   \item{target}{The sha of the object the tag reference points to,
+##'   the tag object of an annotated tag}
+##'   \item{peeled}{The sha of the object the tag points to after
+##'   peeling annotated tags, usually a commit}
+##'   \item{tagger}{The name of the tagger, NA for a lightweight tag
+##'   or when \code{tagger} is FALSE}
+##'   \item{email}{The email of the tagger}
+##'   \item{when}{The time of the tag, the wall-clock time of the
+##'   tagger in the "GMT" timezone}
+##' }
+##' @keywords methods
+##' @examples
+##' \dontrun{
+##' ## Open an existing repository
+##' repo <- repository("path/to/git2r")
+##'
+##' ## List the tags with their tagger
+##' tag_targets(repo, tagger = TRUE)
+##' }
+##'
+setGeneric("tag_targets",
+           signature = "object",
+           function(object, tagger = FALSE) standardGeneric("tag_targets"))
+
+##' @rdname tag_targets-methods
+##' @export
+setMethod("tag_targets",
+          signature(object = "git_repository"),
+          function (object, tagger)
+          {
+              .Call("tags_data_frame", object, tagger)
+          }
+)
+
 ##' Brief summary of a tag
 ##'
 ##' @aliases show,git_tag-methods
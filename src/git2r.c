@@ -28,16 +28,25 @@
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
 
+#include <sys/stat.h>
+
 #include <git2.h>
 #include <git2/repository.h>
 
+#include "git2r_thread.h"
+
 static size_t count_staged_changes(git_status_list *status_list);
 static size_t count_unstaged_changes(git_status_list *status_list);
 static git_repository* get_repository(const SEXP repo);
+static const char* get_repository_path(const SEXP repo);
+static void columns_as_data_frame(SEXP columns, R_xlen_t nrow);
 static void init_commit(const git_commit *commit, SEXP sexp_commit);
+static git_repository* repository_cache_lookup(const char *path);
 static void init_reference(git_reference *ref, SEXP reference);
 static void init_signature(const git_signature *sig, SEXP signature);
-static int number_of_branches(git_repository *repo, int flags, size_t *n);
+static int revparse_oids(git_oid *oids, git_repository *repo, SEXP revs);
+static void set_pack_threads(void);
+static unsigned int threads_option(const char *name, int default_value);
 
 /**
  * Error messages
@@ -49,16 +58,159 @@ const char err_nothing_added_to_commit[] = "Nothing added to commit";
 const char err_unexpected_type_of_branch[] = "Unexpected type of branch";
 const char err_unexpected_head_of_branch[] = "Unexpected head of branch";
 
+/**
+ * Cache of opened repositories
+ *
+ * Opening a repository discovers the repository directory, reads the
+ * config and creates empty object, pack and reference caches. To keep
+ * these warm between calls from R, the opened repositories are kept
+ * in a process-wide cache keyed by the normalized path of the S4
+ * class git_repository. A cached repository is reopened when HEAD,
+ * config or packed-refs change on disk, and the index is re-read
+ * when it has changed.
+ */
+#define GIT2R_REPOSITORY_CACHE_SIZE 16
+
+enum {
+    GIT2R_STAMP_HEAD = 0,
+    GIT2R_STAMP_CONFIG,
+    GIT2R_STAMP_PACKED_REFS,
+    GIT2R_STAMP_INDEX,
+    GIT2R_N_STAMPS
+};
+
+static const char *repository_stamp_files[GIT2R_N_STAMPS] =
+    {"HEAD", "config", "packed-refs", "index"};
+
+typedef struct {
+    double mtime;
+    double size;
+    double ino;
+} git2r_stamp;
+
+typedef struct {
+    char *path;
+    git_repository *repository;
+    git2r_stamp stamps[GIT2R_N_STAMPS];
+    unsigned long last_used;
+} git2r_repository_cache_entry;
+
+static git2r_repository_cache_entry repository_cache[GIT2R_REPOSITORY_CACHE_SIZE];
+static unsigned long repository_cache_clock = 0;
+
+/**
+ * The paths of add, sorted, and if each one matched a file
+ */
+typedef struct {
+    const char **paths;
+    int *matched;
+    size_t count;
+} git2r_add_payload;
+
+static int add_compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/**
+ * Mark the path of add that matched a file
+ *
+ * @param path The path of the file
+ * @param matched_pathspec The path of add that matched the file
+ * @param payload git2r_add_payload
+ * @return 0 to add the file
+ */
+static int add_matched_cb(const char *path,
+                          const char *matched_pathspec,
+                          void *payload)
+{
+    git2r_add_payload *p = (git2r_add_payload*)payload;
+    const char **found;
+
+    if (matched_pathspec) {
+        found = bsearch(&matched_pathspec, p->paths, p->count,
+                        sizeof(char*), add_compare_paths);
+        if (found)
+            p->matched[found - p->paths] = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Note that a path of add matched a file, and skip the file
+ */
+static int add_found_cb(const char *path,
+                        const char *matched_pathspec,
+                        void *payload)
+{
+    *(int*)payload = 1;
+    return 1;
+}
+
+/**
+ * Check if a path of add matches a file in the index or in the
+ * working directory, ignored files included
+ *
+ * The callback of git_index_add_all is not called for the ignored
+ * files, and its pathspec is normalized, e.g. a trailing '/' is
+ * removed. This check is only made for the paths that were not seen
+ * by the callback.
+ * @param out 1 if the path matches a file, else 0
+ * @param index The index
+ * @param path The path of add
+ * @return 0 or an error code
+ */
+static int add_path_matches(int *out, git_index *index, const char *path)
+{
+    int err;
+    git_strarray paths;
+    git_pathspec *ps = NULL;
+
+    *out = 0;
+    paths.strings = (char**)&path;
+    paths.count = 1;
+
+    err = git_pathspec_new(&ps, &paths);
+    if (err < 0)
+        return err;
+
+    err = git_pathspec_match_index(NULL, index, GIT_PATHSPEC_NO_MATCH_ERROR, ps);
+    if (0 == err) {
+        *out = 1;
+    } else if (GIT_ENOTFOUND == err) {
+        giterr_clear();
+        err = git_index_add_all(index, &paths, GIT_INDEX_ADD_FORCE,
+                                add_found_cb, out);
+    }
+
+    git_pathspec_free(ps);
+
+    return err;
+}
+
 /**
  * Add files to a repository
  *
+ * The paths are matched against the working directory in one pass,
+ * the blobs of the matched files are written on several threads, and
+ * the index is written once. Like git add, nothing is added if a path
+ * matches no file.
+ *
  * @param repo S4 class git_repository
- * @param path
+ * @param path character vector with paths or pathspecs to add
+ * @param force add ignored files
  * @return R_NilValue
  */
-SEXP add(const SEXP repo, const SEXP path)
+SEXP add(const SEXP repo, const SEXP path, const SEXP force)
 {
-    int err;
+    int err, found;
+    size_t i;
+    unsigned int flags = GIT_INDEX_ADD_DEFAULT;
+    const char* err_msg = NULL;
+    const char* unmatched = NULL;
+    git_strarray paths = {0};
+    git2r_add_payload payload = {0};
     git_index *index = NULL;
     git_repository *repository = NULL;
 
@@ -66,210 +218,599 @@ SEXP add(const SEXP repo, const SEXP path)
         error("'path' equals R_NilValue");
     if (!isString(path))
         error("'path' must be a string");
+    if (!isLogical(force) || 1 != length(force) || NA_LOGICAL == LOGICAL(force)[0])
+        error("'force' must be TRUE or FALSE");
+
+    if (LOGICAL(force)[0])
+        flags |= GIT_INDEX_ADD_FORCE;
+
+    /* An empty pathspec would match every file */
+    if (0 == length(path))
+        return R_NilValue;
 
     repository= get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
+    git_libgit2_opts(GIT_OPT_SET_INDEX_ADD_THREADS,
+                     threads_option("git2r.add.threads", 0));
+
+    paths.count = length(path);
+    paths.strings = malloc(paths.count * sizeof(char*));
+    payload.count = paths.count;
+    payload.paths = malloc(payload.count * sizeof(char*));
+    payload.matched = calloc(payload.count, sizeof(int));
+    if (NULL == paths.strings || NULL == payload.paths || NULL == payload.matched) {
+        err = -1;
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+    for (i = 0; i < paths.count; i++) {
+        paths.strings[i] = (char *)CHAR(STRING_ELT(path, i));
+        payload.paths[i] = paths.strings[i];
+    }
+    qsort(payload.paths, payload.count, sizeof(char*), add_compare_paths);
+
     err = git_repository_index(&index, repository);
     if (err < 0)
         goto cleanup;
 
-    err = git_index_add_bypath(index, CHAR(STRING_ELT(path, 0)));
+    err = git_index_add_all(index, &paths, flags, add_matched_cb, &payload);
     if (err < 0)
         goto cleanup;
 
+    for (i = 0; i < payload.count && !unmatched; i++) {
+        if (payload.matched[i])
+            continue;
+
+        err = add_path_matches(&found, index, payload.paths[i]);
+        if (err < 0)
+            goto cleanup;
+        if (!found)
+            unmatched = payload.paths[i];
+    }
+
+    /* Drop the files added to the index in memory */
+    if (unmatched) {
+        err = git_index_read(index, 1);
+        goto cleanup;
+    }
+
     err = git_index_write(index);
     if (err < 0)
         goto cleanup;
 
 cleanup:
+    free(paths.strings);
+    free(payload.paths);
+    free(payload.matched);
+
     if (index)
         git_index_free(index);
 
-    if (repository)
-        git_repository_free(repository);
-
     if (err < 0) {
-        const git_error *e = giterr_last();
-        error("Error %d/%d: %s\n", err, e->klass, e->message);
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
     }
 
+    if (unmatched)
+        error("pathspec '%s' did not match any files", unmatched);
+
     return R_NilValue;
 }
 
 /**
- * List branches in a repository
+ * Count the unique commits of two revisions
+ *
+ * When the repository has reachability bitmaps, the commits are
+ * counted with the bitmaps instead of walking the history.
  *
  * @param repo S4 class git_repository
- * @return VECXSP with S4 objects of class git_branch
+ * @param local the local revision
+ * @param upstream the upstream revision
+ * @return INTSXP with the number of commits ahead and behind
  */
-SEXP branches(const SEXP repo, const SEXP flags)
+SEXP ahead_behind(const SEXP repo, const SEXP local, const SEXP upstream)
 {
-    SEXP list;
-    int err = 0;
-    const char* err_msg = NULL;
-    git_branch_iterator *iter = NULL;
-    size_t i = 0, n = 0;
-    size_t protected = 0;
-    git_repository *repository = NULL;
+    int err;
+    size_t ahead, behind;
+    git_oid oid_local, oid_upstream;
+    git_repository *repository;
+    SEXP result;
+
+    if (!isString(local) || 1 != length(local))
+        error("'local' must be a character vector of length one");
+    if (!isString(upstream) || 1 != length(upstream))
+        error("'upstream' must be a character vector of length one");
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    /* Count number of branches before creating the list */
-    err = number_of_branches(repository, INTEGER(flags)[0], &n);
+    err = revparse_oids(&oid_local, repository, local);
     if (err < 0)
         goto cleanup;
 
-    PROTECT(list = allocVector(VECSXP, n));
-    protected++;
-
-    err = git_branch_iterator_new(&iter, repository,  INTEGER(flags)[0]);
+    err = revparse_oids(&oid_upstream, repository, upstream);
     if (err < 0)
         goto cleanup;
 
-    for (;;) {
-        SEXP branch;
-        git_branch_t type;
-        git_reference *ref;
-        const char *refname;
+    err = git_graph_ahead_behind(&ahead, &behind, repository,
+                                 &oid_local, &oid_upstream);
 
-        err = git_branch_next(&ref, &type, iter);
-        if (err < 0) {
-            if (GIT_ITEROVER == err) {
-                err = 0;
-                break;
-            }
-            goto cleanup;
-        }
+cleanup:
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
 
-        PROTECT(branch = NEW_OBJECT(MAKE_CLASS("git_branch")));
-        protected++;
+    PROTECT(result = allocVector(INTSXP, 2));
+    INTEGER(result)[0] = ahead;
+    INTEGER(result)[1] = behind;
+    UNPROTECT(1);
 
-        refname = git_reference_name(ref);
-        init_reference(ref, branch);
+    return result;
+}
 
-        switch (type) {
-        case GIT_BRANCH_LOCAL:
-            break;
-        case GIT_BRANCH_REMOTE: {
-            char *buf;
-            size_t buf_size;
-            git_remote *remote = NULL;
+/**
+ * Get the size of the blob at a path in each commit of the history
+ *
+ * The blobs are found by walking the history, and their sizes are
+ * read from the object headers in one batch.
+ *
+ * @param repo S4 class git_repository
+ * @param path the path of the blob in the tree of the commits
+ * @param push character vector with the revisions to walk from
+ * @return data.frame with the columns commit, blob and size
+ */
+SEXP blob_sizes(const SEXP repo, const SEXP path, const SEXP push)
+{
+    int err;
+    size_t i, n = 0, alloc = 0;
+    const char* err_msg = NULL;
+    git_oid oid, *commits = NULL, *blobs = NULL;
+    size_t *sizes = NULL;
+    git_otype *types = NULL;
+    git_odb *odb = NULL;
+    git_revwalk *walker = NULL;
+    git_repository *repository;
+    SEXP result = R_NilValue, names;
 
-            buf_size = git_branch_remote_name(NULL, 0, repository, refname);
-            buf = malloc(buf_size * sizeof(char));
-            if (NULL == buf) {
-                err = -1;
-                err_msg = err_alloc_memory_buffer;
-                goto cleanup;
-            }
+    if (!isString(path) || 1 != length(path))
+        error("'path' must be a character vector of length one");
+    if (!isString(push))
+        error("'push' must be a character vector");
 
-            git_branch_remote_name(buf, buf_size, repository, refname);
-            SET_SLOT(branch, Rf_install("remote"), ScalarString(mkChar(buf)));
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
-            err = git_remote_load(&remote, repository, buf);
-            if (err < 0) {
-                err = git_remote_create_inmemory(&remote, repository, NULL, buf);
-                if (err < 0)
-                    goto cleanup;
-            }
+    err = git_revwalk_new(&walker, repository);
+    if (err < 0)
+        goto cleanup;
+    git_revwalk_sorting(walker, GIT_SORT_TIME);
 
-            SET_SLOT(branch,
-                     Rf_install("url"),
-                     ScalarString(mkChar(git_remote_url(remote))));
+    for (i = 0; i < length(push); i++) {
+        git_object *obj;
 
-            free(buf);
-            git_remote_free(remote);
-            break;
-        }
-        default:
-            err = -1;
-            err_msg = err_unexpected_type_of_branch;
+        err = git_revparse_single(&obj, repository, CHAR(STRING_ELT(push, i)));
+        if (err < 0)
+            goto cleanup;
+        err = git_revwalk_push(walker, git_object_id(obj));
+        git_object_free(obj);
+        if (err < 0)
             goto cleanup;
+    }
+
+    while ((err = git_revwalk_next(&oid, walker)) == 0) {
+        git_commit *commit = NULL;
+        git_tree *tree = NULL;
+        git_tree_entry *entry = NULL;
+
+        err = git_commit_lookup(&commit, repository, &oid);
+        if (!err)
+            err = git_commit_tree(&tree, commit);
+        if (!err)
+            err = git_tree_entry_bypath(&entry, tree, CHAR(STRING_ELT(path, 0)));
+
+        if (!err && GIT_OBJ_BLOB == git_tree_entry_type(entry)) {
+            if (n == alloc) {
+                git_oid *c, *b;
+                alloc = alloc ? 2 * alloc : 256;
+                c = realloc(commits, alloc * sizeof(git_oid));
+                if (c)
+                    commits = c;
+                b = realloc(blobs, alloc * sizeof(git_oid));
+                if (b)
+                    blobs = b;
+                if (!c || !b) {
+                    err = -1;
+                    err_msg = err_alloc_memory_buffer;
+                }
+            }
+
+            if (!err) {
+                git_oid_cpy(&commits[n], &oid);
+                git_oid_cpy(&blobs[n], git_tree_entry_id(entry));
+                n++;
+            }
+        } else if (GIT_ENOTFOUND == err) {
+            /* The path is not in the tree of the commit */
+            giterr_clear();
+            err = 0;
         }
 
-        switch (git_branch_is_head(ref)) {
-        case 0:
-            SET_SLOT(branch, Rf_install("head"), ScalarLogical(0));
-            break;
-        case 1:
-            SET_SLOT(branch, Rf_install("head"), ScalarLogical(1));
-            break;
-        default:
-            err = -1;
-            err_msg = err_unexpected_head_of_branch;
+        git_tree_entry_free(entry);
+        git_tree_free(tree);
+        git_commit_free(commit);
+
+        if (err < 0)
             goto cleanup;
-        }
+    }
 
-        git_reference_free(ref);
-        SET_VECTOR_ELT(list, i, branch);
-        UNPROTECT(1);
-        protected--;
-        i++;
+    if (GIT_ITEROVER != err)
+        goto cleanup;
+
+    sizes = malloc((n + 1) * sizeof(size_t));
+    types = malloc((n + 1) * sizeof(git_otype));
+    if (!sizes || !types) {
+        err = -1;
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_odb_read_header_many(sizes, types, odb, blobs, n);
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(result = allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(result, 0, allocVector(STRSXP, n));
+    SET_VECTOR_ELT(result, 1, allocVector(STRSXP, n));
+    SET_VECTOR_ELT(result, 2, allocVector(REALSXP, n));
+    PROTECT(names = allocVector(STRSXP, 3));
+    SET_STRING_ELT(names, 0, mkChar("commit"));
+    SET_STRING_ELT(names, 1, mkChar("blob"));
+    SET_STRING_ELT(names, 2, mkChar("size"));
+    setAttrib(result, R_NamesSymbol, names);
+
+    for (i = 0; i < n; i++) {
+        char hex[GIT_OID_HEXSZ + 1];
+
+        git_oid_tostr(hex, sizeof(hex), &commits[i]);
+        SET_STRING_ELT(VECTOR_ELT(result, 0), i, mkChar(hex));
+        git_oid_tostr(hex, sizeof(hex), &blobs[i]);
+        SET_STRING_ELT(VECTOR_ELT(result, 1), i, mkChar(hex));
+        REAL(VECTOR_ELT(result, 2))[i] =
+            GIT_OBJ_BAD == types[i] ? NA_REAL : (double)sizes[i];
     }
 
+    columns_as_data_frame(result, n);
+    UNPROTECT(2);
+
 cleanup:
-    if (iter)
-        git_branch_iterator_free(iter);
+    free(commits);
+    free(blobs);
+    free(sizes);
+    free(types);
 
-    if (repository)
-        git_repository_free(repository);
+    if (odb)
+        git_odb_free(odb);
 
-    if (protected)
-        UNPROTECT(protected);
+    if (walker)
+        git_revwalk_free(walker);
 
     if (err < 0) {
         if (err_msg) {
             error(err_msg);
         } else {
             const git_error *e = giterr_last();
-            error("Error %d: %s\n", e->klass, e->message);
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
         }
     }
 
-    return list;
+    return result;
 }
 
 /**
- * Checkout
+ * References collected in one pass of an iterator
+ */
+typedef struct {
+    git_reference **refs;
+    git_branch_t *types; /* the types of the branches */
+    size_t n;
+    size_t alloc;
+} git2r_reference_list;
+
+/**
+ * Add a reference to a list of references
  *
- * @param repo S4 class git_repository
- * @param treeish
- * @return R_NilValue
+ * @param list The list to add to, which owns the reference on success
+ * @param ref The reference
+ * @param type The type of the branch, or 0 for other references
+ * @return 0 or GIT_EUSER when out of memory
  */
-SEXP checkout(SEXP repo, SEXP treeish)
+static int add_to_reference_list(git2r_reference_list *list,
+                                  git_reference *ref,
+                                  git_branch_t type)
 {
-    git_repository *repository = NULL;
-
-    repository = get_repository(repo);
-    if (!repository)
-        error(err_invalid_repository);
+    if (list->n == list->alloc) {
+        size_t alloc = list->alloc ? 2 * list->alloc : 64;
+        git_reference **refs;
+        git_branch_t *types;
+
+        refs = realloc(list->refs, alloc * sizeof(*refs));
+        if (NULL == refs)
+            return GIT_EUSER;
+        list->refs = refs;
+
+        types = realloc(list->types, alloc * sizeof(*types));
+        if (NULL == types)
+            return GIT_EUSER;
+        list->types = types;
+
+        list->alloc = alloc;
+    }
 
-cleanup:
-    if (repository)
-        git_repository_free(repository);
+    list->refs[list->n] = ref;
+    list->types[list->n] = type;
+    list->n++;
 
-    return R_NilValue;
+    return 0;
 }
 
-typedef struct {
-    int received_progress;
-    int received_done;
-} progress_data;
-
 /**
- * Show progress of clone
+ * Free the references of a list of references
  *
- * @param progress
- * @param payload
- * @return 0
+ * @param list The list
+ * @return void
  */
-static int clone_progress(const git_transfer_progress *progress, void *payload)
+static void free_reference_list(git2r_reference_list *list)
 {
-    int kbytes = progress->received_bytes / 1024;
+    size_t i;
+
+    for (i = 0; i < list->n; i++)
+        git_reference_free(list->refs[i]);
+    free(list->refs);
+    free(list->types);
+}
+
+/**
+ * List the branches in one pass of the branch iterator.
+ *
+ * @param list The list to add the branches to
+ * @param repo The repository
+ * @param flags The types of branches to list
+ * @return 0, GIT_EUSER when out of memory, or an error code
+ */
+static int load_branches(git2r_reference_list *list, git_repository *repo, int flags)
+{
+    int err;
+    git_branch_iterator *iter;
+    git_branch_t type;
+    git_reference *ref;
+
+    err = git_branch_iterator_new(&iter, repo, flags);
+    if (err < 0)
+        return err;
+
+    while (!(err = git_branch_next(&ref, &type, iter))) {
+        err = add_to_reference_list(list, ref, type);
+        if (err < 0) {
+            git_reference_free(ref);
+            break;
+        }
+    }
+
+    git_branch_iterator_free(iter);
+
+    if (GIT_ITEROVER != err)
+        return err;
+    return 0;
+}
+
+/**
+ * List the references that match a glob, resolving each reference
+ * once.
+ *
+ * @param list The list to add the references to
+ * @param repo The repository
+ * @param glob The glob of the names of the references, or NULL for
+ * all references
+ * @return 0, GIT_EUSER when out of memory, or an error code
+ */
+static int load_references(git2r_reference_list *list,
+                           git_repository *repo,
+                           const char *glob)
+{
+    int err;
+    git_reference_iterator *iter;
+    git_reference *ref;
+
+    if (glob)
+        err = git_reference_iterator_glob_new(&iter, repo, glob);
+    else
+        err = git_reference_iterator_new(&iter, repo);
+    if (err < 0)
+        return err;
+
+    while (!(err = git_reference_next(&ref, iter))) {
+        err = add_to_reference_list(list, ref, 0);
+        if (err < 0) {
+            git_reference_free(ref);
+            break;
+        }
+    }
+
+    git_reference_iterator_free(iter);
+
+    if (GIT_ITEROVER != err)
+        return err;
+    return 0;
+}
+
+/**
+ * List branches in a repository
+ *
+ * @param repo S4 class git_repository
+ * @return VECXSP with S4 objects of class git_branch
+ */
+SEXP branches(const SEXP repo, const SEXP flags)
+{
+    SEXP list = R_NilValue;
+    int err = 0;
+    const char* err_msg = NULL;
+    git2r_reference_list branch_list = {0};
+    size_t i;
+    size_t protected = 0;
+    git_repository *repository = NULL;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    /* List the branches in one pass before creating the list */
+    err = load_branches(&branch_list, repository, INTEGER(flags)[0]);
+    if (GIT_EUSER == err) {
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(list = allocVector(VECSXP, branch_list.n));
+    protected++;
+
+    for (i = 0; i < branch_list.n; i++) {
+        SEXP branch;
+        git_reference *ref = branch_list.refs[i];
+        const char *refname;
+
+        PROTECT(branch = NEW_OBJECT(MAKE_CLASS("git_branch")));
+        protected++;
+
+        refname = git_reference_name(ref);
+        init_reference(ref, branch);
+
+        switch (branch_list.types[i]) {
+        case GIT_BRANCH_LOCAL:
+            break;
+        case GIT_BRANCH_REMOTE: {
+            char *buf;
+            size_t buf_size;
+            git_remote *remote = NULL;
+
+            buf_size = git_branch_remote_name(NULL, 0, repository, refname);
+            buf = malloc(buf_size * sizeof(char));
+            if (NULL == buf) {
+                err = -1;
+                err_msg = err_alloc_memory_buffer;
+                goto cleanup;
+            }
+
+            git_branch_remote_name(buf, buf_size, repository, refname);
+            SET_SLOT(branch, Rf_install("remote"), ScalarString(mkChar(buf)));
+
+            err = git_remote_load(&remote, repository, buf);
+            if (err < 0) {
+                err = git_remote_create_inmemory(&remote, repository, NULL, buf);
+                if (err < 0) {
+                    free(buf);
+                    goto cleanup;
+                }
+            }
+
+            SET_SLOT(branch,
+                     Rf_install("url"),
+                     ScalarString(mkChar(git_remote_url(remote))));
+
+            free(buf);
+            git_remote_free(remote);
+            break;
+        }
+        default:
+            err = -1;
+            err_msg = err_unexpected_type_of_branch;
+            goto cleanup;
+        }
+
+        switch (git_branch_is_head(ref)) {
+        case 0:
+            SET_SLOT(branch, Rf_install("head"), ScalarLogical(0));
+            break;
+        case 1:
+            SET_SLOT(branch, Rf_install("head"), ScalarLogical(1));
+            break;
+        default:
+            err = -1;
+            err_msg = err_unexpected_head_of_branch;
+            goto cleanup;
+        }
+
+        SET_VECTOR_ELT(list, i, branch);
+        UNPROTECT(1);
+        protected--;
+    }
+
+cleanup:
+    free_reference_list(&branch_list);
+
+    if (protected)
+        UNPROTECT(protected);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d: %s\n", e->klass, e->message);
+        }
+    }
+
+    return list;
+}
+
+/**
+ * Checkout
+ *
+ * @param repo S4 class git_repository
+ * @param treeish
+ * @return R_NilValue
+ */
+SEXP checkout(SEXP repo, SEXP treeish)
+{
+    git_repository *repository = NULL;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+cleanup:
+    return R_NilValue;
+}
+
+typedef struct {
+    int received_progress;
+    int received_done;
+} progress_data;
+
+/**
+ * Show progress of clone
+ *
+ * @param progress
+ * @param payload
+ * @return 0
+ */
+static int clone_progress(const git_transfer_progress *progress, void *payload)
+{
+    int kbytes = progress->received_bytes / 1024;
     progress_data *pd = (progress_data*)payload;
 
     if (progress->received_objects < progress->total_objects) {
@@ -324,6 +865,9 @@ SEXP clone(SEXP url, SEXP local_path, SEXP progress)
         || 1 != length(progress))
         error("Invalid arguments to clone");
 
+    /* Cloning builds a pack from a local repository and indexes it */
+    set_pack_threads();
+
     checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE_CREATE;
     clone_opts.checkout_opts = checkout_opts;
     if (LOGICAL(progress)[0]) {
@@ -526,9 +1070,6 @@ cleanup:
     if (tree)
         git_tree_free(tree);
 
-    if (repository)
-        git_repository_free(repository);
-
     if (parents) {
         for (i = 0; i < count; i++) {
             if (parents[i])
@@ -555,311 +1096,1365 @@ cleanup:
 }
 
 /**
- * Config
- *
- * @param repo S4 class git_repository
- * @param variables
- * @return R_NilValue
+ * Contributions are counted per author in buckets of time. Authors
+ * are interned in a string table and the counts are kept in a hash
+ * table keyed by the bucket and the index of the author.
  */
-SEXP config(SEXP repo, SEXP variables)
-{
-    SEXP names;
-    int err, i;
-    git_config *cfg = NULL;
-    git_repository *repository = NULL;
-
-    if (R_NilValue == variables)
-        error("'variables' equals R_NilValue.");
-    if (!isNewList(variables))
-        error("'variables' must be a list.");
+typedef struct {
+    char **names;
+    size_t n, n_alloc;
+    size_t *slots; /* Index + 1 of the name, 0 if the slot is empty */
+    size_t n_slots;
+} git2r_string_table;
 
-    repository = get_repository(repo);
-    if (!repository)
-        error(err_invalid_repository);
+typedef struct {
+    int bucket;
+    int author;
+    int rank;
+    int n;
+} git2r_contribution;
 
-    err = git_repository_config(&cfg, repository);
-    if (err < 0)
-        goto cleanup;
+typedef struct {
+    git2r_contribution *entries;
+    size_t n, n_alloc;
+    size_t *slots; /* Index + 1 of the entry, 0 if the slot is empty */
+    size_t n_slots;
+} git2r_contribution_table;
 
-    names = getAttrib(variables, R_NamesSymbol);
-    for (i = 0; i < length(variables); i++) {
-        const char *key = CHAR(STRING_ELT(names, i));
-        const char *value = CHAR(STRING_ELT(VECTOR_ELT(variables, i), 0));
+/**
+ * Hash a string with FNV-1a
+ *
+ * @param str
+ * @return hash
+ */
+static size_t hash_string(const char *str)
+{
+    size_t h = 2166136261u;
 
-        err = git_config_set_string(cfg, key, value);
-        if (err < 0)
-            goto cleanup;
+    for (; *str; str++) {
+        h ^= (unsigned char)*str;
+        h *= 16777619u;
     }
 
-cleanup:
-    if (config)
-        git_config_free(cfg);
-
-    if (repository)
-        git_repository_free(repository);
+    return h;
+}
 
-    return R_NilValue;
+/**
+ * Hash a bucket and author pair
+ *
+ * @param bucket
+ * @param author
+ * @return hash
+ */
+static size_t hash_contribution(int bucket, int author)
+{
+    return (size_t)bucket * 2654435761u ^ (size_t)(author + 1) * 40503u;
 }
 
 /**
- * Count number of ignored files
+ * Grow the slots of a hash table and rehash the entries
  *
- * @param status
- * @return The number of files
+ * @param slots pointer to the slots
+ * @param n_slots pointer to the number of slots
+ * @param n number of entries
+ * @param hash function to get the hash of an entry
+ * @param payload passed to hash
+ * @return 0 on success, else -1
  */
-static size_t count_ignored_files(git_status_list *status_list)
+static int rehash_slots(size_t **slots,
+                        size_t *n_slots,
+                        size_t n,
+                        size_t (*hash)(size_t i, void *payload),
+                        void *payload)
 {
-    size_t i = 0;
-    size_t ignored = 0;
-    size_t count = git_status_list_entrycount(status_list);
+    size_t i, n_new = *n_slots ? 2 * *n_slots : 64;
+    size_t *new_slots = calloc(n_new, sizeof(size_t));
 
-    for (; i < count; ++i) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    if (NULL == new_slots)
+        return -1;
 
-        if (s->status == GIT_STATUS_IGNORED)
-            ignored++;
+    for (i = 0; i < n; i++) {
+        size_t j = hash(i, payload) & (n_new - 1);
+        while (new_slots[j])
+            j = (j + 1) & (n_new - 1);
+        new_slots[j] = i + 1;
     }
 
-    return ignored;
+    free(*slots);
+    *slots = new_slots;
+    *n_slots = n_new;
+
+    return 0;
+}
+
+static size_t hash_string_entry(size_t i, void *payload)
+{
+    return hash_string(((git2r_string_table*)payload)->names[i]);
+}
+
+static size_t hash_contribution_entry(size_t i, void *payload)
+{
+    git2r_contribution *c = &((git2r_contribution_table*)payload)->entries[i];
+    return hash_contribution(c->bucket, c->author);
 }
 
 /**
- * Count number of changes in index
+ * Intern a string
  *
- * @param status
- * @return The number of changes
+ * @param table the string table
+ * @param str the string to intern
+ * @return the index of the string in the table, or -1 on failure
  */
-static size_t count_staged_changes(git_status_list *status_list)
+static int string_table_intern(git2r_string_table *table, const char *str)
 {
-    size_t i = 0;
-    size_t changes = 0;
-    size_t count = git_status_list_entrycount(status_list);
-
-    for (; i < count; ++i) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
-
-        if (s->status == GIT_STATUS_CURRENT)
-            continue;
+    size_t j;
+
+    if (2 * (table->n + 1) > table->n_slots
+        && rehash_slots(&table->slots, &table->n_slots, table->n,
+                        hash_string_entry, table) < 0)
+        return -1;
+
+    j = hash_string(str) & (table->n_slots - 1);
+    while (table->slots[j]) {
+        if (0 == strcmp(table->names[table->slots[j] - 1], str))
+            return (int)(table->slots[j] - 1);
+        j = (j + 1) & (table->n_slots - 1);
+    }
 
-        if (s->status & GIT_STATUS_INDEX_NEW)
-            changes++;
-        else if (s->status & GIT_STATUS_INDEX_MODIFIED)
-            changes++;
-        else if (s->status & GIT_STATUS_INDEX_DELETED)
-            changes++;
-        else if (s->status & GIT_STATUS_INDEX_RENAMED)
-            changes++;
-        else if (s->status & GIT_STATUS_INDEX_TYPECHANGE)
-            changes++;
+    if (table->n == table->n_alloc) {
+        size_t n_alloc = table->n_alloc ? 2 * table->n_alloc : 64;
+        char **names = realloc(table->names, n_alloc * sizeof(char*));
+        if (NULL == names)
+            return -1;
+        table->names = names;
+        table->n_alloc = n_alloc;
     }
 
-    return changes;
+    table->names[table->n] = malloc(strlen(str) + 1);
+    if (NULL == table->names[table->n])
+        return -1;
+    strcpy(table->names[table->n], str);
+    table->slots[j] = ++table->n;
+
+    return (int)(table->n - 1);
 }
 
 /**
- * Count number of changes in workdir relative to index
+ * Increment the number of contributions of an author in a bucket
  *
- * @param status
- * @return The number of changes
+ * @param table the contribution table
+ * @param bucket
+ * @param author the index of the author, or -1 to count commits
+ * @return 0 on success, else -1
  */
-static size_t count_unstaged_changes(git_status_list *status_list)
+static int contribution_table_add(git2r_contribution_table *table,
+                                  int bucket,
+                                  int author)
 {
-    size_t i = 0;
-    size_t changes = 0;
-    size_t count = git_status_list_entrycount(status_list);
+    size_t j;
+    git2r_contribution *c;
+
+    if (2 * (table->n + 1) > table->n_slots
+        && rehash_slots(&table->slots, &table->n_slots, table->n,
+                        hash_contribution_entry, table) < 0)
+        return -1;
+
+    j = hash_contribution(bucket, author) & (table->n_slots - 1);
+    while (table->slots[j]) {
+        c = &table->entries[table->slots[j] - 1];
+        if (c->bucket == bucket && c->author == author) {
+            c->n++;
+            return 0;
+        }
+        j = (j + 1) & (table->n_slots - 1);
+    }
 
-    for (; i < count; ++i) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    if (table->n == table->n_alloc) {
+        size_t n_alloc = table->n_alloc ? 2 * table->n_alloc : 64;
+        c = realloc(table->entries, n_alloc * sizeof(git2r_contribution));
+        if (NULL == c)
+            return -1;
+        table->entries = c;
+        table->n_alloc = n_alloc;
+    }
 
-        if (s->status == GIT_STATUS_CURRENT || s->index_to_workdir == NULL)
-            continue;
+    c = &table->entries[table->n];
+    c->bucket = bucket;
+    c->author = author;
+    c->rank = 0;
+    c->n = 1;
+    table->slots[j] = ++table->n;
 
-        if (s->status & GIT_STATUS_WT_MODIFIED)
-            changes++;
-        else if (s->status & GIT_STATUS_WT_DELETED)
-            changes++;
-        else if (s->status & GIT_STATUS_WT_RENAMED)
-            changes++;
-        else if (s->status & GIT_STATUS_WT_TYPECHANGE)
-            changes++;
-    }
+    return 0;
+}
 
-    return changes;
+/**
+ * Number of days since 1970-01-01 of a date
+ *
+ * @param y year
+ * @param m month 1-12
+ * @param d day 1-31
+ * @return days since epoch
+ */
+static int days_from_civil(int y, int m, int d)
+{
+    int era;
+    unsigned int yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = (unsigned int)(y - era * 400);
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int)doe - 719468;
 }
 
 /**
- * Count number of untracked files
+ * The date of a number of days since 1970-01-01
  *
- * @param status
- * @return The number of files
+ * @param z days since epoch
+ * @param y year
+ * @param m month 1-12
+ * @param d day 1-31
+ * @return void
  */
-static size_t count_untracked_files(git_status_list *status_list)
+static void civil_from_days(int z, int *y, int *m, int *d)
 {
-    size_t i = 0;
-    size_t untracked = 0;
-    size_t count = git_status_list_entrycount(status_list);
+    int era;
+    unsigned int doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = (unsigned int)(z - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = (int)yoe + era * 400 + (*m <= 2);
+}
 
-    for (; i < count; ++i) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
+enum {
+    GIT2R_BREAKS_MONTH = 0,
+    GIT2R_BREAKS_WEEK,
+    GIT2R_BREAKS_DAY
+};
 
-        if (s->status == GIT_STATUS_WT_NEW)
-            untracked++;
+/**
+ * The first day of the bucket that contains a point in time
+ *
+ * Days are in the timezone of the signature. Weeks start on Monday.
+ *
+ * @param when the time
+ * @param breaks GIT2R_BREAKS_XXX
+ * @return days since 1970-01-01 of the first day in the bucket
+ */
+static int time_bucket(const git_time *when, int breaks)
+{
+    int y, m, d, days;
+    git_time_t t = when->time + (git_time_t)when->offset * 60;
+
+    days = (int)(t >= 0 ? t / 86400 : -((-t + 86399) / 86400));
+
+    switch (breaks) {
+    case GIT2R_BREAKS_MONTH:
+        civil_from_days(days, &y, &m, &d);
+        return days_from_civil(y, m, 1);
+    case GIT2R_BREAKS_WEEK:
+        /* 1970-01-01 was a Thursday */
+        return days - (((days + 3) % 7) + 7) % 7;
+    default:
+        return days;
     }
+}
 
-    return untracked;
+/**
+ * The first day of the bucket after a bucket
+ *
+ * @param bucket days since 1970-01-01 of the first day in the bucket
+ * @param breaks GIT2R_BREAKS_XXX
+ * @return days since 1970-01-01 of the first day in the next bucket
+ */
+static int next_bucket(int bucket, int breaks)
+{
+    int y, m, d;
+
+    switch (breaks) {
+    case GIT2R_BREAKS_MONTH:
+        civil_from_days(bucket, &y, &m, &d);
+        return m == 12 ? days_from_civil(y + 1, 1, 1) : days_from_civil(y, m + 1, 1);
+    case GIT2R_BREAKS_WEEK:
+        return bucket + 7;
+    default:
+        return bucket + 1;
+    }
 }
 
 /**
- * Get the configured signature for a repository
+ * Check if a commit changes any of the paths in a pathspec
  *
- * @param repo S4 class git_repository
- * @return S4 class git_signature
+ * Like 'git log -- path', a merge commit is only included if it
+ * differs from all of its parents in the paths.
+ *
+ * @param out 1 if the commit changes the paths, else 0
+ * @param commit
+ * @param repository
+ * @param opts diff options with the pathspec
+ * @return 0 on success, else error code
  */
-SEXP default_signature(const SEXP repo)
+static int commit_changes_paths(int *out,
+                                git_commit *commit,
+                                git_repository *repository,
+                                const git_diff_options *opts)
 {
     int err;
-    git_repository *repository = NULL;
-    git_signature *signature = NULL;
-    SEXP sig;
+    unsigned int i, n = git_commit_parentcount(commit);
+    git_tree *tree = NULL, *parent_tree = NULL;
+    git_commit *parent = NULL;
+    git_diff *diff = NULL;
 
-    repository = get_repository(repo);
-    if (!repository)
-        error(err_invalid_repository);
+    *out = 1;
 
-    err = git_signature_default(&signature, repository);
+    err = git_commit_tree(&tree, commit);
     if (err < 0)
-        goto cleanup;
+        return err;
 
-    PROTECT(sig = NEW_OBJECT(MAKE_CLASS("git_signature")));
-    init_signature(signature, sig);
+    for (i = 0; i < (n ? n : 1); i++) {
+        if (n) {
+            err = git_commit_parent(&parent, commit, i);
+            if (err < 0)
+                break;
+            err = git_commit_tree(&parent_tree, parent);
+            if (err < 0)
+                break;
+        }
 
-cleanup:
-    if (repository)
-        git_repository_free(repository);
+        err = git_diff_tree_to_tree(&diff, repository, parent_tree, tree, opts);
+        if (err < 0)
+            break;
 
-    if (signature)
-        git_signature_free(signature);
+        if (!git_diff_num_deltas(diff))
+            *out = 0;
 
-    UNPROTECT(1);
+        git_diff_free(diff);
+        diff = NULL;
+        git_tree_free(parent_tree);
+        parent_tree = NULL;
+        git_commit_free(parent);
+        parent = NULL;
 
-    if (err < 0) {
-        const git_error *e = giterr_last();
-        error("Error %d/%d: %s\n", err, e->klass, e->message);
+        if (!*out)
+            break;
     }
 
-    return sig;
+    if (parent_tree)
+        git_tree_free(parent_tree);
+    if (parent)
+        git_commit_free(parent);
+    git_tree_free(tree);
+
+    return err;
 }
 
 /**
- * Get repo slot from S4 class git_repository
- *
- * @param repo S4 class git_repository
- * @return a git_repository pointer on success else NULL
+ * An author name with its index in the string table of authors
  */
-static git_repository* get_repository(const SEXP repo)
-{
-    SEXP class_name;
-    SEXP path;
-    git_repository *r;
-
-    if (R_NilValue == repo || S4SXP != TYPEOF(repo))
-        return NULL;
-
-    class_name = getAttrib(repo, R_ClassSymbol);
-    if (0 != strcmp(CHAR(STRING_ELT(class_name, 0)), "git_repository"))
-        return NULL;
+typedef struct {
+    const char *name;
+    int index;
+} git2r_author_index;
 
-    path = GET_SLOT(repo, Rf_install("path"));
-    if (R_NilValue == path)
-        return NULL;
+/**
+ * Compare two authors by name, byte by byte. The R method orders the
+ * authors again with the collation of the locale.
+ */
+static int compare_author_index(const void *a, const void *b)
+{
+    return strcmp(((const git2r_author_index*)a)->name,
+                  ((const git2r_author_index*)b)->name);
+}
 
-    if (git_repository_open(&r, CHAR(STRING_ELT(path, 0))) < 0)
-        return NULL;
+/**
+ * Compare two contributions by bucket and rank of the author
+ */
+static int compare_contribution(const void *a, const void *b)
+{
+    const git2r_contribution *x = a, *y = b;
 
-    return r;
+    if (x->bucket != y->bucket)
+        return x->bucket < y->bucket ? -1 : 1;
+    if (x->rank != y->rank)
+        return x->rank < y->rank ? -1 : 1;
+    return 0;
 }
 
 /**
- * Init a repository.
+ * Number of commits in a row before 'since' after which the walk of
+ * the contributions stops, to allow for some clock skew like the
+ * date slop of git
+ */
+#define GIT2R_SINCE_SLOP 5
+
+/**
+ * Walk the history from HEAD and count the commits in the
+ * contributions table
  *
- * @param path
- * @param bare
- * @return R_NilValue
+ * The walk is sorted by the committer time, which can be out of
+ * order when clocks are skewed. The commits are therefore filtered
+ * one by one on the author time, and the walk only stops after
+ * GIT2R_SINCE_SLOP commits in a row with a committer time before
+ * 'since'.
+ *
+ * @param table the contributions table to add the commits to
+ * @param authors the string table with the author names
+ * @param repository the repository
+ * @param breaks GIT2R_BREAKS_XXX
+ * @param by_author count by author if 1
+ * @param since only count commits at or after this time, or NA
+ * @param until only count commits at or before this time, or NA
+ * @param opts diff options with the pathspec, or NULL to count the
+ * commits that change any path
+ * @return 0 on success, GIT_EUSER if memory could not be allocated,
+ * else error code
  */
-SEXP init(const SEXP path, const SEXP bare)
+static int count_contributions(git2r_contribution_table *table,
+                               git2r_string_table *authors,
+                               git_repository *repository,
+                               int breaks,
+                               int by_author,
+                               double since,
+                               double until,
+                               const git_diff_options *opts)
 {
-    int err;
-    git_repository *repository = NULL;
+    int err, slop = 0;
+    git_revwalk *walker = NULL;
 
-    if (R_NilValue == path)
-        error("'path' equals R_NilValue");
-    if (!isString(path))
-        error("'path' must be a string");
-    if (R_NilValue == bare)
-        error("'bare' equals R_NilValue");
-    if (!isLogical(bare))
-        error("'bare' must be a logical");
+    err = git_revwalk_new(&walker, repository);
+    if (err < 0)
+        return err;
 
-    err = git_repository_init(&repository,
-                              CHAR(STRING_ELT(path, 0)),
-                              LOGICAL(bare)[0]);
+    git_revwalk_sorting(walker, GIT_SORT_TIME);
+    err = git_revwalk_push_head(walker);
     if (err < 0)
-        error("Unable to init repository");
+        goto cleanup;
 
-    git_repository_free(repository);
+    for (;;) {
+        git_oid oid;
+        git_commit *commit;
+        const git_signature *sig;
+        int author_index = -1, changes = 1;
 
-    return R_NilValue;
-}
+        err = git_revwalk_next(&oid, walker);
+        if (err < 0) {
+            if (GIT_ITEROVER == err)
+                err = 0;
+            break;
+        }
 
-/**
- * Init slots in S4 class git_commit
- *
- * @param commit a commit object
- * @param sexp_commit S4 class git_commit
- * @return void
- */
-static void init_commit(const git_commit *commit, SEXP sexp_commit)
-{
-    const char *message;
-    const char *summary;
-    const git_signature *author;
-    const git_signature *committer;
-    char hex[GIT_OID_HEXSZ + 1];
+        err = git_commit_lookup(&commit, repository, &oid);
+        if (err < 0)
+            break;
 
-    git_oid_fmt(hex, git_commit_id(commit));
-    hex[GIT_OID_HEXSZ] = '\0';
-    SET_SLOT(sexp_commit,
-             Rf_install("hex"),
-             ScalarString(mkChar(hex)));
+        if (!ISNA(since) && (double)git_commit_time(commit) < since) {
+            if (++slop >= GIT2R_SINCE_SLOP) {
+                git_commit_free(commit);
+                break;
+            }
+        } else {
+            slop = 0;
+        }
 
-    author = git_commit_author(commit);
-    if (author) {
-        SEXP sexp_author;
+        sig = git_commit_author(commit);
+        if (!sig
+            || (!ISNA(since) && (double)sig->when.time < since)
+            || (!ISNA(until) && (double)sig->when.time > until)) {
+            git_commit_free(commit);
+            continue;
+        }
 
-        PROTECT(sexp_author = NEW_OBJECT(MAKE_CLASS("git_signature")));
-        init_signature(author, sexp_author);
-        SET_SLOT(sexp_commit, Rf_install("author"), sexp_author);
-        UNPROTECT(1);
-    }
+        if (opts) {
+            err = commit_changes_paths(&changes, commit, repository, opts);
+            if (err < 0) {
+                git_commit_free(commit);
+                break;
+            }
+        }
 
-    committer = git_commit_committer(commit);
-    if (committer) {
-        SEXP sexp_committer;
+        if (changes) {
+            if (by_author)
+                author_index = string_table_intern(authors, sig->name);
+            if ((by_author && author_index < 0)
+                || contribution_table_add(table,
+                                          time_bucket(&sig->when, breaks),
+                                          author_index) < 0)
+                err = GIT_EUSER;
+        }
 
-        PROTECT(sexp_committer = NEW_OBJECT(MAKE_CLASS("git_signature")));
-        init_signature(committer, sexp_committer);
-        SET_SLOT(sexp_commit, Rf_install("committer"), sexp_committer);
-        UNPROTECT(1);
+        git_commit_free(commit);
+        if (err < 0)
+            break;
     }
 
-    summary = git_commit_summary(commit);
-    if (summary) {
-        SET_SLOT(sexp_commit,
-                 Rf_install("summary"),
-                 ScalarString(mkChar(summary)));
-    }
+cleanup:
+    git_revwalk_free(walker);
 
-    message = git_commit_message(commit);
+    return err;
+}
+
+/**
+ * Contributions to a repository
+ *
+ * The history is walked once from HEAD and the commits are counted
+ * per bucket of time, and by author if requested. The time of a
+ * commit is the time of the author in the timezone of the author.
+ *
+ * @param repo S4 class git_repository
+ * @param breaks "month", "week" or "day"
+ * @param by "commits" or "author"
+ * @param since only count commits at or after this time (seconds
+ * since epoch), NA to count all
+ * @param until only count commits at or before this time (seconds
+ * since epoch), NA to count all
+ * @param path character vector with pathspec, only count commits
+ * that changes the paths. An empty vector counts all commits.
+ * @return data.frame with the columns when and n, and author when
+ * counting by author.
+ */
+SEXP contributions(const SEXP repo,
+                   const SEXP breaks,
+                   const SEXP by,
+                   const SEXP since,
+                   const SEXP until,
+                   const SEXP path)
+{
+    int err = 0;
+    int i_breaks, by_author;
+    size_t i, j, n;
+    double t_since, t_until;
+    const char* err_msg = NULL;
+    SEXP result = R_NilValue, names, when, author, count;
+    git_repository *repository;
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    git2r_string_table authors = {0};
+    git2r_contribution_table table = {0};
+    int *rank = NULL;
+    char **pathspec = NULL;
+
+    if (R_NilValue == breaks
+        || R_NilValue == by
+        || !isString(breaks)
+        || !isString(by)
+        || 1 != length(breaks)
+        || 1 != length(by)
+        || !isReal(since)
+        || !isReal(until)
+        || 1 != length(since)
+        || 1 != length(until)
+        || !isString(path))
+        error("Invalid arguments to contributions");
+
+    if (0 == strcmp(CHAR(STRING_ELT(breaks, 0)), "month"))
+        i_breaks = GIT2R_BREAKS_MONTH;
+    else if (0 == strcmp(CHAR(STRING_ELT(breaks, 0)), "week"))
+        i_breaks = GIT2R_BREAKS_WEEK;
+    else if (0 == strcmp(CHAR(STRING_ELT(breaks, 0)), "day"))
+        i_breaks = GIT2R_BREAKS_DAY;
+    else
+        error("Invalid arguments to contributions");
+    by_author = (0 == strcmp(CHAR(STRING_ELT(by, 0)), "author"));
+    t_since = REAL(since)[0];
+    t_until = REAL(until)[0];
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    if (LENGTH(path)) {
+        pathspec = malloc(LENGTH(path) * sizeof(char*));
+        if (NULL == pathspec) {
+            err = -1;
+            err_msg = err_alloc_memory_buffer;
+            goto cleanup;
+        }
+        for (i = 0; i < LENGTH(path); i++)
+            pathspec[i] = (char*)CHAR(STRING_ELT(path, i));
+        opts.pathspec.strings = pathspec;
+        opts.pathspec.count = LENGTH(path);
+    }
+
+    if (!git_repository_is_empty(repository)) {
+        err = count_contributions(&table, &authors, repository, i_breaks,
+                                  by_author, t_since, t_until,
+                                  pathspec ? &opts : NULL);
+        if (GIT_EUSER == err) {
+            err = -1;
+            err_msg = err_alloc_memory_buffer;
+        }
+    }
+
+    if (err < 0)
+        goto cleanup;
+
+    /* Sort the authors by name and the contributions by bucket and
+     * the rank of the author name */
+    if (by_author && authors.n) {
+        git2r_author_index *order = malloc(authors.n * sizeof(git2r_author_index));
+        rank = malloc(authors.n * sizeof(int));
+        if (NULL == order || NULL == rank) {
+            free(order);
+            err = -1;
+            err_msg = err_alloc_memory_buffer;
+            goto cleanup;
+        }
+        for (i = 0; i < authors.n; i++) {
+            order[i].name = authors.names[i];
+            order[i].index = (int)i;
+        }
+        qsort(order, authors.n, sizeof(git2r_author_index), compare_author_index);
+        for (i = 0; i < authors.n; i++)
+            rank[order[i].index] = (int)i;
+        free(order);
+        for (i = 0; i < table.n; i++)
+            table.entries[i].rank = rank[table.entries[i].author];
+    }
+    qsort(table.entries, table.n, sizeof(git2r_contribution), compare_contribution);
+
+    /* Count commits in all buckets from the first to the last, also
+     * buckets without commits. */
+    n = table.n;
+    if (!by_author && table.n) {
+        int bucket = table.entries[0].bucket;
+        for (n = 0; bucket <= table.entries[table.n - 1].bucket; n++)
+            bucket = next_bucket(bucket, i_breaks);
+    }
+
+    PROTECT(result = allocVector(VECSXP, by_author ? 3 : 2));
+    PROTECT(names = allocVector(STRSXP, by_author ? 3 : 2));
+    SET_VECTOR_ELT(result, 0, when = allocVector(REALSXP, n));
+    SET_STRING_ELT(names, 0, mkChar("when"));
+    if (by_author) {
+        SET_VECTOR_ELT(result, 1, author = allocVector(STRSXP, n));
+        SET_VECTOR_ELT(result, 2, count = allocVector(INTSXP, n));
+        SET_STRING_ELT(names, 1, mkChar("author"));
+        SET_STRING_ELT(names, 2, mkChar("n"));
+
+        for (i = 0; i < n; i++) {
+            REAL(when)[i] = table.entries[i].bucket;
+            SET_STRING_ELT(author, i, mkChar(authors.names[table.entries[i].author]));
+            INTEGER(count)[i] = table.entries[i].n;
+        }
+    } else {
+        int bucket = n ? table.entries[0].bucket : 0;
+
+        SET_VECTOR_ELT(result, 1, count = allocVector(INTSXP, n));
+        SET_STRING_ELT(names, 1, mkChar("n"));
+
+        for (i = 0, j = 0; i < n; i++) {
+            REAL(when)[i] = bucket;
+            if (j < table.n && table.entries[j].bucket == bucket)
+                INTEGER(count)[i] = table.entries[j++].n;
+            else
+                INTEGER(count)[i] = 0;
+            bucket = next_bucket(bucket, i_breaks);
+        }
+    }
+
+    setAttrib(result, R_NamesSymbol, names);
+    UNPROTECT(1);
+    setAttrib(when, R_ClassSymbol, mkString("Date"));
+    columns_as_data_frame(result, n);
+
+cleanup:
+    for (i = 0; i < authors.n; i++)
+        free(authors.names[i]);
+    free(authors.names);
+    free(authors.slots);
+    free(table.entries);
+    free(table.slots);
+    free(rank);
+    free(pathspec);
+
+    if (R_NilValue != result)
+        UNPROTECT(1);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Config
+ *
+ * @param repo S4 class git_repository
+ * @param variables
+ * @return R_NilValue
+ */
+SEXP config(SEXP repo, SEXP variables)
+{
+    SEXP names;
+    int err, i;
+    git_config *cfg = NULL;
+    git_repository *repository = NULL;
+
+    if (R_NilValue == variables)
+        error("'variables' equals R_NilValue.");
+    if (!isNewList(variables))
+        error("'variables' must be a list.");
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_repository_config(&cfg, repository);
+    if (err < 0)
+        goto cleanup;
+
+    names = getAttrib(variables, R_NamesSymbol);
+    for (i = 0; i < length(variables); i++) {
+        const char *key = CHAR(STRING_ELT(names, i));
+        const char *value = CHAR(STRING_ELT(VECTOR_ELT(variables, i), 0));
+
+        err = git_config_set_string(cfg, key, value);
+        if (err < 0)
+            goto cleanup;
+    }
+
+cleanup:
+    if (config)
+        git_config_free(cfg);
+
+    return R_NilValue;
+}
+
+/**
+ * Count number of ignored files
+ *
+ * @param status
+ * @return The number of files
+ */
+static size_t count_ignored_files(git_status_list *status_list)
+{
+    size_t i = 0;
+    size_t ignored = 0;
+    size_t count = git_status_list_entrycount(status_list);
+
+    for (; i < count; ++i) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_IGNORED)
+            ignored++;
+    }
+
+    return ignored;
+}
+
+/**
+ * Count number of changes in index
+ *
+ * @param status
+ * @return The number of changes
+ */
+static size_t count_staged_changes(git_status_list *status_list)
+{
+    size_t i = 0;
+    size_t changes = 0;
+    size_t count = git_status_list_entrycount(status_list);
+
+    for (; i < count; ++i) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_CURRENT)
+            continue;
+
+        if (s->status & GIT_STATUS_INDEX_NEW)
+            changes++;
+        else if (s->status & GIT_STATUS_INDEX_MODIFIED)
+            changes++;
+        else if (s->status & GIT_STATUS_INDEX_DELETED)
+            changes++;
+        else if (s->status & GIT_STATUS_INDEX_RENAMED)
+            changes++;
+        else if (s->status & GIT_STATUS_INDEX_TYPECHANGE)
+            changes++;
+    }
+
+    return changes;
+}
+
+/**
+ * Count number of changes in workdir relative to index
+ *
+ * @param status
+ * @return The number of changes
+ */
+static size_t count_unstaged_changes(git_status_list *status_list)
+{
+    size_t i = 0;
+    size_t changes = 0;
+    size_t count = git_status_list_entrycount(status_list);
+
+    for (; i < count; ++i) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_CURRENT || s->index_to_workdir == NULL)
+            continue;
+
+        if (s->status & GIT_STATUS_WT_MODIFIED)
+            changes++;
+        else if (s->status & GIT_STATUS_WT_DELETED)
+            changes++;
+        else if (s->status & GIT_STATUS_WT_RENAMED)
+            changes++;
+        else if (s->status & GIT_STATUS_WT_TYPECHANGE)
+            changes++;
+    }
+
+    return changes;
+}
+
+/**
+ * Count number of untracked files
+ *
+ * @param status
+ * @return The number of files
+ */
+static size_t count_untracked_files(git_status_list *status_list)
+{
+    size_t i = 0;
+    size_t untracked = 0;
+    size_t count = git_status_list_entrycount(status_list);
+
+    for (; i < count; ++i) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_WT_NEW)
+            untracked++;
+    }
+
+    return untracked;
+}
+
+/**
+ * Count the objects reachable from revisions
+ *
+ * When the repository has reachability bitmaps, the objects of the
+ * selected commits are read from the bitmaps instead of walking their
+ * trees.
+ *
+ * @param repo S4 class git_repository
+ * @param include the revisions to count the objects of
+ * @param exclude the revisions whose objects are not counted
+ * @return INTSXP with the number of commits, trees, blobs and tags
+ */
+SEXP count_reachable(const SEXP repo, const SEXP include, const SEXP exclude)
+{
+    int err;
+    const char* err_msg = NULL;
+    git_oid *oids_include = NULL, *oids_exclude = NULL;
+    git_graph_object_counts counts;
+    git_repository *repository;
+    SEXP result, names;
+
+    if (!isString(include))
+        error("'include' must be a character vector");
+    if (!isString(exclude))
+        error("'exclude' must be a character vector");
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    oids_include = malloc((length(include) + 1) * sizeof(git_oid));
+    oids_exclude = malloc((length(exclude) + 1) * sizeof(git_oid));
+    if (NULL == oids_include || NULL == oids_exclude) {
+        err = -1;
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+
+    err = revparse_oids(oids_include, repository, include);
+    if (err < 0)
+        goto cleanup;
+
+    err = revparse_oids(oids_exclude, repository, exclude);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_graph_count_reachable(&counts, repository,
+                                    oids_include, length(include),
+                                    oids_exclude, length(exclude));
+
+cleanup:
+    free(oids_include);
+    free(oids_exclude);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    PROTECT(result = allocVector(INTSXP, 4));
+    INTEGER(result)[0] = counts.commits;
+    INTEGER(result)[1] = counts.trees;
+    INTEGER(result)[2] = counts.blobs;
+    INTEGER(result)[3] = counts.tags;
+    PROTECT(names = allocVector(STRSXP, 4));
+    SET_STRING_ELT(names, 0, mkChar("commits"));
+    SET_STRING_ELT(names, 1, mkChar("trees"));
+    SET_STRING_ELT(names, 2, mkChar("blobs"));
+    SET_STRING_ELT(names, 3, mkChar("tags"));
+    setAttrib(result, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return result;
+}
+
+/**
+ * Get the configured signature for a repository
+ *
+ * @param repo S4 class git_repository
+ * @return S4 class git_signature
+ */
+SEXP default_signature(const SEXP repo)
+{
+    int err;
+    git_repository *repository = NULL;
+    git_signature *signature = NULL;
+    SEXP sig;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_signature_default(&signature, repository);
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(sig = NEW_OBJECT(MAKE_CLASS("git_signature")));
+    init_signature(signature, sig);
+
+cleanup:
+    if (signature)
+        git_signature_free(signature);
+
+    UNPROTECT(1);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    return sig;
+}
+
+/**
+ * Get the statistics of the delta base caches of a repository, and
+ * optionally set the memory limit of the cache of each packfile.
+ *
+ * @param repo S4 class git_repository
+ * @param limit The memory limit in bytes, or R_NilValue to keep the
+ * current limit
+ * @return VECSXP with the statistics
+ */
+SEXP delta_base_cache(const SEXP repo, const SEXP limit)
+{
+    int err;
+    SEXP list, names;
+    git_odb *odb = NULL;
+    git_repository *repository;
+    git_odb_delta_base_cache_stats stats;
+    double value = 0;
+
+    /* Check arguments to delta_base_cache */
+    if (R_NilValue != limit) {
+        if ((!isReal(limit) && !isInteger(limit)) || 1 != length(limit))
+            error("Invalid arguments to delta_base_cache");
+        value = asReal(limit);
+        if (ISNA(value) || value < 0)
+            error("Invalid arguments to delta_base_cache");
+    }
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
+
+    if (R_NilValue != limit) {
+        err = git_odb_set_delta_base_cache_limit(odb, (size_t)value);
+        if (err < 0)
+            goto cleanup;
+    }
+
+    err = git_odb_get_delta_base_cache_stats(&stats, odb);
+
+cleanup:
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    PROTECT(list = allocVector(VECSXP, 6));
+    PROTECT(names = allocVector(STRSXP, 6));
+    SET_STRING_ELT(names, 0, mkChar("memory_used"));
+    SET_VECTOR_ELT(list, 0, ScalarReal((double)stats.memory_used));
+    SET_STRING_ELT(names, 1, mkChar("memory_limit"));
+    SET_VECTOR_ELT(list, 1, ScalarReal((double)stats.memory_limit));
+    SET_STRING_ELT(names, 2, mkChar("entries"));
+    SET_VECTOR_ELT(list, 2, ScalarReal((double)stats.entries));
+    SET_STRING_ELT(names, 3, mkChar("hits"));
+    SET_VECTOR_ELT(list, 3, ScalarReal((double)stats.hits));
+    SET_STRING_ELT(names, 4, mkChar("misses"));
+    SET_VECTOR_ELT(list, 4, ScalarReal((double)stats.misses));
+    SET_STRING_ELT(names, 5, mkChar("evictions"));
+    SET_VECTOR_ELT(list, 5, ScalarReal((double)stats.evictions));
+    setAttrib(list, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return list;
+}
+
+/**
+ * Get repo slot from S4 class git_repository
+ *
+ * The returned repository is owned by the repository cache and must
+ * not be freed by the caller.
+ *
+ * @param repo S4 class git_repository
+ * @return a git_repository pointer on success else NULL
+ */
+static git_repository* get_repository(const SEXP repo)
+{
+    const char *path = get_repository_path(repo);
+
+    if (!path)
+        return NULL;
+
+    return repository_cache_lookup(path);
+}
+
+/**
+ * Get path slot from S4 class git_repository
+ *
+ * @param repo S4 class git_repository
+ * @return the path on success else NULL
+ */
+static const char* get_repository_path(const SEXP repo)
+{
+    SEXP class_name;
+    SEXP path;
+
+    if (R_NilValue == repo || S4SXP != TYPEOF(repo))
+        return NULL;
+
+    class_name = getAttrib(repo, R_ClassSymbol);
+    if (0 != strcmp(CHAR(STRING_ELT(class_name, 0)), "git_repository"))
+        return NULL;
+
+    path = GET_SLOT(repo, Rf_install("path"));
+    if (R_NilValue == path)
+        return NULL;
+
+    return CHAR(STRING_ELT(path, 0));
+}
+
+/**
+ * Read the stamps of the files that invalidate a cached repository
+ *
+ * A missing file gives a stamp with all fields set to zero.
+ *
+ * @param stamps array with GIT2R_N_STAMPS stamps to fill
+ * @param repo_path path to the repository directory
+ * @return void
+ */
+static void read_repository_stamps(git2r_stamp *stamps, const char *repo_path)
+{
+    size_t i;
+    char *buf;
+    size_t len = strlen(repo_path);
+
+    memset(stamps, 0, GIT2R_N_STAMPS * sizeof(git2r_stamp));
+
+    buf = malloc(len + sizeof("packed-refs") + 1);
+    if (NULL == buf) {
+        /* Force the stamps to be out of date */
+        for (i = 0; i < GIT2R_N_STAMPS; i++)
+            stamps[i].mtime = -1;
+        return;
+    }
+
+    for (i = 0; i < GIT2R_N_STAMPS; i++) {
+        struct stat st;
+
+        strcpy(buf, repo_path);
+        if (len && buf[len - 1] != '/')
+            strcat(buf, "/");
+        strcat(buf, repository_stamp_files[i]);
+
+        if (stat(buf, &st) == 0) {
+            stamps[i].mtime = (double)st.st_mtime;
+            stamps[i].size = (double)st.st_size;
+            stamps[i].ino = (double)st.st_ino;
+        }
+    }
+
+    free(buf);
+}
+
+/**
+ * Check if two stamps are equal
+ *
+ * @param a
+ * @param b
+ * @return 1 if equal else 0
+ */
+static int stamp_equal(const git2r_stamp *a, const git2r_stamp *b)
+{
+    return a->mtime == b->mtime && a->size == b->size && a->ino == b->ino;
+}
+
+/**
+ * Remove an entry from the repository cache
+ *
+ * @param entry
+ * @return void
+ */
+static void repository_cache_evict(git2r_repository_cache_entry *entry)
+{
+    if (entry->repository)
+        git_repository_free(entry->repository);
+    free(entry->path);
+    memset(entry, 0, sizeof(git2r_repository_cache_entry));
+}
+
+/**
+ * Refresh a cached repository if files on disk have changed
+ *
+ * @param entry the cache entry to refresh
+ * @return 0 if the entry is still valid, else -1 and the entry has
+ * been evicted
+ */
+static int repository_cache_refresh(git2r_repository_cache_entry *entry)
+{
+    size_t i;
+    git2r_stamp stamps[GIT2R_N_STAMPS];
+    git2r_stamp missing = {0};
+    git_index *index = NULL;
+
+    read_repository_stamps(stamps, git_repository_path(entry->repository));
+
+    for (i = 0; i < GIT2R_STAMP_INDEX; i++) {
+        if (!stamp_equal(&stamps[i], &entry->stamps[i])) {
+            repository_cache_evict(entry);
+            return -1;
+        }
+    }
+
+    if (!stamp_equal(&stamps[GIT2R_STAMP_INDEX],
+                     &entry->stamps[GIT2R_STAMP_INDEX])) {
+        /* A removed index is handled by reopening the repository */
+        if (stamp_equal(&stamps[GIT2R_STAMP_INDEX], &missing)
+            || git_repository_index(&index, entry->repository) < 0
+            || git_index_read(index, 0) < 0) {
+            if (index)
+                git_index_free(index);
+            repository_cache_evict(entry);
+            return -1;
+        }
+
+        git_index_free(index);
+    }
+
+    memcpy(entry->stamps, stamps, sizeof(stamps));
+
+    return 0;
+}
+
+/**
+ * Lookup a repository in the repository cache
+ *
+ * If the repository is not in the cache it is opened and added to
+ * the cache. The least recently used repository is evicted when the
+ * cache is full.
+ *
+ * @param path normalized path to the repository
+ * @return a git_repository pointer on success else NULL
+ */
+static git_repository* repository_cache_lookup(const char *path)
+{
+    size_t i;
+    git_repository *r;
+    git2r_repository_cache_entry *entry = NULL;
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        entry = &repository_cache[i];
+        if (entry->path && 0 == strcmp(entry->path, path)) {
+            if (0 == repository_cache_refresh(entry)) {
+                entry->last_used = ++repository_cache_clock;
+                return entry->repository;
+            }
+            break;
+        }
+    }
+
+    if (git_repository_open(&r, path) < 0)
+        return NULL;
+
+    /* Find a free entry or the least recently used entry */
+    entry = &repository_cache[0];
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        if (!repository_cache[i].path) {
+            entry = &repository_cache[i];
+            break;
+        }
+        if (repository_cache[i].last_used < entry->last_used)
+            entry = &repository_cache[i];
+    }
+
+    if (entry->path)
+        repository_cache_evict(entry);
+
+    entry->path = malloc(strlen(path) + 1);
+    if (NULL == entry->path) {
+        /* Unable to cache, the repository can't be returned since
+         * the caller doesn't free it. */
+        git_repository_free(r);
+        return NULL;
+    }
+
+    strcpy(entry->path, path);
+    entry->repository = r;
+    entry->last_used = ++repository_cache_clock;
+    read_repository_stamps(entry->stamps, git_repository_path(r));
+
+    return r;
+}
+
+/**
+ * Free all repositories in the repository cache
+ *
+ * @return void
+ */
+static void repository_cache_clear(void)
+{
+    size_t i;
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        if (repository_cache[i].path)
+            repository_cache_evict(&repository_cache[i]);
+    }
+}
+
+/**
+ * Init a repository.
+ *
+ * @param path
+ * @param bare
+ * @param ref_table Store the references in reference tables
+ * @return R_NilValue
+ */
+SEXP init(const SEXP path, const SEXP bare, const SEXP ref_table)
+{
+    int err;
+    git_repository *repository = NULL;
+    git_repository_init_options opts = GIT_REPOSITORY_INIT_OPTIONS_INIT;
+
+    if (R_NilValue == path)
+        error("'path' equals R_NilValue");
+    if (!isString(path))
+        error("'path' must be a string");
+    if (R_NilValue == bare)
+        error("'bare' equals R_NilValue");
+    if (!isLogical(bare))
+        error("'bare' must be a logical");
+    if (R_NilValue == ref_table)
+        error("'ref_table' equals R_NilValue");
+    if (!isLogical(ref_table))
+        error("'ref_table' must be a logical");
+
+    opts.flags = GIT_REPOSITORY_INIT_MKPATH;
+    if (LOGICAL(bare)[0])
+        opts.flags |= GIT_REPOSITORY_INIT_BARE;
+    if (LOGICAL(ref_table)[0])
+        opts.flags |= GIT_REPOSITORY_INIT_REF_TABLE;
+
+    err = git_repository_init_ext(&repository,
+                                  CHAR(STRING_ELT(path, 0)),
+                                  &opts);
+    if (err < 0)
+        error("Unable to init repository");
+
+    git_repository_free(repository);
+
+    return R_NilValue;
+}
+
+/**
+ * Init slots in S4 class git_commit
+ *
+ * @param commit a commit object
+ * @param sexp_commit S4 class git_commit
+ * @return void
+ */
+static void init_commit(const git_commit *commit, SEXP sexp_commit)
+{
+    const char *message;
+    const char *summary;
+    const git_signature *author;
+    const git_signature *committer;
+    char hex[GIT_OID_HEXSZ + 1];
+
+    git_oid_fmt(hex, git_commit_id(commit));
+    hex[GIT_OID_HEXSZ] = '\0';
+    SET_SLOT(sexp_commit,
+             Rf_install("hex"),
+             ScalarString(mkChar(hex)));
+
+    author = git_commit_author(commit);
+    if (author) {
+        SEXP sexp_author;
+
+        PROTECT(sexp_author = NEW_OBJECT(MAKE_CLASS("git_signature")));
+        init_signature(author, sexp_author);
+        SET_SLOT(sexp_commit, Rf_install("author"), sexp_author);
+        UNPROTECT(1);
+    }
+
+    committer = git_commit_committer(commit);
+    if (committer) {
+        SEXP sexp_committer;
+
+        PROTECT(sexp_committer = NEW_OBJECT(MAKE_CLASS("git_signature")));
+        init_signature(committer, sexp_committer);
+        SET_SLOT(sexp_commit, Rf_install("committer"), sexp_committer);
+        UNPROTECT(1);
+    }
+
+    summary = git_commit_summary(commit);
+    if (summary) {
+        SET_SLOT(sexp_commit,
+                 Rf_install("summary"),
+                 ScalarString(mkChar(summary)));
+    }
+
+    message = git_commit_message(commit);
     if (message) {
         SET_SLOT(sexp_commit,
                  Rf_install("message"),
@@ -868,900 +2463,2782 @@ static void init_commit(const git_commit *commit, SEXP sexp_commit)
 }
 
 /**
- * Init slots in S4 class git_reference.
+ * Init slots in S4 class git_reference.
+ *
+ * @param ref
+ * @param reference
+ * @return void
+ */
+static void init_reference(git_reference *ref, SEXP reference)
+{
+    char out[41];
+    out[40] = '\0';
+
+    SET_SLOT(reference,
+             Rf_install("name"),
+             ScalarString(mkChar(git_reference_name(ref))));
+
+    SET_SLOT(reference,
+             Rf_install("shorthand"),
+             ScalarString(mkChar(git_reference_shorthand(ref))));
+
+    switch (git_reference_type(ref)) {
+    case GIT_REF_OID:
+        SET_SLOT(reference, Rf_install("type"), ScalarInteger(GIT_REF_OID));
+        git_oid_fmt(out, git_reference_target(ref));
+        SET_SLOT(reference, Rf_install("hex"), ScalarString(mkChar(out)));
+        break;
+    case GIT_REF_SYMBOLIC:
+        SET_SLOT(reference, Rf_install("type"), ScalarInteger(GIT_REF_SYMBOLIC));
+        SET_SLOT(reference,
+                 Rf_install("target"),
+                 ScalarString(mkChar(git_reference_symbolic_target(ref))));
+        break;
+    default:
+        error("Unexpected reference type");
+    }
+}
+
+/**
+ * Init slots in S4 class git_signature.
+ *
+ * @param sig
+ * @param signature
+ * @return void
+ */
+static void init_signature(const git_signature *sig, SEXP signature)
+{
+    SEXP when;
+
+    SET_SLOT(signature,
+             Rf_install("name"),
+             ScalarString(mkChar(sig->name)));
+
+    SET_SLOT(signature,
+             Rf_install("email"),
+             ScalarString(mkChar(sig->email)));
+
+    when = GET_SLOT(signature, Rf_install("when"));
+
+    SET_SLOT(when,
+             Rf_install("time"),
+             ScalarReal((double)sig->when.time));
+
+    SET_SLOT(when,
+             Rf_install("offset"),
+             ScalarReal((double)sig->when.offset));
+}
+
+/**
+ * Init slots in S4 class git_tag
+ *
+ * @param source a tag
+ * @param dest S4 class git_tag to initialize
+ * @return void
+ */
+static void init_tag(git_tag *source, SEXP dest)
+{
+    int err;
+    const git_signature *tagger;
+    const git_oid *oid;
+    char target[GIT_OID_HEXSZ + 1];
+
+    SET_SLOT(dest,
+             Rf_install("message"),
+             ScalarString(mkChar(git_tag_message(source))));
+
+    SET_SLOT(dest,
+             Rf_install("name"),
+             ScalarString(mkChar(git_tag_name(source))));
+
+    tagger = git_tag_tagger(source);
+    if (tagger) {
+        SEXP sexp_tagger;
+
+        PROTECT(sexp_tagger = NEW_OBJECT(MAKE_CLASS("git_signature")));
+        init_signature(tagger, sexp_tagger);
+        SET_SLOT(dest, Rf_install("tagger"), sexp_tagger);
+        UNPROTECT(1);
+    }
+
+    oid = git_tag_target_id(source);
+    git_oid_tostr(target, sizeof(target), oid);;
+    SET_SLOT(dest,
+             Rf_install("target"),
+             ScalarString(mkChar(target)));
+}
+
+/**
+ * Columns in the data.frame with commits
+ */
+enum {
+    GIT2R_COMMIT_HEX = 0,
+    GIT2R_COMMIT_SUMMARY,
+    GIT2R_COMMIT_MESSAGE,
+    GIT2R_COMMIT_AUTHOR,
+    GIT2R_COMMIT_EMAIL,
+    GIT2R_COMMIT_WHEN,
+    GIT2R_COMMIT_OFFSET,
+    GIT2R_COMMIT_COMMITTER,
+    GIT2R_COMMIT_PARENTS,
+    GIT2R_N_COMMIT_COLUMNS
+};
+
+static const char *commit_column_names[GIT2R_N_COMMIT_COLUMNS] =
+    {"hex", "summary", "message", "author", "email",
+     "when", "offset", "committer", "parents"};
+
+static const SEXPTYPE commit_column_types[GIT2R_N_COMMIT_COLUMNS] =
+    {STRSXP, STRSXP, STRSXP, STRSXP, STRSXP,
+     REALSXP, REALSXP, STRSXP, INTSXP};
+
+/**
+ * Create the columns to hold commits
+ *
+ * @param capacity initial length of each column
+ * @return unprotected VECSXP with one vector per column
+ */
+static SEXP new_commit_columns(R_xlen_t capacity)
+{
+    size_t i;
+    SEXP columns, names;
+
+    PROTECT(columns = allocVector(VECSXP, GIT2R_N_COMMIT_COLUMNS));
+    PROTECT(names = allocVector(STRSXP, GIT2R_N_COMMIT_COLUMNS));
+    for (i = 0; i < GIT2R_N_COMMIT_COLUMNS; i++) {
+        SET_VECTOR_ELT(columns, i, allocVector(commit_column_types[i], capacity));
+        SET_STRING_ELT(names, i, mkChar(commit_column_names[i]));
+    }
+    setAttrib(columns, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return columns;
+}
+
+/**
+ * Change the length of all columns
+ *
+ * @param columns VECSXP with columns
+ * @param length the new length of each column
+ * @return void
+ */
+static void resize_columns(SEXP columns, R_xlen_t length)
+{
+    R_xlen_t i;
+
+    for (i = 0; i < XLENGTH(columns); i++) {
+        SEXP column = VECTOR_ELT(columns, i);
+        if (XLENGTH(column) != length)
+            SET_VECTOR_ELT(columns, i, xlengthgets(column, length));
+    }
+}
+
+/**
+ * Turn a list of columns into a data.frame with nrow rows
+ *
+ * The columns are truncated to nrow and the attributes of a
+ * data.frame are set on the list.
+ *
+ * @param columns VECSXP with columns
+ * @param nrow number of rows
+ * @return void
+ */
+static void columns_as_data_frame(SEXP columns, R_xlen_t nrow)
+{
+    SEXP row_names;
+
+    resize_columns(columns, nrow);
+
+    /* Compact representation of row names 1:nrow */
+    PROTECT(row_names = allocVector(INTSXP, 2));
+    INTEGER(row_names)[0] = NA_INTEGER;
+    INTEGER(row_names)[1] = -(int)nrow;
+    setAttrib(columns, R_RowNamesSymbol, row_names);
+    setAttrib(columns, R_ClassSymbol, mkString("data.frame"));
+    UNPROTECT(1);
+}
+
+/**
+ * Turn the list of commit columns into a data.frame with nrow rows
+ *
+ * The when column holds the wall-clock time of the author in the
+ * "GMT" timezone, as the coercion of a git_time to POSIXct does.
+ *
+ * @param columns VECSXP with commit columns
+ * @param nrow number of rows
+ * @return void
+ */
+static void commit_columns_as_data_frame(SEXP columns, R_xlen_t nrow)
+{
+    SEXP class_name;
+
+    columns_as_data_frame(columns, nrow);
+
+    PROTECT(class_name = allocVector(STRSXP, 2));
+    SET_STRING_ELT(class_name, 0, mkChar("POSIXct"));
+    SET_STRING_ELT(class_name, 1, mkChar("POSIXt"));
+    setAttrib(VECTOR_ELT(columns, GIT2R_COMMIT_WHEN), R_ClassSymbol, class_name);
+    setAttrib(VECTOR_ELT(columns, GIT2R_COMMIT_WHEN), install("tzone"), mkString("GMT"));
+    UNPROTECT(1);
+}
+
+/**
+ * Walk commits and add them as rows to the commit columns
+ *
+ * The columns are grown by doubling their length when full.
+ *
+ * @param columns protected VECSXP with commit columns
+ * @param nrow number of rows in use, updated with added rows
+ * @param walker
+ * @param repository
+ * @param max maximum number of commits to add, or -1 to add all
+ * @return 0 on success or GIT_ITEROVER when the walk ended before
+ * max commits was added, else error code
+ */
+static int walk_commit_columns(SEXP columns,
+                               R_xlen_t *nrow,
+                               git_revwalk *walker,
+                               git_repository *repository,
+                               R_xlen_t max)
+{
+    int err = 0;
+    R_xlen_t i = *nrow;
+    R_xlen_t capacity = XLENGTH(VECTOR_ELT(columns, 0));
+    R_xlen_t end = max < 0 ? -1 : *nrow + max;
+
+    while (i != end) {
+        git_oid oid;
+        git_commit *commit;
+        const git_signature *author, *committer;
+        const char *summary, *message;
+        char hex[GIT_OID_HEXSZ + 1];
+
+        err = git_revwalk_next(&oid, walker);
+        if (err < 0)
+            break;
+
+        err = git_commit_lookup(&commit, repository, &oid);
+        if (err < 0)
+            break;
+
+        if (i == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            resize_columns(columns, capacity);
+        }
+
+        git_oid_tostr(hex, sizeof(hex), &oid);
+        SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_HEX), i, mkChar(hex));
+
+        summary = git_commit_summary(commit);
+        if (summary)
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_SUMMARY), i, mkChar(summary));
+
+        message = git_commit_message(commit);
+        if (message)
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_MESSAGE), i, mkChar(message));
+
+        author = git_commit_author(commit);
+        if (author) {
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_AUTHOR), i, mkChar(author->name));
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_EMAIL), i, mkChar(author->email));
+            REAL(VECTOR_ELT(columns, GIT2R_COMMIT_WHEN))[i] =
+                (double)author->when.time + 60.0 * author->when.offset;
+            REAL(VECTOR_ELT(columns, GIT2R_COMMIT_OFFSET))[i] = (double)author->when.offset;
+        } else {
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_AUTHOR), i, NA_STRING);
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_EMAIL), i, NA_STRING);
+            REAL(VECTOR_ELT(columns, GIT2R_COMMIT_WHEN))[i] = NA_REAL;
+            REAL(VECTOR_ELT(columns, GIT2R_COMMIT_OFFSET))[i] = NA_REAL;
+        }
+
+        committer = git_commit_committer(commit);
+        SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_COMMIT_COMMITTER), i,
+                       committer ? mkChar(committer->name) : NA_STRING);
+
+        INTEGER(VECTOR_ELT(columns, GIT2R_COMMIT_PARENTS))[i] =
+            (int)git_commit_parentcount(commit);
+
+        git_commit_free(commit);
+        i++;
+    }
+
+    *nrow = i;
+
+    if (GIT_ITEROVER == err && max < 0)
+        err = 0;
+
+    return err;
+}
+
+/**
+ * Check if repository is bare.
+ *
+ * @param repo S4 class git_repository
+ * @return
+ */
+SEXP is_bare(const SEXP repo)
+{
+    SEXP result;
+    git_repository *repository;
+
+    repository= get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    if (git_repository_is_bare(repository))
+        result = ScalarLogical(TRUE);
+    else
+        result = ScalarLogical(FALSE);
+
+    return result;
+}
+
+/**
+ * Check if repository is empty.
+ *
+ * @param repo S4 class git_repository
+ * @return
+ */
+SEXP is_empty(const SEXP repo)
+{
+    SEXP result;
+    git_repository *repository;
+
+    repository= get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    if (git_repository_is_empty(repository))
+        result = ScalarLogical(TRUE);
+    else
+        result = ScalarLogical(FALSE);
+
+    return result;
+}
+
+/**
+ * Check if valid repository.
+ *
+ * @param path
+ * @return
+ */
+SEXP is_repository(const SEXP path)
+{
+    SEXP result;
+    git_repository *repository;
+    int err;
+
+    if (R_NilValue == path)
+        error("'path' equals R_NilValue");
+    if (!isString(path))
+        error("'path' must be a string");
+
+    err = git_repository_open(&repository, CHAR(STRING_ELT(path, 0)));
+    if (err < 0) {
+        result = ScalarLogical(FALSE);
+    } else {
+        git_repository_free(repository);
+        result = ScalarLogical(TRUE);
+    }
+
+    return result;
+}
+
+/**
+ * Add ignored files
+ *
+ * @param list
+ * @param list_index
+ * @param status_list
+ * @return void
+ */
+static void list_ignored_files(SEXP list,
+                               size_t list_index,
+                               git_status_list *status_list)
+{
+    size_t i = 0, j = 0, count;
+    SEXP sub_list, sub_list_names, item;
+
+    /* Create list with the correct number of entries */
+    count = count_ignored_files(status_list);
+    PROTECT(sub_list = allocVector(VECSXP, count));
+    PROTECT(sub_list_names = allocVector(STRSXP, count));
+
+    /* i index the entrycount. j index the added change in list */
+    count = git_status_list_entrycount(status_list);
+    for (; i < count; i++) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_IGNORED) {
+            SET_STRING_ELT(sub_list_names, j, mkChar("ignored"));
+            PROTECT(item = allocVector(STRSXP, 1));
+            SET_STRING_ELT(item, 0, mkChar(s->index_to_workdir->old_file.path));
+            SET_VECTOR_ELT(sub_list, j, item);
+            UNPROTECT(1);
+            j++;
+        }
+    }
+
+    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
+    SET_VECTOR_ELT(list, list_index, sub_list);
+    UNPROTECT(2);
+}
+
+/**
+ * Add changes in index
+ *
+ * @param list
+ * @param list_index
+ * @param status_list
+ * @return void
+ */
+static void list_staged_changes(SEXP list,
+                              size_t list_index,
+                              git_status_list *status_list)
+{
+    size_t i = 0, j = 0, count;
+    SEXP sub_list, sub_list_names, item;
+
+    /* Create list with the correct number of entries */
+    count = count_staged_changes(status_list);
+    PROTECT(sub_list = allocVector(VECSXP, count));
+    PROTECT(sub_list_names = allocVector(STRSXP, count));
+
+    /* i index the entrycount. j index the added change in list */
+    count = git_status_list_entrycount(status_list);
+    for (; i < count; i++) {
+        char *istatus = NULL;
+        const char *old_path, *new_path;
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_CURRENT)
+            continue;
+
+        if (s->status & GIT_STATUS_INDEX_NEW)
+            istatus = "new";
+        else if (s->status & GIT_STATUS_INDEX_MODIFIED)
+            istatus = "modified";
+        else if (s->status & GIT_STATUS_INDEX_DELETED)
+            istatus = "deleted";
+        else if (s->status & GIT_STATUS_INDEX_RENAMED)
+            istatus = "renamed";
+        else if (s->status & GIT_STATUS_INDEX_TYPECHANGE)
+            istatus = "typechange";
+
+        if (!istatus)
+            continue;
+        SET_STRING_ELT(sub_list_names, j, mkChar(istatus));
+
+        old_path = s->head_to_index->old_file.path;
+        new_path = s->head_to_index->new_file.path;
+
+        if (old_path && new_path && strcmp(old_path, new_path)) {
+            PROTECT(item = allocVector(STRSXP, 2));
+            SET_STRING_ELT(item, 0, mkChar(old_path));
+            SET_STRING_ELT(item, 1, mkChar(new_path));
+        } else {
+            PROTECT(item = allocVector(STRSXP, 1));
+            SET_STRING_ELT(item, 0, mkChar(old_path ? old_path : new_path));
+        }
+
+        SET_VECTOR_ELT(sub_list, j, item);
+        UNPROTECT(1);
+        j++;
+    }
+
+    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
+    SET_VECTOR_ELT(list, list_index, sub_list);
+    UNPROTECT(2);
+}
+
+/**
+ * Add changes in workdir relative to index
+ *
+ * @param list
+ * @param list_index
+ * @param status_list
+ * @return void
+ */
+static void list_unstaged_changes(SEXP list,
+                                size_t list_index,
+                                git_status_list *status_list)
+{
+    size_t i = 0, j = 0, count;
+    SEXP sub_list, sub_list_names, item;
+
+    /* Create list with the correct number of entries */
+    count = count_unstaged_changes(status_list);
+    PROTECT(sub_list = allocVector(VECSXP, count));
+    PROTECT(sub_list_names = allocVector(STRSXP, count));
+
+    /* i index the entrycount. j index the added change in list */
+    count = git_status_list_entrycount(status_list);
+    for (; i < count; i++) {
+        char *wstatus = NULL;
+        const char *old_path, *new_path;
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_CURRENT || s->index_to_workdir == NULL)
+            continue;
+
+        if (s->status & GIT_STATUS_WT_MODIFIED)
+            wstatus = "modified";
+        else if (s->status & GIT_STATUS_WT_DELETED)
+            wstatus = "deleted";
+        else if (s->status & GIT_STATUS_WT_RENAMED)
+            wstatus = "renamed";
+        else if (s->status & GIT_STATUS_WT_TYPECHANGE)
+            wstatus = "typechange";
+
+        if (!wstatus)
+            continue;
+        SET_STRING_ELT(sub_list_names, j, mkChar(wstatus));
+
+        old_path = s->index_to_workdir->old_file.path;
+        new_path = s->index_to_workdir->new_file.path;
+
+        if (old_path && new_path && strcmp(old_path, new_path)) {
+            PROTECT(item = allocVector(STRSXP, 2));
+            SET_STRING_ELT(item, 0, mkChar(old_path));
+            SET_STRING_ELT(item, 1, mkChar(new_path));
+        } else {
+            PROTECT(item = allocVector(STRSXP, 1));
+            SET_STRING_ELT(item, 0, mkChar(old_path ? old_path : new_path));
+        }
+
+        SET_VECTOR_ELT(sub_list, j, item);
+        UNPROTECT(1);
+        j++;
+    }
+
+    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
+    SET_VECTOR_ELT(list, list_index, sub_list);
+    UNPROTECT(2);
+}
+
+/**
+ * Add untracked files
+ *
+ * @param list
+ * @param list_index
+ * @param status_list
+ * @return void
+ */
+static void list_untracked_files(SEXP list,
+                                 size_t list_index,
+                                 git_status_list *status_list)
+{
+    size_t i = 0, j = 0, count;
+    SEXP sub_list, sub_list_names, item;
+
+    /* Create list with the correct number of entries */
+    count = count_untracked_files(status_list);
+    PROTECT(sub_list = allocVector(VECSXP, count));
+    PROTECT(sub_list_names = allocVector(STRSXP, count));
+
+    /* i index the entrycount. j index the added change in list */
+    count = git_status_list_entrycount(status_list);
+    for (; i < count; i++) {
+        const git_status_entry *s = git_status_byindex(status_list, i);
+
+        if (s->status == GIT_STATUS_WT_NEW) {
+            SET_STRING_ELT(sub_list_names, j, mkChar("untracked"));
+            PROTECT(item = allocVector(STRSXP, 1));
+            SET_STRING_ELT(item, 0, mkChar(s->index_to_workdir->old_file.path));
+            SET_VECTOR_ELT(sub_list, j, item);
+            UNPROTECT(1);
+            j++;
+        }
+    }
+
+    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
+    SET_VECTOR_ELT(list, list_index, sub_list);
+    UNPROTECT(2);
+}
+
+
+/**
+ * Get the statistics of the object cache of a repository
+ *
+ * @param repo S4 class git_repository
+ * @return VECSXP with the statistics
+ */
+SEXP object_cache(const SEXP repo)
+{
+    int err;
+    SEXP list, names;
+    git_repository *repository;
+    git_repository_object_cache_stats stats;
+    ssize_t total = 0, max_size = 0;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_repository_get_object_cache_stats(&stats, repository);
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &total, &max_size);
+
+    PROTECT(list = allocVector(VECSXP, 7));
+    PROTECT(names = allocVector(STRSXP, 7));
+    SET_STRING_ELT(names, 0, mkChar("entries"));
+    SET_VECTOR_ELT(list, 0, ScalarReal((double)stats.entries));
+    SET_STRING_ELT(names, 1, mkChar("memory_used"));
+    SET_VECTOR_ELT(list, 1, ScalarReal((double)stats.memory_used));
+    SET_STRING_ELT(names, 2, mkChar("hits"));
+    SET_VECTOR_ELT(list, 2, ScalarReal((double)stats.hits));
+    SET_STRING_ELT(names, 3, mkChar("misses"));
+    SET_VECTOR_ELT(list, 3, ScalarReal((double)stats.misses));
+    SET_STRING_ELT(names, 4, mkChar("evictions"));
+    SET_VECTOR_ELT(list, 4, ScalarReal((double)stats.evictions));
+    SET_STRING_ELT(names, 5, mkChar("total_memory_used"));
+    SET_VECTOR_ELT(list, 5, ScalarReal((double)total));
+    SET_STRING_ELT(names, 6, mkChar("max_size"));
+    SET_VECTOR_ELT(list, 6, ScalarReal((double)max_size));
+    setAttrib(list, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return list;
+}
+
+/**
+ * Check a size argument to object_cache_limits
+ *
+ * @param size The size in bytes, or R_NilValue
+ * @return The size, or -1 if size is R_NilValue
+ */
+static double object_cache_size_arg(const SEXP size)
+{
+    double value;
+
+    if (R_NilValue == size)
+        return -1;
+
+    if ((!isReal(size) && !isInteger(size)) || 1 != length(size))
+        error("Invalid arguments to object_cache_limits");
+    value = asReal(size);
+    if (ISNA(value) || value < 0)
+        error("Invalid arguments to object_cache_limits");
+
+    return value;
+}
+
+/**
+ * Get, and optionally set, the size limits of the object caches. The
+ * limits are shared by all repositories.
+ *
+ * @param max_size The maximum total bytes of cached objects, or
+ * R_NilValue to keep the current value
+ * @param commit The maximum size of a cached commit, or R_NilValue
+ * @param tree The maximum size of a cached tree, or R_NilValue
+ * @param blob The maximum size of a cached blob, or R_NilValue
+ * @param tag The maximum size of a cached tag, or R_NilValue
+ * @return VECSXP with the limits
+ */
+SEXP object_cache_limits(const SEXP max_size,
+                         const SEXP commit,
+                         const SEXP tree,
+                         const SEXP blob,
+                         const SEXP tag)
+{
+    int i, err = 0;
+    SEXP list, names;
+    ssize_t total, allowed;
+    double value[5];
+    const char *name[5] = {"max_size", "commit", "tree", "blob", "tag"};
+    const git_otype type[5] = {GIT_OBJ_ANY, GIT_OBJ_COMMIT, GIT_OBJ_TREE,
+                               GIT_OBJ_BLOB, GIT_OBJ_TAG};
+
+    value[0] = object_cache_size_arg(max_size);
+    value[1] = object_cache_size_arg(commit);
+    value[2] = object_cache_size_arg(tree);
+    value[3] = object_cache_size_arg(blob);
+    value[4] = object_cache_size_arg(tag);
+
+    if (value[0] >= 0)
+        git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)value[0]);
+    git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &total, &allowed);
+    value[0] = (double)allowed;
+
+    for (i = 1; i < 5; i++) {
+        size_t size;
+
+        if (value[i] >= 0) {
+            err = git_libgit2_opts(GIT_OPT_SET_CACHE_OBJECT_LIMIT,
+                                   (int)type[i], (size_t)value[i]);
+            if (err < 0)
+                break;
+        }
+
+        err = git_libgit2_opts(GIT_OPT_GET_CACHE_OBJECT_LIMIT,
+                               (int)type[i], &size);
+        if (err < 0)
+            break;
+        value[i] = (double)size;
+    }
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    PROTECT(list = allocVector(VECSXP, 5));
+    PROTECT(names = allocVector(STRSXP, 5));
+    for (i = 0; i < 5; i++) {
+        SET_STRING_ELT(names, i, mkChar(name[i]));
+        SET_VECTOR_ELT(list, i, ScalarReal(value[i]));
+    }
+    setAttrib(list, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return list;
+}
+
+/**
+ * Read the type and size of objects
+ *
+ * The headers are read in one batch, pack by pack in the order of the
+ * packfile.
+ *
+ * @param repo S4 class git_repository
+ * @param hex character vector with the sha of the objects
+ * @return data.frame with the columns hex, type and size
+ */
+SEXP odb_headers(const SEXP repo, const SEXP hex)
+{
+    int err;
+    size_t i, n;
+    const char* err_msg = NULL;
+    git_oid *ids = NULL;
+    size_t *sizes = NULL;
+    git_otype *types = NULL;
+    git_odb *odb = NULL;
+    git_repository *repository;
+    SEXP result = R_NilValue, names;
+
+    if (!isString(hex))
+        error("'hex' must be a character vector");
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    n = length(hex);
+    ids = malloc((n + 1) * sizeof(git_oid));
+    sizes = malloc((n + 1) * sizeof(size_t));
+    types = malloc((n + 1) * sizeof(git_otype));
+    if (!ids || !sizes || !types) {
+        err = -1;
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++) {
+        err = git_oid_fromstr(&ids[i], CHAR(STRING_ELT(hex, i)));
+        if (err < 0)
+            goto cleanup;
+    }
+
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_odb_read_header_many(sizes, types, odb, ids, n);
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(result = allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(result, 0, duplicate(hex));
+    SET_VECTOR_ELT(result, 1, allocVector(STRSXP, n));
+    SET_VECTOR_ELT(result, 2, allocVector(REALSXP, n));
+    PROTECT(names = allocVector(STRSXP, 3));
+    SET_STRING_ELT(names, 0, mkChar("hex"));
+    SET_STRING_ELT(names, 1, mkChar("type"));
+    SET_STRING_ELT(names, 2, mkChar("size"));
+    setAttrib(result, R_NamesSymbol, names);
+
+    for (i = 0; i < n; i++) {
+        if (GIT_OBJ_BAD == types[i]) {
+            SET_STRING_ELT(VECTOR_ELT(result, 1), i, NA_STRING);
+            REAL(VECTOR_ELT(result, 2))[i] = NA_REAL;
+        } else {
+            SET_STRING_ELT(VECTOR_ELT(result, 1), i,
+                           mkChar(git_object_type2string(types[i])));
+            REAL(VECTOR_ELT(result, 2))[i] = sizes[i];
+        }
+    }
+
+    columns_as_data_frame(result, n);
+    UNPROTECT(2);
+
+cleanup:
+    free(ids);
+    free(sizes);
+    free(types);
+
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * The objects of an object database, as listed by
+ * git_odb_foreach_header
+ */
+typedef struct {
+    git_oid oid;
+    git_otype type;
+    size_t size;
+    int pack; /* index in packs, or -1 for a loose object */
+} git2r_odb_object;
+
+typedef struct {
+    git2r_odb_object *objects;
+    size_t n;
+    size_t alloc;
+    char **packs; /* file names of the packfiles */
+    size_t npacks;
+    const char *last_pack; /* path of the packfile of the last object */
+} git2r_odb_objects;
+
+/**
+ * Callback to add an object to the list of objects
+ *
+ * @param id oid of the object
+ * @param type type of the object
+ * @param size size of the object
+ * @param pack path of the packfile of the object, or NULL
+ * @param payload the git2r_odb_objects to add to
+ * @return 0 or -1 when out of memory
+ */
+static int odb_objects_cb(const git_oid *id,
+                          git_otype type,
+                          size_t size,
+                          const char *pack,
+                          void *payload)
+{
+    git2r_odb_objects *list = (git2r_odb_objects*)payload;
+    git2r_odb_object *object;
+
+    if (list->n == list->alloc) {
+        size_t alloc = list->alloc ? 2 * list->alloc : 1024;
+        git2r_odb_object *objects = realloc(list->objects, alloc * sizeof(*objects));
+        if (NULL == objects)
+            return GIT_EUSER;
+        list->objects = objects;
+        list->alloc = alloc;
+    }
+
+    /* The objects of a packfile are listed together */
+    if (pack && pack != list->last_pack) {
+        const char *name = strrchr(pack, '/');
+        char **packs = realloc(list->packs, (list->npacks + 1) * sizeof(char*));
+        if (NULL == packs)
+            return GIT_EUSER;
+        list->packs = packs;
+        list->packs[list->npacks] = strdup(name ? name + 1 : pack);
+        if (NULL == list->packs[list->npacks])
+            return GIT_EUSER;
+        list->npacks++;
+        list->last_pack = pack;
+    }
+
+    object = &list->objects[list->n++];
+    git_oid_cpy(&object->oid, id);
+    object->type = type;
+    object->size = size;
+    object->pack = pack ? (int)list->npacks - 1 : -1;
+
+    return 0;
+}
+
+/**
+ * List the objects of a repository
+ *
+ * The objects of the packfiles are read from the pack indexes and the
+ * object headers, without inflating the objects.
+ *
+ * @param repo S4 class git_repository
+ * @return data.frame with the columns hex, type, size and pack
+ */
+SEXP odb_objects(const SEXP repo)
+{
+    int err;
+    size_t i;
+    const char* err_msg = NULL;
+    git_odb *odb = NULL;
+    git_repository *repository;
+    git2r_odb_objects list = {0};
+    SEXP result = R_NilValue, names, packs;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_odb_foreach_header(odb, odb_objects_cb, &list);
+    if (err == GIT_EUSER) {
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(result = allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(result, 0, allocVector(STRSXP, list.n));
+    SET_VECTOR_ELT(result, 1, allocVector(STRSXP, list.n));
+    SET_VECTOR_ELT(result, 2, allocVector(REALSXP, list.n));
+    SET_VECTOR_ELT(result, 3, allocVector(STRSXP, list.n));
+    PROTECT(names = allocVector(STRSXP, 4));
+    SET_STRING_ELT(names, 0, mkChar("hex"));
+    SET_STRING_ELT(names, 1, mkChar("type"));
+    SET_STRING_ELT(names, 2, mkChar("size"));
+    SET_STRING_ELT(names, 3, mkChar("pack"));
+    setAttrib(result, R_NamesSymbol, names);
+
+    PROTECT(packs = allocVector(STRSXP, list.npacks));
+    for (i = 0; i < list.npacks; i++)
+        SET_STRING_ELT(packs, i, mkChar(list.packs[i]));
+
+    for (i = 0; i < list.n; i++) {
+        char hex[GIT_OID_HEXSZ + 1];
+        git2r_odb_object *object = &list.objects[i];
+
+        git_oid_tostr(hex, sizeof(hex), &object->oid);
+        SET_STRING_ELT(VECTOR_ELT(result, 0), i, mkChar(hex));
+        SET_STRING_ELT(VECTOR_ELT(result, 1), i,
+                       mkChar(git_object_type2string(object->type)));
+        REAL(VECTOR_ELT(result, 2))[i] = object->size;
+        SET_STRING_ELT(VECTOR_ELT(result, 3), i,
+                       object->pack < 0 ? NA_STRING : STRING_ELT(packs, object->pack));
+    }
+
+    columns_as_data_frame(result, list.n);
+    UNPROTECT(3);
+
+cleanup:
+    free(list.objects);
+    for (i = 0; i < list.npacks; i++)
+        free(list.packs[i]);
+    free(list.packs);
+
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Check an optional size in bytes argument
+ *
+ * @param arg The argument, R_NilValue or a number
+ * @param out The value of the argument
+ * @return 1 if the argument is a valid size, 0 if it is R_NilValue,
+ * else -1
+ */
+static int get_size_arg(const SEXP arg, double *out)
+{
+    if (R_NilValue == arg)
+        return 0;
+    if ((!isReal(arg) && !isInteger(arg)) || 1 != length(arg))
+        return -1;
+    *out = asReal(arg);
+    if (ISNA(*out) || *out < 0)
+        return -1;
+    return 1;
+}
+
+/**
+ * Get the mapping statistics of the packfiles of a repository, and
+ * optionally set the window size and the mapped limit of the
+ * packfiles.
+ *
+ * @param repo S4 class git_repository
+ * @param limit The mapped limit in bytes, or R_NilValue to keep the
+ * current limit
+ * @param window_size The window size in bytes, or R_NilValue to keep
+ * the current window size
+ * @return VECSXP with the statistics
+ */
+SEXP pack_windows(const SEXP repo, const SEXP limit, const SEXP window_size)
+{
+    int err, set_limit, set_window_size;
+    SEXP list, names;
+    git_odb *odb = NULL;
+    git_repository *repository;
+    git_odb_mwindow_stats stats;
+    double limit_value = 0, window_size_value = 0;
+
+    /* Check arguments to pack_windows */
+    set_limit = get_size_arg(limit, &limit_value);
+    set_window_size = get_size_arg(window_size, &window_size_value);
+    if (set_limit < 0 || set_window_size < 0)
+        error("Invalid arguments to pack_windows");
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_odb_get_mwindow_stats(&stats, odb);
+    if (err < 0)
+        goto cleanup;
+
+    if (set_limit || set_window_size) {
+        err = git_odb_set_mwindow_limits(
+            odb,
+            set_window_size ? (size_t)window_size_value : stats.window_size,
+            set_limit ? (size_t)limit_value : stats.mapped_limit);
+        if (err < 0)
+            goto cleanup;
+
+        err = git_odb_get_mwindow_stats(&stats, odb);
+    }
+
+cleanup:
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    PROTECT(list = allocVector(VECSXP, 6));
+    PROTECT(names = allocVector(STRSXP, 6));
+    SET_STRING_ELT(names, 0, mkChar("window_size"));
+    SET_VECTOR_ELT(list, 0, ScalarReal((double)stats.window_size));
+    SET_STRING_ELT(names, 1, mkChar("mapped_limit"));
+    SET_VECTOR_ELT(list, 1, ScalarReal((double)stats.mapped_limit));
+    SET_STRING_ELT(names, 2, mkChar("mapped"));
+    SET_VECTOR_ELT(list, 2, ScalarReal((double)stats.mapped));
+    SET_STRING_ELT(names, 3, mkChar("peak_mapped"));
+    SET_VECTOR_ELT(list, 3, ScalarReal((double)stats.peak_mapped));
+    SET_STRING_ELT(names, 4, mkChar("open_windows"));
+    SET_VECTOR_ELT(list, 4, ScalarReal((double)stats.open_windows));
+    SET_STRING_ELT(names, 5, mkChar("mmap_calls"));
+    SET_VECTOR_ELT(list, 5, ScalarReal((double)stats.mmap_calls));
+    setAttrib(list, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return list;
+}
+
+/**
+ * The glob of the references whose name starts with a prefix
+ *
+ * The characters of the prefix that fnmatch treats as a pattern are
+ * escaped, so the prefix is matched literally.
+ * @param prefix R_NilValue for all references, or a character vector
+ * of length one with the prefix
+ * @return The glob to free, or NULL for all references
+ */
+static char* reference_prefix_glob(const SEXP prefix)
+{
+    const char *str;
+    char *glob, *dst;
+
+    if (R_NilValue == prefix)
+        return NULL;
+
+    if (!isString(prefix) || 1 != length(prefix) ||
+        NA_STRING == STRING_ELT(prefix, 0))
+        error("'prefix' must be a character vector of length one");
+
+    str = CHAR(STRING_ELT(prefix, 0));
+    glob = malloc(2 * strlen(str) + 2);
+    if (NULL == glob)
+        error(err_alloc_memory_buffer);
+    for (dst = glob; *str; str++) {
+        if (strchr("*?[\\", *str))
+            *dst++ = '\\';
+        *dst++ = *str;
+    }
+    strcpy(dst, "*");
+
+    return glob;
+}
+
+/**
+ * List the names, targets and peeled targets of the references of a
+ * repository
+ *
+ * The references are read in one pass of a reference iterator, which
+ * only reads the folders and the part of the packed-refs file that
+ * can hold references with the prefix. The peeled target of a tag
+ * stored with the reference in the packed-refs file or the reference
+ * tables is used, and the other tags are read in one batch of object
+ * headers.
+ *
+ * @param repo S4 class git_repository
+ * @param prefix R_NilValue for all references, or only the references
+ * whose name starts with prefix
+ * @return data.frame with the columns name, symbolic, target and
+ * peeled
+ */
+SEXP reference_targets(const SEXP repo, const SEXP prefix)
+{
+    int err;
+    size_t i, n_tags = 0;
+    const char* err_msg = NULL;
+    char *glob;
+    git2r_reference_list list = {0};
+    git_odb *odb = NULL;
+    git_oid *tag_ids = NULL;
+    size_t *tag_sizes = NULL;
+    git_otype *tag_types = NULL;
+    git_object *peeled = NULL;
+    git_repository *repository;
+    SEXP result = R_NilValue, names;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    glob = reference_prefix_glob(prefix);
+    err = load_references(&list, repository, glob);
+    free(glob);
+    if (GIT_EUSER == err) {
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+    if (err < 0)
+        goto cleanup;
+
+    /* The type of the objects of the tags without a peeled target */
+    tag_ids = malloc((list.n + 1) * sizeof(git_oid));
+    tag_sizes = malloc((list.n + 1) * sizeof(size_t));
+    tag_types = malloc((list.n + 1) * sizeof(git_otype));
+    if (!tag_ids || !tag_sizes || !tag_types) {
+        err = -1;
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+
+    for (i = 0; i < list.n; i++) {
+        git_reference *ref = list.refs[i];
+
+        if (GIT_REF_OID == git_reference_type(ref) &&
+            !git_reference_target_peel(ref) &&
+            !strncmp(git_reference_name(ref), "refs/tags/", 10))
+            git_oid_cpy(&tag_ids[n_tags++], git_reference_target(ref));
+    }
+
+    if (n_tags) {
+        err = git_repository_odb(&odb, repository);
+        if (err < 0)
+            goto cleanup;
+
+        err = git_odb_read_header_many(tag_sizes, tag_types, odb, tag_ids, n_tags);
+        if (err < 0)
+            goto cleanup;
+    }
+
+    PROTECT(result = allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(result, 0, allocVector(STRSXP, list.n));
+    SET_VECTOR_ELT(result, 1, allocVector(LGLSXP, list.n));
+    SET_VECTOR_ELT(result, 2, allocVector(STRSXP, list.n));
+    SET_VECTOR_ELT(result, 3, allocVector(STRSXP, list.n));
+    PROTECT(names = allocVector(STRSXP, 4));
+    SET_STRING_ELT(names, 0, mkChar("name"));
+    SET_STRING_ELT(names, 1, mkChar("symbolic"));
+    SET_STRING_ELT(names, 2, mkChar("target"));
+    SET_STRING_ELT(names, 3, mkChar("peeled"));
+    setAttrib(result, R_NamesSymbol, names);
+
+    for (i = 0, n_tags = 0; i < list.n; i++) {
+        char hex[GIT_OID_HEXSZ + 1];
+        git_reference *ref = list.refs[i];
+        const git_oid *peel;
+
+        SET_STRING_ELT(VECTOR_ELT(result, 0), i, mkChar(git_reference_name(ref)));
+        SET_STRING_ELT(VECTOR_ELT(result, 3), i, NA_STRING);
+
+        if (GIT_REF_SYMBOLIC == git_reference_type(ref)) {
+            LOGICAL(VECTOR_ELT(result, 1))[i] = 1;
+            SET_STRING_ELT(VECTOR_ELT(result, 2), i,
+                           mkChar(git_reference_symbolic_target(ref)));
+            continue;
+        }
+
+        LOGICAL(VECTOR_ELT(result, 1))[i] = 0;
+        git_oid_tostr(hex, sizeof(hex), git_reference_target(ref));
+        SET_STRING_ELT(VECTOR_ELT(result, 2), i, mkChar(hex));
+
+        peel = git_reference_target_peel(ref);
+        if (!peel && !strncmp(git_reference_name(ref), "refs/tags/", 10) &&
+            GIT_OBJ_TAG == tag_types[n_tags++]) {
+            err = git_reference_peel(&peeled, ref, GIT_OBJ_ANY);
+            if (err < 0) {
+                UNPROTECT(2);
+                result = R_NilValue;
+                goto cleanup;
+            }
+            peel = git_object_id(peeled);
+        }
+
+        if (peel) {
+            git_oid_tostr(hex, sizeof(hex), peel);
+            SET_STRING_ELT(VECTOR_ELT(result, 3), i, mkChar(hex));
+        }
+
+        git_object_free(peeled);
+        peeled = NULL;
+    }
+
+    columns_as_data_frame(result, list.n);
+    UNPROTECT(2);
+
+cleanup:
+    free_reference_list(&list);
+    free(tag_ids);
+    free(tag_sizes);
+    free(tag_types);
+
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Get all references that can be found in a repository.
+ *
+ * The references are read in one pass of a reference iterator.
+ *
+ * @param repo S4 class git_repository
+ * @param prefix R_NilValue for all references, or only the references
+ * whose name starts with prefix
+ * @return VECXSP with S4 objects of class git_reference
+ */
+SEXP references(const SEXP repo, const SEXP prefix)
+{
+    int err;
+    size_t i;
+    const char* err_msg = NULL;
+    char *glob;
+    git2r_reference_list list = {0};
+    SEXP result = R_NilValue, names;
+    git_repository *repository;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    glob = reference_prefix_glob(prefix);
+    err = load_references(&list, repository, glob);
+    free(glob);
+    if (GIT_EUSER == err) {
+        err_msg = err_alloc_memory_buffer;
+        goto cleanup;
+    }
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(result = allocVector(VECSXP, list.n));
+    PROTECT(names = allocVector(STRSXP, list.n));
+
+    for (i = 0; i < list.n; i++) {
+        SEXP reference;
+
+        PROTECT(reference = NEW_OBJECT(MAKE_CLASS("git_reference")));
+        init_reference(list.refs[i], reference);
+        SET_STRING_ELT(names, i, mkChar(git_reference_name(list.refs[i])));
+        SET_VECTOR_ELT(result, i, reference);
+        UNPROTECT(1);
+    }
+
+    setAttrib(result, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+cleanup:
+    free_reference_list(&list);
+
+    if (err < 0) {
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d/%d: %s\n", err, e->klass, e->message);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Get the configured remotes for a repo
+ *
+ * @param repo S4 class git_repository
+ * @return
+ */
+SEXP remotes(const SEXP repo)
+{
+    int i, err;
+    git_strarray rem_list;
+    SEXP list;
+    git_repository *repository;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    err = git_remote_list(&rem_list, repository);
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(list = allocVector(STRSXP, rem_list.count));
+    for (i = 0; i < rem_list.count; i++)
+        SET_STRING_ELT(list, i, mkChar(rem_list.strings[i]));
+    UNPROTECT(1);
+
+cleanup:
+    git_strarray_free(&rem_list);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    return list;
+}
+
+/**
+ * Get the remote's url
  *
- * @param ref
- * @param reference
- * @return void
+ * @param repo S4 class git_repository
+ * @return
  */
-static void init_reference(git_reference *ref, SEXP reference)
+SEXP remote_url(const SEXP repo, const SEXP remote)
 {
-    char out[41];
-    out[40] = '\0';
+    int err;
+    SEXP url;
+    size_t len = LENGTH(remote);
+    size_t i = 0;
+    git_repository *repository;
 
-    SET_SLOT(reference,
-             Rf_install("name"),
-             ScalarString(mkChar(git_reference_name(ref))));
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
-    SET_SLOT(reference,
-             Rf_install("shorthand"),
-             ScalarString(mkChar(git_reference_shorthand(ref))));
+    PROTECT(url = allocVector(STRSXP, len));
 
-    switch (git_reference_type(ref)) {
-    case GIT_REF_OID:
-        SET_SLOT(reference, Rf_install("type"), ScalarInteger(GIT_REF_OID));
-        git_oid_fmt(out, git_reference_target(ref));
-        SET_SLOT(reference, Rf_install("hex"), ScalarString(mkChar(out)));
-        break;
-    case GIT_REF_SYMBOLIC:
-        SET_SLOT(reference, Rf_install("type"), ScalarInteger(GIT_REF_SYMBOLIC));
-        SET_SLOT(reference,
-                 Rf_install("target"),
-                 ScalarString(mkChar(git_reference_symbolic_target(ref))));
-        break;
-    default:
-        error("Unexpected reference type");
+    for (; i < len; i++) {
+        git_remote *r;
+
+        err = git_remote_load(&r, repository, CHAR(STRING_ELT(remote, i)));
+        if (err < 0)
+            goto cleanup;
+
+        SET_STRING_ELT(url, i, mkChar(git_remote_url(r)));
+        git_remote_free(r);
+    }
+
+cleanup:
+    UNPROTECT(1);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
+
+    return url;
 }
 
 /**
- * Init slots in S4 class git_signature.
+ * Fetch from a remote and update the remote-tracking references
  *
- * @param sig
- * @param signature
- * @return void
+ * The remote-tracking references are updated in one transaction, so
+ * either all of them are updated or none of them.
+ * @param repo S4 class git_repository
+ * @param name The name of the remote
+ * @return R_NilValue
  */
-static void init_signature(const git_signature *sig, SEXP signature)
+SEXP fetch(const SEXP repo, const SEXP name)
 {
-    SEXP when;
+    int err;
+    git_remote *remote = NULL;
+    git_repository *repository;
 
-    SET_SLOT(signature,
-             Rf_install("name"),
-             ScalarString(mkChar(sig->name)));
+    if (R_NilValue == name
+        || !isString(name)
+        || 1 != length(name)
+        || NA_STRING == STRING_ELT(name, 0))
+        error("'name' must be a character vector of length one");
 
-    SET_SLOT(signature,
-             Rf_install("email"),
-             ScalarString(mkChar(sig->email)));
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
-    when = GET_SLOT(signature, Rf_install("when"));
+    err = git_remote_load(&remote, repository, CHAR(STRING_ELT(name, 0)));
+    if (err < 0)
+        goto cleanup;
 
-    SET_SLOT(when,
-             Rf_install("time"),
-             ScalarReal((double)sig->when.time));
+    err = git_remote_fetch(remote);
 
-    SET_SLOT(when,
-             Rf_install("offset"),
-             ScalarReal((double)sig->when.offset));
+cleanup:
+    if (remote)
+        git_remote_free(remote);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    return R_NilValue;
 }
 
 /**
- * Init slots in S4 class git_tag
+ * Lookup the objects of revisions
  *
- * @param source a tag
- * @param dest S4 class git_tag to initialize
- * @return void
+ * @param oids the oid of each revision
+ * @param repo the repository
+ * @param revs character vector with revisions
+ * @return 0 or an error code
  */
-static void init_tag(git_tag *source, SEXP dest)
+static int revparse_oids(git_oid *oids, git_repository *repo, SEXP revs)
 {
     int err;
-    const git_signature *tagger;
-    const git_oid *oid;
-    char target[GIT_OID_HEXSZ + 1];
+    size_t i;
+    git_object *obj;
 
-    SET_SLOT(dest,
-             Rf_install("message"),
-             ScalarString(mkChar(git_tag_message(source))));
+    for (i = 0; i < length(revs); i++) {
+        err = git_revparse_single(&obj, repo, CHAR(STRING_ELT(revs, i)));
+        if (err < 0)
+            return err;
+        git_oid_cpy(&oids[i], git_object_id(obj));
+        git_object_free(obj);
+    }
 
-    SET_SLOT(dest,
-             Rf_install("name"),
-             ScalarString(mkChar(git_tag_name(source))));
+    return 0;
+}
 
-    tagger = git_tag_tagger(source);
-    if (tagger) {
-        SEXP sexp_tagger;
+/**
+ * List revisions
+ *
+ * @param repo S4 class git_repository
+ * @return VECXSP with S4 objects of class git_commit
+ */
+SEXP revisions(SEXP repo)
+{
+    R_xlen_t i = 0, capacity = 64;
+    int err = 0;
+    SEXP list;
+    PROTECT_INDEX pi;
+    git_revwalk *walker = NULL;
+    git_repository *repository;
 
-        PROTECT(sexp_tagger = NEW_OBJECT(MAKE_CLASS("git_signature")));
-        init_signature(tagger, sexp_tagger);
-        SET_SLOT(dest, Rf_install("tagger"), sexp_tagger);
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    PROTECT_WITH_INDEX(list = allocVector(VECSXP, capacity), &pi);
+
+    if (git_repository_is_empty(repository)) {
+        /* No commits, create empty list */
+        goto cleanup;
+    }
+
+    err = git_revwalk_new(&walker, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_revwalk_push_head(walker);
+    if (err < 0)
+        goto cleanup;
+
+    /* Walk once and grow the list as needed */
+    for (;;) {
+        git_commit *commit;
+        SEXP sexp_commit;
+        git_oid oid;
+
+        err = git_revwalk_next(&oid, walker);
+        if (err < 0) {
+            if (GIT_ITEROVER == err)
+                err = 0;
+            goto cleanup;
+        }
+
+        err = git_commit_lookup(&commit, repository, &oid);
+        if (err < 0)
+            goto cleanup;
+
+        if (i == capacity) {
+            capacity *= 2;
+            REPROTECT(list = lengthgets(list, capacity), pi);
+        }
+
+        PROTECT(sexp_commit = NEW_OBJECT(MAKE_CLASS("git_commit")));
+        init_commit(commit, sexp_commit);
+        SET_VECTOR_ELT(list, i, sexp_commit);
+        UNPROTECT(1);
+        i++;
+
+        git_commit_free(commit);
+    }
+
+cleanup:
+    if (walker)
+        git_revwalk_free(walker);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
         UNPROTECT(1);
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    oid = git_tag_target_id(source);
-    git_oid_tostr(target, sizeof(target), oid);;
-    SET_SLOT(dest,
-             Rf_install("target"),
-             ScalarString(mkChar(target)));
+    if (i != capacity)
+        REPROTECT(list = lengthgets(list, i), pi);
+
+    UNPROTECT(1);
+
+    return list;
+}
+
+/**
+ * List revisions as a data.frame
+ *
+ * The history is walked once and the columns are filled in the same
+ * pass, see walk_commit_columns.
+ *
+ * @param repo S4 class git_repository
+ * @return data.frame with one row per commit
+ */
+SEXP revisions_data_frame(SEXP repo)
+{
+    int err = 0;
+    R_xlen_t n = 0;
+    SEXP columns;
+    git_revwalk *walker = NULL;
+    git_repository *repository;
+
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
+
+    PROTECT(columns = new_commit_columns(64));
+
+    if (git_repository_is_empty(repository))
+        goto cleanup;
+
+    err = git_revwalk_new(&walker, repository);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_revwalk_push_head(walker);
+    if (err < 0)
+        goto cleanup;
+
+    err = walk_commit_columns(columns, &n, walker, repository, -1);
+
+cleanup:
+    if (walker)
+        git_revwalk_free(walker);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        UNPROTECT(1);
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    commit_columns_as_data_frame(columns, n);
+    UNPROTECT(1);
+
+    return columns;
 }
 
 /**
- * Check if repository is bare.
+ * Commit iterator
+ *
+ * The iterator opens its own repository, since a repository in the
+ * repository cache can be freed while the iterator is in use.
+ */
+typedef struct {
+    git_repository *repository;
+    git_revwalk *walker;
+    int done;
+} git2r_revwalk;
+
+/**
+ * Free a commit iterator
  *
- * @param repo S4 class git_repository
- * @return
+ * @param revwalk
+ * @return void
  */
-SEXP is_bare(const SEXP repo)
+static void revwalk_free(git2r_revwalk *revwalk)
 {
-    SEXP result;
-    git_repository *repository;
-
-    repository= get_repository(repo);
-    if (!repository)
-        error(err_invalid_repository);
-
-    if (git_repository_is_bare(repository))
-        result = ScalarLogical(TRUE);
-    else
-        result = ScalarLogical(FALSE);
+    if (revwalk->walker)
+        git_revwalk_free(revwalk->walker);
+    if (revwalk->repository)
+        git_repository_free(revwalk->repository);
+    free(revwalk);
+}
 
-    git_repository_free(repository);
+/**
+ * Finalizer for the external pointer to a commit iterator
+ *
+ * @param ptr external pointer to a git2r_revwalk
+ * @return void
+ */
+static void revwalk_finalize(SEXP ptr)
+{
+    git2r_revwalk *revwalk = (git2r_revwalk*)R_ExternalPtrAddr(ptr);
 
-    return result;
+    if (revwalk) {
+        revwalk_free(revwalk);
+        R_ClearExternalPtr(ptr);
+    }
 }
 
 /**
- * Check if repository is empty.
+ * Create a commit iterator
  *
  * @param repo S4 class git_repository
- * @return
+ * @param sorting combination of GIT_SORT_XXX flags
+ * @param first_parent follow only the first parent of merges
+ * @param push revisions to start the walk from
+ * @param hide revisions (and their ancestors) to hide from the walk
+ * @param range ranges on the form 'a..b' to push
+ * @return external pointer to the iterator
  */
-SEXP is_empty(const SEXP repo)
+SEXP revwalk_new(const SEXP repo,
+                 const SEXP sorting,
+                 const SEXP first_parent,
+                 const SEXP push,
+                 const SEXP hide,
+                 const SEXP range)
 {
-    SEXP result;
-    git_repository *repository;
-
-    repository= get_repository(repo);
-    if (!repository)
+    int err;
+    size_t i;
+    SEXP ptr;
+    const char *path;
+    git_object *obj = NULL;
+    git2r_revwalk *revwalk = NULL;
+
+    if (R_NilValue == sorting
+        || R_NilValue == first_parent
+        || !isInteger(sorting)
+        || !isLogical(first_parent)
+        || 1 != length(sorting)
+        || 1 != length(first_parent)
+        || !isString(push)
+        || !isString(hide)
+        || !isString(range))
+        error("Invalid arguments to revwalk");
+
+    path = get_repository_path(repo);
+    if (!path)
         error(err_invalid_repository);
 
-    if (git_repository_is_empty(repository))
-        result = ScalarLogical(TRUE);
-    else
-        result = ScalarLogical(FALSE);
+    revwalk = calloc(1, sizeof(git2r_revwalk));
+    if (NULL == revwalk)
+        error(err_alloc_memory_buffer);
 
-    git_repository_free(repository);
+    err = git_repository_open(&revwalk->repository, path);
+    if (err < 0)
+        goto cleanup;
 
-    return result;
+    err = git_revwalk_new(&revwalk->walker, revwalk->repository);
+    if (err < 0)
+        goto cleanup;
+
+    git_revwalk_sorting(revwalk->walker, INTEGER(sorting)[0]);
+    if (LOGICAL(first_parent)[0])
+        git_revwalk_simplify_first_parent(revwalk->walker);
+
+    for (i = 0; i < LENGTH(push); i++) {
+        err = git_revparse_single(&obj, revwalk->repository, CHAR(STRING_ELT(push, i)));
+        if (err < 0)
+            goto cleanup;
+        err = git_revwalk_push(revwalk->walker, git_object_id(obj));
+        git_object_free(obj);
+        obj = NULL;
+        if (err < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < LENGTH(hide); i++) {
+        err = git_revparse_single(&obj, revwalk->repository, CHAR(STRING_ELT(hide, i)));
+        if (err < 0)
+            goto cleanup;
+        err = git_revwalk_hide(revwalk->walker, git_object_id(obj));
+        git_object_free(obj);
+        obj = NULL;
+        if (err < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < LENGTH(range); i++) {
+        err = git_revwalk_push_range(revwalk->walker, CHAR(STRING_ELT(range, i)));
+        if (err < 0)
+            goto cleanup;
+    }
+
+cleanup:
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        revwalk_free(revwalk);
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    PROTECT(ptr = R_MakeExternalPtr(revwalk, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, revwalk_finalize, TRUE);
+    UNPROTECT(1);
+
+    return ptr;
 }
 
 /**
- * Check if valid repository.
+ * Get the next chunk of commits from a commit iterator
  *
- * @param path
- * @return
+ * @param ptr external pointer to the iterator
+ * @param n maximum number of commits in the chunk
+ * @return data.frame with at most n commits. A data.frame without
+ * rows is returned when the walk is done.
  */
-SEXP is_repository(const SEXP path)
+SEXP revwalk_next_chunk(const SEXP ptr, const SEXP n)
 {
-    SEXP result;
-    git_repository *repository;
-    int err;
-
-    if (R_NilValue == path)
-        error("'path' equals R_NilValue");
-    if (!isString(path))
-        error("'path' must be a string");
+    int err = 0;
+    R_xlen_t nrow = 0, max;
+    SEXP columns;
+    git2r_revwalk *revwalk;
+
+    if (R_NilValue == n
+        || !isInteger(n)
+        || 1 != length(n)
+        || INTEGER(n)[0] < 0)
+        error("Invalid arguments to next_chunk");
+
+    if (EXTPTRSXP != TYPEOF(ptr))
+        error("Invalid commit iterator");
+    revwalk = (git2r_revwalk*)R_ExternalPtrAddr(ptr);
+    if (!revwalk)
+        error("Invalid commit iterator");
+
+    max = INTEGER(n)[0];
+    PROTECT(columns = new_commit_columns(max < 1024 ? max : 1024));
+
+    if (!revwalk->done) {
+        err = walk_commit_columns(columns,
+                                  &nrow,
+                                  revwalk->walker,
+                                  revwalk->repository,
+                                  max);
+        if (GIT_ITEROVER == err) {
+            revwalk->done = 1;
+            err = 0;
+        }
+    }
 
-    err = git_repository_open(&repository, CHAR(STRING_ELT(path, 0)));
     if (err < 0) {
-        result = ScalarLogical(FALSE);
-    } else {
-        git_repository_free(repository);
-        result = ScalarLogical(TRUE);
+        const git_error *e = giterr_last();
+        UNPROTECT(1);
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    return result;
+    commit_columns_as_data_frame(columns, nrow);
+    UNPROTECT(1);
+
+    return columns;
 }
 
 /**
- * Add ignored files
+ * Get a number of threads from an option.
  *
- * @param list
- * @param list_index
- * @param status_list
- * @return void
+ * @param name The name of the option
+ * @param default_value The value when the option is not set
+ * @return The number of threads
  */
-static void list_ignored_files(SEXP list,
-                               size_t list_index,
-                               git_status_list *status_list)
+static unsigned int threads_option(const char *name, int default_value)
 {
-    size_t i = 0, j = 0, count;
-    SEXP sub_list, sub_list_names, item;
-
-    /* Create list with the correct number of entries */
-    count = count_ignored_files(status_list);
-    PROTECT(sub_list = allocVector(VECSXP, count));
-    PROTECT(sub_list_names = allocVector(STRSXP, count));
-
-    /* i index the entrycount. j index the added change in list */
-    count = git_status_list_entrycount(status_list);
-    for (; i < count; i++) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    int n = default_value;
+    SEXP threads = GetOption1(install(name));
 
-        if (s->status == GIT_STATUS_IGNORED) {
-            SET_STRING_ELT(sub_list_names, j, mkChar("ignored"));
-            PROTECT(item = allocVector(STRSXP, 1));
-            SET_STRING_ELT(item, 0, mkChar(s->index_to_workdir->old_file.path));
-            SET_VECTOR_ELT(sub_list, j, item);
-            UNPROTECT(1);
-            j++;
-        }
+    if (!isNull(threads)) {
+        n = asInteger(threads);
+        if (NA_INTEGER == n || n < 0)
+            error("Invalid option '%s'", name);
     }
 
-    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
-    SET_VECTOR_ELT(list, list_index, sub_list);
-    UNPROTECT(2);
+    return (unsigned int)n;
 }
 
 /**
- * Add changes in index
+ * Set the number of threads used to search for deltas when building a
+ * pack from the option 'git2r.pack.threads', and the number of threads
+ * used to resolve deltas when indexing a pack from the option
+ * 'git2r.index.threads'. 0 uses one thread per online CPU, which is
+ * the default of both.
  *
- * @param list
- * @param list_index
- * @param status_list
  * @return void
  */
-static void list_staged_changes(SEXP list,
-                              size_t list_index,
-                              git_status_list *status_list)
+static void set_pack_threads(void)
 {
-    size_t i = 0, j = 0, count;
-    SEXP sub_list, sub_list_names, item;
+    git_libgit2_opts(GIT_OPT_SET_PACK_THREADS,
+                     threads_option("git2r.pack.threads", 0));
+    git_libgit2_opts(GIT_OPT_SET_INDEXER_THREADS,
+                     threads_option("git2r.index.threads", 0));
+}
 
-    /* Create list with the correct number of entries */
-    count = count_staged_changes(status_list);
-    PROTECT(sub_list = allocVector(VECSXP, count));
-    PROTECT(sub_list_names = allocVector(STRSXP, count));
+/**
+ * Init the options to get the status of a repository.
+ *
+ * @param opts The options to init
+ * @param untracked include untracked files
+ * @param ignored include ignored files
+ * @return void
+ */
+static void init_status_options(git_status_options *opts,
+                                int untracked,
+                                int ignored)
+{
+    opts->show  = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    opts->flags = GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX |
+        GIT_STATUS_OPT_SORT_CASE_SENSITIVELY;
 
-    /* i index the entrycount. j index the added change in list */
-    count = git_status_list_entrycount(status_list);
-    for (; i < count; i++) {
-        char *istatus = NULL;
-        const char *old_path, *new_path;
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    if (untracked)
+        opts->flags |= GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+    if (ignored)
+        opts->flags |= GIT_STATUS_OPT_INCLUDE_IGNORED;
+}
 
-        if (s->status == GIT_STATUS_CURRENT)
-            continue;
+/**
+ * Create a named list with the sections of a status list.
+ *
+ * @param status_list The status list
+ * @param staged include staged files
+ * @param unstaged include unstaged files
+ * @param untracked include untracked files
+ * @param ignored include ignored files
+ * @return VECSXP with status, not protected
+ */
+static SEXP status_list_sections(git_status_list *status_list,
+                                 int staged,
+                                 int unstaged,
+                                 int untracked,
+                                 int ignored)
+{
+    size_t i = 0;
+    SEXP list, list_names;
 
-        if (s->status & GIT_STATUS_INDEX_NEW)
-            istatus = "new";
-        else if (s->status & GIT_STATUS_INDEX_MODIFIED)
-            istatus = "modified";
-        else if (s->status & GIT_STATUS_INDEX_DELETED)
-            istatus = "deleted";
-        else if (s->status & GIT_STATUS_INDEX_RENAMED)
-            istatus = "renamed";
-        else if (s->status & GIT_STATUS_INDEX_TYPECHANGE)
-            istatus = "typechange";
+    PROTECT(list = allocVector(VECSXP, staged + unstaged + untracked + ignored));
+    PROTECT(list_names = allocVector(STRSXP, staged + unstaged + untracked + ignored));
 
-        if (!istatus)
-            continue;
-        SET_STRING_ELT(sub_list_names, j, mkChar(istatus));
+    if (staged) {
+        SET_STRING_ELT(list_names, i, mkChar("staged"));
+        list_staged_changes(list, i, status_list);
+        i++;
+    }
 
-        old_path = s->head_to_index->old_file.path;
-        new_path = s->head_to_index->new_file.path;
+    if (unstaged) {
+        SET_STRING_ELT(list_names, i, mkChar("unstaged"));
+        list_unstaged_changes(list, i, status_list);
+        i++;
+    }
 
-        if (old_path && new_path && strcmp(old_path, new_path)) {
-            PROTECT(item = allocVector(STRSXP, 2));
-            SET_STRING_ELT(item, 0, mkChar(old_path));
-            SET_STRING_ELT(item, 1, mkChar(new_path));
-        } else {
-            PROTECT(item = allocVector(STRSXP, 1));
-            SET_STRING_ELT(item, 0, mkChar(old_path ? old_path : new_path));
-        }
+    if (untracked) {
+        SET_STRING_ELT(list_names, i, mkChar("untracked"));
+        list_untracked_files(list, i, status_list);
+        i++;
+    }
 
-        SET_VECTOR_ELT(sub_list, j, item);
-        UNPROTECT(1);
-        j++;
+    if (ignored) {
+        SET_STRING_ELT(list_names, i, mkChar("ignored"));
+        list_ignored_files(list, i, status_list);
     }
 
-    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
-    SET_VECTOR_ELT(list, list_index, sub_list);
+    setAttrib(list, R_NamesSymbol, list_names);
     UNPROTECT(2);
+
+    return list;
 }
 
 /**
- * Add changes in workdir relative to index
+ * Get state of the repository working directory and the staging area.
  *
- * @param list
- * @param list_index
- * @param status_list
- * @return void
+ * @param repo S4 class git_repository
+ * @return VECXSP with status
  */
-static void list_unstaged_changes(SEXP list,
-                                size_t list_index,
-                                git_status_list *status_list)
+SEXP status(const SEXP repo,
+            const SEXP staged,
+            const SEXP unstaged,
+            const SEXP untracked,
+            const SEXP ignored)
 {
-    size_t i = 0, j = 0, count;
-    SEXP sub_list, sub_list_names, item;
-
-    /* Create list with the correct number of entries */
-    count = count_unstaged_changes(status_list);
-    PROTECT(sub_list = allocVector(VECSXP, count));
-    PROTECT(sub_list_names = allocVector(STRSXP, count));
+    int err;
+    SEXP list = R_NilValue;
+    git_repository *repository;
+    git_status_list *status_list = NULL;
+    git_status_options opts = GIT_STATUS_OPTIONS_INIT;
 
-    /* i index the entrycount. j index the added change in list */
-    count = git_status_list_entrycount(status_list);
-    for (; i < count; i++) {
-        char *wstatus = NULL;
-        const char *old_path, *new_path;
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    /* Check arguments to status */
+    if (R_NilValue == staged
+        || R_NilValue == unstaged
+        || R_NilValue == untracked
+        || R_NilValue == ignored
+        || !isLogical(staged)
+        || !isLogical(unstaged)
+        || !isLogical(untracked)
+        || !isLogical(ignored)
+        || 1 != length(staged)
+        || 1 != length(unstaged)
+        || 1 != length(untracked)
+        || 1 != length(ignored))
+        error("Invalid arguments to status");
 
-        if (s->status == GIT_STATUS_CURRENT || s->index_to_workdir == NULL)
-            continue;
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
-        if (s->status & GIT_STATUS_WT_MODIFIED)
-            wstatus = "modified";
-        else if (s->status & GIT_STATUS_WT_DELETED)
-            wstatus = "deleted";
-        else if (s->status & GIT_STATUS_WT_RENAMED)
-            wstatus = "renamed";
-        else if (s->status & GIT_STATUS_WT_TYPECHANGE)
-            wstatus = "typechange";
+    git_libgit2_opts(GIT_OPT_SET_INDEX_PRELOAD_THREADS,
+                     threads_option("git2r.preload.threads", 0));
 
-        if (!wstatus)
-            continue;
-        SET_STRING_ELT(sub_list_names, j, mkChar(wstatus));
+    init_status_options(&opts, LOGICAL(untracked)[0], LOGICAL(ignored)[0]);
+    err = git_status_list_new(&status_list, repository, &opts);
+    if (err < 0)
+        goto cleanup;
 
-        old_path = s->index_to_workdir->old_file.path;
-        new_path = s->index_to_workdir->new_file.path;
+    list = status_list_sections(status_list,
+                                LOGICAL(staged)[0],
+                                LOGICAL(unstaged)[0],
+                                LOGICAL(untracked)[0],
+                                LOGICAL(ignored)[0]);
 
-        if (old_path && new_path && strcmp(old_path, new_path)) {
-            PROTECT(item = allocVector(STRSXP, 2));
-            SET_STRING_ELT(item, 0, mkChar(old_path));
-            SET_STRING_ELT(item, 1, mkChar(new_path));
-        } else {
-            PROTECT(item = allocVector(STRSXP, 1));
-            SET_STRING_ELT(item, 0, mkChar(old_path ? old_path : new_path));
-        }
+cleanup:
+    if (status_list)
+        git_status_list_free(status_list);
 
-        SET_VECTOR_ELT(sub_list, j, item);
-        UNPROTECT(1);
-        j++;
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
-    SET_VECTOR_ELT(list, list_index, sub_list);
-    UNPROTECT(2);
+    return list;
 }
 
 /**
- * Add untracked files
+ * A repository to get the status of on a worker thread
+ */
+typedef struct {
+    const char *path;
+    git_status_options opts;
+    git_repository *repository;
+    git_status_list *status_list;
+    int err;
+    int klass;
+    char *message;
+} git2r_status_job;
+
+/**
+ * Open a repository and get its status. Runs on a worker thread, so
+ * it must not use the R API or the cache of opened repositories.
  *
- * @param list
- * @param list_index
- * @param status_list
+ * @param job Index of the job
+ * @param payload The git2r_status_job array
  * @return void
  */
-static void list_untracked_files(SEXP list,
-                                 size_t list_index,
-                                 git_status_list *status_list)
+static void status_job(size_t job, void *payload)
 {
-    size_t i = 0, j = 0, count;
-    SEXP sub_list, sub_list_names, item;
+    git2r_status_job *j = (git2r_status_job*)payload + job;
 
-    /* Create list with the correct number of entries */
-    count = count_untracked_files(status_list);
-    PROTECT(sub_list = allocVector(VECSXP, count));
-    PROTECT(sub_list_names = allocVector(STRSXP, count));
+    j->err = git_repository_open(&j->repository, j->path);
+    if (!j->err)
+        j->err = git_status_list_new(&j->status_list, j->repository, &j->opts);
 
-    /* i index the entrycount. j index the added change in list */
-    count = git_status_list_entrycount(status_list);
-    for (; i < count; i++) {
-        const git_status_entry *s = git_status_byindex(status_list, i);
+    /* The error is thread-local, copy it for the R main thread */
+    if (j->err < 0) {
+        const git_error *e = giterr_last();
+        const char *message = e ? e->message : "Unknown error";
 
-        if (s->status == GIT_STATUS_WT_NEW) {
-            SET_STRING_ELT(sub_list_names, j, mkChar("untracked"));
-            PROTECT(item = allocVector(STRSXP, 1));
-            SET_STRING_ELT(item, 0, mkChar(s->index_to_workdir->old_file.path));
-            SET_VECTOR_ELT(sub_list, j, item);
-            UNPROTECT(1);
-            j++;
-        }
+        j->klass = e ? e->klass : 0;
+        j->message = malloc(strlen(message) + 1);
+        if (j->message)
+            strcpy(j->message, message);
     }
-
-    setAttrib(sub_list, R_NamesSymbol, sub_list_names);
-    SET_VECTOR_ELT(list, list_index, sub_list);
-    UNPROTECT(2);
 }
 
 /**
- * Count number of branches.
+ * Get the status of many repositories on native worker threads.
  *
- * @param repo S4 class git_repository
- * @param flags
- * @return
+ * Each repository is opened on a worker thread and is not kept in
+ * the cache of opened repositories.
+ *
+ * @param repos list of S4 class git_repository
+ * @param staged include staged files
+ * @param unstaged include unstaged files
+ * @param untracked include untracked files
+ * @param ignored include ignored files
+ * @param threads number of threads, 0 for one per online CPU
+ * @return VECSXP with the status of each repository
  */
-static int number_of_branches(git_repository *repo, int flags, size_t *n)
+SEXP statuses(const SEXP repos,
+              const SEXP staged,
+              const SEXP unstaged,
+              const SEXP untracked,
+              const SEXP ignored,
+              const SEXP threads)
 {
-    int err;
-    git_branch_iterator *iter;
-    git_branch_t type;
-    git_reference *ref;
+    size_t i, n;
+    SEXP list;
+    git2r_status_job *jobs;
+    char err_msg[1024];
+
+    /* Check arguments to statuses */
+    if (R_NilValue == repos
+        || R_NilValue == staged
+        || R_NilValue == unstaged
+        || R_NilValue == untracked
+        || R_NilValue == ignored
+        || R_NilValue == threads
+        || !isNewList(repos)
+        || !isLogical(staged)
+        || !isLogical(unstaged)
+        || !isLogical(untracked)
+        || !isLogical(ignored)
+        || !isInteger(threads)
+        || 1 != length(staged)
+        || 1 != length(unstaged)
+        || 1 != length(untracked)
+        || 1 != length(ignored)
+        || 1 != length(threads)
+        || NA_INTEGER == INTEGER(threads)[0]
+        || INTEGER(threads)[0] < 0)
+        error("Invalid arguments to statuses");
+
+    n = length(repos);
+    for (i = 0; i < n; i++) {
+        if (!get_repository_path(VECTOR_ELT(repos, i)))
+            error(err_invalid_repository);
+    }
 
-    *n = 0;
+    git_libgit2_opts(GIT_OPT_SET_INDEX_PRELOAD_THREADS,
+                     threads_option("git2r.preload.threads", 0));
 
-    err = git_branch_iterator_new(&iter, repo, flags);
-    if (err < 0)
-        return err;
+    jobs = calloc(n ? n : 1, sizeof(git2r_status_job));
+    if (!jobs)
+        error(err_alloc_memory_buffer);
 
-    for (;;) {
-        err = git_branch_next(&ref, &type, iter);
-        if (err < 0)
-            break;
-        git_reference_free(ref);
-        (*n)++;
+    for (i = 0; i < n; i++) {
+        git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+
+        jobs[i].opts = opts;
+        init_status_options(&jobs[i].opts,
+                            LOGICAL(untracked)[0],
+                            LOGICAL(ignored)[0]);
+        jobs[i].path = get_repository_path(VECTOR_ELT(repos, i));
     }
 
-    git_branch_iterator_free(iter);
+    git2r_parallel_for(n, INTEGER(threads)[0], status_job, jobs);
 
-    if (GIT_ITEROVER != err)
-        return err;
-    return 0;
-}
+    err_msg[0] = '\0';
+    PROTECT(list = allocVector(VECSXP, n));
+    for (i = 0; i < n; i++) {
+        if (jobs[i].err < 0) {
+            if (!err_msg[0]) {
+                snprintf(err_msg, sizeof(err_msg), "Error %d/%d in '%s': %s\n",
+                         jobs[i].err, jobs[i].klass, jobs[i].path,
+                         jobs[i].message ? jobs[i].message : "Unknown error");
+            }
+        } else if (!err_msg[0]) {
+            SET_VECTOR_ELT(list, i, status_list_sections(
+                               jobs[i].status_list,
+                               LOGICAL(staged)[0],
+                               LOGICAL(unstaged)[0],
+                               LOGICAL(untracked)[0],
+                               LOGICAL(ignored)[0]));
+        }
+    }
 
-/**
- * Count number of revisions.
- *
- * @param walker
- * @return
- */
-static size_t number_of_revisions(git_revwalk *walker)
-{
-    size_t n = 0;
-    git_oid oid;
+    for (i = 0; i < n; i++) {
+        if (jobs[i].status_list)
+            git_status_list_free(jobs[i].status_list);
+        if (jobs[i].repository)
+            git_repository_free(jobs[i].repository);
+        free(jobs[i].message);
+    }
+    free(jobs);
 
-    while (!git_revwalk_next(&oid, walker))
-        n++;
-    return n;
+    UNPROTECT(1);
+
+    if (err_msg[0])
+        error("%s", err_msg);
+
+    return list;
 }
 
 /**
- * Get all references that can be found in a repository.
+ * Create a tag of the commit at HEAD
  *
  * @param repo S4 class git_repository
- * @return VECXSP with S4 objects of class git_reference
+ * @param name The name of the tag
+ * @param message The message of an annotated tag, or R_NilValue to
+ * create a lightweight tag
+ * @param tagger S4 class git_signature with the tagger of an annotated
+ * tag
+ * @return S4 class git_tag with the annotated tag, or R_NilValue for a
+ * lightweight tag
  */
-SEXP references(const SEXP repo)
+SEXP tag_create(SEXP repo, SEXP name, SEXP message, SEXP tagger)
 {
-    int i, err;
-    git_strarray ref_list;
-    SEXP list = R_NilValue;
-    SEXP names = R_NilValue;
-    git_reference *ref;
-    git_repository *repository;
+    SEXP when, sexp_tag = R_NilValue;
+    int err;
+    git_oid oid;
+    git_signature *sig_tagger = NULL;
+    git_object *target = NULL;
+    git_tag *new_tag = NULL;
+    git_repository *repository = NULL;
+
+    if (R_NilValue == name
+        || !isString(name)
+        || 1 != length(name)
+        || NA_STRING == STRING_ELT(name, 0)
+        || (R_NilValue != message
+            && (!isString(message)
+                || 1 != length(message)
+                || NA_STRING == STRING_ELT(message, 0)))
+        || R_NilValue == tagger
+        || S4SXP != TYPEOF(tagger))
+        error("Invalid arguments to tag");
+
+    if (0 != strcmp(CHAR(STRING_ELT(getAttrib(tagger, R_ClassSymbol), 0)),
+                    "git_signature"))
+        error("tagger argument not a git_signature");
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    err = git_reference_list(&ref_list, repository);
+    err = git_reference_name_to_id(&oid, repository, "HEAD");
     if (err < 0)
         goto cleanup;
 
-    PROTECT(list = allocVector(VECSXP, ref_list.count));
-    PROTECT(names = allocVector(STRSXP, ref_list.count));
+    err = git_object_lookup(&target, repository, &oid, GIT_OBJ_COMMIT);
+    if (err < 0)
+        goto cleanup;
 
-    for (i = 0; i < ref_list.count; i++) {
-        SEXP reference;
+    if (R_NilValue == message) {
+        err = git_tag_create_lightweight(&oid, repository,
+                                         CHAR(STRING_ELT(name, 0)),
+                                         target, 0);
+        goto cleanup;
+    }
 
-        err = git_reference_lookup(&ref, repository, ref_list.strings[i]);
-        if (err < 0)
-            goto cleanup;
+    when = GET_SLOT(tagger, Rf_install("when"));
+    err = git_signature_new(&sig_tagger,
+                            CHAR(STRING_ELT(GET_SLOT(tagger, Rf_install("name")), 0)),
+                            CHAR(STRING_ELT(GET_SLOT(tagger, Rf_install("email")), 0)),
+                            REAL(GET_SLOT(when, Rf_install("time")))[0],
+                            REAL(GET_SLOT(when, Rf_install("offset")))[0]);
+    if (err < 0)
+        goto cleanup;
 
-        PROTECT(reference = NEW_OBJECT(MAKE_CLASS("git_reference")));
-        init_reference(ref, reference);
-        SET_STRING_ELT(names, i, mkChar(ref_list.strings[i]));
-        SET_VECTOR_ELT(list, i, reference);
-        UNPROTECT(1);
-    }
+    err = git_tag_create(&oid, repository, CHAR(STRING_ELT(name, 0)), target,
+                         sig_tagger, CHAR(STRING_ELT(message, 0)), 0);
+    if (err < 0)
+        goto cleanup;
+
+    err = git_tag_lookup(&new_tag, repository, &oid);
+    if (err < 0)
+        goto cleanup;
+
+    PROTECT(sexp_tag = NEW_OBJECT(MAKE_CLASS("git_tag")));
+    init_tag(new_tag, sexp_tag);
+    UNPROTECT(1);
 
 cleanup:
-    git_strarray_free(&ref_list);
+    if (sig_tagger)
+        git_signature_free(sig_tagger);
 
-    if (repository)
-        git_repository_free(repository);
+    if (target)
+        git_object_free(target);
 
-    if (R_NilValue != list && R_NilValue != names) {
-        setAttrib(list, R_NamesSymbol, names);
-        UNPROTECT(2);
-    }
+    if (new_tag)
+        git_tag_free(new_tag);
 
     if (err < 0) {
         const git_error *e = giterr_last();
         error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    return list;
+    return sexp_tag;
 }
 
 /**
- * Get the configured remotes for a repo
+ * Load the targets of the tags of a repository
  *
- * @param repo S4 class git_repository
- * @return
+ * A symbolic tag is resolved to the reference it points to. The
+ * peeled target stored with a tag in the packed-refs file or the
+ * reference tables is used to tell that a tag is annotated without
+ * reading the tag object. The type of the target of the other tags
+ * is read from the object headers in one batch.
+ *
+ * @param targets array of list->n ids to fill with the targets
+ * @param peeled array of list->n ids to fill with the stored peeled
+ * targets, or zero when the reference has none
+ * @param types array of list->n types to fill with the type of the
+ * targets
+ * @param list the tag references
+ * @param repo the repository
+ * @return 0 on success, GIT_EUSER if memory could not be allocated,
+ * else error code
  */
-SEXP remotes(const SEXP repo)
+static int load_tag_targets(git_oid *targets,
+                            git_oid *peeled,
+                            git_otype *types,
+                            const git2r_reference_list *list,
+                            git_repository *repo)
 {
-    int i, err;
-    git_strarray rem_list;
-    SEXP list;
-    git_repository *repository;
+    int err = 0;
+    size_t i, n = 0;
+    size_t *pos = NULL, *sizes = NULL;
+    git_oid *ids = NULL;
+    git_otype *id_types = NULL;
+    git_odb *odb = NULL;
+
+    pos = malloc((list->n + 1) * sizeof(size_t));
+    sizes = malloc((list->n + 1) * sizeof(size_t));
+    ids = malloc((list->n + 1) * sizeof(git_oid));
+    id_types = malloc((list->n + 1) * sizeof(git_otype));
+    if (!pos || !sizes || !ids || !id_types) {
+        err = GIT_EUSER;
+        goto cleanup;
+    }
 
-    repository = get_repository(repo);
-    if (!repository)
-        error(err_invalid_repository);
+    for (i = 0; i < list->n; i++) {
+        git_reference *ref = list->refs[i], *resolved = NULL;
 
-    err = git_remote_list(&rem_list, repository);
-    if (err < 0)
-        goto cleanup;
+        if (GIT_REF_SYMBOLIC == git_reference_type(ref)) {
+            err = git_reference_resolve(&resolved, ref);
+            if (err < 0)
+                goto cleanup;
+            ref = resolved;
+        }
 
-    PROTECT(list = allocVector(STRSXP, rem_list.count));
-    for (i = 0; i < rem_list.count; i++)
-        SET_STRING_ELT(list, i, mkChar(rem_list.strings[i]));
-    UNPROTECT(1);
+        git_oid_cpy(&targets[i], git_reference_target(ref));
+        if (git_reference_target_peel(ref)) {
+            git_oid_cpy(&peeled[i], git_reference_target_peel(ref));
+            types[i] = GIT_OBJ_TAG;
+        } else {
+            memset(&peeled[i], 0, sizeof(git_oid));
+            git_oid_cpy(&ids[n], &targets[i]);
+            pos[n++] = i;
+        }
 
-cleanup:
-    git_strarray_free(&rem_list);
+        git_reference_free(resolved);
+    }
 
-    if (repository)
-        git_repository_free(repository);
+    if (n) {
+        err = git_repository_odb(&odb, repo);
+        if (err < 0)
+            goto cleanup;
 
-    if (err < 0) {
-        const git_error *e = giterr_last();
-        error("Error %d/%d: %s\n", err, e->klass, e->message);
+        err = git_odb_read_header_many(sizes, id_types, odb, ids, n);
+        if (err < 0)
+            goto cleanup;
+
+        for (i = 0; i < n; i++)
+            types[pos[i]] = id_types[i];
     }
 
-    return list;
+cleanup:
+    free(pos);
+    free(sizes);
+    free(ids);
+    free(id_types);
+
+    if (odb)
+        git_odb_free(odb);
+
+    return err;
 }
 
 /**
- * Get the remote's url
+ * Get all tags that can be found in a repository.
+ *
+ * Only the annotated tags are listed, a lightweight tag has no tag
+ * object.
  *
  * @param repo S4 class git_repository
- * @return
+ * @return VECXSP with S4 objects of class git_tag
  */
-SEXP remote_url(const SEXP repo, const SEXP remote)
+SEXP tags(const SEXP repo)
 {
     int err;
-    SEXP url;
-    size_t len = LENGTH(remote);
-    size_t i = 0;
+    const char* err_msg = NULL;
+    SEXP list = R_NilValue;
+    size_t protected = 0;
     git_repository *repository;
+    git_tag *tag = NULL;
+    git2r_reference_list tag_list = {0};
+    git_oid *targets = NULL, *peeled = NULL;
+    git_otype *types = NULL;
+    size_t i, j, n = 0;
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    PROTECT(url = allocVector(STRSXP, len));
+    err = load_references(&tag_list, repository, "refs/tags/*");
+    if (err < 0)
+        goto cleanup;
 
-    for (; i < len; i++) {
-        git_remote *r;
+    targets = malloc((tag_list.n + 1) * sizeof(git_oid));
+    peeled = malloc((tag_list.n + 1) * sizeof(git_oid));
+    types = malloc((tag_list.n + 1) * sizeof(git_otype));
+    if (!targets || !peeled || !types) {
+        err = GIT_EUSER;
+        goto cleanup;
+    }
 
-        err = git_remote_load(&r, repository, CHAR(STRING_ELT(remote, i)));
+    err = load_tag_targets(targets, peeled, types, &tag_list, repository);
+    if (err < 0)
+        goto cleanup;
+
+    for (i = 0; i < tag_list.n; i++) {
+        if (GIT_OBJ_TAG == types[i])
+            n++;
+    }
+
+    PROTECT(list = allocVector(VECSXP, n));
+    protected++;
+
+    for (i = 0, j = 0; i < tag_list.n; i++) {
+        SEXP sexp_tag;
+
+        if (GIT_OBJ_TAG != types[i])
+            continue;
+
+        err = git_tag_lookup(&tag, repository, &targets[i]);
         if (err < 0)
             goto cleanup;
 
-        SET_STRING_ELT(url, i, mkChar(git_remote_url(r)));
-        git_remote_free(r);
+        PROTECT(sexp_tag = NEW_OBJECT(MAKE_CLASS("git_tag")));
+        protected++;
+        init_tag(tag, sexp_tag);
+
+        SET_VECTOR_ELT(list, j++, sexp_tag);
+        UNPROTECT(1);
+        protected--;
+
+        git_tag_free(tag);
+        tag = NULL;
     }
 
-cleanup:
-    git_repository_free(repository);
+cleanup:
+    free_reference_list(&tag_list);
+    free(targets);
+    free(peeled);
+    free(types);
+
+    if (tag)
+        git_tag_free(tag);
+
+    if (protected)
+        UNPROTECT(protected);
 
-    UNPROTECT(1);
+    if (GIT_EUSER == err)
+        err_msg = err_alloc_memory_buffer;
 
     if (err < 0) {
-        const git_error *e = giterr_last();
-        error("Error %d/%d: %s\n", err, e->klass, e->message);
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d: %s\n", e->klass, e->message);
+        }
     }
 
-    return url;
+    return list;
 }
 
 /**
- * List revisions
+ * Columns in the data.frame with tags
+ */
+enum {
+    GIT2R_TAG_NAME = 0,
+    GIT2R_TAG_TARGET,
+    GIT2R_TAG_PEELED,
+    GIT2R_TAG_TAGGER,
+    GIT2R_TAG_EMAIL,
+    GIT2R_TAG_WHEN,
+    GIT2R_N_TAG_COLUMNS
+};
+
+static const char *tag_column_names[GIT2R_N_TAG_COLUMNS] =
+    {"name", "target", "peeled", "tagger", "email", "when"};
+
+static const SEXPTYPE tag_column_types[GIT2R_N_TAG_COLUMNS] =
+    {STRSXP, STRSXP, STRSXP, STRSXP, STRSXP, REALSXP};
+
+/**
+ * List the tags of a repository as a data.frame
+ *
+ * The tags are listed in one pass of the references under
+ * refs/tags/. The peeled target of an annotated tag is taken from the
+ * packed-refs file or the reference tables when it is stored there,
+ * and the type of the other targets is read from the object headers
+ * in one batch. The tag objects are only read for the tags without a
+ * stored peeled target, and for all annotated tags when the tagger is
+ * requested.
  *
  * @param repo S4 class git_repository
- * @return
+ * @param tagger TRUE to read the tagger and time of the annotated
+ * tags, else FALSE
+ * @return data.frame with the columns name, target, peeled, tagger,
+ * email and when
  */
-SEXP revisions(SEXP repo)
+SEXP tags_data_frame(const SEXP repo, const SEXP tagger)
 {
-    int i=0;
-    int err = 0;
-    SEXP list;
-    size_t n = 0;
-    git_revwalk *walker = NULL;
+    int err;
+    const char* err_msg = NULL;
+    SEXP columns = R_NilValue, names, class_name;
     git_repository *repository;
+    git_tag *tag = NULL;
+    git_object *object = NULL;
+    git2r_reference_list tag_list = {0};
+    git_oid *targets = NULL, *peeled = NULL;
+    git_otype *types = NULL;
+    size_t i, protected = 0;
+
+    if (!isLogical(tagger) || 1 != length(tagger) || NA_LOGICAL == LOGICAL(tagger)[0])
+        error("'tagger' must be TRUE or FALSE");
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    if (git_repository_is_empty(repository)) {
-        /* No commits, create empty list */
-        PROTECT(list = allocVector(VECSXP, 0));
+    err = load_references(&tag_list, repository, "refs/tags/*");
+    if (err < 0)
         goto cleanup;
-    }
 
-    err = git_revwalk_new(&walker, repository);
-    if (err < 0)
+    targets = malloc((tag_list.n + 1) * sizeof(git_oid));
+    peeled = malloc((tag_list.n + 1) * sizeof(git_oid));
+    types = malloc((tag_list.n + 1) * sizeof(git_otype));
+    if (!targets || !peeled || !types) {
+        err = GIT_EUSER;
         goto cleanup;
+    }
 
-    err = git_revwalk_push_head(walker);
+    err = load_tag_targets(targets, peeled, types, &tag_list, repository);
     if (err < 0)
         goto cleanup;
 
-    /* Count number of revisions before creating the list */
-    n = number_of_revisions(walker);
+    PROTECT(columns = allocVector(VECSXP, GIT2R_N_TAG_COLUMNS));
+    PROTECT(names = allocVector(STRSXP, GIT2R_N_TAG_COLUMNS));
+    protected += 2;
+    for (i = 0; i < GIT2R_N_TAG_COLUMNS; i++) {
+        SET_VECTOR_ELT(columns, i, allocVector(tag_column_types[i], tag_list.n));
+        SET_STRING_ELT(names, i, mkChar(tag_column_names[i]));
+    }
+    setAttrib(columns, R_NamesSymbol, names);
 
-    /* Create list to store result */
-    PROTECT(list = allocVector(VECSXP, n));
+    for (i = 0; i < tag_list.n; i++) {
+        char hex[GIT_OID_HEXSZ + 1];
+        const git_signature *sig = NULL;
+        const git_oid *peel = &targets[i];
 
-    git_revwalk_reset(walker);
-    err = git_revwalk_push_head(walker);
-    if (err < 0)
-        goto cleanup;
+        SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_NAME), i,
+                       mkChar(git_reference_shorthand(tag_list.refs[i])));
+        git_oid_tostr(hex, sizeof(hex), &targets[i]);
+        SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_TARGET), i, mkChar(hex));
 
-    for (;;) {
-        git_commit *commit;
-        SEXP sexp_commit;
-        git_oid oid;
+        if (GIT_OBJ_TAG == types[i]) {
+            if (!git_oid_iszero(&peeled[i]))
+                peel = &peeled[i];
 
-        err = git_revwalk_next(&oid, walker);
-        if (err < 0) {
-            if (GIT_ITEROVER == err)
-                err = 0;
-            goto cleanup;
+            if (LOGICAL(tagger)[0] || git_oid_iszero(&peeled[i])) {
+                err = git_tag_lookup(&tag, repository, &targets[i]);
+                if (err < 0)
+                    goto cleanup;
+                sig = git_tag_tagger(tag);
+            }
+
+            if (git_oid_iszero(&peeled[i])) {
+                err = git_tag_peel(&object, tag);
+                if (err < 0)
+                    goto cleanup;
+                peel = git_object_id(object);
+            }
+
+            if (!LOGICAL(tagger)[0])
+                sig = NULL;
         }
 
-        err = git_commit_lookup(&commit, repository, &oid);
-        if (err < 0)
-            goto cleanup;
+        git_oid_tostr(hex, sizeof(hex), peel);
+        SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_PEELED), i, mkChar(hex));
 
-        PROTECT(sexp_commit = NEW_OBJECT(MAKE_CLASS("git_commit")));
-        init_commit(commit, sexp_commit);
-        SET_VECTOR_ELT(list, i, sexp_commit);
-        UNPROTECT(1);
-        i++;
+        if (sig) {
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_TAGGER), i, mkChar(sig->name));
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_EMAIL), i, mkChar(sig->email));
+            REAL(VECTOR_ELT(columns, GIT2R_TAG_WHEN))[i] =
+                (double)sig->when.time + 60.0 * sig->when.offset;
+        } else {
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_TAGGER), i, NA_STRING);
+            SET_STRING_ELT(VECTOR_ELT(columns, GIT2R_TAG_EMAIL), i, NA_STRING);
+            REAL(VECTOR_ELT(columns, GIT2R_TAG_WHEN))[i] = NA_REAL;
+        }
 
-        git_commit_free(commit);
+        git_object_free(object);
+        object = NULL;
+        git_tag_free(tag);
+        tag = NULL;
     }
 
+    columns_as_data_frame(columns, tag_list.n);
+    PROTECT(class_name = allocVector(STRSXP, 2));
+    protected++;
+    SET_STRING_ELT(class_name, 0, mkChar("POSIXct"));
+    SET_STRING_ELT(class_name, 1, mkChar("POSIXt"));
+    setAttrib(VECTOR_ELT(columns, GIT2R_TAG_WHEN), R_ClassSymbol, class_name);
+    setAttrib(VECTOR_ELT(columns, GIT2R_TAG_WHEN), install("tzone"), mkString("GMT"));
+
 cleanup:
-    if (walker)
-        git_revwalk_free(walker);
+    free_reference_list(&tag_list);
+    free(targets);
+    free(peeled);
+    free(types);
 
-    git_repository_free(repository);
+    if (object)
+        git_object_free(object);
 
-    UNPROTECT(1);
+    if (tag)
+        git_tag_free(tag);
+
+    if (protected)
+        UNPROTECT(protected);
+
+    if (GIT_EUSER == err)
+        err_msg = err_alloc_memory_buffer;
 
     if (err < 0) {
-        const git_error *e = giterr_last();
-        error("Error %d/%d: %s\n", err, e->klass, e->message);
+        if (err_msg) {
+            error(err_msg);
+        } else {
+            const git_error *e = giterr_last();
+            error("Error %d: %s\n", e->klass, e->message);
+        }
     }
 
-    return list;
+    return columns;
 }
 
 /**
- * Get state of the repository working directory and the staging area.
+ * Get workdir of repository.
  *
  * @param repo S4 class git_repository
- * @return VECXSP with status
+ * @return
  */
-SEXP status(const SEXP repo,
-            const SEXP staged,
-            const SEXP unstaged,
-            const SEXP untracked,
-            const SEXP ignored)
+SEXP workdir(const SEXP repo)
 {
-    int err;
-    size_t i=0, count;
-    SEXP list, list_names;
+    SEXP result;
     git_repository *repository;
-    git_status_list *status_list = NULL;
-    git_status_options opts = GIT_STATUS_OPTIONS_INIT;
-
-    /* Check arguments to status */
-    if (R_NilValue == staged
-        || R_NilValue == unstaged
-        || R_NilValue == untracked
-        || R_NilValue == ignored
-        || !isLogical(staged)
-        || !isLogical(unstaged)
-        || !isLogical(untracked)
-        || !isLogical(ignored)
-        || 1 != length(staged)
-        || 1 != length(unstaged)
-        || 1 != length(untracked)
-        || 1 != length(ignored))
-        error("Invalid arguments to status");
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    opts.show  = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
-    opts.flags = GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX |
-        GIT_STATUS_OPT_SORT_CASE_SENSITIVELY;
-
-    if (LOGICAL(untracked)[0])
-        opts.flags |= GIT_STATUS_OPT_INCLUDE_UNTRACKED;
-    if (LOGICAL(ignored)[0])
-        opts.flags |= GIT_STATUS_OPT_INCLUDE_IGNORED;
-    err = git_status_list_new(&status_list, repository, &opts);
-    if (err < 0)
-        goto cleanup;
-
-    count = LOGICAL(staged)[0] +
-        LOGICAL(unstaged)[0] +
-        LOGICAL(untracked)[0] +
-        LOGICAL(ignored)[0];
-
-    PROTECT(list = allocVector(VECSXP, count));
-    PROTECT(list_names = allocVector(STRSXP, count));
+    result = ScalarString(mkChar(git_repository_workdir(repository)));
 
-    if (LOGICAL(staged)[0]) {
-        SET_STRING_ELT(list_names, i, mkChar("staged"));
-        list_staged_changes(list, i, status_list);
-        i++;
-    }
+    return result;
+}
 
-    if (LOGICAL(unstaged)[0]) {
-        SET_STRING_ELT(list_names, i, mkChar("unstaged"));
-        list_unstaged_changes(list, i, status_list);
-        i++;
-    }
+/**
+ * Write the reachability bitmaps of a repository.
+ *
+ * @param repo S4 class git_repository
+ * @return R_NilValue
+ */
+SEXP write_bitmap_index(const SEXP repo)
+{
+    int err;
+    git_repository *repository;
 
-    if (LOGICAL(untracked)[0]) {
-        SET_STRING_ELT(list_names, i, mkChar("untracked"));
-        list_untracked_files(list, i, status_list);
-        i++;
-    }
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
-    if (LOGICAL(ignored)[0]) {
-        SET_STRING_ELT(list_names, i, mkChar("ignored"));
-        list_ignored_files(list, i, status_list);
+    err = git_graph_write_bitmap(repository);
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    setAttrib(list, R_NamesSymbol, list_names);
-
-cleanup:
-    if (status_list)
-        git_status_list_free(status_list);
+    return R_NilValue;
+}
 
-    if (repository)
-        git_repository_free(repository);
+/**
+ * Write the commit-graph file of a repository.
+ *
+ * @param repo S4 class git_repository
+ * @return R_NilValue
+ */
+SEXP write_commit_graph(const SEXP repo)
+{
+    int err;
+    git_repository *repository;
 
-    UNPROTECT(2);
+    repository = get_repository(repo);
+    if (!repository)
+        error(err_invalid_repository);
 
+    err = git_graph_write_commit_graph(repository);
     if (err < 0) {
         const git_error *e = giterr_last();
         error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    return list;
+    return R_NilValue;
 }
 
 /**
- * Get all tags that can be found in a repository.
+ * Write the multi-pack-index of a repository.
  *
  * @param repo S4 class git_repository
- * @return VECXSP with S4 objects of class git_tag
+ * @return R_NilValue
  */
-SEXP tags(const SEXP repo)
+SEXP write_multi_pack_index(const SEXP repo)
 {
     int err;
-    SEXP list;
-    size_t protected = 0;
+    git_odb *odb = NULL;
     git_repository *repository;
-    git_reference* reference = NULL;
-    git_tag *tag = NULL;
-    git_strarray tag_names = {0};
-    size_t i;
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    err = git_tag_list(&tag_names, repository);
+    err = git_repository_odb(&odb, repository);
     if (err < 0)
         goto cleanup;
 
-    PROTECT(list = allocVector(VECSXP, tag_names.count));
-    protected++;
-
-    for(i = 0; i < tag_names.count; i++) {
-        SEXP sexp_tag;
-        const git_oid *oid;
-
-        err = git_reference_dwim(&reference, repository, tag_names.strings[i]);
-        if (err < 0)
-            goto cleanup;
-
-        oid = git_reference_target(reference);
-        err = git_tag_lookup(&tag, repository, oid);
-        if (err < 0)
-            goto cleanup;
-
-        PROTECT(sexp_tag = NEW_OBJECT(MAKE_CLASS("git_tag")));
-        protected++;
-        init_tag(tag, sexp_tag);
-
-        SET_VECTOR_ELT(list, i, sexp_tag);
-        UNPROTECT(1);
-        protected--;
-
-        git_tag_free(tag);
-        tag = NULL;
-        git_reference_free(reference);
-        reference = NULL;
-    }
+    err = git_odb_write_multi_pack_index(odb);
 
 cleanup:
-    git_strarray_free(&tag_names);
-
-    if (tag)
-        git_tag_free(tag);
-
-    if (reference)
-        git_reference_free(reference);
-
-    if (repository)
-        git_repository_free(repository);
-
-    if (protected)
-        UNPROTECT(protected);
+    if (odb)
+        git_odb_free(odb);
 
     if (err < 0) {
         const git_error *e = giterr_last();
-        error("Error %d: %s\n", e->klass, e->message);
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
     }
 
-    return list;
+    return R_NilValue;
 }
 
 /**
- * Get workdir of repository.
+ * Verify the multi-pack-index of a repository.
  *
  * @param repo S4 class git_repository
- * @return
+ * @return TRUE if the multi-pack-index is valid or missing
  */
-SEXP workdir(const SEXP repo)
+SEXP verify_multi_pack_index(const SEXP repo)
 {
-    SEXP result;
+    int err;
+    git_odb *odb = NULL;
     git_repository *repository;
 
     repository = get_repository(repo);
     if (!repository)
         error(err_invalid_repository);
 
-    result = ScalarString(mkChar(git_repository_workdir(repository)));
+    err = git_repository_odb(&odb, repository);
+    if (err < 0)
+        goto cleanup;
 
-    git_repository_free(repository);
+    err = git_odb_verify_multi_pack_index(odb);
 
-    return result;
+cleanup:
+    if (odb)
+        git_odb_free(odb);
+
+    if (err < 0) {
+        const git_error *e = giterr_last();
+        error("Error %d/%d: %s\n", err, e->klass, e->message);
+    }
+
+    return ScalarLogical(1);
 }
 
 static const R_CallMethodDef callMethods[] =
 {
-    {"add", (DL_FUNC)&add, 2},
+    {"add", (DL_FUNC)&add, 3},
+    {"ahead_behind", (DL_FUNC)&ahead_behind, 3},
+    {"blob_sizes", (DL_FUNC)&blob_sizes, 3},
     {"branches", (DL_FUNC)&branches, 2},
     {"checkout", (DL_FUNC)&checkout, 2},
     {"clone", (DL_FUNC)&clone, 2},
     {"commit", (DL_FUNC)&commit, 5},
     {"config", (DL_FUNC)&config, 2},
+    {"contributions", (DL_FUNC)&contributions, 6},
+    {"count_reachable", (DL_FUNC)&count_reachable, 3},
     {"default_signature", (DL_FUNC)&default_signature, 1},
-    {"init", (DL_FUNC)&init, 2},
+    {"delta_base_cache", (DL_FUNC)&delta_base_cache, 2},
+    {"fetch", (DL_FUNC)&fetch, 2},
+    {"init", (DL_FUNC)&init, 3},
     {"is_bare", (DL_FUNC)&is_bare, 1},
     {"is_empty", (DL_FUNC)&is_empty, 1},
     {"is_repository", (DL_FUNC)&is_repository, 1},
-    {"references", (DL_FUNC)&references, 1},
+    {"object_cache", (DL_FUNC)&object_cache, 1},
+    {"object_cache_limits", (DL_FUNC)&object_cache_limits, 5},
+    {"odb_headers", (DL_FUNC)&odb_headers, 2},
+    {"odb_objects", (DL_FUNC)&odb_objects, 1},
+    {"pack_windows", (DL_FUNC)&pack_windows, 3},
+    {"reference_targets", (DL_FUNC)&reference_targets, 2},
+    {"references", (DL_FUNC)&references, 2},
     {"remotes", (DL_FUNC)&remotes, 1},
     {"remote_url", (DL_FUNC)&remote_url, 2},
     {"revisions", (DL_FUNC)&revisions, 1},
+    {"revisions_data_frame", (DL_FUNC)&revisions_data_frame, 1},
+    {"revwalk_new", (DL_FUNC)&revwalk_new, 6},
+    {"revwalk_next_chunk", (DL_FUNC)&revwalk_next_chunk, 2},
     {"status", (DL_FUNC)&status, 5},
+    {"statuses", (DL_FUNC)&statuses, 6},
+    {"tag_create", (DL_FUNC)&tag_create, 4},
     {"tags", (DL_FUNC)&tags, 1},
+    {"tags_data_frame", (DL_FUNC)&tags_data_frame, 2},
+    {"verify_multi_pack_index", (DL_FUNC)&verify_multi_pack_index, 1},
     {"workdir", (DL_FUNC)&workdir, 1},
+    {"write_bitmap_index", (DL_FUNC)&write_bitmap_index, 1},
+    {"write_commit_graph", (DL_FUNC)&write_commit_graph, 1},
+    {"write_multi_pack_index", (DL_FUNC)&write_multi_pack_index, 1},
     {NULL, NULL, 0}
 };
 
@@ -1771,7 +5248,24 @@ static const R_CallMethodDef callMethods[] =
  * @param info Information about the DLL being loaded
  */
 void
-R_init_gitr(DllInfo *info)
+R_init_git2r(DllInfo *info)
 {
+    /* libgit2 is built with thread support and keeps the last error
+     * in thread-local storage that must be set up before any call */
+    if (git_threads_init() < 0)
+        error("Unable to initialize libgit2");
+
     R_registerRoutines(info, NULL, callMethods, NULL, NULL);
 }
+
+/**
+ * Free resources when the shared library is unloaded.
+ *
+ * @param info Information about the DLL being unloaded
+ */
+void
+R_unload_git2r(DllInfo *info)
+{
+    repository_cache_clear();
+    git_threads_shutdown();
+}
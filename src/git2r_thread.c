@@ -0,0 +1,116 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2013-2014  Stefan Widgren
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file git2r_thread.c
+ *  @brief Run independent jobs on native worker threads
+ *
+ *  This file uses the thread primitives of libgit2 and must not
+ *  include the R headers, since the jobs run outside the R main
+ *  thread.
+ */
+
+#include "common.h"
+#include "thread-utils.h"
+#include "git2r_thread.h"
+
+typedef struct {
+    size_t n_jobs;
+    git_atomic next;
+    git2r_job_fn fn;
+    void *payload;
+} git2r_jobs;
+
+/**
+ * Run jobs until there are no jobs left.
+ *
+ * @param arg The git2r_jobs
+ * @return NULL
+ */
+static void* run_jobs(void *arg)
+{
+    git2r_jobs *jobs = (git2r_jobs*)arg;
+
+    for (;;) {
+        size_t job = (size_t)git_atomic_inc(&jobs->next) - 1;
+        if (job >= jobs->n_jobs)
+            break;
+        jobs->fn(job, jobs->payload);
+    }
+
+    return NULL;
+}
+
+/**
+ * Run n_jobs jobs on worker threads. The threads take the next job
+ * from a shared counter, so a slow job does not hold up the
+ * others. The calling thread runs jobs too and returns when all jobs
+ * are done.
+ *
+ * @param n_jobs The number of jobs
+ * @param n_threads The number of threads, 0 uses one thread per
+ * online CPU.
+ * @param fn The job function, called once for each job
+ * @param payload Passed to fn
+ * @return 0
+ */
+int git2r_parallel_for(size_t n_jobs,
+                       unsigned int n_threads,
+                       git2r_job_fn fn,
+                       void *payload)
+{
+    git2r_jobs jobs;
+#ifdef GIT_THREADS
+    git_thread *threads = NULL;
+    unsigned int i, n_started = 0;
+#endif
+
+    jobs.n_jobs = n_jobs;
+    jobs.next.val = 0;
+    jobs.fn = fn;
+    jobs.payload = payload;
+
+#ifdef GIT_THREADS
+    if (!n_threads)
+        n_threads = (unsigned int)git_online_cpus();
+    if (n_threads > n_jobs)
+        n_threads = (unsigned int)n_jobs;
+
+    /* The calling thread is one of the threads */
+    if (n_threads > 1)
+        threads = malloc((n_threads - 1) * sizeof(git_thread));
+
+    if (threads) {
+        for (i = 0; i < n_threads - 1; i++) {
+            /* Fewer threads if a thread cannot be created */
+            if (git_thread_create(&threads[n_started], NULL, run_jobs, &jobs))
+                break;
+            n_started++;
+        }
+    }
+
+    run_jobs(&jobs);
+
+    for (i = 0; i < n_started; i++)
+        git_thread_join(threads[i], NULL);
+    free(threads);
+#else
+    (void)n_threads;
+    run_jobs(&jobs);
+#endif
+
+    return 0;
+}
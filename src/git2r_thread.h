@@ -0,0 +1,40 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2013-2014  Stefan Widgren
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2 of the License.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file git2r_thread.h
+ *  @brief Run independent jobs on native worker threads
+ */
+
+#ifndef INCLUDE_git2r_thread_h__
+#define INCLUDE_git2r_thread_h__
+
+#include <stddef.h>
+
+/**
+ * A job run on a worker thread. The job must not call the R API.
+ *
+ * @param job Index of the job
+ * @param payload The payload passed to git2r_parallel_for
+ */
+typedef void (*git2r_job_fn)(size_t job, void *payload);
+
+int git2r_parallel_for(size_t n_jobs,
+                       unsigned int n_threads,
+                       git2r_job_fn fn,
+                       void *payload);
+
+#endif
@@ -123,35 +123,53 @@ on_error:
 	return error;
 }
 
+/*
+ * The local and the remote branches are listed one after the other,
+ * each with an iterator over their own folder.
+ */
 typedef struct {
+	git_repository *repo;
 	git_reference_iterator *iter;
-	unsigned int flags;
+	git_branch_t type;
+	unsigned int flags; /* the types still to list */
 } branch_iter;
 
+static int branch_iter_start(branch_iter *iter)
+{
+	const char *glob;
+
+	git_reference_iterator_free(iter->iter);
+	iter->iter = NULL;
+
+	if (iter->flags & GIT_BRANCH_LOCAL) {
+		iter->type = GIT_BRANCH_LOCAL;
+		glob = GIT_REFS_HEADS_DIR "*";
+	} else if (iter->flags & GIT_BRANCH_REMOTE) {
+		iter->type = GIT_BRANCH_REMOTE;
+		glob = GIT_REFS_REMOTES_DIR "*";
+	} else {
+		return GIT_ITEROVER;
+	}
+
+	iter->flags &= ~iter->type;
+
+	return git_reference_iterator_glob_new(&iter->iter, iter->repo, glob);
+}
+
 int git_branch_next(git_reference **out, git_branch_t *out_type, git_branch_iterator *_iter)
 {
 	branch_iter *iter = (branch_iter *) _iter;
-	git_reference *ref;
-	int error;
+	int error = GIT_ITEROVER;
 
-	while ((error = git_reference_next(&ref, iter->iter)) == 0) {
-		if ((iter->flags & GIT_BRANCH_LOCAL) &&
-		    !git__prefixcmp(ref->name, GIT_REFS_HEADS_DIR)) {
-			*out = ref;
-			*out_type = GIT_BRANCH_LOCAL;
-
-			return 0;
-		} else  if ((iter->flags & GIT_BRANCH_REMOTE) &&
-			    !git__prefixcmp(ref->name, GIT_REFS_REMOTES_DIR)) {
-			*out = ref;
-			*out_type = GIT_BRANCH_REMOTE;
-
-			return 0;
-		} else {
-			git_reference_free(ref);
-		}
+	while (iter->iter &&
+		(error = git_reference_next(out, iter->iter)) == GIT_ITEROVER) {
+		if ((error = branch_iter_start(iter)) < 0)
+			return error;
 	}
 
+	if (!error)
+		*out_type = iter->type;
+
 	return error;
 }
 
@@ -161,19 +179,20 @@ int git_branch_iterator_new(
 	git_branch_t list_flags)
 {
 	branch_iter *iter;
+	int error;
 
 	iter = git__calloc(1, sizeof(branch_iter));
 	GITERR_CHECK_ALLOC(iter);
 
+	iter->repo = repo;
 	iter->flags = list_flags;
 
-	if (git_reference_iterator_new(&iter->iter, repo) < 0) {
+	if ((error = branch_iter_start(iter)) < 0 && error != GIT_ITEROVER) {
 		git__free(iter);
-		return -1;
+		return error;
 	}
 
 	*out = (git_branch_iterator *) iter;
-
 	return 0;
 }
 
@@ -43,17 +43,34 @@ int git_cache_set_max_object_size(git_otype type, size_t size)
 	return 0;
 }
 
+int git_cache_get_max_object_size(size_t *out, git_otype type)
+{
+	if (type < 0 || (size_t)type >= ARRAY_SIZE(git_cache__max_object_size)) {
+		giterr_set(GITERR_INVALID, "type out of range");
+		return -1;
+	}
+
+	*out = git_cache__max_object_size[type];
+	return 0;
+}
+
 /* Stefan Widgren <stefan.widgren@gmail.com>     */
 /* 2013-12-28: Changed to use R printing routine */
 void git_cache_dump_stats(git_cache *cache)
 {
 	git_cached_obj *object;
 
-	if (kh_size(cache->map) == 0)
+	if (git_mutex_lock(&cache->lock) < 0)
 		return;
 
-	Rprintf("Cache %p: %d items cached, %d bytes\n",
-		cache, kh_size(cache->map), (int)cache->used_memory);
+	if (kh_size(cache->map) == 0) {
+		git_mutex_unlock(&cache->lock);
+		return;
+	}
+
+	Rprintf("Cache %p: %d items cached, %d bytes, %d hits, %d misses, %d evictions\n",
+		cache, kh_size(cache->map), (int)cache->used_memory,
+		(int)cache->hits, (int)cache->misses, (int)cache->evictions);
 
 	kh_foreach_value(cache->map, object, {
 		char oid_str[9];
@@ -64,6 +81,8 @@ void git_cache_dump_stats(git_cache *cache)
 			(int)object->size
 		);
 	});
+
+	git_mutex_unlock(&cache->lock);
 }
 
 int git_cache_init(git_cache *cache)
@@ -92,6 +111,7 @@ static void clear_cache(git_cache *cache)
 	kh_clear(oid, cache->map);
 	git_atomic_ssize_add(&git_cache__current_storage, -cache->used_memory);
 	cache->used_memory = 0;
+	cache->clock_hand = 0;
 }
 
 void git_cache_clear(git_cache *cache)
@@ -104,6 +124,25 @@ void git_cache_clear(git_cache *cache)
 	git_mutex_unlock(&cache->lock);
 }
 
+int git_cache_get_stats(git_repository_object_cache_stats *out, git_cache *cache)
+{
+	assert(out && cache);
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock cache");
+		return -1;
+	}
+
+	out->entries = (size_t)kh_size(cache->map);
+	out->memory_used = (size_t)cache->used_memory;
+	out->hits = cache->hits;
+	out->misses = cache->misses;
+	out->evictions = cache->evictions;
+
+	git_mutex_unlock(&cache->lock);
+	return 0;
+}
+
 void git_cache_free(git_cache *cache)
 {
 	git_cache_clear(cache);
@@ -112,31 +151,43 @@ void git_cache_free(git_cache *cache)
 	git__memzero(cache, sizeof(*cache));
 }
 
-/* Called with lock */
+/*
+ * Called with lock. Evict entries until the total storage is back
+ * under the limit, using the second chance (clock) approximation of
+ * LRU: the hand sweeps the slots of the map, and an entry that was
+ * looked up since the hand last passed it has its bit cleared and is
+ * skipped once. New entries start without the bit, so objects that
+ * are only read once leave the cache before the ones in use.
+ */
 static void cache_evict_entries(git_cache *cache)
 {
-	uint32_t seed = rand();
-	size_t evict_count = 8;
 	ssize_t evicted_memory = 0;
 
-	/* do not infinite loop if there's not enough entries to evict  */
-	if (evict_count > kh_size(cache->map)) {
-		clear_cache(cache);
-		return;
-	}
+	while (kh_size(cache->map) > 0 &&
+		git_atomic_ssize_get(&git_cache__current_storage) - evicted_memory >
+		git_cache__max_storage) {
+		khiter_t pos = cache->clock_hand++;
+		git_cached_obj *evict;
 
-	while (evict_count > 0) {
-		khiter_t pos = seed++ % kh_end(cache->map);
-
-		if (kh_exist(cache->map, pos)) {
-			git_cached_obj *evict = kh_val(cache->map, pos);
+		if (pos >= kh_end(cache->map)) {
+			cache->clock_hand = 0;
+			continue;
+		}
 
-			evict_count--;
-			evicted_memory += evict->size;
-			git_cached_obj_decref(evict);
+		if (!kh_exist(cache->map, pos))
+			continue;
 
-			kh_del(oid, cache->map, pos);
+		evict = kh_val(cache->map, pos);
+		if (evict->referenced) {
+			evict->referenced = 0;
+			continue;
 		}
+
+		evicted_memory += evict->size;
+		cache->evictions++;
+		git_cached_obj_decref(evict);
+
+		kh_del(oid, cache->map, pos);
 	}
 
 	cache->used_memory -= evicted_memory;
@@ -164,10 +215,16 @@ static void *cache_get(git_cache *cache, const git_oid *oid, unsigned int flags)
 		if (flags && entry->flags != flags) {
 			entry = NULL;
 		} else {
+			entry->referenced = 1;
 			git_cached_obj_incref(entry);
 		}
 	}
 
+	if (entry)
+		cache->hits++;
+	else
+		cache->misses++;
+
 	git_mutex_unlock(&cache->lock);
 
 	return entry;
@@ -191,7 +248,7 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 		return entry;
 
 	/* soften the load on the cache */
-	if (git_cache__current_storage.val > git_cache__max_storage)
+	if (git_atomic_ssize_get(&git_cache__current_storage) > git_cache__max_storage)
 		cache_evict_entries(cache);
 
 	pos = kh_get(oid, cache->map, &entry->oid);
@@ -204,6 +261,7 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 		if (rval >= 0) {
 			kh_key(cache->map, pos) = &entry->oid;
 			kh_val(cache->map, pos) = entry;
+			entry->referenced = 0;
 			git_cached_obj_incref(entry);
 			cache->used_memory += entry->size;
 			git_atomic_ssize_add(&git_cache__current_storage, (ssize_t)entry->size);
@@ -221,6 +279,7 @@ static void *cache_store(git_cache *cache, git_cached_obj *entry)
 			entry->flags == GIT_CACHE_STORE_PARSED) {
 			git_cached_obj_decref(stored_entry);
 			git_cached_obj_incref(entry);
+			entry->referenced = 1;
 
 			kh_key(cache->map, pos) = &entry->oid;
 			kh_val(cache->map, pos) = entry;
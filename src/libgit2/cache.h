@@ -10,6 +10,7 @@
 #include "git2/common.h"
 #include "git2/oid.h"
 #include "git2/odb.h"
+#include "git2/repository.h"
 
 #include "thread-utils.h"
 #include "oidmap.h"
@@ -26,12 +27,17 @@ typedef struct {
 	uint16_t   flags; /* GIT_CACHE_STORE value */
 	size_t     size;
 	git_atomic refcount;
+	int        referenced; /* second chance bit, protected by cache lock */
 } git_cached_obj;
 
 typedef struct {
 	git_oidmap *map;
 	git_mutex   lock;
 	ssize_t     used_memory;
+	khiter_t    clock_hand; /* protected by lock */
+	size_t      hits;
+	size_t      misses;
+	size_t      evictions;
 } git_cache;
 
 extern bool git_cache__enabled;
@@ -39,10 +45,12 @@ extern ssize_t git_cache__max_storage;
 extern git_atomic_ssize git_cache__current_storage;
 
 int git_cache_set_max_object_size(git_otype type, size_t size);
+int git_cache_get_max_object_size(size_t *out, git_otype type);
 
 int git_cache_init(git_cache *cache);
 void git_cache_free(git_cache *cache);
 void git_cache_clear(git_cache *cache);
+int git_cache_get_stats(git_repository_object_cache_stats *out, git_cache *cache);
 
 void *git_cache_store_raw(git_cache *cache, git_odb_object *entry);
 void *git_cache_store_parsed(git_cache *cache, git_object *entry);
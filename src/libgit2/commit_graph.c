@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "commit_graph.h"
+#include "commit_list.h"
+#include "revwalk.h"
+#include "repository.h"
+#include "filebuf.h"
+#include "fileops.h"
+#include "odb.h"
+#include "array.h"
+#include "git2/graph.h"
+#include "git2/refs.h"
+
+#define COMMIT_GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
+#define COMMIT_GRAPH_VERSION 1
+#define COMMIT_GRAPH_HASH_VERSION 1 /* SHA-1 */
+
+#define COMMIT_GRAPH_CHUNK_OIDF 0x4f494446 /* "OIDF" */
+#define COMMIT_GRAPH_CHUNK_OIDL 0x4f49444c /* "OIDL" */
+#define COMMIT_GRAPH_CHUNK_CDAT 0x43444154 /* "CDAT" */
+#define COMMIT_GRAPH_CHUNK_EDGE 0x45444745 /* "EDGE" */
+
+#define COMMIT_GRAPH_HEADER_SIZE 8
+#define COMMIT_GRAPH_CHUNK_LOOKUP_WIDTH 12
+#define COMMIT_GRAPH_DATA_WIDTH (GIT_OID_RAWSZ + 16)
+
+#define COMMIT_GRAPH_NO_PARENT 0x70000000
+#define COMMIT_GRAPH_EXTRA_EDGES 0x80000000
+#define COMMIT_GRAPH_LAST_EDGE 0x80000000
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(void) put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static int commit_graph_error(const char *path, const char *msg)
+{
+	giterr_set(GITERR_ODB, "Invalid commit-graph file '%s' - %s", path, msg);
+	return -1;
+}
+
+static int commit_graph_parse(git_commit_graph *graph, const char *path)
+{
+	const unsigned char *data = graph->map.data;
+	size_t len = graph->map.len, i, num_chunks;
+	uint64_t oidf_offset = 0, oidl_offset = 0, cdat_offset = 0, edge_offset = 0;
+	uint64_t edge_len = 0, trailer_offset;
+
+	if (len < COMMIT_GRAPH_HEADER_SIZE + GIT_OID_RAWSZ)
+		return commit_graph_error(path, "file is too short");
+
+	if (get_be32(data) != COMMIT_GRAPH_SIGNATURE)
+		return commit_graph_error(path, "unknown signature");
+
+	if (data[4] != COMMIT_GRAPH_VERSION || data[5] != COMMIT_GRAPH_HASH_VERSION)
+		return commit_graph_error(path, "unsupported version");
+
+	/* Chains of split commit-graph files are not supported */
+	if (data[7] != 0)
+		return commit_graph_error(path, "base commit-graph files are not supported");
+
+	num_chunks = data[6];
+	trailer_offset = len - GIT_OID_RAWSZ;
+
+	if (COMMIT_GRAPH_HEADER_SIZE +
+		(num_chunks + 1) * COMMIT_GRAPH_CHUNK_LOOKUP_WIDTH > trailer_offset)
+		return commit_graph_error(path, "chunk lookup table is truncated");
+
+	for (i = 0; i < num_chunks; i++) {
+		const unsigned char *chunk = data + COMMIT_GRAPH_HEADER_SIZE +
+			i * COMMIT_GRAPH_CHUNK_LOOKUP_WIDTH;
+		uint32_t id = get_be32(chunk);
+		uint64_t offset = ((uint64_t)get_be32(chunk + 4) << 32) | get_be32(chunk + 8);
+		uint64_t next = ((uint64_t)get_be32(chunk + 16) << 32) | get_be32(chunk + 20);
+
+		if (offset > next || next > trailer_offset)
+			return commit_graph_error(path, "chunk offset out of bounds");
+
+		switch (id) {
+		case COMMIT_GRAPH_CHUNK_OIDF:
+			if (next - offset != 256 * 4)
+				return commit_graph_error(path, "invalid fanout chunk");
+			oidf_offset = offset;
+			break;
+		case COMMIT_GRAPH_CHUNK_OIDL:
+			oidl_offset = offset;
+			break;
+		case COMMIT_GRAPH_CHUNK_CDAT:
+			cdat_offset = offset;
+			break;
+		case COMMIT_GRAPH_CHUNK_EDGE:
+			edge_offset = offset;
+			edge_len = next - offset;
+			break;
+		default:
+			/* Unknown chunks are optional */
+			break;
+		}
+	}
+
+	if (!oidf_offset || !oidl_offset || !cdat_offset)
+		return commit_graph_error(path, "missing required chunk");
+
+	graph->fanout = (const uint32_t *)(data + oidf_offset);
+	graph->num_commits = get_be32(data + oidf_offset + 255 * 4);
+
+	for (i = 1; i < 256; i++) {
+		if (get_be32(data + oidf_offset + i * 4) <
+			get_be32(data + oidf_offset + (i - 1) * 4))
+			return commit_graph_error(path, "fanout is not monotonic");
+	}
+
+	if (oidl_offset + (uint64_t)graph->num_commits * GIT_OID_RAWSZ > trailer_offset ||
+		cdat_offset + (uint64_t)graph->num_commits * COMMIT_GRAPH_DATA_WIDTH > trailer_offset)
+		return commit_graph_error(path, "commit tables are truncated");
+
+	graph->oids = data + oidl_offset;
+	graph->commit_data = data + cdat_offset;
+
+	if (edge_offset) {
+		graph->extra_edges = data + edge_offset;
+		graph->num_extra_edges = (uint32_t)(edge_len / 4);
+	}
+
+	return 0;
+}
+
+int git_commit_graph_open(git_commit_graph **out, const char *path)
+{
+	git_commit_graph *graph;
+	int error;
+
+	*out = NULL;
+
+	if (!git_path_exists(path))
+		return GIT_ENOTFOUND;
+
+	graph = git__calloc(1, sizeof(git_commit_graph));
+	GITERR_CHECK_ALLOC(graph);
+
+	if ((error = git_futils_mmap_ro_file(&graph->map, path)) < 0) {
+		git__free(graph);
+		return error;
+	}
+
+	if ((error = commit_graph_parse(graph, path)) < 0) {
+		p_munmap(&graph->map);
+		git__free(graph);
+		return error;
+	}
+
+	GIT_REFCOUNT_INC(graph);
+	*out = graph;
+	return 0;
+}
+
+static void commit_graph_free(git_commit_graph *graph)
+{
+	p_munmap(&graph->map);
+	git__free(graph);
+}
+
+void git_commit_graph_free(git_commit_graph *graph)
+{
+	if (graph == NULL)
+		return;
+
+	GIT_REFCOUNT_DEC(graph, commit_graph_free);
+}
+
+int git_commit_graph_find(
+	uint32_t *pos, const git_commit_graph *graph, const git_oid *oid)
+{
+	const unsigned char *fanout = (const unsigned char *)graph->fanout;
+	uint32_t lo, hi;
+
+	lo = oid->id[0] ? get_be32(fanout + (oid->id[0] - 1) * 4) : 0;
+	hi = get_be32(fanout + oid->id[0] * 4);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = git_oid__cmp(oid, git_commit_graph_oid(graph, mid));
+
+		if (!cmp) {
+			*pos = mid;
+			return 0;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+int git_commit_graph_entry_get(
+	git_commit_graph_entry *out, const git_commit_graph *graph, uint32_t pos)
+{
+	const unsigned char *data;
+	uint32_t parent1, parent2, gen_time;
+
+	if (pos >= graph->num_commits) {
+		giterr_set(GITERR_ODB, "Commit-graph position %u out of bounds", pos);
+		return -1;
+	}
+
+	data = graph->commit_data + (size_t)pos * COMMIT_GRAPH_DATA_WIDTH;
+	parent1 = get_be32(data + GIT_OID_RAWSZ);
+	parent2 = get_be32(data + GIT_OID_RAWSZ + 4);
+	gen_time = get_be32(data + GIT_OID_RAWSZ + 8);
+
+	out->tree = (const git_oid *)data;
+	out->generation = gen_time >> 2;
+	out->time = ((git_time_t)(gen_time & 0x3) << 32) |
+		get_be32(data + GIT_OID_RAWSZ + 12);
+	out->parents[0] = parent1;
+	out->parents[1] = parent2;
+	out->extra_parents = NULL;
+
+	if (parent1 == COMMIT_GRAPH_NO_PARENT) {
+		out->parent_count = 0;
+	} else if (parent2 == COMMIT_GRAPH_NO_PARENT) {
+		out->parent_count = 1;
+	} else if (!(parent2 & COMMIT_GRAPH_EXTRA_EDGES)) {
+		out->parent_count = 2;
+	} else {
+		uint32_t i = parent2 & ~COMMIT_GRAPH_EXTRA_EDGES;
+
+		if (!graph->extra_edges || i >= graph->num_extra_edges)
+			goto corrupted;
+
+		out->extra_parents = graph->extra_edges + (size_t)i * 4;
+		out->parent_count = 2;
+		while (!(get_be32(graph->extra_edges + (size_t)i * 4) & COMMIT_GRAPH_LAST_EDGE)) {
+			if (++i >= graph->num_extra_edges)
+				goto corrupted;
+			out->parent_count++;
+		}
+	}
+
+	return 0;
+
+corrupted:
+	giterr_set(GITERR_ODB, "Commit-graph extra edges are corrupted");
+	return -1;
+}
+
+int git_commit_graph_entry_parent(
+	uint32_t *pos,
+	const git_commit_graph *graph,
+	const git_commit_graph_entry *entry,
+	size_t n)
+{
+	if (n >= entry->parent_count) {
+		giterr_set(GITERR_INVALID, "Parent %u does not exist", (unsigned int)n);
+		return GIT_ENOTFOUND;
+	}
+
+	if (n == 0)
+		*pos = entry->parents[0];
+	else if (!entry->extra_parents)
+		*pos = entry->parents[1];
+	else
+		*pos = get_be32(entry->extra_parents + (n - 1) * 4) & ~COMMIT_GRAPH_LAST_EDGE;
+
+	if (*pos >= graph->num_commits) {
+		giterr_set(GITERR_ODB, "Commit-graph parent position out of bounds");
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_repository__commit_graph(git_commit_graph **out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_commit_graph *graph = NULL, *old = NULL;
+	int error, updated;
+
+	*out = NULL;
+
+	if (git_buf_joinpath(&path, repo->path_repository, GIT_OBJECTS_DIR GIT_COMMIT_GRAPH_FILE) < 0)
+		return -1;
+
+	if (git_mutex_lock(&repo->commit_graph_lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock commit-graph mutex");
+		git_buf_free(&path);
+		return -1;
+	}
+
+	updated = git_futils_filestamp_check(&repo->commit_graph_stamp, path.ptr);
+
+	if (updated == GIT_ENOTFOUND) {
+		/* The file has been removed */
+		giterr_clear();
+		old = repo->_commit_graph;
+		repo->_commit_graph = NULL;
+		git_futils_filestamp_set(&repo->commit_graph_stamp, NULL);
+	} else if (updated < 0) {
+		error = updated;
+		goto done;
+	} else if (updated > 0) {
+		if (git_commit_graph_open(&graph, path.ptr) < 0) {
+			/* An invalid commit-graph is ignored */
+			giterr_clear();
+			graph = NULL;
+		}
+
+		old = repo->_commit_graph;
+		repo->_commit_graph = graph;
+	}
+
+	if ((*out = repo->_commit_graph) != NULL)
+		GIT_REFCOUNT_INC(*out);
+	error = 0;
+
+done:
+	git_mutex_unlock(&repo->commit_graph_lock);
+	git_commit_graph_free(old);
+	git_buf_free(&path);
+	return error;
+}
+
+/*
+ * Writing a commit-graph file
+ */
+
+typedef struct {
+	git_commit_list_node **commits;
+	size_t count;
+} commit_graph_writer;
+
+static int commit_node_cmp(const void *a, const void *b)
+{
+	const git_commit_list_node *x = *(const git_commit_list_node **)a;
+	const git_commit_list_node *y = *(const git_commit_list_node **)b;
+
+	return git_oid__cmp(&x->oid, &y->oid);
+}
+
+static uint32_t commit_position(
+	const commit_graph_writer *w, const git_commit_list_node *commit)
+{
+	size_t lo = 0, hi = w->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = git_oid__cmp(&commit->oid, &w->commits[mid]->oid);
+
+		if (!cmp)
+			return (uint32_t)mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	/* All parents of the commits are in the writer */
+	assert(0);
+	return COMMIT_GRAPH_NO_PARENT;
+}
+
+static int push_reference_tips(git_revwalk *walk, git_repository *repo)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	git_object *obj;
+	int error;
+
+	if ((error = git_reference_iterator_new(&iter, repo)) < 0)
+		return error;
+
+	while ((error = git_reference_next(&ref, iter)) == 0) {
+		/* References that don't point to commits are skipped */
+		if (git_reference_peel(&obj, ref, GIT_OBJ_COMMIT) == 0) {
+			error = git_revwalk_push(walk, git_object_id(obj));
+			git_object_free(obj);
+		} else {
+			giterr_clear();
+		}
+
+		git_reference_free(ref);
+		if (error < 0)
+			break;
+	}
+
+	git_reference_iterator_free(iter);
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	/* A detached HEAD is not one of the references */
+	if (!error && git_revwalk_push_head(walk) < 0)
+		giterr_clear();
+
+	return error;
+}
+
+static int compute_generations(commit_graph_writer *w)
+{
+	git_array_t(git_commit_list_node *) stack = GIT_ARRAY_INIT;
+	size_t i;
+	unsigned short j;
+
+	/*
+	 * Generation numbers read from an existing commit-graph are kept,
+	 * the others are computed in post-order with an explicit stack,
+	 * since histories can be far deeper than the C stack.
+	 */
+	for (i = 0; i < w->count; i++) {
+		git_commit_list_node **node;
+
+		if (w->commits[i]->generation)
+			continue;
+
+		if ((node = git_array_alloc(stack)) == NULL)
+			goto on_oom;
+		*node = w->commits[i];
+
+		while (git_array_size(stack)) {
+			git_commit_list_node *commit = *git_array_last(stack);
+			uint32_t generation = 0;
+			int pending = 0;
+
+			if (commit->generation) {
+				git_array_pop(stack);
+				continue;
+			}
+
+			for (j = 0; j < commit->out_degree; j++) {
+				git_commit_list_node *parent = commit->parents[j];
+
+				if (!parent->generation) {
+					if ((node = git_array_alloc(stack)) == NULL)
+						goto on_oom;
+					*node = parent;
+					pending = 1;
+				} else if (parent->generation > generation) {
+					generation = parent->generation;
+				}
+			}
+
+			if (pending)
+				continue;
+
+			commit->generation = generation < GIT_COMMIT_GRAPH_GENERATION_MAX ?
+				generation + 1 : GIT_COMMIT_GRAPH_GENERATION_MAX;
+			git_array_pop(stack);
+		}
+	}
+
+	git_array_clear(stack);
+	return 0;
+
+on_oom:
+	git_array_clear(stack);
+	giterr_set_oom();
+	return -1;
+}
+
+static int read_tree_oid(git_oid *out, git_odb *odb, git_commit_graph *graph,
+	const git_commit_list_node *commit)
+{
+	git_odb_object *obj;
+	const char *data;
+	uint32_t pos;
+	int error;
+
+	if (graph && !git_commit_graph_find(&pos, graph, &commit->oid)) {
+		git_commit_graph_entry entry;
+
+		if (git_commit_graph_entry_get(&entry, graph, pos) < 0)
+			return -1;
+		git_oid_cpy(out, entry.tree);
+		return 0;
+	}
+
+	if ((error = git_odb_read(&obj, odb, &commit->oid)) < 0)
+		return error;
+
+	data = (const char *)git_odb_object_data(obj);
+	if (git_odb_object_size(obj) < strlen("tree ") + GIT_OID_HEXSZ ||
+		git__prefixcmp(data, "tree ") != 0 ||
+		git_oid_fromstrn(out, data + strlen("tree "), GIT_OID_HEXSZ) < 0) {
+		giterr_set(GITERR_OBJECT, "Failed to parse tree of commit");
+		error = -1;
+	}
+
+	git_odb_object_free(obj);
+	return error;
+}
+
+static int write_chunk_lookup(git_filebuf *file, uint32_t id, uint64_t offset)
+{
+	unsigned char entry[COMMIT_GRAPH_CHUNK_LOOKUP_WIDTH];
+
+	put_be32(entry, id);
+	put_be32(entry + 4, (uint32_t)(offset >> 32));
+	put_be32(entry + 8, (uint32_t)offset);
+
+	return git_filebuf_write(file, entry, sizeof(entry));
+}
+
+static int write_commit_graph(
+	git_filebuf *file,
+	commit_graph_writer *w,
+	git_odb *odb,
+	git_commit_graph *old_graph)
+{
+	unsigned char header[COMMIT_GRAPH_HEADER_SIZE], buf[COMMIT_GRAPH_DATA_WIDTH];
+	uint32_t num_extra_edges = 0, fanout[256];
+	uint64_t offset;
+	size_t i, num_chunks;
+	git_oid tree, checksum;
+	unsigned short j;
+
+	memset(fanout, 0, sizeof(fanout));
+	for (i = 0; i < w->count; i++) {
+		fanout[w->commits[i]->oid.id[0]]++;
+		if (w->commits[i]->out_degree > 2)
+			num_extra_edges += w->commits[i]->out_degree - 1;
+	}
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+
+	num_chunks = num_extra_edges ? 4 : 3;
+
+	put_be32(header, COMMIT_GRAPH_SIGNATURE);
+	header[4] = COMMIT_GRAPH_VERSION;
+	header[5] = COMMIT_GRAPH_HASH_VERSION;
+	header[6] = (unsigned char)num_chunks;
+	header[7] = 0;
+	if (git_filebuf_write(file, header, sizeof(header)) < 0)
+		return -1;
+
+	offset = COMMIT_GRAPH_HEADER_SIZE + (num_chunks + 1) * COMMIT_GRAPH_CHUNK_LOOKUP_WIDTH;
+	if (write_chunk_lookup(file, COMMIT_GRAPH_CHUNK_OIDF, offset) < 0)
+		return -1;
+	offset += 256 * 4;
+	if (write_chunk_lookup(file, COMMIT_GRAPH_CHUNK_OIDL, offset) < 0)
+		return -1;
+	offset += (uint64_t)w->count * GIT_OID_RAWSZ;
+	if (write_chunk_lookup(file, COMMIT_GRAPH_CHUNK_CDAT, offset) < 0)
+		return -1;
+	offset += (uint64_t)w->count * COMMIT_GRAPH_DATA_WIDTH;
+	if (num_extra_edges) {
+		if (write_chunk_lookup(file, COMMIT_GRAPH_CHUNK_EDGE, offset) < 0)
+			return -1;
+		offset += (uint64_t)num_extra_edges * 4;
+	}
+	if (write_chunk_lookup(file, 0, offset) < 0)
+		return -1;
+
+	for (i = 0; i < 256; i++) {
+		put_be32(buf, fanout[i]);
+		if (git_filebuf_write(file, buf, 4) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < w->count; i++) {
+		if (git_filebuf_write(file, w->commits[i]->oid.id, GIT_OID_RAWSZ) < 0)
+			return -1;
+	}
+
+	num_extra_edges = 0;
+	for (i = 0; i < w->count; i++) {
+		git_commit_list_node *commit = w->commits[i];
+		uint32_t parent1 = COMMIT_GRAPH_NO_PARENT, parent2 = COMMIT_GRAPH_NO_PARENT;
+		uint64_t time = commit->time;
+
+		if (read_tree_oid(&tree, odb, old_graph, commit) < 0)
+			return -1;
+
+		if (commit->out_degree > 0)
+			parent1 = commit_position(w, commit->parents[0]);
+		if (commit->out_degree == 2)
+			parent2 = commit_position(w, commit->parents[1]);
+		else if (commit->out_degree > 2) {
+			parent2 = COMMIT_GRAPH_EXTRA_EDGES | num_extra_edges;
+			num_extra_edges += commit->out_degree - 1;
+		}
+
+		memcpy(buf, tree.id, GIT_OID_RAWSZ);
+		put_be32(buf + GIT_OID_RAWSZ, parent1);
+		put_be32(buf + GIT_OID_RAWSZ + 4, parent2);
+		put_be32(buf + GIT_OID_RAWSZ + 8,
+			(commit->generation << 2) | (uint32_t)((time >> 32) & 0x3));
+		put_be32(buf + GIT_OID_RAWSZ + 12, (uint32_t)time);
+
+		if (git_filebuf_write(file, buf, COMMIT_GRAPH_DATA_WIDTH) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < w->count; i++) {
+		git_commit_list_node *commit = w->commits[i];
+
+		if (commit->out_degree <= 2)
+			continue;
+
+		for (j = 1; j < commit->out_degree; j++) {
+			uint32_t pos = commit_position(w, commit->parents[j]);
+
+			if (j == commit->out_degree - 1)
+				pos |= COMMIT_GRAPH_LAST_EDGE;
+			put_be32(buf, pos);
+			if (git_filebuf_write(file, buf, 4) < 0)
+				return -1;
+		}
+	}
+
+	if (git_filebuf_hash(&checksum, file) < 0)
+		return -1;
+
+	return git_filebuf_write(file, checksum.id, GIT_OID_RAWSZ);
+}
+
+int git_graph_write_commit_graph(git_repository *repo)
+{
+	git_revwalk *walk = NULL;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_commit_list_node *commit;
+	commit_graph_writer w = {0};
+	git_oid oid;
+	uint32_t pos;
+	int error;
+
+	assert(repo);
+
+	if ((error = git_revwalk_new(&walk, repo)) < 0)
+		return error;
+
+	/* Walk all commits reachable from the references */
+	if ((error = push_reference_tips(walk, repo)) < 0)
+		goto cleanup;
+
+	while ((error = git_revwalk_next(&oid, walk)) == 0)
+		/* nothing */;
+
+	if (error != GIT_ITEROVER)
+		goto cleanup;
+
+	/* Keep the commits in an existing commit-graph */
+	if (walk->commit_graph) {
+		for (pos = 0; pos < walk->commit_graph->num_commits; pos++) {
+			commit = git_revwalk__commit_lookup(
+				walk, git_commit_graph_oid(walk->commit_graph, pos));
+			if (commit == NULL || (error = git_commit_list_parse(walk, commit)) < 0)
+				goto cleanup;
+		}
+	}
+
+	w.commits = git__malloc((kh_size(walk->commits) + 1) * sizeof(git_commit_list_node *));
+	if (w.commits == NULL) {
+		error = -1;
+		goto cleanup;
+	}
+
+	kh_foreach_value(walk->commits, commit, {
+		if (!commit->parsed && (error = git_commit_list_parse(walk, commit)) < 0)
+			goto cleanup;
+		w.commits[w.count++] = commit;
+	});
+
+	qsort(w.commits, w.count, sizeof(git_commit_list_node *), commit_node_cmp);
+
+	if ((error = compute_generations(&w)) < 0)
+		goto cleanup;
+
+	if ((error = git_buf_joinpath(&path,
+			repo->path_repository, GIT_OBJECTS_DIR "info")) < 0 ||
+		(error = git_futils_mkdir(path.ptr, NULL, GIT_OBJECT_DIR_MODE, GIT_MKDIR_PATH)) < 0 ||
+		(error = git_buf_joinpath(&path,
+			repo->path_repository, GIT_OBJECTS_DIR GIT_COMMIT_GRAPH_FILE)) < 0)
+		goto cleanup;
+
+	if ((error = git_filebuf_open(&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS, 0444)) < 0)
+		goto cleanup;
+
+	if ((error = write_commit_graph(&file, &w, walk->odb, walk->commit_graph)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto cleanup;
+	}
+
+	error = git_filebuf_commit(&file);
+
+cleanup:
+	git__free(w.commits);
+	git_buf_free(&path);
+	git_revwalk_free(walk);
+	return error;
+}
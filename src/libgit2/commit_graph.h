@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_graph_h__
+#define INCLUDE_commit_graph_h__
+
+#include "common.h"
+#include "map.h"
+#include "git2/oid.h"
+
+#define GIT_COMMIT_GRAPH_FILE "info/commit-graph"
+
+#define GIT_COMMIT_GRAPH_GENERATION_MAX 0x3FFFFFFF
+
+/*
+ * A commit-graph file in the format written by `git commit-graph`.
+ *
+ * The file stores, for each commit sorted by oid, the root tree, the
+ * positions of the parents in the file, the commit time and the
+ * generation number of the commit. The generation number of a root
+ * commit is 1, and of any other commit one more than the largest
+ * generation number of its parents. A commit can only be an ancestor
+ * of commits with a larger generation number.
+ */
+typedef struct git_commit_graph {
+	git_refcount rc;
+	git_map map;
+
+	uint32_t num_commits;
+	const uint32_t *fanout;
+	const unsigned char *oids;
+	const unsigned char *commit_data;
+	const unsigned char *extra_edges;
+	uint32_t num_extra_edges;
+} git_commit_graph;
+
+typedef struct {
+	const git_oid *tree;
+	git_time_t time;
+	uint32_t generation;
+	size_t parent_count;
+	/* Positions of the first two parents */
+	uint32_t parents[2];
+	/* Positions of the remaining parents of an octopus merge */
+	const unsigned char *extra_parents;
+} git_commit_graph_entry;
+
+extern int git_commit_graph_open(git_commit_graph **out, const char *path);
+extern void git_commit_graph_free(git_commit_graph *graph);
+
+/* Find the position of a commit, returns GIT_ENOTFOUND if not in the graph */
+extern int git_commit_graph_find(
+	uint32_t *pos, const git_commit_graph *graph, const git_oid *oid);
+
+GIT_INLINE(const git_oid *) git_commit_graph_oid(
+	const git_commit_graph *graph, uint32_t pos)
+{
+	return (const git_oid *)(graph->oids + (size_t)pos * GIT_OID_RAWSZ);
+}
+
+extern int git_commit_graph_entry_get(
+	git_commit_graph_entry *out, const git_commit_graph *graph, uint32_t pos);
+
+/* Position of the n:th parent of an entry */
+extern int git_commit_graph_entry_parent(
+	uint32_t *pos,
+	const git_commit_graph *graph,
+	const git_commit_graph_entry *entry,
+	size_t n);
+
+/*
+ * Get the commit-graph of a repository, or NULL if the repository has
+ * no commit-graph file. The file is reloaded if it has changed on
+ * disk. The returned graph must be freed with git_commit_graph_free.
+ */
+extern int git_repository__commit_graph(
+	git_commit_graph **out, git_repository *repo);
+
+#endif
@@ -10,6 +10,7 @@
 #include "revwalk.h"
 #include "pool.h"
 #include "odb.h"
+#include "commit_graph.h"
 
 int git_commit_list_time_cmp(void *a, void *b)
 {
@@ -19,6 +20,25 @@ int git_commit_list_time_cmp(void *a, void *b)
 	return (commit_a->time < commit_b->time);
 }
 
+/*
+ * Order commits by generation number, largest first, and by time
+ * for commits of the same generation. A generation number of 0 means
+ * the commit is not in the commit-graph and could be of any
+ * generation, so it sorts before all known generations.
+ */
+int git_commit_list_generation_cmp(void *a, void *b)
+{
+	git_commit_list_node *commit_a = (git_commit_list_node *)a;
+	git_commit_list_node *commit_b = (git_commit_list_node *)b;
+	uint32_t gen_a = commit_a->generation ? commit_a->generation : UINT32_MAX;
+	uint32_t gen_b = commit_b->generation ? commit_b->generation : UINT32_MAX;
+
+	if (gen_a != gen_b)
+		return (gen_a < gen_b);
+
+	return (commit_a->time < commit_b->time);
+}
+
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p)
 {
 	git_commit_list *new_list = git__malloc(sizeof(git_commit_list));
@@ -174,14 +194,54 @@ static int commit_quick_parse(
 	return 0;
 }
 
+static int commit_graph_parse(
+	git_revwalk *walk,
+	git_commit_list_node *commit,
+	uint32_t pos)
+{
+	git_commit_graph *graph = walk->commit_graph;
+	git_commit_graph_entry entry;
+	size_t i;
+
+	if (git_commit_graph_entry_get(&entry, graph, pos) < 0)
+		return -1;
+
+	commit->parents = alloc_parents(walk, commit, entry.parent_count);
+	GITERR_CHECK_ALLOC(commit->parents);
+
+	for (i = 0; i < entry.parent_count; ++i) {
+		uint32_t parent_pos;
+
+		if (git_commit_graph_entry_parent(&parent_pos, graph, &entry, i) < 0)
+			return -1;
+
+		commit->parents[i] = git_revwalk__commit_lookup(
+			walk, git_commit_graph_oid(graph, parent_pos));
+		if (commit->parents[i] == NULL)
+			return -1;
+	}
+
+	commit->out_degree = (unsigned short)entry.parent_count;
+	commit->time = (uint32_t)entry.time;
+	commit->generation = entry.generation;
+	commit->parsed = 1;
+	return 0;
+}
+
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit)
 {
 	git_odb_object *obj;
+	uint32_t pos;
 	int error;
 
 	if (commit->parsed)
 		return 0;
 
+	/* Read the parents from the commit-graph instead of the object */
+	if (walk->commit_graph &&
+		!git_commit_graph_find(&pos, walk->commit_graph, &commit->oid))
+		return commit_graph_parse(walk, commit, pos);
+
 	if ((error = git_odb_read(&obj, walk->odb, &commit->oid)) < 0)
 		return error;
 
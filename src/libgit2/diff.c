@@ -1214,17 +1214,38 @@ int git_diff_index_to_workdir(
 	const git_diff_options *opts)
 {
 	int error = 0;
+	git_untracked_cache *untracked;
+	git_index_preload *preload = NULL;
 
 	assert(diff && repo);
 
 	if (!index && (error = diff_load_index(&index, repo)) < 0)
 		return error;
 
-	DIFF_FROM_ITERATORS(
-		git_iterator_for_index(&a, index, 0, pfx, pfx),
-		git_iterator_for_workdir(
-			&b, repo, GIT_ITERATOR_DONT_AUTOEXPAND, pfx, pfx)
-	);
+	untracked = (index->untracked && index->untracked->active) ?
+		index->untracked : NULL;
+
+	GITERR_CHECK_VERSION(opts, GIT_DIFF_OPTIONS_VERSION, "git_diff_options");
+
+	/* lstat the indexed files on several threads before the scan */
+	if ((error = git_index__preload(
+			&preload, repo, index, opts ? &opts->pathspec : NULL)) < 0)
+		return error;
+
+	if (untracked || preload)
+		DIFF_FROM_ITERATORS(
+			git_iterator_for_index(&a, index, 0, pfx, pfx),
+			git_iterator_for_workdir_cached(&b, repo, untracked, preload,
+				GIT_ITERATOR_DONT_AUTOEXPAND, pfx, pfx)
+		);
+	else
+		DIFF_FROM_ITERATORS(
+			git_iterator_for_index(&a, index, 0, pfx, pfx),
+			git_iterator_for_workdir(
+				&b, repo, GIT_ITERATOR_DONT_AUTOEXPAND, pfx, pfx)
+		);
+
+	git_index__preload_free(preload);
 
 	return error;
 }
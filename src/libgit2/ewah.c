@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+#define RLW_RUNNING_BITS 32
+#define RLW_LITERAL_BITS 31
+#define RLW_LARGEST_RUNNING_COUNT (((uint64_t)1 << RLW_RUNNING_BITS) - 1)
+#define RLW_LARGEST_LITERAL_COUNT (((uint64_t)1 << RLW_LITERAL_BITS) - 1)
+
+#define rlw_run_bit(w) ((w) & 1)
+#define rlw_running_len(w) (((w) >> 1) & RLW_LARGEST_RUNNING_COUNT)
+#define rlw_literal_words(w) ((w) >> (1 + RLW_RUNNING_BITS))
+
+static uint32_t get_be32(const char *buffer)
+{
+	const unsigned char *p = (const unsigned char *)buffer;
+
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t get_be64(const char *buffer)
+{
+	return ((uint64_t)get_be32(buffer) << 32) | get_be32(buffer + 4);
+}
+
+static int put_be32(git_buf *out, uint32_t value)
+{
+	unsigned char bytes[4];
+
+	bytes[0] = (unsigned char)(value >> 24);
+	bytes[1] = (unsigned char)(value >> 16);
+	bytes[2] = (unsigned char)(value >> 8);
+	bytes[3] = (unsigned char)value;
+
+	return git_buf_put(out, (const char *)bytes, sizeof(bytes));
+}
+
+static int put_be64(git_buf *out, uint64_t value)
+{
+	if (put_be32(out, (uint32_t)(value >> 32)) < 0)
+		return -1;
+	return put_be32(out, (uint32_t)value);
+}
+
+/* combine one uncompressed word into the bits, failing past `nbits` */
+static int ewah_apply_word(
+	git_bitvec *bits, size_t nbits, size_t word_pos, uint64_t word, bool xor)
+{
+	uint64_t *dst;
+
+	if (word == 0)
+		return 0;
+
+	if (word_pos * 64 + 64 > nbits) {
+		size_t valid = nbits > word_pos * 64 ? nbits - word_pos * 64 : 0;
+
+		if (valid == 0 || (word >> valid) != 0)
+			return -1;
+	}
+
+	dst = GIT_BITVEC_WORD(bits, word_pos * 64);
+
+	if (xor)
+		*dst ^= word;
+	else
+		*dst |= word;
+
+	return 0;
+}
+
+static int ewah_apply(
+	git_bitvec *bits,
+	size_t nbits,
+	const char *buffer,
+	size_t buffer_size,
+	bool xor)
+{
+	const char *words;
+	size_t word_count, word_pos = 0, i, j;
+
+	if (buffer_size < 12)
+		goto corrupt;
+
+	/* git rounds up the number of bits, only the bits set are checked */
+	word_count = get_be32(buffer + 4);
+
+	if (word_count > (buffer_size - 12) / 8 ||
+		buffer_size < 12 + word_count * 8)
+		goto corrupt;
+
+	words = buffer + 8;
+
+	for (i = 0; i < word_count; ) {
+		uint64_t rlw = get_be64(words + i * 8);
+		uint64_t running = rlw_running_len(rlw);
+		uint64_t literals = rlw_literal_words(rlw);
+
+		++i;
+
+		if (rlw_run_bit(rlw)) {
+			for (j = 0; j < running; ++j)
+				if (ewah_apply_word(bits, nbits,
+						word_pos + j, ~(uint64_t)0, xor) < 0)
+					goto corrupt;
+		}
+		word_pos += (size_t)running;
+
+		if (literals > word_count - i)
+			goto corrupt;
+
+		for (j = 0; j < literals; ++j, ++i, ++word_pos)
+			if (ewah_apply_word(bits, nbits,
+					word_pos, get_be64(words + i * 8), xor) < 0)
+				goto corrupt;
+	}
+
+	/* the position of the last marker word is only used to append */
+	return (int)(12 + word_count * 8);
+
+corrupt:
+	giterr_set(GITERR_INDEX, "Corrupted EWAH bitmap");
+	return -1;
+}
+
+int git_ewah_read(
+	git_bitvec *bits, size_t nbits, const char *buffer, size_t buffer_size)
+{
+	return ewah_apply(bits, nbits, buffer, buffer_size, false);
+}
+
+int git_ewah_read_xor(
+	git_bitvec *bits, size_t nbits, const char *buffer, size_t buffer_size)
+{
+	return ewah_apply(bits, nbits, buffer, buffer_size, true);
+}
+
+int git_ewah_size(const char *buffer, size_t buffer_size)
+{
+	size_t word_count;
+
+	if (buffer_size < 12 ||
+		(word_count = get_be32(buffer + 4)) > (buffer_size - 12) / 8) {
+		giterr_set(GITERR_INDEX, "Corrupted EWAH bitmap");
+		return -1;
+	}
+
+	return (int)(12 + word_count * 8);
+}
+
+/* one word of the bits, without the bits past `nbits` */
+static uint64_t ewah_get_word(git_bitvec *bits, size_t nbits, size_t word_pos)
+{
+	uint64_t word = *GIT_BITVEC_WORD(bits, word_pos * 64);
+	size_t valid = nbits - word_pos * 64;
+
+	return valid < 64 ? word & (((uint64_t)1 << valid) - 1) : word;
+}
+
+int git_ewah_write(git_buf *out, git_bitvec *bits, size_t nbits)
+{
+	git_buf words = GIT_BUF_INIT;
+	size_t bit_size = 0, nwords, w, rlw_at = 0, last_rlw = 0;
+	uint64_t running = 0, literals = 0;
+	int error = -1;
+
+	for (w = (nbits + 63) / 64; w > 0 && !bit_size; --w) {
+		uint64_t word = ewah_get_word(bits, nbits, w - 1);
+
+		for (; word; word >>= 1)
+			++bit_size;
+		if (bit_size)
+			bit_size += (w - 1) * 64;
+	}
+
+	nwords = (bit_size + 63) / 64;
+
+	/* the first marker word, filled in when the next one starts */
+	if (put_be64(&words, 0) < 0)
+		goto done;
+
+	for (w = 0; w < nwords; ++w) {
+		uint64_t word = ewah_get_word(bits, bit_size, w);
+
+		if (word == 0 && literals == 0 && running < RLW_LARGEST_RUNNING_COUNT) {
+			++running;
+			continue;
+		}
+
+		if (word == 0 || literals == RLW_LARGEST_LITERAL_COUNT) {
+			/* close this marker word and start a new one */
+			uint64_t rlw = (running << 1) | (literals << (1 + RLW_RUNNING_BITS));
+			size_t i;
+
+			for (i = 0; i < 8; ++i)
+				words.ptr[rlw_at + i] = (char)(rlw >> (56 - 8 * i));
+
+			rlw_at = words.size;
+			last_rlw = rlw_at / 8;
+			running = literals = 0;
+
+			if (put_be64(&words, 0) < 0)
+				goto done;
+
+			if (word == 0) {
+				++running;
+				continue;
+			}
+		}
+
+		if (put_be64(&words, word) < 0)
+			goto done;
+		++literals;
+	}
+
+	{
+		uint64_t rlw = (running << 1) | (literals << (1 + RLW_RUNNING_BITS));
+		size_t i;
+
+		for (i = 0; i < 8; ++i)
+			words.ptr[rlw_at + i] = (char)(rlw >> (56 - 8 * i));
+	}
+
+	if (put_be32(out, (uint32_t)bit_size) < 0 ||
+		put_be32(out, (uint32_t)(words.size / 8)) < 0 ||
+		git_buf_put(out, words.ptr, words.size) < 0 ||
+		put_be32(out, (uint32_t)last_rlw) < 0)
+		goto done;
+
+	error = 0;
+
+done:
+	git_buf_free(&words);
+	return error;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+#include "bitvec.h"
+#include "buffer.h"
+
+/*
+ * EWAH compressed bitmaps, in the serialization git uses in the index
+ * and in pack bitmaps: the number of bits, the number of 64-bit words,
+ * the words and the position of the last marker word, all big-endian.
+ *
+ * Each marker word holds a run of clean words (bit 0 tells whether they
+ * are all zeros or all ones, bits 1-32 their count) followed by up to
+ * 2^31 - 1 literal words (bits 33-63).
+ */
+
+/*
+ * Read a bitmap into `bits`, or-ed with the bits already set; `bits`
+ * must have room for `nbits` bits and a bit set past `nbits` is an error. Returns the number of bytes read,
+ * or -1 if the bitmap is corrupted.
+ */
+extern int git_ewah_read(
+	git_bitvec *bits, size_t nbits, const char *buffer, size_t buffer_size);
+
+/* Same as `git_ewah_read`, but the bitmap is xor-ed into `bits` */
+extern int git_ewah_read_xor(
+	git_bitvec *bits, size_t nbits, const char *buffer, size_t buffer_size);
+
+/* The size in bytes of the bitmap at the start of `buffer`, or -1 */
+extern int git_ewah_size(const char *buffer, size_t buffer_size);
+
+/* Append the first `nbits` bits of `bits` to `out` */
+extern int git_ewah_write(git_buf *out, git_bitvec *bits, size_t nbits);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "fsmonitor.h"
+#include "buffer.h"
+#include "repository.h"
+
+#include <stdio.h>
+
+#define FSMONITOR_HOOK_VERSION "2"
+
+#ifdef GIT_WIN32
+# define fsmonitor_popen _popen
+# define fsmonitor_pclose _pclose
+#else
+# define fsmonitor_popen popen
+# define fsmonitor_pclose pclose
+#endif
+
+/* quote an argument for the shell that runs the hook */
+static int fsmonitor_quote(git_buf *cmd, const char *arg)
+{
+#ifdef GIT_WIN32
+	git_buf_putc(cmd, '"');
+	git_buf_puts(cmd, arg);
+	git_buf_putc(cmd, '"');
+#else
+	git_buf_putc(cmd, '\'');
+	for (; *arg; ++arg) {
+		if (*arg == '\'')
+			git_buf_puts(cmd, "'\\''");
+		else
+			git_buf_putc(cmd, *arg);
+	}
+	git_buf_putc(cmd, '\'');
+#endif
+
+	return git_buf_oom(cmd) ? -1 : 0;
+}
+
+static int fsmonitor_run(
+	git_buf *out, const char *workdir, const char *hook, const char *since)
+{
+	git_buf cmd = GIT_BUF_INIT;
+	char buffer[4096];
+	size_t nread;
+	FILE *fp;
+	int status, error = 0;
+
+#ifdef GIT_WIN32
+	git_buf_puts(&cmd, "cd /d ");
+#else
+	git_buf_puts(&cmd, "cd ");
+#endif
+	if (fsmonitor_quote(&cmd, workdir) < 0 ||
+		git_buf_puts(&cmd, " && ") < 0 ||
+		fsmonitor_quote(&cmd, hook) < 0 ||
+		git_buf_puts(&cmd, " " FSMONITOR_HOOK_VERSION " ") < 0 ||
+		fsmonitor_quote(&cmd, since) < 0) {
+		git_buf_free(&cmd);
+		return -1;
+	}
+
+	if ((fp = fsmonitor_popen(cmd.ptr, "r")) == NULL) {
+		giterr_set(GITERR_OS, "Failed to run the fsmonitor hook '%s'", hook);
+		git_buf_free(&cmd);
+		return -1;
+	}
+
+	while ((nread = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		if ((error = git_buf_put(out, buffer, nread)) < 0)
+			break;
+	}
+
+	status = fsmonitor_pclose(fp);
+	if (!error && status != 0) {
+		giterr_set(GITERR_INVALID,
+			"The fsmonitor hook '%s' failed with status %d", hook, status);
+		error = -1;
+	}
+
+	git_buf_free(&cmd);
+	return error;
+}
+
+int git_fsmonitor_query(
+	char **token,
+	git_vector *paths,
+	bool *everything,
+	git_repository *repo,
+	const char *hook,
+	const char *since)
+{
+	git_buf out = GIT_BUF_INIT;
+	const char *workdir, *scan, *end, *path;
+	int error;
+
+	assert(token && paths && everything && repo && hook);
+
+	*token = NULL;
+	*everything = false;
+
+	if ((workdir = git_repository_workdir(repo)) == NULL)
+		return GIT_EBAREREPO;
+
+	if ((error = fsmonitor_run(&out, workdir, hook, since ? since : "")) < 0)
+		goto done;
+
+	scan = out.ptr;
+	end = out.ptr + out.size;
+
+	path = scan;
+	scan = memchr(scan, '\0', end - scan);
+	if (scan == NULL || scan == path) {
+		giterr_set(GITERR_INVALID,
+			"The fsmonitor hook '%s' did not report a token", hook);
+		error = -1;
+		goto done;
+	}
+
+	if ((*token = git__strdup(path)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	for (++scan; scan < end; scan = path + strlen(path) + 1) {
+		char *copy;
+
+		path = scan;
+
+		if (!strcmp(path, "/")) {
+			*everything = true;
+			continue;
+		}
+
+		/* changes inside the repository directory are not interesting */
+		if (!*path || !strcmp(path, ".git") || !git__prefixcmp(path, ".git/"))
+			continue;
+
+		if ((copy = git__strdup(path)) == NULL ||
+			(error = git_vector_insert(paths, copy)) < 0) {
+			git__free(copy);
+			error = -1;
+			goto done;
+		}
+	}
+
+done:
+	if (error < 0) {
+		git__free(*token);
+		*token = NULL;
+		git_vector_free_deep(paths);
+	}
+
+	git_buf_free(&out);
+	return error;
+}
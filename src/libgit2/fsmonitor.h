@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_fsmonitor_h__
+#define INCLUDE_fsmonitor_h__
+
+#include "common.h"
+#include "vector.h"
+
+/*
+ * Ask the core.fsmonitor hook which paths changed since `since`.
+ *
+ * The hook is run in the working directory as `hook 2 <token>`, with an
+ * empty token on the first query. It must print a new token followed by
+ * the changed paths, relative to the working directory, all terminated
+ * by a NUL. Reporting the path "/" means that anything may have changed.
+ *
+ * On success `token` is set to the new token, `paths` is filled with
+ * allocated paths and `everything` is set if "/" was reported. Fails if
+ * the hook could not be run or did not exit with zero.
+ */
+extern int git_fsmonitor_query(
+	char **token,
+	git_vector *paths,
+	bool *everything,
+	git_repository *repo,
+	const char *hook,
+	const char *since);
+
+#endif
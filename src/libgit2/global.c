@@ -158,7 +158,11 @@ int init_error = 0;
 
 static void cb__free_status(void *st)
 {
-	git__free(st);
+	git_global_st *state = st;
+
+	/* The last error message of the exiting thread */
+	git__free(state->error_t.message);
+	git__free(state);
 }
 
 static void init_once(void)
@@ -192,7 +196,8 @@ void git_threads_shutdown(void)
 
 	void *ptr = pthread_getspecific(_tls_key);
 	pthread_setspecific(_tls_key, NULL);
-	git__free(ptr);
+	if (ptr)
+		cb__free_status(ptr);
 
 	pthread_key_delete(_tls_key);
 	git_mutex_free(&git__mwindow_mutex);
@@ -8,6 +8,9 @@
 
 #include "revwalk.h"
 #include "merge.h"
+#include "odb.h"
+#include "pack-bitmap.h"
+#include "repository.h"
 #include "git2/graph.h"
 
 static int interesting(git_pqueue *list, git_commit_list *roots)
@@ -42,7 +45,7 @@ static int mark_parents(git_revwalk *walk, git_commit_list_node *one,
 		return 0;
 	}
 
-	if (git_pqueue_init(&list, 2, git_commit_list_time_cmp) < 0)
+	if (git_pqueue_init(&list, 2, git_commit_list_generation_cmp) < 0)
 		return -1;
 
 	if (git_commit_list_parse(walk, one) < 0)
@@ -126,9 +129,9 @@ static int ahead_behind(git_commit_list_node *one, git_commit_list_node *two,
 			(commit->flags & (PARENT1 | PARENT2)) == (PARENT1 | PARENT2))
 			continue;
 		else if (commit->flags & PARENT1)
-			(*behind)++;
-		else if (commit->flags & PARENT2)
 			(*ahead)++;
+		else if (commit->flags & PARENT2)
+			(*behind)++;
 
 		for (i = 0; i < commit->out_degree; i++) {
 			git_commit_list_node *p = commit->parents[i];
@@ -146,11 +149,65 @@ on_error:
 	return -1;
 }
 
+/*
+ * Count the commits with the reachability bitmaps of the repository.
+ * Returns GIT_ENOTFOUND when there are no bitmaps, or when one of the
+ * objects is not a commit, to let the walk below report it.
+ */
+static int ahead_behind_bitmap(size_t *ahead, size_t *behind,
+	git_repository *repo, const git_oid *local, const git_oid *upstream)
+{
+	git_pack_bitmap *bitmap;
+	git_pack_bitmap_set set_l, set_u;
+	git_otype type_l, type_u;
+	size_t size;
+	git_odb *odb;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0 ||
+		(error = git_odb__pack_bitmap(&bitmap, odb)) < 0)
+		return error;
+
+	if (git_odb_read_header(&size, &type_l, odb, local) < 0 ||
+		git_odb_read_header(&size, &type_u, odb, upstream) < 0 ||
+		type_l != GIT_OBJ_COMMIT || type_u != GIT_OBJ_COMMIT) {
+		git_pack_bitmap_free(bitmap);
+		return GIT_ENOTFOUND;
+	}
+
+	if ((error = git_pack_bitmap_set_init(&set_l, bitmap)) < 0)
+		goto done_bitmap;
+	if ((error = git_pack_bitmap_set_init(&set_u, bitmap)) < 0)
+		goto done_local;
+
+	if ((error = git_pack_bitmap_walk(&set_l, repo, local, 1, NULL,
+			GIT_PACK_BITMAP_COMMITS_ONLY)) < 0 ||
+		(error = git_pack_bitmap_walk(&set_u, repo, upstream, 1, NULL,
+			GIT_PACK_BITMAP_COMMITS_ONLY)) < 0)
+		goto done;
+
+	*ahead = git_pack_bitmap_set_count(&set_l, &set_u, GIT_OBJ_COMMIT);
+	*behind = git_pack_bitmap_set_count(&set_u, &set_l, GIT_OBJ_COMMIT);
+
+done:
+	git_pack_bitmap_set_free(&set_u);
+done_local:
+	git_pack_bitmap_set_free(&set_l);
+done_bitmap:
+	git_pack_bitmap_free(bitmap);
+	return error;
+}
+
 int git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo,
 	const git_oid *local, const git_oid *upstream)
 {
 	git_revwalk *walk;
 	git_commit_list_node *commit_u, *commit_l;
+	int error;
+
+	if ((error = ahead_behind_bitmap(ahead, behind, repo, local, upstream)) != GIT_ENOTFOUND)
+		return error;
+	giterr_clear();
 
 	if (git_revwalk_new(&walk, repo) < 0)
 		return -1;
@@ -176,3 +233,81 @@ on_error:
 	git_revwalk_free(walk);
 	return -1;
 }
+
+int git_graph_descendant_of(git_repository *repo, const git_oid *commit,
+	const git_oid *ancestor)
+{
+	git_revwalk *walk;
+	git_commit_list *stack = NULL;
+	git_commit_list_node *node, *target;
+	unsigned int i;
+	int error = 0;
+
+	if (git_oid_equal(commit, ancestor))
+		return 0;
+
+	if (git_revwalk_new(&walk, repo) < 0)
+		return -1;
+
+	if ((target = git_revwalk__commit_lookup(walk, ancestor)) == NULL ||
+		(node = git_revwalk__commit_lookup(walk, commit)) == NULL ||
+		git_commit_list_parse(walk, target) < 0)
+		goto on_error;
+
+	/*
+	 * Without a generation number nothing bounds the search; the
+	 * merge base painting at least stops at the common commits.
+	 */
+	if (!target->generation) {
+		git_oid base;
+
+		git_revwalk_free(walk);
+
+		if ((error = git_merge_base(&base, repo, commit, ancestor)) == GIT_ENOTFOUND) {
+			giterr_clear();
+			return 0;
+		}
+
+		return error < 0 ? error : git_oid_equal(&base, ancestor);
+	}
+
+	if (git_commit_list_insert(node, &stack) == NULL)
+		goto on_error;
+
+	node->seen = 1;
+
+	while ((node = git_commit_list_pop(&stack)) != NULL) {
+		if (node == target) {
+			error = 1;
+			break;
+		}
+
+		if (git_commit_list_parse(walk, node) < 0)
+			goto on_error;
+
+		/* The parents of a commit have lower generation numbers */
+		if (target->generation && node->generation &&
+			node->generation <= target->generation)
+			continue;
+
+		for (i = 0; i < node->out_degree; i++) {
+			git_commit_list_node *p = node->parents[i];
+
+			if (p->seen)
+				continue;
+
+			p->seen = 1;
+			if (git_commit_list_insert(p, &stack) == NULL)
+				goto on_error;
+		}
+	}
+
+	git_commit_list_free(&stack);
+	git_revwalk_free(walk);
+	return error;
+
+on_error:
+	git_commit_list_free(&stack);
+	git_revwalk_free(walk);
+	return -1;
+}
@@ -20,6 +20,16 @@ struct git_hash_ctx {
 #define git_hash_ctx_init(ctx) git_hash_init(ctx)
 #define git_hash_ctx_cleanup(ctx)
 
+/*
+ * The SHA1_* functions are deprecated in OpenSSL 3.0 in favour of EVP,
+ * but they still use the SHA extensions of the CPU when available and
+ * let the context live on the stack like the other backends.
+ */
+#if defined(__GNUC__)
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
 GIT_INLINE(int) git_hash_init(git_hash_ctx *ctx)
 {
 	assert(ctx);
@@ -41,4 +51,8 @@ GIT_INLINE(int) git_hash_final(git_oid *out, git_hash_ctx *ctx)
 	return 0;
 }
 
+#if defined(__GNUC__)
+# pragma GCC diagnostic pop
+#endif
+
 #endif /* INCLUDE_hash_openssl_h__ */
@@ -52,6 +52,7 @@
 #include "git2/submodule.h"
 #include "git2/tag.h"
 #include "git2/threads.h"
+#include "git2/transaction.h"
 #include "git2/transport.h"
 #include "git2/tree.h"
 #include "git2/types.h"
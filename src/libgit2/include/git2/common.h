@@ -138,7 +138,18 @@ typedef enum {
 	GIT_OPT_ENABLE_CACHING,
 	GIT_OPT_GET_CACHED_MEMORY,
 	GIT_OPT_GET_TEMPLATE_PATH,
-	GIT_OPT_SET_TEMPLATE_PATH
+	GIT_OPT_SET_TEMPLATE_PATH,
+	GIT_OPT_GET_PACK_THREADS,
+	GIT_OPT_SET_PACK_THREADS,
+	GIT_OPT_GET_INDEXER_THREADS,
+	GIT_OPT_SET_INDEXER_THREADS,
+	GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT,
+	GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT,
+	GIT_OPT_GET_CACHE_OBJECT_LIMIT,
+	GIT_OPT_GET_INDEX_ADD_THREADS,
+	GIT_OPT_SET_INDEX_ADD_THREADS,
+	GIT_OPT_GET_INDEX_PRELOAD_THREADS,
+	GIT_OPT_SET_INDEX_PRELOAD_THREADS
 } git_libgit2_opt_t;
 
 /**
@@ -196,8 +207,9 @@ typedef enum {
  *		> Set the maximum total data size that will be cached in memory
  *		> across all repositories before libgit2 starts evicting objects
  *		> from the cache.  This is a soft limit, in that the library might
- *		> briefly exceed it, but will start aggressively evicting objects
- *		> from cache when that happens.  The default cache size is 256Mb.
+ *		> briefly exceed it, but will evict the least recently used
+ *		> objects of a cache on the next attempt to store in it.  The
+ *		> default cache size is 256Mb.
  *
  *	* opts(GIT_OPT_ENABLE_CACHING, int enabled)
  *
@@ -224,6 +236,79 @@ typedef enum {
  *		>
  *		> - `path` directory of template.
  *
+ *	* opts(GIT_OPT_GET_PACK_THREADS, unsigned int *)
+ *
+ *		> Get the default number of threads used by a packbuilder to
+ *		> search for deltas.
+ *
+ *	* opts(GIT_OPT_SET_PACK_THREADS, unsigned int)
+ *
+ *		> Set the default number of threads used by a packbuilder to
+ *		> search for deltas.  The `pack.threads` config of a repository
+ *		> takes precedence.  Zero means one thread per online CPU.  The
+ *		> default is 1, and the value has no effect unless libgit2 was
+ *		> built with thread support.
+ *
+ *	* opts(GIT_OPT_GET_INDEXER_THREADS, unsigned int *)
+ *
+ *		> Get the number of threads used by an indexer to resolve
+ *		> deltas.
+ *
+ *	* opts(GIT_OPT_SET_INDEXER_THREADS, unsigned int)
+ *
+ *		> Set the number of threads used by an indexer to resolve
+ *		> deltas.  Zero means one thread per online CPU, which is the
+ *		> default.  The value has no effect unless libgit2 was built
+ *		> with thread support.
+ *
+ *	* opts(GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT, size_t *)
+ *
+ *		> Get the default memory limit of the delta base cache of a
+ *		> packfile.
+ *
+ *	* opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, size_t)
+ *
+ *		> Set the default memory limit of the delta base cache of a
+ *		> packfile, for packfiles opened after the call.  The
+ *		> `core.deltaBaseCacheLimit` config of a repository takes
+ *		> precedence.  The default is 16MB.
+ *
+ *	* opts(GIT_OPT_GET_CACHE_OBJECT_LIMIT, git_otype type, size_t *size)
+ *
+ *		> Get the maximum data size for the given type of object to be
+ *		> considered eligible for caching in memory.
+ *
+ *	* opts(GIT_OPT_GET_INDEX_ADD_THREADS, unsigned int *)
+ *
+ *		> Get the number of threads used by `git_index_add_all` to
+ *		> write the blobs of the added files.
+ *
+ *	* opts(GIT_OPT_SET_INDEX_ADD_THREADS, unsigned int)
+ *
+ *		> Set the number of threads used by `git_index_add_all` to
+ *		> write the blobs of the added files.  Only files that are
+ *		> stored without filters are written in parallel.  Zero means
+ *		> one thread per online CPU, which is the default.  The value
+ *		> has no effect unless libgit2 was built with thread support.
+ *
+ *	* opts(GIT_OPT_GET_INDEX_PRELOAD_THREADS, unsigned int *)
+ *
+ *		> Get the maximum number of threads used to lstat the files of
+ *		> the index before a diff between the index and the working
+ *		> directory.
+ *
+ *	* opts(GIT_OPT_SET_INDEX_PRELOAD_THREADS, unsigned int)
+ *
+ *		> Set the maximum number of threads used to lstat the files of
+ *		> the index before a diff between the index and the working
+ *		> directory.  One thread is used per 500 entries of the index,
+ *		> and no preload is done with less than two threads or when
+ *		> core.preloadIndex is false.  Zero means 20, which is the
+ *		> default; the lstat calls mostly wait on the file system, so
+ *		> more threads than CPUs pay off on network file systems.  The
+ *		> value has no effect unless libgit2 was built with thread
+ *		> support.
+ *
  * @param option Option key
  * @param ... value to set the option
  * @return 0 on success, <0 on failure
@@ -40,6 +40,7 @@ typedef enum {
 	GIT_EINVALIDSPEC    = -12,	/*< Name/ref spec was not in a valid format */
 	GIT_EMERGECONFLICT  = -13,	/*< Merge conflicts prevented operation */
 	GIT_ELOCKED         = -14,	/*< Lock file prevented operation */
+	GIT_EMODIFIED       = -15,	/*< Reference value does not match expected */
 
 	GIT_PASSTHROUGH     = -30,	/*< Internal only */
 	GIT_ITEROVER        = -31,	/*< Signals end of iteration with iterator */
@@ -28,14 +28,100 @@ GIT_BEGIN_DECL
  * the other as its upstream, the `ahead` and `behind` values will be
  * what git would report for the branches.
  *
- * @param ahead number of unique from commits in `upstream`
- * @param behind number of unique from commits in `local`
+ * When the repository has reachability bitmaps, the commits are
+ * counted with the bitmaps instead of walking the history.
+ *
+ * @param ahead number of unique commits in `local`
+ * @param behind number of unique commits in `upstream`
  * @param repo the repository where the commits exist
  * @param local the commit for local
  * @param upstream the commit for upstream
  */
 GIT_EXTERN(int) git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *local, const git_oid *upstream);
 
+/**
+ * Determine if a commit is the descendant of another commit.
+ *
+ * When the repository has a commit-graph file, the search does not
+ * look at commits with a generation number lower than the one of
+ * `ancestor`. Otherwise the merge base of the commits is compared to
+ * `ancestor`.
+ *
+ * @param repo the repository where the commits exist
+ * @param commit a previously loaded commit
+ * @param ancestor a potential ancestor commit
+ * @return 1 if the given commit is a descendant of the potential
+ * ancestor, 0 if not, error code otherwise.
+ */
+GIT_EXTERN(int) git_graph_descendant_of(
+	git_repository *repo,
+	const git_oid *commit,
+	const git_oid *ancestor);
+
+/**
+ * Write the commit-graph file of a repository
+ *
+ * The file `objects/info/commit-graph` stores the parents, commit
+ * times and generation numbers of all commits reachable from the
+ * references, in the format used by `git commit-graph write`. Revision
+ * walks and merge-base computations read the commit-graph instead of
+ * parsing the commit objects. Commits in an existing commit-graph
+ * file are kept in the new one.
+ *
+ * @param repo the repository
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_write_commit_graph(git_repository *repo);
+
+/**
+ * Write the reachability bitmaps of a repository
+ *
+ * The file `pack-<hash>.bitmap` next to the largest pack stores, for
+ * the commits of the references and one commit in every hundred of the
+ * history, the set of objects of the pack reachable from the commit,
+ * in the format used by `git repack -b`. Counting the objects reachable
+ * from a commit, ahead/behind counts and building a pack for a fetch or
+ * a push then read the bitmaps instead of walking the trees. The
+ * bitmaps of the other packs are removed.
+ *
+ * @param repo the repository
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_write_bitmap(git_repository *repo);
+
+/**
+ * The number of objects of each type found by `git_graph_count_reachable`
+ */
+typedef struct {
+	size_t commits;
+	size_t trees;
+	size_t blobs;
+	size_t tags;
+} git_graph_object_counts;
+
+/**
+ * Count the objects reachable from some objects but not from others
+ *
+ * The objects are counted with the reachability bitmaps of the
+ * repository, when it has some, and only the objects that are not
+ * covered by a bitmap are walked.
+ *
+ * @param out the number of objects of each type
+ * @param repo the repository where the objects exist
+ * @param include the objects to count the reachable objects of
+ * @param include_count the number of objects in `include`
+ * @param exclude the objects whose reachable objects are not counted
+ * @param exclude_count the number of objects in `exclude`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_count_reachable(
+	git_graph_object_counts *out,
+	git_repository *repo,
+	const git_oid *include,
+	size_t include_count,
+	const git_oid *exclude,
+	size_t exclude_count);
+
 /** @} */
 GIT_END_DECL
 #endif
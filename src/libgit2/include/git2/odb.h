@@ -25,6 +25,16 @@ GIT_BEGIN_DECL
  */
 typedef int (*git_odb_foreach_cb)(const git_oid *id, void *payload);
 
+/**
+ * Function type for callbacks from git_odb_foreach_header.
+ *
+ * `pack` is the path of the packfile of the object, or NULL when the
+ * object is not in a packfile.
+ */
+typedef int (*git_odb_foreach_header_cb)(
+	const git_oid *id, git_otype type, size_t size,
+	const char *pack, void *payload);
+
 /**
  * Create a new object database with no backends.
  *
@@ -147,6 +157,28 @@ GIT_EXTERN(int) git_odb_read_prefix(git_odb_object **out, git_odb *db, const git
  */
 GIT_EXTERN(int) git_odb_read_header(size_t *len_out, git_otype *type_out, git_odb *db, const git_oid *id);
 
+/**
+ * Read the header of many objects from the database
+ *
+ * This is the same as calling `git_odb_read_header` for each object,
+ * but the packed objects are read pack by pack in the order of the
+ * packfile, and the type of a delta base is only resolved once for
+ * all the deltas that use it.
+ *
+ * An object that is not in the database gets the type `GIT_OBJ_BAD`
+ * and the size 0.
+ *
+ * @param sizes array of `count` sizes to fill
+ * @param types array of `count` types to fill
+ * @param db database to search for the objects in
+ * @param ids the ids of the objects
+ * @param count the number of objects
+ * @return 0 on success, or an error code
+ */
+GIT_EXTERN(int) git_odb_read_header_many(
+	size_t *sizes, git_otype *types, git_odb *db,
+	const git_oid *ids, size_t count);
+
 /**
  * Determine if the given object can be found in the object database.
  *
@@ -193,6 +225,24 @@ GIT_EXTERN(int) git_odb_refresh(struct git_odb *db);
  */
 GIT_EXTERN(int) git_odb_foreach(git_odb *db, git_odb_foreach_cb cb, void *payload);
 
+/**
+ * List the type and size of all objects available in the database
+ *
+ * The objects of each packfile are listed in pack order, from the
+ * pack index and the object headers: only the first bytes of a delta
+ * are inflated to read its size, and its type is the type of its
+ * base. Loose objects are listed with their headers. An object stored
+ * in several packfiles, or both loose and packed, is listed once for
+ * each copy. Return a non-zero value from the callback to stop
+ * looping.
+ *
+ * @param db database to use
+ * @param cb the callback to call for each object
+ * @param payload data to pass to the callback
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_odb_foreach_header(git_odb *db, git_odb_foreach_header_cb cb, void *payload);
+
 /**
  * Write an object directly into the ODB
  *
@@ -477,6 +527,127 @@ GIT_EXTERN(size_t) git_odb_num_backends(git_odb *odb);
  */
 GIT_EXTERN(int) git_odb_get_backend(git_odb_backend **out, git_odb *odb, size_t pos);
 
+/**
+ * Statistics of the delta base caches of the packfiles in an object
+ * database
+ */
+typedef struct {
+	/** Bytes of inflated bases in the caches */
+	size_t memory_used;
+	/** Memory limit of the cache of each packfile */
+	size_t memory_limit;
+	/** Number of cached bases */
+	size_t entries;
+	/** Lookups that found the base in a cache */
+	size_t hits;
+	/** Lookups that had to inflate the base */
+	size_t misses;
+	/** Bases evicted to make room for others */
+	size_t evictions;
+} git_odb_delta_base_cache_stats;
+
+/**
+ * Set the memory limit of the delta base cache of each packfile in
+ * the object database
+ *
+ * Unused bases are evicted right away when the cache is above the
+ * new limit. Packfiles found later get the same limit. A base larger
+ * than 1/16 of the limit is not cached.
+ *
+ * @param odb object database
+ * @param limit the limit in bytes
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_set_delta_base_cache_limit(git_odb *odb, size_t limit);
+
+/**
+ * Get the statistics of the delta base caches of the packfiles in the
+ * object database
+ *
+ * @param out the statistics, added up over all packfiles
+ * @param odb object database
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_get_delta_base_cache_stats(
+	git_odb_delta_base_cache_stats *out, git_odb *odb);
+
+/**
+ * Mapping statistics of the packfiles of an object database
+ */
+typedef struct {
+	/** Size of the windows mapped from each packfile */
+	size_t window_size;
+	/** Limit of the bytes mapped from the packfiles */
+	size_t mapped_limit;
+	/** Bytes mapped from the packfiles */
+	size_t mapped;
+	/** Highest number of bytes mapped from the packfiles */
+	size_t peak_mapped;
+	/** Number of mapped windows */
+	unsigned int open_windows;
+	/** Number of windows mapped so far */
+	unsigned int mmap_calls;
+} git_odb_mwindow_stats;
+
+/**
+ * Set the window size and the mapped limit of the packfiles of the
+ * object database
+ *
+ * The packfiles are read through windows that are mapped on demand.
+ * When the windows of the packfiles of the object database map more
+ * than `mapped_limit` bytes, the least recently used windows that are
+ * not in use are closed, as for the global limit set with
+ * `GIT_OPT_SET_MWINDOW_MAPPED_LIMIT`, which still applies. The window
+ * size is rounded up to a multiple of 128KB and applies to windows
+ * mapped later. Packfiles found later get the same limits.
+ *
+ * @param odb object database
+ * @param window_size the window size in bytes, or 0 for the global
+ *        `GIT_OPT_SET_MWINDOW_SIZE`
+ * @param mapped_limit the limit in bytes, or 0 for the global limit only
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_set_mwindow_limits(
+	git_odb *odb, size_t window_size, size_t mapped_limit);
+
+/**
+ * Get the mapping statistics of the packfiles of the object database
+ *
+ * @param out the statistics, added up over the pack folders
+ * @param odb object database
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_get_mwindow_stats(
+	git_odb_mwindow_stats *out, git_odb *odb);
+
+/**
+ * Write the multi-pack-index of the packfiles of the object database
+ *
+ * The multi-pack-index, `objects/pack/multi-pack-index`, lists the
+ * objects of all the packfiles sorted by oid with their packfile and
+ * offset, so that looking up an object is one binary search however
+ * many packfiles there are. Packfiles added later are searched one by
+ * one until the file is written again. The file has the format written
+ * by `git multi-pack-index write`. The packfiles of the alternates are
+ * not indexed.
+ *
+ * @param odb object database
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_write_multi_pack_index(git_odb *odb);
+
+/**
+ * Verify the multi-pack-index of the object database
+ *
+ * Checks the checksum and ordering of the file, and that the offset of
+ * every object matches the index of its packfile. An object database
+ * without a multi-pack-index is valid.
+ *
+ * @param odb object database
+ * @return 0 if the multi-pack-index is valid; error code otherwise
+ */
+GIT_EXTERN(int) git_odb_verify_multi_pack_index(git_odb *odb);
+
 /** @} */
 GIT_END_DECL
 #endif
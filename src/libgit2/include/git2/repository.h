@@ -198,6 +198,8 @@ GIT_EXTERN(int) git_repository_init(
  *        looking the "template_path" from the options if set, or the
  *        `init.templatedir` global config if not, or falling back on
  *        "/usr/share/git-core/templates" if it exists.
+ * * REF_TABLE - Store the references under "refs/" and the reflogs in
+ *        reference tables instead of files (see `git_refdb_backend_table`).
  */
 typedef enum {
 	GIT_REPOSITORY_INIT_BARE              = (1u << 0),
@@ -206,6 +208,7 @@ typedef enum {
 	GIT_REPOSITORY_INIT_MKDIR             = (1u << 3),
 	GIT_REPOSITORY_INIT_MKPATH            = (1u << 4),
 	GIT_REPOSITORY_INIT_EXTERNAL_TEMPLATE = (1u << 5),
+	GIT_REPOSITORY_INIT_REF_TABLE         = (1u << 6),
 } git_repository_init_flag_t;
 
 /**
@@ -678,6 +681,35 @@ GIT_EXTERN(const char *) git_repository_get_namespace(git_repository *repo);
  */
 GIT_EXTERN(int) git_repository_is_shallow(git_repository *repo);
 
+/**
+ * Statistics of the object cache of a repository
+ */
+typedef struct {
+	/** Number of cached objects */
+	size_t entries;
+	/** Bytes of object data in the cache */
+	size_t memory_used;
+	/** Lookups that found the object in the cache */
+	size_t hits;
+	/** Lookups that had to read the object from the odb */
+	size_t misses;
+	/** Objects evicted to keep the caches under the limit */
+	size_t evictions;
+} git_repository_object_cache_stats;
+
+/**
+ * Get the statistics of the object cache of a repository
+ *
+ * The size limit of the caches is shared by all repositories, see
+ * `GIT_OPT_SET_CACHE_MAX_SIZE` and `GIT_OPT_SET_CACHE_OBJECT_LIMIT`.
+ *
+ * @param out the statistics
+ * @param repo The repository
+ * @return 0 on success; error code otherwise
+ */
+GIT_EXTERN(int) git_repository_get_object_cache_stats(
+	git_repository_object_cache_stats *out, git_repository *repo);
+
 /** @} */
 GIT_END_DECL
 #endif
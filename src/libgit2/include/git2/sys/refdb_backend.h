@@ -56,6 +56,23 @@ struct git_reference_iterator {
 		git_reference_iterator *iter);
 };
 
+/**
+ * An update of a reference in a transaction.
+ *
+ * `ref` is the new value of the reference, or NULL to delete it.
+ * `old_id` is the value the reference must have before the update:
+ * NULL for any value, a zero id if the reference must not exist, or
+ * the id that a direct reference must point to. `who` and `message`
+ * are logged in the reflog of the reference.
+ */
+typedef struct {
+	const char *name;
+	const git_reference *ref;
+	const git_oid *old_id;
+	const git_signature *who;
+	const char *message;
+} git_refdb_update;
+
 /** An instance for a custom backend */
 struct git_refdb_backend {
 	unsigned int version;
@@ -152,6 +169,22 @@ struct git_refdb_backend {
 	 * Remove a reflog.
 	 */
 	int (*reflog_delete)(git_refdb_backend *backend, const char *name);
+
+	/**
+	 * Applies the updates, sorted by name and with distinct names.
+	 * Every reference is locked and its old value is checked before
+	 * anything is written, so a failed check applies none of them. A
+	 * backend that cannot write all the updates atomically must
+	 * document what a failure while writing leaves behind. Returns
+	 * GIT_EMODIFIED if a
+	 * reference does not have the expected old value, and GIT_ELOCKED
+	 * if it is locked. A refdb implementation may provide this
+	 * function; if it is not provided, transactions fail.
+	 */
+	int (*transaction)(
+		git_refdb_backend *backend,
+		const git_refdb_update **updates,
+		size_t count);
 };
 
 #define GIT_REFDB_BACKEND_VERSION 1
@@ -172,6 +205,22 @@ GIT_EXTERN(int) git_refdb_backend_fs(
 	git_refdb_backend **backend_out,
 	git_repository *repo);
 
+/**
+ * Constructors for the reference table backend
+ *
+ * This backend keeps the references under "refs/" and all the reflogs
+ * in a stack of reference tables in "reftable/", and the other
+ * references (such as HEAD) in files. Each update is atomic. It is
+ * used for repositories whose "extensions.refstorage" is "table".
+ *
+ * @param backend_out Output pointer to the git_refdb_backend object
+ * @param repo Git repository to access
+ * @return 0 on success, <0 error code on failure
+ */
+GIT_EXTERN(int) git_refdb_backend_table(
+	git_refdb_backend **backend_out,
+	git_repository *repo);
+
 /**
  * Sets the custom backend to an existing reference DB
  *
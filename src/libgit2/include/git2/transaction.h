@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_git_transaction_h__
+#define INCLUDE_git_transaction_h__
+
+#include "common.h"
+#include "types.h"
+#include "oid.h"
+
+/**
+ * @file git2/transaction.h
+ * @brief Git checked updates of many references
+ * @defgroup git_transaction Git reference transactions
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * Create a new transaction of reference updates.
+ *
+ * The updates are queued, and applied together by
+ * `git_transaction_commit()`. Every reference is locked and its
+ * expected old value is checked before any of them is written, so a
+ * locked reference or a mismatched value leaves all the references
+ * unchanged.
+ *
+ * Whether the writes that follow are atomic depends on the refdb
+ * backend. The reference table backend writes the whole transaction
+ * as one table, which is applied completely or not at all. The
+ * filesystem backend writes each loose reference, and the
+ * packed-refs file, separately: a failure while they are written,
+ * e.g. a full disk, can leave part of the transaction applied.
+ *
+ * @param out pointer to store the transaction
+ * @param repo the repository of the references
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_transaction_new(git_transaction **out, git_repository *repo);
+
+/**
+ * Queue the update of a reference to point to an object.
+ *
+ * `old_id` is the value the reference must have when the transaction
+ * is committed: NULL to accept any value, a zero id if the reference
+ * must not exist yet, or the object the reference must point to.
+ *
+ * @param tx the transaction
+ * @param refname the name of the reference
+ * @param id the object the reference will point to
+ * @param old_id the expected value of the reference, or NULL
+ * @param signature the identity that will be used to populate the
+ * reflog entry, or NULL for the default signature of the repository
+ * @param log_message the one line long message to be appended to the
+ * reflog, or NULL
+ * @return 0, GIT_EEXISTS if the reference is already updated in the
+ * transaction, or an error code
+ */
+GIT_EXTERN(int) git_transaction_set_target(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *id,
+	const git_oid *old_id,
+	const git_signature *signature,
+	const char *log_message);
+
+/**
+ * Queue the update of a reference to point to another reference.
+ *
+ * @param tx the transaction
+ * @param refname the name of the reference
+ * @param target the name of the reference it will point to
+ * @param old_id the expected value of the reference, or NULL; see
+ * `git_transaction_set_target()`
+ * @return 0, GIT_EEXISTS if the reference is already updated in the
+ * transaction, or an error code
+ */
+GIT_EXTERN(int) git_transaction_set_symbolic_target(
+	git_transaction *tx,
+	const char *refname,
+	const char *target,
+	const git_oid *old_id);
+
+/**
+ * Queue the deletion of a reference.
+ *
+ * The reference must exist when the transaction is committed.
+ *
+ * @param tx the transaction
+ * @param refname the name of the reference
+ * @param old_id the expected value of the reference, or NULL; see
+ * `git_transaction_set_target()`
+ * @return 0, GIT_EEXISTS if the reference is already updated in the
+ * transaction, or an error code
+ */
+GIT_EXTERN(int) git_transaction_remove(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *old_id);
+
+/**
+ * Apply the queued updates.
+ *
+ * A transaction can be committed only once.
+ *
+ * @param tx the transaction
+ * @return 0, GIT_EMODIFIED if a reference does not have its expected
+ * value, GIT_ENOTFOUND if a reference to delete does not exist,
+ * GIT_ELOCKED if a reference is locked, or an error code
+ */
+GIT_EXTERN(int) git_transaction_commit(git_transaction *tx);
+
+/**
+ * Free a transaction and the updates it did not apply.
+ *
+ * @param tx the transaction
+ */
+GIT_EXTERN(void) git_transaction_free(git_transaction *tx);
+
+/** @} */
+GIT_END_DECL
+#endif
@@ -17,6 +17,8 @@
 #include "pathspec.h"
 #include "ignore.h"
 #include "blob.h"
+#include "filter.h"
+#include "ewah.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -36,10 +38,22 @@ static const size_t INDEX_HEADER_SIZE = 12;
 static const unsigned int INDEX_VERSION_NUMBER = 2;
 static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
 
+unsigned int git_index__add_threads = 0;
+unsigned int git_index__preload_threads = 0;
+
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+/* private to libgit2, not git's UNTR */
+static const char INDEX_EXT_UNTRACKED_SIG[] = {'L', 'G', 'U', 'C'};
+static const char INDEX_EXT_LINK_SIG[] = {'l', 'i', 'n', 'k'};
+
+#define INDEX_SHARED_PREFIX "sharedindex."
+/* default splitIndex.maxPercentChange */
+#define INDEX_SPLIT_MAX_PERCENT 20
+/* shared indexes that nobody used for two weeks are removed */
+#define INDEX_SHARED_EXPIRE (14 * 24 * 60 * 60)
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -94,13 +108,22 @@ struct entry_srch_key {
 };
 
 /* local declarations */
-static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size);
+static size_t read_extension(
+	git_index *index, const char **link, size_t *link_size,
+	const char *buffer, size_t buffer_size);
 static size_t read_entry(git_index_entry *dest, const void *buffer, size_t buffer_size);
 static int read_header(struct index_header *dest, const void *buffer);
 
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
 static bool is_index_extended(git_index *index);
-static int write_index(git_index *index, git_filebuf *file);
+
+typedef struct index_split_delta index_split_delta;
+
+static int index_split_prepare(index_split_delta **out, git_index *index);
+static void index_split_delta_free(index_split_delta *delta);
+static void index_split_free(git_index_split *split);
+static int write_index(
+	git_index *index, git_filebuf *file, index_split_delta *delta);
 
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
@@ -370,6 +393,8 @@ static void index_free(git_index *index)
 	git_vector_free(&index->names);
 	git_vector_free(&index->reuc);
 
+	index_split_free(index->split);
+
 	git__free(index->index_file_path);
 
 	git__memzero(index, sizeof(*index));
@@ -406,6 +431,9 @@ void git_index_clear(git_index *index)
 
 	git_tree_cache_free(index->tree);
 	index->tree = NULL;
+
+	git_untracked_cache_free(index->untracked);
+	index->untracked = NULL;
 }
 
 static int create_index_error(int error, const char *msg)
@@ -496,6 +524,7 @@ int git_index_read(git_index *index, int force)
 int git_index_write(git_index *index)
 {
 	git_filebuf file = GIT_FILEBUF_INIT;
+	index_split_delta *delta = NULL;
 	int error;
 
 	if (!index->index_file_path)
@@ -513,11 +542,16 @@ int git_index_write(git_index *index)
 		return error;
 	}
 
-	if ((error = write_index(index, &file)) < 0) {
+	/* this may write a new shared index, under the lock of the index */
+	if ((error = index_split_prepare(&delta, index)) < 0 ||
+		(error = write_index(index, &file, delta)) < 0) {
+		index_split_delta_free(delta);
 		git_filebuf_cleanup(&file);
 		return error;
 	}
 
+	index_split_delta_free(delta);
+
 	if ((error = git_filebuf_commit(&file)) < 0)
 		return error;
 
@@ -526,9 +560,33 @@ int git_index_write(git_index *index)
 		return error;
 
 	index->on_disk = 1;
+
+	if (index->untracked)
+		index->untracked->dirty = 0;
+
 	return 0;
 }
 
+void git_index__write_untracked_cache(git_index *index)
+{
+	git_futils_filestamp stamp;
+
+	if (!index->untracked || !index->untracked->dirty ||
+		!index->index_file_path)
+		return;
+
+	/* somebody else wrote the index since we read it */
+	memcpy(&stamp, &index->stamp, sizeof(stamp));
+	if (git_futils_filestamp_check(&stamp, index->index_file_path) != 0) {
+		giterr_clear();
+		return;
+	}
+
+	/* the cache is only an optimization, e.g. the index may be locked */
+	if (git_index_write(index) < 0)
+		giterr_clear();
+}
+
 const char * git_index_path(git_index *index)
 {
 	assert(index);
@@ -1572,7 +1630,9 @@ static int read_header(struct index_header *dest, const void *buffer)
 	return 0;
 }
 
-static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size)
+static size_t read_extension(
+	git_index *index, const char **link, size_t *link_size,
+	const char *buffer, size_t buffer_size)
 {
 	const struct index_extension *source;
 	struct index_extension dest;
@@ -1590,6 +1650,13 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		buffer_size - total_size < INDEX_FOOTER_SIZE)
 		return 0;
 
+	/* the split index link is required, it is merged after the entries */
+	if (memcmp(dest.signature, INDEX_EXT_LINK_SIG, 4) == 0) {
+		*link = buffer + 8;
+		*link_size = dest.extension_size;
+		return total_size;
+	}
+
 	/* optional extension */
 	if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
 		/* tree cache */
@@ -1602,6 +1669,13 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		} else if (memcmp(dest.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4) == 0) {
 			if (read_conflict_names(index, buffer + 8, dest.extension_size) < 0)
 				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNTRACKED_SIG, 4) == 0) {
+			/* a broken cache is dropped, it will be built again */
+			git_untracked_cache_free(index->untracked);
+			index->untracked = NULL;
+			if (git_untracked_cache_read(
+					&index->untracked, buffer + 8, dest.extension_size) < 0)
+				giterr_clear();
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
@@ -1614,11 +1688,232 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 	return total_size;
 }
 
+static void index_split_free(git_index_split *split)
+{
+	if (split == NULL)
+		return;
+
+	index_entries_free(&split->base);
+	git_vector_free(&split->base);
+	git__free(split);
+}
+
+static int index_split_path(git_buf *out, git_index *index, const git_oid *id)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+
+	git_oid_tostr(hex, sizeof(hex), id);
+
+	if (git_path_dirname_r(out, index->index_file_path) < 0)
+		return -1;
+
+	return git_buf_printf(out, "/" INDEX_SHARED_PREFIX "%s", hex);
+}
+
+static int index_split_load(
+	git_index_split **out, git_index *index, const git_oid *base_id)
+{
+	git_buf path = GIT_BUF_INIT, buffer = GIT_BUF_INIT;
+	git_index *base = NULL;
+	git_index_split *split;
+	int error = -1;
+
+	if (!index->index_file_path) {
+		giterr_set(GITERR_INDEX, "A shared index cannot be split itself");
+		return -1;
+	}
+
+	if (index_split_path(&path, index, base_id) < 0 ||
+		git_futils_readbuffer(&buffer, path.ptr) < 0)
+		goto done;
+
+	/* the link names the shared index by its checksum */
+	if (buffer.size < INDEX_FOOTER_SIZE ||
+		memcmp(buffer.ptr + buffer.size - INDEX_FOOTER_SIZE,
+			base_id->id, GIT_OID_RAWSZ) != 0) {
+		giterr_set(GITERR_INDEX,
+			"The shared index '%s' does not match the index", path.ptr);
+		goto done;
+	}
+
+	if (git_index_new(&base) < 0 ||
+		parse_index(base, buffer.ptr, buffer.size) < 0)
+		goto done;
+
+	split = git__calloc(1, sizeof(git_index_split));
+	if (split == NULL)
+		goto done;
+
+	git_oid_cpy(&split->base_id, base_id);
+	git_vector_swap(&split->base, &base->entries);
+
+	*out = split;
+	error = 0;
+
+done:
+	git_index_free(base);
+	git_buf_free(&buffer);
+	git_buf_free(&path);
+	return error;
+}
+
+static int index_split_merge(
+	git_index *index,
+	git_index_split *split,
+	git_bitvec *delete_bits,
+	git_bitvec *replace_bits)
+{
+	git_vector merged = GIT_VECTOR_INIT;
+	git_vector_cmp entries_cmp = index->entries._cmp;
+	git_index_entry *entry, *dup;
+	size_t i, pos, next = 0;
+
+	if (git_vector_init(&merged,
+			split->base.length + index->entries.length, index_cmp) < 0)
+		return -1;
+
+	git_vector_foreach(&split->base, i, entry) {
+		if (git_bitvec_get(replace_bits, i)) {
+			git_index_entry *replacement =
+				git_vector_get(&index->entries, next++);
+
+			/* replacements come first and keep the path of the base */
+			if (replacement == NULL || *replacement->path) {
+				index_error_invalid("invalid split index replacement");
+				goto on_error;
+			}
+
+			if (git_bitvec_get(delete_bits, i))
+				continue;
+
+			if ((dup = git__malloc(sizeof(git_index_entry))) != NULL) {
+				memcpy(dup, replacement, sizeof(git_index_entry));
+				dup->path = git__strdup(entry->path);
+				dup->flags = (replacement->flags & ~GIT_IDXENTRY_NAMEMASK) |
+					(entry->flags & GIT_IDXENTRY_NAMEMASK);
+			}
+		} else if (git_bitvec_get(delete_bits, i)) {
+			continue;
+		} else
+			dup = index_entry_dup(entry);
+
+		if (dup == NULL || dup->path == NULL ||
+			git_vector_insert(&merged, dup) < 0) {
+			index_entry_free(dup);
+			goto on_error;
+		}
+	}
+
+	git_vector_sort(&merged);
+
+	for (i = next; i < index->entries.length; ++i) {
+		entry = git_vector_get(&index->entries, i);
+
+		if (!*entry->path) {
+			index_error_invalid("invalid split index entry");
+			goto on_error;
+		}
+
+		if ((dup = index_entry_dup(entry)) == NULL)
+			goto on_error;
+
+		if (!git__bsearch(merged.contents, merged.length, dup, index_cmp, &pos)) {
+			index_entry_free(merged.contents[pos]);
+			merged.contents[pos] = dup;
+		} else if (git_vector_insert_sorted(&merged, dup, NULL) < 0) {
+			index_entry_free(dup);
+			goto on_error;
+		}
+	}
+
+	git_vector_swap(&index->entries, &merged);
+	git_vector_set_cmp(&index->entries, entries_cmp);
+
+	index_entries_free(&merged);
+	git_vector_free(&merged);
+	return 0;
+
+on_error:
+	index_entries_free(&merged);
+	git_vector_free(&merged);
+	return -1;
+}
+
+static int index_split_read(git_index *index, const char *data, size_t size)
+{
+	git_oid base_id;
+	git_index_split *split = NULL;
+	git_bitvec delete_bits, replace_bits;
+	int consumed, error = -1;
+
+	if (size < GIT_OID_RAWSZ)
+		return index_error_invalid("link extension is truncated");
+
+	git_oid_fromraw(&base_id, (const unsigned char *)data);
+	data += GIT_OID_RAWSZ;
+	size -= GIT_OID_RAWSZ;
+
+	/* git leaves a null link behind when it stops splitting the index */
+	if (git_oid_iszero(&base_id)) {
+		index_split_free(index->split);
+		index->split = NULL;
+		return 0;
+	}
+
+	/* the shared index does not change once written */
+	if (index->split && git_oid_equal(&index->split->base_id, &base_id))
+		split = index->split;
+	else if (index_split_load(&split, index, &base_id) < 0)
+		return -1;
+
+	memset(&delete_bits, 0, sizeof(delete_bits));
+	memset(&replace_bits, 0, sizeof(replace_bits));
+
+	if (git_bitvec_init(&delete_bits, split->base.length) < 0 ||
+		git_bitvec_init(&replace_bits, split->base.length) < 0)
+		goto done;
+
+	if (size > 0) {
+		if ((consumed = git_ewah_read(
+				&delete_bits, split->base.length, data, size)) < 0)
+			goto done;
+		data += consumed;
+		size -= consumed;
+
+		if ((consumed = git_ewah_read(
+				&replace_bits, split->base.length, data, size)) < 0)
+			goto done;
+		if ((size_t)consumed != size) {
+			index_error_invalid("link extension has trailing data");
+			goto done;
+		}
+	}
+
+	if ((error = index_split_merge(
+			index, split, &delete_bits, &replace_bits)) < 0)
+		goto done;
+
+	if (split != index->split) {
+		index_split_free(index->split);
+		index->split = split;
+	}
+
+done:
+	if (error < 0 && split != index->split)
+		index_split_free(split);
+
+	git_bitvec_free(&delete_bits);
+	git_bitvec_free(&replace_bits);
+	return error;
+}
+
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 {
 	unsigned int i;
 	struct index_header header = { 0 };
 	git_oid checksum_calculated, checksum_expected;
+	const char *link = NULL;
+	size_t link_size = 0;
 
 #define seek_forward(_increase) { \
 	if (_increase >= buffer_size) \
@@ -1669,7 +1964,8 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	while (buffer_size > INDEX_FOOTER_SIZE) {
 		size_t extension_size;
 
-		extension_size = read_extension(index, buffer, buffer_size);
+		extension_size = read_extension(
+			index, &link, &link_size, buffer, buffer_size);
 
 		/* see if we have read any bytes from the extension */
 		if (extension_size == 0)
@@ -1689,6 +1985,14 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 
 #undef seek_forward
 
+	if (link != NULL) {
+		if (index_split_read(index, link, link_size) < 0)
+			return -1;
+	} else {
+		index_split_free(index->split);
+		index->split = NULL;
+	}
+
 	/* Entries are stored case-sensitively on disk. */
 	index->entries.sorted = !index->ignore_case;
 	git_vector_sort(&index->entries);
@@ -1918,7 +2222,380 @@ done:
 	return error;
 }
 
-static int write_index(git_index *index, git_filebuf *file)
+static int write_untracked_extension(git_index *index, git_filebuf *file)
+{
+	git_buf untracked_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_untracked_cache_write(&untracked_buf, index->untracked)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNTRACKED_SIG, 4);
+	extension.extension_size = (uint32_t)untracked_buf.size;
+
+	error = write_extension(file, &extension, &untracked_buf);
+
+done:
+	git_buf_free(&untracked_buf);
+	return error;
+}
+
+struct index_split_delta {
+	git_vector entries; /* the replacements, then the new entries */
+	git_index_entry *stripped; /* replacements, written without a path */
+	git_bitvec delete_bits;
+	git_bitvec replace_bits;
+};
+
+static void index_split_delta_free(index_split_delta *delta)
+{
+	if (delta == NULL)
+		return;
+
+	git_vector_free(&delta->entries);
+	git__free(delta->stripped);
+	git_bitvec_free(&delta->delete_bits);
+	git_bitvec_free(&delta->replace_bits);
+	git__free(delta);
+}
+
+static int index_split_delta_init(index_split_delta *delta, size_t base_count)
+{
+	git_vector_clear(&delta->entries);
+	git__free(delta->stripped);
+	delta->stripped = NULL;
+	git_bitvec_free(&delta->delete_bits);
+	git_bitvec_free(&delta->replace_bits);
+	memset(&delta->delete_bits, 0, sizeof(delta->delete_bits));
+	memset(&delta->replace_bits, 0, sizeof(delta->replace_bits));
+
+	if (git_bitvec_init(&delta->delete_bits, base_count) < 0 ||
+		git_bitvec_init(&delta->replace_bits, base_count) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* returns 1 when the index is to be written split, 0 when it is not */
+static int index_split_config(int *max_percent, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *cfg;
+	int enabled, error;
+
+	*max_percent = INDEX_SPLIT_MAX_PERCENT;
+
+	if (!repo || git_repository_config__weakptr(&cfg, repo) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	/* when core.splitIndex is not set, a split index stays split */
+	if ((error = git_config_get_bool(&enabled, cfg, "core.splitindex")) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		giterr_clear();
+		enabled = (index->split != NULL);
+	}
+
+	if (!enabled)
+		return 0;
+
+	if (git_config_get_int32(
+			max_percent, cfg, "splitindex.maxpercentchange") < 0 ||
+		*max_percent < 0 || *max_percent > 100) {
+		giterr_clear();
+		*max_percent = INDEX_SPLIT_MAX_PERCENT;
+	}
+
+	return 1;
+}
+
+static bool index_entry_same(const git_index_entry *a, const git_index_entry *b)
+{
+	return a->ctime.seconds == b->ctime.seconds &&
+		a->ctime.nanoseconds == b->ctime.nanoseconds &&
+		a->mtime.seconds == b->mtime.seconds &&
+		a->mtime.nanoseconds == b->mtime.nanoseconds &&
+		a->dev == b->dev && a->ino == b->ino && a->mode == b->mode &&
+		a->uid == b->uid && a->gid == b->gid &&
+		a->file_size == b->file_size &&
+		git_oid_equal(&a->oid, &b->oid) &&
+		((a->flags ^ b->flags) & ~GIT_IDXENTRY_EXTENDED) == 0 &&
+		((a->flags_extended ^ b->flags_extended) &
+			GIT_IDXENTRY_EXTENDED_FLAGS) == 0;
+}
+
+/* find what changed since the shared index; returns the number of changes */
+static int index_split_diff(
+	size_t *changes,
+	index_split_delta *delta,
+	git_index_split *split,
+	git_vector *entries)
+{
+	git_vector added = GIT_VECTOR_INIT;
+	git_index_entry *entry, *base;
+	size_t i = 0, j = 0, replaced = 0, deleted = 0;
+	int cmp, error = -1;
+
+	if (index_split_delta_init(delta, split->base.length) < 0)
+		return -1;
+
+	delta->stripped = git__calloc(
+		max(entries->length, 1), sizeof(git_index_entry));
+	GITERR_CHECK_ALLOC(delta->stripped);
+
+	/* both lists are sorted case-sensitively, as they are on disk */
+	while (i < entries->length || j < split->base.length) {
+		entry = git_vector_get(entries, i);
+		base = git_vector_get(&split->base, j);
+
+		if (entry == NULL)
+			cmp = 1;
+		else if (base == NULL)
+			cmp = -1;
+		else
+			cmp = index_cmp(entry, base);
+
+		if (cmp < 0) {
+			if (git_vector_insert(&added, entry) < 0)
+				goto done;
+			++i;
+		} else if (cmp > 0) {
+			git_bitvec_set(&delta->delete_bits, j, true);
+			++deleted;
+			++j;
+		} else {
+			if (!index_entry_same(entry, base)) {
+				git_index_entry *stripped = &delta->stripped[replaced++];
+
+				memcpy(stripped, entry, sizeof(git_index_entry));
+				stripped->path = "";
+				stripped->flags &= ~GIT_IDXENTRY_NAMEMASK;
+
+				git_bitvec_set(&delta->replace_bits, j, true);
+				if (git_vector_insert(&delta->entries, stripped) < 0)
+					goto done;
+			}
+			++i;
+			++j;
+		}
+	}
+
+	git_vector_foreach(&added, i, entry)
+		if (git_vector_insert(&delta->entries, entry) < 0)
+			goto done;
+
+	*changes = replaced + added.length + deleted;
+	error = 0;
+
+done:
+	git_vector_free(&added);
+	return error;
+}
+
+static int index_split_expire_cb(void *payload, git_buf *path)
+{
+	const char *current = payload, *filename = git_path_basename(path->ptr);
+	struct stat st;
+
+	if (filename != NULL &&
+		!git__prefixcmp(filename, INDEX_SHARED_PREFIX) &&
+		strcmp(filename, current) != 0 &&
+		p_stat(path->ptr, &st) == 0 &&
+		st.st_mtime < time(NULL) - INDEX_SHARED_EXPIRE)
+		p_unlink(path->ptr);
+
+	git__free((char *)filename);
+	return 0;
+}
+
+/* remove the shared indexes that no index used for a while */
+static void index_split_expire(git_index *index, const git_oid *current)
+{
+	git_buf path = GIT_BUF_INIT, dir = GIT_BUF_INIT;
+
+	if (index_split_path(&path, index, current) == 0 &&
+		git_path_dirname_r(&dir, path.ptr) >= 0)
+		git_path_direach(&dir, 0, index_split_expire_cb,
+			(void *)(path.ptr + dir.size + 1));
+
+	giterr_clear();
+	git_buf_free(&path);
+	git_buf_free(&dir);
+}
+
+/* write all the entries in a new shared index */
+static int index_split_write_shared(
+	git_index_split **out, git_index *index, git_vector *entries)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_index_split *split = NULL;
+	git_index_entry *entry, *dup;
+	struct index_header header;
+	bool is_extended = false;
+	size_t i;
+	int error;
+
+	git_vector_foreach(entries, i, entry)
+		if (entry->flags & GIT_IDXENTRY_EXTENDED)
+			is_extended = true;
+
+	header.signature = htonl(INDEX_HEADER_SIG);
+	header.version = htonl(is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER);
+	header.entry_count = htonl((uint32_t)entries->length);
+
+	if ((error = git_buf_printf(&path, "%s.shared", index->index_file_path)) < 0 ||
+		(error = git_filebuf_open(&file, path.ptr,
+			GIT_FILEBUF_HASH_CONTENTS, GIT_INDEX_FILE_MODE)) < 0)
+		goto done;
+
+	if ((error = git_filebuf_write(&file, &header, sizeof(header))) < 0)
+		goto done;
+
+	git_vector_foreach(entries, i, entry)
+		if ((error = write_disk_entry(&file, entry)) < 0)
+			goto done;
+
+	split = git__calloc(1, sizeof(git_index_split));
+	GITERR_CHECK_ALLOC(split);
+
+	git_filebuf_hash(&split->base_id, &file);
+	git_buf_clear(&path);
+
+	if ((error = git_filebuf_write(
+			&file, split->base_id.id, GIT_OID_RAWSZ)) < 0 ||
+		(error = index_split_path(&path, index, &split->base_id)) < 0 ||
+		(error = git_filebuf_commit_at(&file, path.ptr)) < 0 ||
+		(error = git_vector_init(&split->base, entries->length, index_cmp)) < 0)
+		goto done;
+
+	git_vector_foreach(entries, i, entry) {
+		if ((dup = index_entry_dup(entry)) == NULL ||
+			(error = git_vector_insert(&split->base, dup)) < 0) {
+			index_entry_free(dup);
+			error = -1;
+			goto done;
+		}
+	}
+
+	*out = split;
+	split = NULL;
+
+done:
+	git_filebuf_cleanup(&file);
+	index_split_free(split);
+	git_buf_free(&path);
+	return error;
+}
+
+/*
+ * Decide how the index is written: `out` is left NULL to write all the
+ * entries in the index, or holds what changed since the shared index.
+ */
+static int index_split_prepare(index_split_delta **out, git_index *index)
+{
+	git_vector sorted = GIT_VECTOR_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_index_split *split;
+	index_split_delta *delta;
+	size_t changes = 0;
+	bool rewrite = true;
+	int max_percent, error;
+
+	*out = NULL;
+
+	if ((error = index_split_config(&max_percent, index)) <= 0) {
+		index_split_free(index->split);
+		index->split = NULL;
+		return error;
+	}
+
+	delta = git__calloc(1, sizeof(index_split_delta));
+	GITERR_CHECK_ALLOC(delta);
+
+	/* fix up the extended flags before entries are compared and copied */
+	is_index_extended(index);
+
+	if ((error = git_vector_dup(&sorted, &index->entries, index_cmp)) < 0)
+		goto done;
+	git_vector_sort(&sorted);
+
+	if (index->split != NULL) {
+		if ((error = index_split_diff(
+				&changes, delta, index->split, &sorted)) < 0)
+			goto done;
+
+		if ((error = index_split_path(
+				&path, index, &index->split->base_id)) < 0)
+			goto done;
+
+		/*
+		 * Tell other writers that the shared index is still in use, or
+		 * write it again if it is gone; too many changes are as slow to
+		 * read as a whole index, they go in a new shared index as well.
+		 */
+		if (p_utime_now(path.ptr) == 0)
+			rewrite = max_percent < 100 && changes * 100 >
+				(size_t)max_percent * index->split->base.length;
+	}
+
+	if (rewrite) {
+		if ((error = index_split_write_shared(&split, index, &sorted)) < 0)
+			goto done;
+
+		index_split_free(index->split);
+		index->split = split;
+
+		index_split_expire(index, &split->base_id);
+
+		if ((error = index_split_delta_init(delta, split->base.length)) < 0)
+			goto done;
+	}
+
+	*out = delta;
+	delta = NULL;
+
+done:
+	index_split_delta_free(delta);
+	git_vector_free(&sorted);
+	git_buf_free(&path);
+	return error;
+}
+
+static int write_link_extension(
+	git_index *index, git_filebuf *file, index_split_delta *delta)
+{
+	git_buf link_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	size_t base_count = index->split->base.length;
+	int error;
+
+	if ((error = git_buf_put(&link_buf,
+			(const char *)index->split->base_id.id, GIT_OID_RAWSZ)) < 0 ||
+		(error = git_ewah_write(
+			&link_buf, &delta->delete_bits, base_count)) < 0 ||
+		(error = git_ewah_write(
+			&link_buf, &delta->replace_bits, base_count)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_LINK_SIG, 4);
+	extension.extension_size = (uint32_t)link_buf.size;
+
+	error = write_extension(file, &extension, &link_buf);
+
+done:
+	git_buf_free(&link_buf);
+	return error;
+}
+
+static int write_index(
+	git_index *index, git_filebuf *file, index_split_delta *delta)
 {
 	git_oid hash_final;
 	struct index_header header;
@@ -1930,12 +2607,24 @@ static int write_index(git_index *index, git_filebuf *file)
 
 	header.signature = htonl(INDEX_HEADER_SIG);
 	header.version = htonl(is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER);
-	header.entry_count = htonl((uint32_t)index->entries.length);
+	header.entry_count = htonl((uint32_t)(delta ?
+		delta->entries.length : index->entries.length));
 
 	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
 		return -1;
 
-	if (write_entries(index, file) < 0)
+	if (delta != NULL) {
+		size_t i;
+		git_index_entry *entry;
+
+		git_vector_foreach(&delta->entries, i, entry)
+			if (write_disk_entry(file, entry) < 0)
+				return -1;
+
+		/* write the split index link, which git expects first */
+		if (write_link_extension(index, file, delta) < 0)
+			return -1;
+	} else if (write_entries(index, file) < 0)
 		return -1;
 
 	/* TODO: write tree cache extension */
@@ -1948,6 +2637,10 @@ static int write_index(git_index *index, git_filebuf *file)
 	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
 		return -1;
 
+	/* write the untracked cache extension */
+	if (index->untracked && write_untracked_extension(index, file) < 0)
+		return -1;
+
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(&hash_final, file);
 
@@ -2052,6 +2745,87 @@ git_repository *git_index_owner(const git_index *index)
 	return INDEX_OWNER(index);
 }
 
+struct index_add_job {
+	git_index_entry *entry;
+	unsigned int parallel:1,
+		hashed:1;
+};
+
+struct index_add_hash {
+	git_repository *repo;
+	struct index_add_job *jobs;
+	size_t nr_jobs;
+	git_atomic next_job;
+};
+
+/*
+ * Write the blobs of regular files without filters. Nothing but the
+ * loose object writer is touched, so several threads can run this on
+ * the same repository. A file that fails is left for the caller to
+ * retry, which reports the error on its own thread.
+ */
+static void *threaded_hash_blobs(void *arg)
+{
+	struct index_add_hash *hash = arg;
+	struct index_add_job *job;
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	while ((i = (size_t)git_atomic_inc(&hash->next_job) - 1) < hash->nr_jobs) {
+		job = &hash->jobs[i];
+		if (!job->parallel)
+			continue;
+
+		if (git_buf_joinpath(&path,
+				git_repository_workdir(hash->repo), job->entry->path) < 0 ||
+			git_blob__create_from_paths(&job->entry->oid, NULL, hash->repo,
+				path.ptr, job->entry->path, job->entry->mode, false) < 0) {
+			giterr_clear();
+			continue;
+		}
+
+		job->hashed = 1;
+	}
+
+	git_buf_free(&path);
+	return NULL;
+}
+
+#ifdef GIT_THREADS
+
+static void hash_blobs(struct index_add_hash *hash, size_t nr_parallel)
+{
+	git_thread *threads = NULL;
+	unsigned int i, nr_threads, active_threads = 0;
+
+	nr_threads = git_index__add_threads;
+	if (!nr_threads)
+		nr_threads = git_online_cpus();
+	if (nr_threads > nr_parallel)
+		nr_threads = (unsigned int)nr_parallel;
+
+	if (nr_threads > 1)
+		threads = git__calloc(nr_threads - 1, sizeof(git_thread));
+
+	/* The calling thread takes part, and runs alone if no thread starts */
+	for (i = 0; threads && i < nr_threads - 1; i++) {
+		if (git_thread_create(&threads[i], NULL, threaded_hash_blobs, hash))
+			break;
+		active_threads++;
+	}
+
+	threaded_hash_blobs(hash);
+
+	for (i = 0; i < active_threads; i++)
+		git_thread_join(threads[i], NULL);
+
+	git__free(threads);
+}
+
+#else
+#define hash_blobs(hash, nr_parallel) threaded_hash_blobs(hash)
+#endif
+
 int git_index_add_all(
 	git_index *index,
 	const git_strarray *paths,
@@ -2066,10 +2840,12 @@ int git_index_add_all(
 	git_index_entry *entry;
 	git_pathspec ps;
 	const char *match;
-	size_t existing;
+	size_t existing, i, nr_parallel = 0;
 	bool no_fnmatch = (flags & GIT_INDEX_ADD_DISABLE_PATHSPEC_MATCH) != 0;
 	int ignorecase;
-	git_oid blobid;
+	git_odb *odb;
+	git_vector matched = GIT_VECTOR_INIT;
+	struct index_add_hash hash = { 0 };
 
 	assert(index);
 
@@ -2122,41 +2898,97 @@ int git_index_add_all(
 			}
 		}
 
-		/* TODO: Should we check if the file on disk is already an exact
-		 * match to the file in the index and skip this work if it is?
-		 */
-
-		/* write the blob to disk and get the oid */
-		if ((error = git_blob_create_fromworkdir(&blobid, repo, wd->path)) < 0)
-			break;
-
-		/* make the new entry to insert */
-		if ((entry = index_entry_dup(wd)) == NULL) {
+		/* make the new entry to insert, the blob is written below */
+		if ((entry = index_entry_dup(wd)) == NULL ||
+			(error = git_vector_insert(&matched, entry)) < 0) {
+			index_entry_free(entry);
 			error = -1;
 			break;
 		}
-		entry->oid = blobid;
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+	if (error < 0)
+		goto cleanup;
+
+	hash.repo = repo;
+	hash.nr_jobs = matched.length;
+	hash.jobs = git__calloc(matched.length + 1, sizeof(struct index_add_job));
+	if (!hash.jobs) {
+		error = -1;
+		goto cleanup;
+	}
+
+	/*
+	 * Regular files that go into the odb unfiltered are written on
+	 * several threads. The filters read attributes, config and maybe
+	 * the odb, so the other files are written one at a time below.
+	 */
+	git_vector_foreach(&matched, i, entry) {
+		git_filter_list *fl = NULL;
+
+		hash.jobs[i].entry = entry;
+
+		if (!S_ISREG(entry->mode))
+			continue;
+
+		if ((error = git_filter_list_load(
+				&fl, repo, NULL, entry->path, GIT_FILTER_TO_ODB)) < 0)
+			goto cleanup;
+
+		if (fl == NULL) {
+			hash.jobs[i].parallel = 1;
+			nr_parallel++;
+		}
+
+		git_filter_list_free(fl);
+	}
+
+	/* load the odb before the threads share it */
+	if (nr_parallel > 0 &&
+		(error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		goto cleanup;
+
+	if (nr_parallel > 0)
+		hash_blobs(&hash, nr_parallel);
+
+	for (i = 0; i < hash.nr_jobs; ++i) {
+		entry = hash.jobs[i].entry;
+
+		/* write the blob to disk and get the oid */
+		if (!hash.jobs[i].hashed &&
+			(error = git_blob_create_fromworkdir(
+				&entry->oid, repo, entry->path)) < 0)
+			break;
 
 		/* add working directory item to index */
-		if ((error = index_insert(index, entry, 1)) < 0) {
-			index_entry_free(entry);
+		if ((error = index_insert(index, entry, 1)) < 0)
 			break;
-		}
+		hash.jobs[i].entry = NULL;
 
-		git_tree_cache_invalidate_path(index->tree, wd->path);
+		git_tree_cache_invalidate_path(index->tree, entry->path);
 
 		/* add implies conflict resolved, move conflict entries to REUC */
-		if ((error = index_conflict_to_reuc(index, wd->path)) < 0) {
+		if ((error = index_conflict_to_reuc(index, entry->path)) < 0) {
 			if (error != GIT_ENOTFOUND)
 				break;
+			error = 0;
 			giterr_clear();
 		}
 	}
 
-	if (error == GIT_ITEROVER)
-		error = 0;
-
 cleanup:
+	if (hash.jobs) {
+		for (i = 0; i < hash.nr_jobs; ++i)
+			index_entry_free(hash.jobs[i].entry);
+	} else {
+		git_vector_foreach(&matched, i, entry)
+			index_entry_free(entry);
+	}
+
+	git__free(hash.jobs);
+	git_vector_free(&matched);
 	git_iterator_free(wditer);
 	git_pathspec__clear(&ps);
 
@@ -2273,3 +3105,191 @@ int git_index_update_all(
 
 	return error;
 }
+
+#define INDEX_PRELOAD_CHUNK 64
+
+/* the number of entries that makes one more thread worth it */
+#define INDEX_PRELOAD_PER_THREAD 500
+#define INDEX_PRELOAD_MAX_THREADS 20
+
+struct index_preload_stat {
+	struct stat st;
+	unsigned int valid:1;
+};
+
+struct git_index_preload {
+	git_index *index;
+	const char *workdir;
+	char *prefix;
+	struct index_preload_stat *stats; /* by position in the index */
+	size_t nr_entries;
+	git_atomic next_chunk;
+};
+
+#ifdef GIT_THREADS
+
+/*
+ * lstat the entries of the index, a chunk at a time. Each thread only
+ * writes the stats of its own chunks, and the index is not modified
+ * until the preload is freed.
+ */
+static void *threaded_preload(void *arg)
+{
+	git_index_preload *preload = arg;
+	git_buf path = GIT_BUF_INIT;
+	size_t chunk, i, end;
+	int (*prefixcmp)(const char *str, const char *prefix) =
+		preload->index->ignore_case ? git__prefixcmp_icase : git__prefixcmp;
+
+	if (git_buf_sets(&path, preload->workdir) < 0)
+		return NULL;
+
+	while ((chunk = (size_t)git_atomic_inc(&preload->next_chunk) - 1) <
+			(preload->nr_entries + INDEX_PRELOAD_CHUNK - 1) / INDEX_PRELOAD_CHUNK) {
+		i = chunk * INDEX_PRELOAD_CHUNK;
+		end = min(i + INDEX_PRELOAD_CHUNK, preload->nr_entries);
+
+		for (; i < end; ++i) {
+			const git_index_entry *entry =
+				git_vector_get(&preload->index->entries, i);
+
+			if (GIT_IDXENTRY_STAGE(entry) != 0 || S_ISGITLINK(entry->mode) ||
+				(preload->prefix && prefixcmp(entry->path, preload->prefix)))
+				continue;
+
+			git_buf_truncate(&path, strlen(preload->workdir));
+			if (git_buf_puts(&path, entry->path) < 0)
+				break;
+
+			if (p_lstat(path.ptr, &preload->stats[i].st) == 0)
+				preload->stats[i].valid = 1;
+		}
+	}
+
+	git_buf_free(&path);
+	return NULL;
+}
+
+static unsigned int index_preload_threads(git_repository *repo, size_t nr_entries)
+{
+	git_config *cfg;
+	unsigned int nr_threads;
+	int enabled;
+
+	if (git_repository_config__weakptr(&cfg, repo) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	if (git_config_get_bool(&enabled, cfg, "core.preloadindex") < 0) {
+		giterr_clear();
+		enabled = 1;
+	}
+
+	if (!enabled)
+		return 0;
+
+	/* lstat waits on the file system, so this does not follow the CPUs */
+	nr_threads = git_index__preload_threads;
+	if (!nr_threads)
+		nr_threads = INDEX_PRELOAD_MAX_THREADS;
+	if (nr_threads > nr_entries / INDEX_PRELOAD_PER_THREAD)
+		nr_threads = (unsigned int)(nr_entries / INDEX_PRELOAD_PER_THREAD);
+
+	return nr_threads;
+}
+
+int git_index__preload(
+	git_index_preload **out,
+	git_repository *repo,
+	git_index *index,
+	const git_strarray *pathspec)
+{
+	git_index_preload *preload;
+	git_thread *threads;
+	unsigned int i, nr_threads, active_threads = 0;
+
+	*out = NULL;
+
+	if (!git_repository_workdir(repo) ||
+		(nr_threads = index_preload_threads(repo, index->entries.length)) < 2)
+		return 0;
+
+	preload = git__calloc(1, sizeof(git_index_preload));
+	GITERR_CHECK_ALLOC(preload);
+
+	git_vector_sort(&index->entries);
+
+	preload->index = index;
+	preload->workdir = git_repository_workdir(repo);
+	preload->nr_entries = index->entries.length;
+	preload->prefix = pathspec ? git_pathspec_prefix(pathspec) : NULL;
+	preload->stats =
+		git__calloc(preload->nr_entries, sizeof(struct index_preload_stat));
+	threads = git__calloc(nr_threads - 1, sizeof(git_thread));
+
+	if (!preload->stats || !threads) {
+		git__free(threads);
+		git_index__preload_free(preload);
+		return -1;
+	}
+
+	/* The calling thread takes part, and runs alone if no thread starts */
+	for (i = 0; i < nr_threads - 1; i++) {
+		if (git_thread_create(&threads[i], NULL, threaded_preload, preload))
+			break;
+		active_threads++;
+	}
+
+	threaded_preload(preload);
+
+	for (i = 0; i < active_threads; i++)
+		git_thread_join(threads[i], NULL);
+
+	git__free(threads);
+
+	*out = preload;
+	return 0;
+}
+
+#else
+
+int git_index__preload(
+	git_index_preload **out,
+	git_repository *repo,
+	git_index *index,
+	const git_strarray *pathspec)
+{
+	GIT_UNUSED(repo);
+	GIT_UNUSED(index);
+	GIT_UNUSED(pathspec);
+
+	/* a single thread does not beat the lstat of the iterator */
+	*out = NULL;
+	return 0;
+}
+
+#endif
+
+void git_index__preload_free(git_index_preload *preload)
+{
+	if (!preload)
+		return;
+
+	git__free(preload->prefix);
+	git__free(preload->stats);
+	git__free(preload);
+}
+
+int git_index__preload_stat(struct stat *st, const char *path, void *payload)
+{
+	git_index_preload *preload = payload;
+	size_t pos;
+
+	if (git_index__find(&pos, preload->index, path, 0) < 0 ||
+		pos >= preload->nr_entries || !preload->stats[pos].valid)
+		return GIT_ENOTFOUND;
+
+	memcpy(st, &preload->stats[pos].st, sizeof(struct stat));
+	return 0;
+}
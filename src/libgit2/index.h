@@ -11,12 +11,24 @@
 #include "filebuf.h"
 #include "vector.h"
 #include "tree-cache.h"
+#include "untracked-cache.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
 #define GIT_INDEX_FILE "index"
 #define GIT_INDEX_FILE_MODE 0666
 
+/*
+ * A split index keeps most of its entries in a shared index file,
+ * `sharedindex.<id>` next to the index, and only writes the entries
+ * that changed since then in the index itself, with the "link"
+ * extension git uses for core.splitIndex.
+ */
+typedef struct {
+	git_oid base_id;
+	git_vector base; /* the entries of the shared index, in file order */
+} git_index_split;
+
 struct git_index {
 	git_refcount rc;
 
@@ -32,6 +44,8 @@ struct git_index {
 	unsigned int no_symlinks:1;
 
 	git_tree_cache *tree;
+	git_untracked_cache *untracked;
+	git_index_split *split;
 
 	git_vector names;
 	git_vector reuc;
@@ -60,4 +74,27 @@ extern int git_index__find(
 
 extern void git_index__set_ignore_case(git_index *index, bool ignore_case);
 
+/* Write the index if only its untracked cache changed and the file on
+ * disk is still the one that was read; errors are not reported */
+extern void git_index__write_untracked_cache(git_index *index);
+
+typedef struct git_index_preload git_index_preload;
+
+/*
+ * Stat the entries of the index on several threads before a diff with
+ * the working directory, when core.preloadIndex is not false; `out` is
+ * set to NULL when the index is too small for threads to pay off.
+ */
+extern int git_index__preload(
+	git_index_preload **out,
+	git_repository *repo,
+	git_index *index,
+	const git_strarray *pathspec);
+
+/* A `git_path_stat_cb` that answers from the preloaded stat data */
+extern int git_index__preload_stat(
+	struct stat *st, const char *path, void *payload);
+
+extern void git_index__preload_free(git_index_preload *preload);
+
 #endif
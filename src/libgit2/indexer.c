@@ -19,9 +19,14 @@
 #include "oid.h"
 #include "oidmap.h"
 #include "compress.h"
+#include "delta-apply.h"
+#include "thread-utils.h"
 
 #define UINT31_MAX (0x7FFFFFFF)
 
+/* Number of threads used to resolve deltas, 0 for one per online CPU */
+unsigned int git_indexer__default_threads = 0;
+
 struct entry {
 	git_oid oid;
 	uint32_t crc;
@@ -62,6 +67,21 @@ struct git_indexer {
 
 struct delta_info {
 	git_off_t delta_off;
+
+	/* Where the compressed delta data starts and its inflated size */
+	git_off_t data_off;
+	size_t size;
+	git_otype type;
+	uint32_t crc;
+
+	/* The base of an OFS_DELTA is found by offset, a REF_DELTA by id */
+	git_off_t base_off;
+	git_oid base_id;
+
+	/* Set when the delta has been resolved in resolve_delta_forest() */
+	git_atomic claimed;
+	unsigned int resolved :1;
+	git_oid oid;
 };
 
 const git_oid *git_indexer_hash(const git_indexer *idx)
@@ -159,21 +179,6 @@ cleanup:
 	return -1;
 }
 
-/* Try to store the delta so we can try to resolve it later */
-static int store_delta(git_indexer *idx)
-{
-	struct delta_info *delta;
-
-	delta = git__calloc(1, sizeof(struct delta_info));
-	GITERR_CHECK_ALLOC(delta);
-	delta->delta_off = idx->entry_start;
-
-	if (git_vector_insert(&idx->deltas, delta) < 0)
-		return -1;
-
-	return 0;
-}
-
 static void hash_header(git_hash_ctx *ctx, git_off_t len, git_otype type)
 {
 	char buffer[64];
@@ -262,6 +267,63 @@ static int crc_object(uint32_t *crc_out, git_mwindow_file *mwf, git_off_t start,
 	return 0;
 }
 
+/*
+ * Try to store the delta so we can try to resolve it later. The whole
+ * entry has been received, so we note where its base is and where its
+ * data starts while the pack is still hot in the cache.
+ */
+static int store_delta(git_indexer *idx)
+{
+	struct delta_info *delta;
+	git_mwindow *w = NULL;
+	git_off_t curpos = idx->entry_start;
+	unsigned char *base_info;
+	unsigned int left;
+
+	delta = git__calloc(1, sizeof(struct delta_info));
+	GITERR_CHECK_ALLOC(delta);
+	delta->delta_off = idx->entry_start;
+
+	if (git_packfile_unpack_header(&delta->size, &delta->type,
+			&idx->pack->mwf, &w, &curpos) < 0)
+		goto on_error;
+	git_mwindow_close(&w);
+
+	if (delta->type == GIT_OBJ_OFS_DELTA) {
+		delta->base_off = get_delta_base(idx->pack, &w, &curpos,
+			delta->type, delta->delta_off);
+		git_mwindow_close(&w);
+		if (delta->base_off <= 0) {
+			giterr_set(GITERR_INDEXER, "invalid delta base offset");
+			goto on_error;
+		}
+	} else {
+		base_info = git_mwindow_open(&idx->pack->mwf, &w, curpos,
+			GIT_OID_RAWSZ, &left);
+		if (base_info == NULL)
+			goto on_error;
+
+		git_oid_fromraw(&delta->base_id, base_info);
+		git_mwindow_close(&w);
+		curpos += GIT_OID_RAWSZ;
+	}
+
+	delta->data_off = curpos;
+
+	if (crc_object(&delta->crc, &idx->pack->mwf, delta->delta_off,
+			idx->off - delta->delta_off) < 0)
+		goto on_error;
+
+	if (git_vector_insert(&idx->deltas, delta) < 0)
+		goto on_error;
+
+	return 0;
+
+on_error:
+	git__free(delta);
+	return -1;
+}
+
 static int store_object(git_indexer *idx)
 {
 	int i, error;
@@ -456,6 +518,9 @@ int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_tran
 		mwf = &idx->pack->mwf;
 		if ((error = git_mwindow_file_register(&idx->pack->mwf)) < 0)
 			return error;
+
+		/* The objects are parsed in the order they are received */
+		git_mwindow_file_advise(mwf, GIT_MADV_SEQUENTIAL);
 	}
 
 	if (!idx->parsed_header) {
@@ -749,12 +814,305 @@ static int fix_thin_pack(git_indexer *idx, git_transfer_progress *stats)
 	return 0;
 }
 
+/*
+ * Once the whole pack has been received, the deltas form a forest: the
+ * roots are the full objects, and the children of an object are the
+ * OFS_DELTAs pointing at its offset and the REF_DELTAs naming its id.
+ * Independent trees are resolved in parallel. A tree is walked depth
+ * first so that only the bases on the current path are kept inflated.
+ */
+struct delta_forest {
+	git_indexer *idx;
+	git_vector ofs;
+	git_vector ref;
+	size_t nr_roots;
+	git_atomic next_root;
+};
+
+static int delta_base_off_cmp(const void *a, const void *b)
+{
+	const struct delta_info *delta_a = a;
+	const struct delta_info *delta_b = b;
+
+	if (delta_a->base_off < delta_b->base_off)
+		return -1;
+	return delta_a->base_off > delta_b->base_off;
+}
+
+static int delta_base_id_cmp(const void *a, const void *b)
+{
+	const struct delta_info *delta_a = a;
+	const struct delta_info *delta_b = b;
+
+	return git_oid__cmp(&delta_a->base_id, &delta_b->base_id);
+}
+
+/* Index of the first OFS_DELTA with a base at or after `off` */
+static size_t first_child_by_off(const git_vector *ofs, git_off_t off)
+{
+	size_t lo = 0, hi = ofs->length;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct delta_info *delta = ofs->contents[mid];
+
+		if (delta->base_off < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Index of the first REF_DELTA with a base id equal to or after `id` */
+static size_t first_child_by_id(const git_vector *ref, const git_oid *id)
+{
+	size_t lo = 0, hi = ref->length;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct delta_info *delta = ref->contents[mid];
+
+		if (git_oid__cmp(&delta->base_id, id) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int has_children(
+	struct delta_forest *forest, git_off_t off, const git_oid *id)
+{
+	size_t i;
+
+	i = first_child_by_off(&forest->ofs, off);
+	if (i < forest->ofs.length &&
+		((struct delta_info *)forest->ofs.contents[i])->base_off == off)
+		return 1;
+
+	i = first_child_by_id(&forest->ref, id);
+	return i < forest->ref.length &&
+		!git_oid__cmp(&((struct delta_info *)forest->ref.contents[i])->base_id, id);
+}
+
+static void resolve_children(
+	struct delta_forest *forest, const git_rawobj *base,
+	git_off_t base_off, const git_oid *base_id);
+
+/*
+ * Apply a delta to its base and hash the result. A delta that cannot
+ * be resolved here is left for resolve_deltas(), which reports the
+ * error or fixes a thin pack.
+ */
+static void resolve_delta(
+	struct delta_forest *forest, const git_rawobj *base, struct delta_info *delta)
+{
+	git_rawobj diff, obj;
+	git_mwindow *w = NULL;
+	git_off_t curpos = delta->data_off;
+	int error;
+
+	/* A base id may appear twice in a broken pack */
+	if (git_atomic_inc(&delta->claimed) != 1)
+		return;
+
+	if (packfile_unpack_compressed(&diff, forest->idx->pack, &w, &curpos,
+			delta->size, delta->type) < 0)
+		return;
+
+	obj.type = base->type;
+	error = git__delta_apply(&obj, base->data, base->len, diff.data, diff.len);
+	git__free(diff.data);
+	if (error < 0)
+		return;
+
+	if (git_odb__hashobj(&delta->oid, &obj) == 0) {
+		delta->resolved = 1;
+		resolve_children(forest, &obj, delta->delta_off, &delta->oid);
+	}
+
+	git__free(obj.data);
+}
+
+static void resolve_children(
+	struct delta_forest *forest, const git_rawobj *base,
+	git_off_t base_off, const git_oid *base_id)
+{
+	size_t i;
+	struct delta_info *delta;
+
+	for (i = first_child_by_off(&forest->ofs, base_off); i < forest->ofs.length; i++) {
+		delta = forest->ofs.contents[i];
+		if (delta->base_off != base_off)
+			break;
+		resolve_delta(forest, base, delta);
+	}
+
+	for (i = first_child_by_id(&forest->ref, base_id); i < forest->ref.length; i++) {
+		delta = forest->ref.contents[i];
+		if (git_oid__cmp(&delta->base_id, base_id))
+			break;
+		resolve_delta(forest, base, delta);
+	}
+}
+
+static void resolve_root(struct delta_forest *forest, struct entry *entry)
+{
+	git_rawobj obj;
+	git_mwindow *w = NULL;
+	git_off_t off, curpos;
+	size_t size;
+	git_otype type;
+
+	off = entry->offset == UINT32_MAX ? (git_off_t)entry->offset_long : entry->offset;
+	if (!has_children(forest, off, &entry->oid))
+		return;
+
+	curpos = off;
+	if (git_packfile_unpack_header(&size, &type, &forest->idx->pack->mwf, &w, &curpos) < 0)
+		return;
+	git_mwindow_close(&w);
+
+	if (packfile_unpack_compressed(&obj, forest->idx->pack, &w, &curpos, size, type) < 0)
+		return;
+
+	resolve_children(forest, &obj, off, &entry->oid);
+	git__free(obj.data);
+}
+
+static void *threaded_resolve_roots(void *arg)
+{
+	struct delta_forest *forest = arg;
+	size_t i;
+
+	while ((i = (size_t)git_atomic_inc(&forest->next_root) - 1) < forest->nr_roots)
+		resolve_root(forest, forest->idx->objects.contents[i]);
+
+	return NULL;
+}
+
+#ifdef GIT_THREADS
+
+static void resolve_roots(struct delta_forest *forest)
+{
+	git_thread *threads = NULL;
+	unsigned int i, nr_threads, active_threads = 0;
+
+	nr_threads = git_indexer__default_threads;
+	if (!nr_threads)
+		nr_threads = git_online_cpus();
+	if (nr_threads > forest->nr_roots)
+		nr_threads = (unsigned int)forest->nr_roots;
+
+	if (nr_threads > 1)
+		threads = git__calloc(nr_threads - 1, sizeof(git_thread));
+
+	/* The calling thread takes part, and runs alone if no thread starts */
+	for (i = 0; threads && i < nr_threads - 1; i++) {
+		if (git_thread_create(&threads[i], NULL,
+				threaded_resolve_roots, forest))
+			break;
+		active_threads++;
+	}
+
+	threaded_resolve_roots(forest);
+
+	for (i = 0; i < active_threads; i++)
+		git_thread_join(threads[i], NULL);
+
+	git__free(threads);
+}
+
+#else
+#define resolve_roots(forest) threaded_resolve_roots(forest)
+#endif
+
+static int resolve_delta_forest(git_indexer *idx, git_transfer_progress *stats)
+{
+	struct delta_forest forest;
+	struct delta_info *delta;
+	struct entry *entry;
+	struct git_pack_entry *pentry;
+	size_t i, j;
+	int error = 0;
+
+	memset(&forest, 0, sizeof(forest));
+	forest.idx = idx;
+	forest.nr_roots = idx->objects.length;
+
+	if (git_vector_init(&forest.ofs, idx->deltas.length, delta_base_off_cmp) < 0 ||
+		git_vector_init(&forest.ref, 0, delta_base_id_cmp) < 0) {
+		error = -1;
+		goto cleanup;
+	}
+
+	git_vector_foreach(&idx->deltas, i, delta) {
+		git_vector *v = delta->type == GIT_OBJ_OFS_DELTA ? &forest.ofs : &forest.ref;
+
+		if ((error = git_vector_insert(v, delta)) < 0)
+			goto cleanup;
+	}
+
+	git_vector_sort(&forest.ofs);
+	git_vector_sort(&forest.ref);
+
+	resolve_roots(&forest);
+	giterr_clear();
+
+	git_vector_foreach(&idx->deltas, i, delta) {
+		if (!delta->resolved)
+			continue;
+
+		entry = git__calloc(1, sizeof(*entry));
+		pentry = git__calloc(1, sizeof(struct git_pack_entry));
+		if (!entry || !pentry) {
+			git__free(entry);
+			git__free(pentry);
+			error = -1;
+			goto cleanup;
+		}
+
+		git_oid_cpy(&pentry->sha1, &delta->oid);
+		git_oid_cpy(&entry->oid, &delta->oid);
+		entry->crc = delta->crc;
+
+		if ((error = save_entry(idx, entry, pentry, delta->delta_off)) < 0)
+			goto cleanup;
+
+		stats->indexed_objects++;
+		stats->indexed_deltas++;
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			goto cleanup;
+	}
+
+	/* Keep the deltas we could not resolve for resolve_deltas() */
+	for (i = 0, j = 0; i < idx->deltas.length; i++) {
+		delta = idx->deltas.contents[i];
+		if (delta->resolved)
+			git__free(delta);
+		else
+			idx->deltas.contents[j++] = delta;
+	}
+	idx->deltas.length = j;
+
+cleanup:
+	git_vector_free(&forest.ofs);
+	git_vector_free(&forest.ref);
+	return error;
+}
+
 static int resolve_deltas(git_indexer *idx, git_transfer_progress *stats)
 {
 	unsigned int i;
 	struct delta_info *delta;
 	int progressed = 0, progress_cb_result;
 
+	if ((progress_cb_result = resolve_delta_forest(idx, stats)) < 0)
+		return progress_cb_result;
+
 	while (idx->deltas.length > 0) {
 		progressed = 0;
 		git_vector_foreach(&idx->deltas, i, delta) {
@@ -808,6 +1166,7 @@ static int update_header_and_rehash(git_indexer *idx, git_transfer_progress *sta
 
 	git_hash_ctx_init(ctx);
 	git_mwindow_free_all(mwf);
+	git_mwindow_file_advise(mwf, GIT_MADV_SEQUENTIAL);
 
 	/* Update the header to include the numer of local objects we injected */
 	idx->hdr.hdr_entries = htonl(stats->total_objects + stats->local_objects);
@@ -883,6 +1242,9 @@ int git_indexer_commit(git_indexer *idx, git_transfer_progress *stats)
 	/* Freeze the number of deltas */
 	stats->total_deltas = stats->total_objects - stats->indexed_objects;
 
+	/* The bases of the deltas are read in any order */
+	git_mwindow_file_advise(&idx->pack->mwf, GIT_MADV_NORMAL);
+
 	if ((error = resolve_deltas(idx, stats)) < 0)
 		return error;
 
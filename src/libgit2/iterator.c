@@ -895,6 +895,8 @@ struct fs_iterator {
 	size_t root_len;
 	uint32_t dirload_flags;
 	int depth;
+	git_untracked_cache *untracked;
+	git_index_preload *preload;
 
 	int (*enter_dir_cb)(fs_iterator *self);
 	int (*leave_dir_cb)(fs_iterator *self);
@@ -971,6 +973,7 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 {
 	int error;
 	fs_iterator_frame *ff;
+	git_path_stat_cb stat_cb;
 
 	if (fi->depth > FS_MAX_DEPTH) {
 		giterr_set(GITERR_REPOSITORY,
@@ -981,9 +984,16 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 	ff = fs_iterator__alloc_frame(fi);
 	GITERR_CHECK_ALLOC(ff);
 
-	error = git_path_dirload_with_stat(
-		fi->path.ptr, fi->root_len, fi->dirload_flags,
-		fi->base.start, fi->base.end, &ff->entries);
+	stat_cb = fi->preload ? git_index__preload_stat : NULL;
+
+	if (fi->untracked && !fi->base.start && !fi->base.end)
+		error = git_untracked_cache_dirload(
+			fi->untracked, fi->path.ptr, fi->root_len, fi->dirload_flags,
+			stat_cb, fi->preload, &ff->entries);
+	else
+		error = git_path_dirload_with_stat_ext(
+			fi->path.ptr, fi->root_len, fi->dirload_flags,
+			fi->base.start, fi->base.end, stat_cb, fi->preload, &ff->entries);
 
 	if (error < 0) {
 		git_error_state last_error = { 0 };
@@ -1329,10 +1339,12 @@ static void workdir_iterator__free(git_iterator *self)
 	git_ignore__free(&wi->ignores);
 }
 
-int git_iterator_for_workdir_ext(
+static int workdir_iterator__new(
 	git_iterator **out,
 	git_repository *repo,
 	const char *repo_workdir,
+	git_untracked_cache *untracked,
+	git_index_preload *preload,
 	git_iterator_flag_t flags,
 	const char *start,
 	const char *end)
@@ -1356,6 +1368,8 @@ int git_iterator_for_workdir_ext(
 	wi->fi.enter_dir_cb = workdir_iterator__enter_dir;
 	wi->fi.leave_dir_cb = workdir_iterator__leave_dir;
 	wi->fi.update_entry_cb = workdir_iterator__update_entry;
+	wi->fi.untracked = untracked;
+	wi->fi.preload = preload;
 
 	if ((error = iterator__update_ignore_case((git_iterator *)wi, flags)) < 0 ||
 		(error = git_ignore__for_path(repo, ".gitignore", &wi->ignores)) < 0)
@@ -1373,6 +1387,33 @@ int git_iterator_for_workdir_ext(
 	return fs_iterator__initialize(out, &wi->fi, repo_workdir);
 }
 
+int git_iterator_for_workdir_ext(
+	git_iterator **out,
+	git_repository *repo,
+	const char *repo_workdir,
+	git_iterator_flag_t flags,
+	const char *start,
+	const char *end)
+{
+	return workdir_iterator__new(
+		out, repo, repo_workdir, NULL, NULL, flags, start, end);
+}
+
+int git_iterator_for_workdir_cached(
+	git_iterator **out,
+	git_repository *repo,
+	git_untracked_cache *untracked,
+	git_index_preload *preload,
+	git_iterator_flag_t flags,
+	const char *start,
+	const char *end)
+{
+	assert(!untracked || untracked->active);
+
+	return workdir_iterator__new(
+		out, repo, NULL, untracked, preload, flags, start, end);
+}
+
 
 void git_iterator_free(git_iterator *iter)
 {
@@ -11,6 +11,7 @@
 #include "git2/index.h"
 #include "vector.h"
 #include "buffer.h"
+#include "index.h"
 
 typedef struct git_iterator git_iterator;
 
@@ -102,6 +103,20 @@ GIT_INLINE(int) git_iterator_for_workdir(
 	return git_iterator_for_workdir_ext(out, repo, NULL, flags, start, end);
 }
 
+/* workdir iterator that reads the directories through the untracked cache
+ * of the index, which must have been started with git_untracked_cache_begin,
+ * and takes the stat data of indexed files from a preload; either may be
+ * NULL
+ */
+extern int git_iterator_for_workdir_cached(
+	git_iterator **out,
+	git_repository *repo,
+	git_untracked_cache *untracked,
+	git_index_preload *preload,
+	git_iterator_flag_t flags,
+	const char *start,
+	const char *end);
+
 /* for filesystem iterators, you have to explicitly pass in the ignore_case
  * behavior that you desire
  */
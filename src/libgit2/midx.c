@@ -0,0 +1,589 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "midx.h"
+#include "pack.h"
+#include "filebuf.h"
+#include "fileops.h"
+#include "hash.h"
+#include "odb.h"
+#include "oid.h"
+#include "array.h"
+
+#define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
+#define MIDX_VERSION 1
+#define MIDX_OBJECT_ID_VERSION 1 /* SHA-1 */
+
+#define MIDX_CHUNK_PNAM 0x504e414d /* "PNAM" */
+#define MIDX_CHUNK_OIDF 0x4f494446 /* "OIDF" */
+#define MIDX_CHUNK_OIDL 0x4f49444c /* "OIDL" */
+#define MIDX_CHUNK_OOFF 0x4f4f4646 /* "OOFF" */
+#define MIDX_CHUNK_LOFF 0x4c4f4646 /* "LOFF" */
+
+#define MIDX_HEADER_SIZE 12
+#define MIDX_CHUNK_LOOKUP_WIDTH 12
+#define MIDX_CHUNK_ALIGNMENT 4
+#define MIDX_OFFSET_WIDTH 8
+
+#define MIDX_LARGE_OFFSET_NEEDED 0x80000000
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(uint64_t) get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+GIT_INLINE(void) put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static int midx_error(const char *path, const char *msg)
+{
+	giterr_set(GITERR_ODB, "Invalid multi-pack-index file '%s' - %s", path, msg);
+	return -1;
+}
+
+static int midx_parse_packfile_names(
+	git_midx_file *idx, const char *path, const unsigned char *data, size_t len)
+{
+	const char *name = (const char *)data, *end = (const char *)data + len;
+	uint32_t i;
+
+	if (git_vector_init(&idx->packfile_names, idx->num_packs, NULL) < 0)
+		return -1;
+
+	for (i = 0; i < idx->num_packs; i++) {
+		const char *nul = memchr(name, '\0', end - name);
+
+		if (nul == NULL || nul == name)
+			return midx_error(path, "packfile names are truncated");
+
+		if (git__suffixcmp(name, ".idx") != 0 || strchr(name, '/') != NULL)
+			return midx_error(path, "invalid packfile name");
+
+		if (i > 0 && strcmp(git_vector_last(&idx->packfile_names), name) >= 0)
+			return midx_error(path, "packfile names are not sorted");
+
+		if (git_vector_insert(&idx->packfile_names, (char *)name) < 0)
+			return -1;
+
+		name = nul + 1;
+	}
+
+	return 0;
+}
+
+static int midx_parse(git_midx_file *idx, const char *path)
+{
+	const unsigned char *data = idx->map.data;
+	size_t len = idx->map.len, i, num_chunks;
+	uint64_t pnam_offset = 0, pnam_len = 0, oidf_offset = 0, oidl_offset = 0;
+	uint64_t ooff_offset = 0, loff_offset = 0, loff_len = 0, trailer_offset;
+
+	if (len < MIDX_HEADER_SIZE + GIT_OID_RAWSZ)
+		return midx_error(path, "file is too short");
+
+	if (get_be32(data) != MIDX_SIGNATURE)
+		return midx_error(path, "unknown signature");
+
+	if (data[4] != MIDX_VERSION || data[5] != MIDX_OBJECT_ID_VERSION)
+		return midx_error(path, "unsupported version");
+
+	/* Chains of incremental multi-pack-indexes are not supported */
+	if (data[7] != 0)
+		return midx_error(path, "base multi-pack-index files are not supported");
+
+	num_chunks = data[6];
+	idx->num_packs = get_be32(data + 8);
+	trailer_offset = len - GIT_OID_RAWSZ;
+
+	if (MIDX_HEADER_SIZE +
+		(num_chunks + 1) * MIDX_CHUNK_LOOKUP_WIDTH > trailer_offset)
+		return midx_error(path, "chunk lookup table is truncated");
+
+	for (i = 0; i < num_chunks; i++) {
+		const unsigned char *chunk = data + MIDX_HEADER_SIZE +
+			i * MIDX_CHUNK_LOOKUP_WIDTH;
+		uint32_t id = get_be32(chunk);
+		uint64_t offset = get_be64(chunk + 4);
+		uint64_t next = get_be64(chunk + 4 + MIDX_CHUNK_LOOKUP_WIDTH);
+
+		if (offset > next || next > trailer_offset)
+			return midx_error(path, "chunk offset out of bounds");
+
+		switch (id) {
+		case MIDX_CHUNK_PNAM:
+			pnam_offset = offset;
+			pnam_len = next - offset;
+			break;
+		case MIDX_CHUNK_OIDF:
+			if (next - offset != 256 * 4)
+				return midx_error(path, "invalid fanout chunk");
+			oidf_offset = offset;
+			break;
+		case MIDX_CHUNK_OIDL:
+			oidl_offset = offset;
+			break;
+		case MIDX_CHUNK_OOFF:
+			ooff_offset = offset;
+			break;
+		case MIDX_CHUNK_LOFF:
+			loff_offset = offset;
+			loff_len = next - offset;
+			break;
+		default:
+			/* Unknown chunks are optional */
+			break;
+		}
+	}
+
+	if (!pnam_offset || !oidf_offset || !oidl_offset || !ooff_offset)
+		return midx_error(path, "missing required chunk");
+
+	if (midx_parse_packfile_names(idx, path, data + pnam_offset, (size_t)pnam_len) < 0)
+		return -1;
+
+	idx->oid_fanout = data + oidf_offset;
+	idx->num_objects = get_be32(data + oidf_offset + 255 * 4);
+
+	for (i = 1; i < 256; i++) {
+		if (get_be32(data + oidf_offset + i * 4) <
+			get_be32(data + oidf_offset + (i - 1) * 4))
+			return midx_error(path, "fanout is not monotonic");
+	}
+
+	if (oidl_offset + (uint64_t)idx->num_objects * GIT_OID_RAWSZ > trailer_offset ||
+		ooff_offset + (uint64_t)idx->num_objects * MIDX_OFFSET_WIDTH > trailer_offset)
+		return midx_error(path, "object tables are truncated");
+
+	idx->oid_lookup = data + oidl_offset;
+	idx->object_offsets = data + ooff_offset;
+
+	if (loff_offset) {
+		idx->object_large_offsets = data + loff_offset;
+		idx->num_object_large_offsets = (uint32_t)(loff_len / 8);
+	}
+
+	git_oid_fromraw(&idx->checksum, data + trailer_offset);
+	return 0;
+}
+
+int git_midx_open(git_midx_file **out, const char *path)
+{
+	git_midx_file *idx;
+	int error;
+
+	*out = NULL;
+
+	if (!git_path_exists(path))
+		return GIT_ENOTFOUND;
+
+	idx = git__calloc(1, sizeof(git_midx_file));
+	GITERR_CHECK_ALLOC(idx);
+
+	if ((error = git_futils_mmap_ro_file(&idx->map, path)) < 0) {
+		git__free(idx);
+		return error;
+	}
+
+	if ((error = midx_parse(idx, path)) < 0) {
+		git_midx_free(idx);
+		return error;
+	}
+
+	*out = idx;
+	return 0;
+}
+
+void git_midx_free(git_midx_file *idx)
+{
+	if (idx == NULL)
+		return;
+
+	git_vector_free(&idx->packfile_names);
+	p_munmap(&idx->map);
+	git__free(idx);
+}
+
+static int midx_entry_get(
+	git_midx_entry *e, const git_midx_file *idx, uint32_t pos)
+{
+	const unsigned char *offset = idx->object_offsets + (size_t)pos * MIDX_OFFSET_WIDTH;
+	uint32_t pack_index = get_be32(offset), object_offset = get_be32(offset + 4);
+
+	if (pack_index >= idx->num_packs) {
+		giterr_set(GITERR_ODB, "Multi-pack-index pack id %u out of bounds", pack_index);
+		return -1;
+	}
+
+	e->pack_index = pack_index;
+
+	if (object_offset & MIDX_LARGE_OFFSET_NEEDED) {
+		uint32_t i = object_offset & ~MIDX_LARGE_OFFSET_NEEDED;
+
+		if (!idx->object_large_offsets || i >= idx->num_object_large_offsets) {
+			giterr_set(GITERR_ODB, "Multi-pack-index large offset out of bounds");
+			return -1;
+		}
+
+		e->offset = (git_off_t)get_be64(idx->object_large_offsets + (size_t)i * 8);
+	} else
+		e->offset = object_offset;
+
+	git_oid_fromraw(&e->sha1, idx->oid_lookup + (size_t)pos * GIT_OID_RAWSZ);
+	return 0;
+}
+
+int git_midx_entry_find(
+	git_midx_entry *e,
+	const git_midx_file *idx,
+	const git_oid *short_oid,
+	size_t len)
+{
+	uint32_t lo, hi, pos;
+	int cmp = -1;
+
+	lo = short_oid->id[0] ? get_be32(idx->oid_fanout + (short_oid->id[0] - 1) * 4) : 0;
+	hi = get_be32(idx->oid_fanout + short_oid->id[0] * 4);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		cmp = git_oid__cmp(short_oid,
+			(const git_oid *)(idx->oid_lookup + (size_t)mid * GIT_OID_RAWSZ));
+
+		if (!cmp) {
+			lo = mid;
+			break;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	/* `lo` is the first oid after a prefix, or the oid itself */
+	pos = lo;
+
+	if (cmp && (pos >= idx->num_objects || git_oid_ncmp(short_oid,
+			(const git_oid *)(idx->oid_lookup + (size_t)pos * GIT_OID_RAWSZ), len)))
+		return git_odb__error_notfound("failed to find offset for multi-pack-index entry", short_oid);
+
+	if (len != GIT_OID_HEXSZ && pos + 1 < idx->num_objects &&
+		!git_oid_ncmp(short_oid,
+			(const git_oid *)(idx->oid_lookup + (size_t)(pos + 1) * GIT_OID_RAWSZ), len))
+		return git_odb__error_ambiguous("found multiple offsets for multi-pack-index entry");
+
+	return midx_entry_get(e, idx, pos);
+}
+
+int git_midx_verify(git_midx_file *idx, git_vector *packs)
+{
+	git_oid checksum;
+	git_midx_entry e;
+	struct git_pack_entry pack_entry;
+	uint32_t i;
+
+	if (git_hash_buf(&checksum, idx->map.data, idx->map.len - GIT_OID_RAWSZ) < 0)
+		return -1;
+
+	if (git_oid__cmp(&checksum, &idx->checksum) != 0) {
+		giterr_set(GITERR_ODB, "Multi-pack-index checksum does not match");
+		return -1;
+	}
+
+	for (i = 0; i < idx->num_objects; i++) {
+		const unsigned char *oid = idx->oid_lookup + (size_t)i * GIT_OID_RAWSZ;
+		uint32_t first = oid[0] ? get_be32(idx->oid_fanout + (oid[0] - 1) * 4) : 0;
+
+		if (i < first || i >= get_be32(idx->oid_fanout + oid[0] * 4)) {
+			giterr_set(GITERR_ODB, "Multi-pack-index fanout does not match the oids");
+			return -1;
+		}
+
+		if (i > 0 && memcmp(oid - GIT_OID_RAWSZ, oid, GIT_OID_RAWSZ) >= 0) {
+			giterr_set(GITERR_ODB, "Multi-pack-index oids are not sorted");
+			return -1;
+		}
+
+		if (midx_entry_get(&e, idx, i) < 0)
+			return -1;
+
+		if (git_pack_entry_find(&pack_entry,
+				git_vector_get(packs, e.pack_index), &e.sha1, GIT_OID_HEXSZ) < 0)
+			return -1;
+
+		if (pack_entry.offset != e.offset) {
+			char hex[GIT_OID_HEXSZ + 1];
+
+			giterr_set(GITERR_ODB,
+				"Multi-pack-index offset of %s does not match its packfile",
+				git_oid_tostr(hex, sizeof(hex), &e.sha1));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Writing a multi-pack-index file
+ */
+
+typedef struct {
+	git_oid oid;
+	git_off_t offset;
+	uint32_t pack_index;
+	git_time_t pack_mtime;
+} midx_write_entry;
+
+typedef struct {
+	git_array_t(midx_write_entry) entries;
+	uint32_t pack_index;
+	git_time_t pack_mtime;
+} midx_writer;
+
+static int midx_entry_cmp(const void *a_, const void *b_)
+{
+	const midx_write_entry *a = a_, *b = b_;
+	int cmp = git_oid__cmp(&a->oid, &b->oid);
+
+	if (cmp)
+		return cmp;
+
+	/* the object is taken from the most recent packfile */
+	if (a->pack_mtime != b->pack_mtime)
+		return a->pack_mtime > b->pack_mtime ? -1 : 1;
+
+	return (int)a->pack_index - (int)b->pack_index;
+}
+
+static int midx_add_entry_cb(const git_oid *oid, git_off_t offset, void *payload)
+{
+	midx_writer *w = payload;
+	midx_write_entry *entry = git_array_alloc(w->entries);
+
+	GITERR_CHECK_ALLOC(entry);
+
+	git_oid_cpy(&entry->oid, oid);
+	entry->offset = offset;
+	entry->pack_index = w->pack_index;
+	entry->pack_mtime = w->pack_mtime;
+	return 0;
+}
+
+static const char *midx_pack_basename(const char *pack_name)
+{
+	const char *slash = strrchr(pack_name, '/');
+
+	return slash ? slash + 1 : pack_name;
+}
+
+static int midx_pack_name_cmp(const void *a_, const void *b_)
+{
+	const struct git_pack_file *a = a_, *b = b_;
+
+	return strcmp(midx_pack_basename(a->pack_name), midx_pack_basename(b->pack_name));
+}
+
+static int write_chunk_lookup(git_filebuf *file, uint32_t id, uint64_t offset)
+{
+	unsigned char entry[MIDX_CHUNK_LOOKUP_WIDTH];
+
+	put_be32(entry, id);
+	put_be32(entry + 4, (uint32_t)(offset >> 32));
+	put_be32(entry + 8, (uint32_t)offset);
+
+	return git_filebuf_write(file, entry, sizeof(entry));
+}
+
+static int write_midx(git_filebuf *file, git_vector *packs, midx_writer *w)
+{
+	unsigned char header[MIDX_HEADER_SIZE], buf[MIDX_OFFSET_WIDTH];
+	static const unsigned char padding[MIDX_CHUNK_ALIGNMENT];
+	git_buf names = GIT_BUF_INIT;
+	struct git_pack_file *p;
+	uint32_t fanout[256], num_large_offsets = 0, num_objects = 0;
+	uint64_t offset;
+	size_t i, num_chunks;
+	git_oid checksum;
+	int error = -1;
+
+	memset(fanout, 0, sizeof(fanout));
+	for (i = 0; i < git_array_size(w->entries); i++) {
+		midx_write_entry *entry = git_array_get(w->entries, i);
+
+		/* duplicates of an object follow its preferred copy */
+		if (i > 0 && !git_oid__cmp(&entry->oid, &(entry - 1)->oid))
+			continue;
+
+		fanout[entry->oid.id[0]]++;
+		num_objects++;
+		if ((uint64_t)entry->offset >> 31)
+			num_large_offsets++;
+	}
+	for (i = 1; i < 256; i++)
+		fanout[i] += fanout[i - 1];
+
+	git_vector_foreach(packs, i, p) {
+		const char *name = midx_pack_basename(p->pack_name);
+
+		git_buf_put(&names, name, strlen(name) - strlen(".pack"));
+		git_buf_put(&names, ".idx", sizeof(".idx"));
+	}
+	if (names.size % MIDX_CHUNK_ALIGNMENT)
+		git_buf_put(&names, (const char *)padding,
+			MIDX_CHUNK_ALIGNMENT - names.size % MIDX_CHUNK_ALIGNMENT);
+	if (git_buf_oom(&names))
+		goto done;
+
+	num_chunks = num_large_offsets ? 5 : 4;
+
+	put_be32(header, MIDX_SIGNATURE);
+	header[4] = MIDX_VERSION;
+	header[5] = MIDX_OBJECT_ID_VERSION;
+	header[6] = (unsigned char)num_chunks;
+	header[7] = 0;
+	put_be32(header + 8, (uint32_t)packs->length);
+	if (git_filebuf_write(file, header, sizeof(header)) < 0)
+		goto done;
+
+	offset = MIDX_HEADER_SIZE + (num_chunks + 1) * MIDX_CHUNK_LOOKUP_WIDTH;
+	if (write_chunk_lookup(file, MIDX_CHUNK_PNAM, offset) < 0)
+		goto done;
+	offset += names.size;
+	if (write_chunk_lookup(file, MIDX_CHUNK_OIDF, offset) < 0)
+		goto done;
+	offset += 256 * 4;
+	if (write_chunk_lookup(file, MIDX_CHUNK_OIDL, offset) < 0)
+		goto done;
+	offset += (uint64_t)num_objects * GIT_OID_RAWSZ;
+	if (write_chunk_lookup(file, MIDX_CHUNK_OOFF, offset) < 0)
+		goto done;
+	offset += (uint64_t)num_objects * MIDX_OFFSET_WIDTH;
+	if (num_large_offsets) {
+		if (write_chunk_lookup(file, MIDX_CHUNK_LOFF, offset) < 0)
+			goto done;
+		offset += (uint64_t)num_large_offsets * 8;
+	}
+	if (write_chunk_lookup(file, 0, offset) < 0)
+		goto done;
+
+	if (git_filebuf_write(file, names.ptr, names.size) < 0)
+		goto done;
+
+	for (i = 0; i < 256; i++) {
+		put_be32(buf, fanout[i]);
+		if (git_filebuf_write(file, buf, 4) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < git_array_size(w->entries); i++) {
+		midx_write_entry *entry = git_array_get(w->entries, i);
+
+		if (i > 0 && !git_oid__cmp(&entry->oid, &(entry - 1)->oid))
+			continue;
+		if (git_filebuf_write(file, entry->oid.id, GIT_OID_RAWSZ) < 0)
+			goto done;
+	}
+
+	num_large_offsets = 0;
+	for (i = 0; i < git_array_size(w->entries); i++) {
+		midx_write_entry *entry = git_array_get(w->entries, i);
+
+		if (i > 0 && !git_oid__cmp(&entry->oid, &(entry - 1)->oid))
+			continue;
+
+		put_be32(buf, entry->pack_index);
+		if ((uint64_t)entry->offset >> 31)
+			put_be32(buf + 4, MIDX_LARGE_OFFSET_NEEDED | num_large_offsets++);
+		else
+			put_be32(buf + 4, (uint32_t)entry->offset);
+
+		if (git_filebuf_write(file, buf, MIDX_OFFSET_WIDTH) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < git_array_size(w->entries); i++) {
+		midx_write_entry *entry = git_array_get(w->entries, i);
+
+		if (i > 0 && !git_oid__cmp(&entry->oid, &(entry - 1)->oid))
+			continue;
+		if (!((uint64_t)entry->offset >> 31))
+			continue;
+
+		put_be32(buf, (uint32_t)((uint64_t)entry->offset >> 32));
+		put_be32(buf + 4, (uint32_t)entry->offset);
+		if (git_filebuf_write(file, buf, 8) < 0)
+			goto done;
+	}
+
+	if (git_filebuf_hash(&checksum, file) < 0)
+		goto done;
+
+	error = git_filebuf_write(file, checksum.id, GIT_OID_RAWSZ);
+
+done:
+	git_buf_free(&names);
+	return error;
+}
+
+int git_midx_write(const char *pack_dir, git_vector *packs)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_vector sorted = GIT_VECTOR_INIT;
+	midx_writer w;
+	struct git_pack_file *p;
+	size_t i;
+	int error;
+
+	memset(&w, 0, sizeof(w));
+
+	/* the packfiles are numbered in the order of their names */
+	if ((error = git_vector_dup(&sorted, packs, midx_pack_name_cmp)) < 0)
+		return error;
+	git_vector_sort(&sorted);
+
+	git_vector_foreach(&sorted, i, p) {
+		w.pack_index = (uint32_t)i;
+		w.pack_mtime = p->mtime;
+
+		if ((error = git_pack_foreach_entry_offset(p, midx_add_entry_cb, &w)) < 0)
+			goto cleanup;
+	}
+
+	qsort(w.entries.ptr, git_array_size(w.entries),
+		sizeof(midx_write_entry), midx_entry_cmp);
+
+	if ((error = git_buf_joinpath(&path, pack_dir, GIT_MIDX_FILE)) < 0 ||
+		(error = git_filebuf_open(&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS, 0444)) < 0)
+		goto cleanup;
+
+	if ((error = write_midx(&file, &sorted, &w)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto cleanup;
+	}
+
+	error = git_filebuf_commit(&file);
+
+cleanup:
+	git_array_clear(w.entries);
+	git_vector_free(&sorted);
+	git_buf_free(&path);
+	return error;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_midx_h__
+#define INCLUDE_midx_h__
+
+#include "common.h"
+#include "map.h"
+#include "vector.h"
+#include "git2/oid.h"
+
+#define GIT_MIDX_FILE "multi-pack-index"
+
+/*
+ * A multi-pack-index in the format written by `git multi-pack-index`.
+ *
+ * The file lists the objects of several packfiles sorted by oid, with
+ * the packfile and the offset of each object, so that a lookup is one
+ * binary search instead of one per packfile. An object in more than
+ * one packfile is listed once, for the most recent packfile.
+ */
+typedef struct git_midx_file {
+	git_map map;
+
+	uint32_t num_packs;
+	git_vector packfile_names; /* "pack-<id>.idx", in the map */
+
+	uint32_t num_objects;
+	const unsigned char *oid_fanout;
+	const unsigned char *oid_lookup;
+	const unsigned char *object_offsets;
+	const unsigned char *object_large_offsets;
+	uint32_t num_object_large_offsets;
+
+	git_oid checksum;
+} git_midx_file;
+
+typedef struct {
+	git_oid sha1;
+	git_off_t offset;
+	uint32_t pack_index;
+} git_midx_entry;
+
+extern int git_midx_open(git_midx_file **out, const char *path);
+extern void git_midx_free(git_midx_file *idx);
+
+/*
+ * Find an object by a prefix of `len` hex characters of its oid, like
+ * `git_pack_entry_find`; returns GIT_ENOTFOUND or GIT_EAMBIGUOUS.
+ */
+extern int git_midx_entry_find(
+	git_midx_entry *e,
+	const git_midx_file *idx,
+	const git_oid *short_oid,
+	size_t len);
+
+/* Check the checksum and the ordering of the file, and that every object
+ * is at its offset in its packfile; `packs` holds the packfiles in the
+ * order of `packfile_names` */
+extern int git_midx_verify(git_midx_file *idx, git_vector *packs);
+
+/* Write the multi-pack-index of `packs` in the pack folder `pack_dir` */
+extern int git_midx_write(const char *pack_dir, git_vector *packs);
+
+#endif
@@ -23,9 +23,61 @@
 size_t git_mwindow__window_size = DEFAULT_WINDOW_SIZE;
 size_t git_mwindow__mapped_limit = DEFAULT_MAPPED_LIMIT;
 
+/*
+ * Half a window must be a multiple of the page size, which is the
+ * allocation granularity of 64KB on Windows
+ */
+#define WINDOW_ALIGN (128 * 1024)
+
 /* Whenever you want to read or modify this, grab git__mwindow_mutex */
 static git_mwindow_ctl mem_ctl;
 
+/* Append an unused window at the most recently used end of the list */
+static void lru_push(git_mwindow_ctl *ctl, git_mwindow *w)
+{
+	w->lru_next = NULL;
+	w->lru_prev = ctl->lru_tail;
+
+	if (ctl->lru_tail)
+		ctl->lru_tail->lru_next = w;
+	else
+		ctl->lru_head = w;
+
+	ctl->lru_tail = w;
+}
+
+static void lru_remove(git_mwindow_ctl *ctl, git_mwindow *w)
+{
+	if (w->lru_prev)
+		w->lru_prev->lru_next = w->lru_next;
+	else
+		ctl->lru_head = w->lru_next;
+
+	if (w->lru_next)
+		w->lru_next->lru_prev = w->lru_prev;
+	else
+		ctl->lru_tail = w->lru_prev;
+
+	w->lru_prev = w->lru_next = NULL;
+}
+
+/* Unmap a window that is no longer on any list */
+static void window_free(git_mwindow_ctl *ctl, git_mwindow *w)
+{
+	git_mwindow_budget *budget = w->mwf->budget;
+
+	ctl->mapped -= w->window_map.len;
+	ctl->open_windows--;
+
+	if (budget) {
+		budget->mapped -= w->window_map.len;
+		budget->open_windows--;
+	}
+
+	git_futils_mmap_free(&w->window_map);
+	git__free(w);
+}
+
 /*
  * Free all the windows in a sequence, typically because we're done
  * with the file
@@ -59,13 +111,9 @@ void git_mwindow_free_all(git_mwindow_file *mwf)
 		git_mwindow *w = mwf->windows;
 		assert(w->inuse_cnt == 0);
 
-		ctl->mapped -= w->window_map.len;
-		ctl->open_windows--;
-
-		git_futils_mmap_free(&w->window_map);
-
+		lru_remove(ctl, w);
 		mwf->windows = w->next;
-		git__free(w);
+		window_free(ctl, w);
 	}
 
 	git_mutex_unlock(&git__mwindow_mutex);
@@ -82,70 +130,30 @@ int git_mwindow_contains(git_mwindow *win, git_off_t offset)
 }
 
 /*
- * Find the least-recently-used window in a file
+ * Close the least recently used window that is not in use, among the
+ * files of `budget`, or among all files if it is NULL. Returns -1 if
+ * every window is in use. Called under lock from new_window.
  */
-static void git_mwindow_scan_lru(
-	git_mwindow_file *mwf,
-	git_mwindow **lru_w,
-	git_mwindow **lru_l)
+static int git_mwindow_close_lru(
+	git_mwindow_ctl *ctl, git_mwindow_budget *budget)
 {
-	git_mwindow *w, *w_l;
-
-	for (w_l = NULL, w = mwf->windows; w; w = w->next) {
-		if (!w->inuse_cnt) {
-			/*
-			 * If the current one is more recent than the last one,
-			 * store it in the output parameter. If lru_w is NULL,
-			 * it's the first loop, so store it as well.
-			 */
-			if (!*lru_w || w->last_used < (*lru_w)->last_used) {
-				*lru_w = w;
-				*lru_l = w_l;
-			}
-		}
-		w_l = w;
-	}
-}
+	git_mwindow *w, **list;
 
-/*
- * Close the least recently used window. You should check to see if
- * the file descriptors need closing from time to time. Called under
- * lock from new_window.
- */
-static int git_mwindow_close_lru(git_mwindow_file *mwf)
-{
-	git_mwindow_ctl *ctl = &mem_ctl;
-	size_t i;
-	git_mwindow *lru_w = NULL, *lru_l = NULL, **list = &mwf->windows;
-
-	/* FIXME: Does this give us any advantage? */
-	if(mwf->windows)
-		git_mwindow_scan_lru(mwf, &lru_w, &lru_l);
-
-	for (i = 0; i < ctl->windowfiles.length; ++i) {
-		git_mwindow *last = lru_w;
-		git_mwindow_file *cur = git_vector_get(&ctl->windowfiles, i);
-		git_mwindow_scan_lru(cur, &lru_w, &lru_l);
-		if (lru_w != last)
-			list = &cur->windows;
+	for (w = ctl->lru_head; w; w = w->lru_next) {
+		if (!budget || w->mwf->budget == budget)
+			break;
 	}
 
-	if (!lru_w) {
-		giterr_set(GITERR_OS, "Failed to close memory window. Couldn't find LRU");
+	if (!w)
 		return -1;
-	}
 
-	ctl->mapped -= lru_w->window_map.len;
-	git_futils_mmap_free(&lru_w->window_map);
+	lru_remove(ctl, w);
 
-	if (lru_l)
-		lru_l->next = lru_w->next;
-	else
-		*list = lru_w->next;
-
-	git__free(lru_w);
-	ctl->open_windows--;
+	for (list = &w->mwf->windows; *list != w; list = &(*list)->next)
+		/* nop */;
+	*list = w->next;
 
+	window_free(ctl, w);
 	return 0;
 }
 
@@ -157,7 +165,10 @@ static git_mwindow *new_window(
 	git_off_t offset)
 {
 	git_mwindow_ctl *ctl = &mem_ctl;
-	size_t walign = git_mwindow__window_size / 2;
+	git_mwindow_budget *budget = mwf->budget;
+	size_t window_size = (budget && budget->window_size) ?
+		budget->window_size : git_mwindow__window_size;
+	size_t walign = window_size / 2;
 	git_off_t len;
 	git_mwindow *w;
 
@@ -167,16 +178,25 @@ static git_mwindow *new_window(
 		return NULL;
 
 	memset(w, 0x0, sizeof(*w));
+	w->mwf = mwf;
 	w->offset = (offset / walign) * walign;
 
 	len = size - w->offset;
-	if (len > (git_off_t)git_mwindow__window_size)
-		len = (git_off_t)git_mwindow__window_size;
+	if (len > (git_off_t)window_size)
+		len = (git_off_t)window_size;
 
 	ctl->mapped += (size_t)len;
 
+	if (budget) {
+		budget->mapped += (size_t)len;
+
+		while (budget->mapped_limit &&
+				budget->mapped_limit < budget->mapped &&
+				git_mwindow_close_lru(ctl, budget) == 0) /* nop */;
+	}
+
 	while (git_mwindow__mapped_limit < ctl->mapped &&
-			git_mwindow_close_lru(mwf) == 0) /* nop */;
+			git_mwindow_close_lru(ctl, NULL) == 0) /* nop */;
 
 	/*
 	 * We treat `mapped_limit` as a soft limit. If we can't find a
@@ -185,10 +205,16 @@ static git_mwindow *new_window(
 	 */
 
 	if (git_futils_mmap_ro(&w->window_map, fd, w->offset, (size_t)len) < 0) {
+		ctl->mapped -= (size_t)len;
+		if (budget)
+			budget->mapped -= (size_t)len;
 		git__free(w);
 		return NULL;
 	}
 
+	if (mwf->advice != GIT_MADV_NORMAL)
+		p_madvise(&w->window_map, mwf->advice);
+
 	ctl->mmap_calls++;
 	ctl->open_windows++;
 
@@ -198,9 +224,27 @@ static git_mwindow *new_window(
 	if (ctl->open_windows > ctl->peak_open_windows)
 		ctl->peak_open_windows = ctl->open_windows;
 
+	if (budget) {
+		budget->mmap_calls++;
+		budget->open_windows++;
+
+		if (budget->mapped > budget->peak_mapped)
+			budget->peak_mapped = budget->mapped;
+	}
+
+	/* The window is not in use until the caller takes it */
+	lru_push(ctl, w);
+
 	return w;
 }
 
+/* Drop a use of a window. Called under lock. */
+static void window_release(git_mwindow_ctl *ctl, git_mwindow *w)
+{
+	if (--w->inuse_cnt == 0)
+		lru_push(ctl, w);
+}
+
 /*
  * Open a new window, closing the least recenty used until we have
  * enough space. Don't forget to add it to your list
@@ -221,8 +265,10 @@ unsigned char *git_mwindow_open(
 	}
 
 	if (!w || !(git_mwindow_contains(w, offset) && git_mwindow_contains(w, offset + extra))) {
+		/* Release the window of the cursor, it may be closed below */
 		if (w) {
-			w->inuse_cnt--;
+			window_release(ctl, w);
+			*cursor = NULL;
 		}
 
 		for (w = mwf->windows; w; w = w->next) {
@@ -248,8 +294,8 @@ unsigned char *git_mwindow_open(
 
 	/* If we changed w, store it in the cursor */
 	if (w != *cursor) {
-		w->last_used = ctl->used_ctr++;
-		w->inuse_cnt++;
+		if (w->inuse_cnt++ == 0)
+			lru_remove(ctl, w);
 		*cursor = w;
 	}
 
@@ -312,8 +358,67 @@ void git_mwindow_close(git_mwindow **window)
 			return;
 		}
 
-		w->inuse_cnt--;
+		window_release(&mem_ctl, w);
 		git_mutex_unlock(&git__mwindow_mutex);
 		*window = NULL;
 	}
 }
+
+void git_mwindow_file_advise(git_mwindow_file *mwf, int advice)
+{
+	git_mwindow *w;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return;
+	}
+
+	mwf->advice = advice;
+
+	/* This is only a hint, errors are ignored */
+	for (w = mwf->windows; w; w = w->next)
+		p_madvise(&w->window_map, advice);
+
+	git_mutex_unlock(&git__mwindow_mutex);
+}
+
+int git_mwindow_budget_set(
+	git_mwindow_budget *budget, size_t window_size, size_t mapped_limit)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+
+	if (window_size > (size_t)-1 - WINDOW_ALIGN) {
+		giterr_set(GITERR_INVALID, "Invalid window size %" PRIuZ, window_size);
+		return -1;
+	}
+
+	window_size = (window_size + WINDOW_ALIGN - 1) / WINDOW_ALIGN * WINDOW_ALIGN;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	budget->window_size = window_size;
+	budget->mapped_limit = mapped_limit;
+
+	while (mapped_limit && mapped_limit < budget->mapped &&
+			git_mwindow_close_lru(ctl, budget) == 0) /* nop */;
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
+
+int git_mwindow_budget_stats(
+	git_mwindow_budget *out, const git_mwindow_budget *budget)
+{
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	memcpy(out, budget, sizeof(*out));
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
@@ -13,16 +13,32 @@
 
 typedef struct git_mwindow {
 	struct git_mwindow *next;
+	struct git_mwindow *lru_prev, *lru_next; /* while not in use */
+	struct git_mwindow_file *mwf;
 	git_map window_map;
 	git_off_t offset;
-	size_t last_used;
 	size_t inuse_cnt;
 } git_mwindow;
 
+/*
+ * The mapping budget of a group of files, typically the packfiles of
+ * one repository. The limits are zero to use the global ones.
+ */
+typedef struct git_mwindow_budget {
+	size_t window_size;
+	size_t mapped_limit;
+	size_t mapped;
+	size_t peak_mapped;
+	unsigned int open_windows;
+	unsigned int mmap_calls;
+} git_mwindow_budget;
+
 typedef struct git_mwindow_file {
 	git_mwindow *windows;
 	int fd;
 	git_off_t size;
+	git_mwindow_budget *budget; /* NULL if only the global limits apply */
+	int advice; /* GIT_MADV_* applied to the windows of the file */
 } git_mwindow_file;
 
 typedef struct git_mwindow_ctl {
@@ -31,7 +47,7 @@ typedef struct git_mwindow_ctl {
 	unsigned int mmap_calls;
 	unsigned int peak_open_windows;
 	size_t peak_mapped;
-	size_t used_ctr;
+	git_mwindow *lru_head, *lru_tail; /* the unused windows, oldest first */
 	git_vector windowfiles;
 } git_mwindow_ctl;
 
@@ -42,4 +58,23 @@ int git_mwindow_file_register(git_mwindow_file *mwf);
 void git_mwindow_file_deregister(git_mwindow_file *mwf);
 void git_mwindow_close(git_mwindow **w_cursor);
 
+/*
+ * Give the kernel a hint about how the windows of the file are going
+ * to be read, e.g. GIT_MADV_SEQUENTIAL for a scan in file order. The
+ * advice applies to the windows that are mapped and to new ones.
+ */
+void git_mwindow_file_advise(git_mwindow_file *mwf, int advice);
+
+/*
+ * Set the window size and mapped limit of a budget, and close the
+ * unused windows that are above the new limit. The sizes are zero for
+ * the global ones.
+ */
+int git_mwindow_budget_set(
+	git_mwindow_budget *budget, size_t window_size, size_t mapped_limit);
+
+/* Copy the counters of a budget under the mwindow lock */
+int git_mwindow_budget_stats(
+	git_mwindow_budget *out, const git_mwindow_budget *budget);
+
 #endif
@@ -457,6 +457,171 @@ int git_odb_get_backend(git_odb_backend **out, git_odb *odb, size_t pos)
 	return GIT_ENOTFOUND;
 }
 
+int git_odb_set_delta_base_cache_limit(git_odb *odb, size_t limit)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(odb);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error = git_odb_backend__pack_set_cache_limit(internal->backend, limit);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+int git_odb_get_delta_base_cache_stats(
+	git_odb_delta_base_cache_stats *out, git_odb *odb)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(out && odb);
+
+	memset(out, 0, sizeof(*out));
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error = git_odb_backend__pack_cache_stats(out, internal->backend);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+int git_odb_set_mwindow_limits(
+	git_odb *odb, size_t window_size, size_t mapped_limit)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(odb);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error = git_odb_backend__pack_set_mwindow_limits(
+			internal->backend, window_size, mapped_limit);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+int git_odb_get_mwindow_stats(git_odb_mwindow_stats *out, git_odb *odb)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(out && odb);
+
+	memset(out, 0, sizeof(*out));
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error = git_odb_backend__pack_mwindow_stats(out, internal->backend);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+void git_odb__advise(git_odb *odb, int advice)
+{
+	size_t i;
+	backend_internal *internal;
+
+	git_vector_foreach(&odb->backends, i, internal)
+		git_odb_backend__pack_advise(internal->backend, advice);
+}
+
+int git_odb_write_multi_pack_index(git_odb *odb)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(odb);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error;
+
+		/* the alternates belong to other repositories */
+		if (internal->is_alternate)
+			continue;
+
+		error = git_odb_backend__pack_write_midx(internal->backend);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+int git_odb_verify_multi_pack_index(git_odb *odb)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(odb);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error;
+
+		if (internal->is_alternate)
+			continue;
+
+		error = git_odb_backend__pack_verify_midx(internal->backend);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
+int git_odb__pack_bitmap(struct git_pack_bitmap **out, git_odb *odb)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(out && odb);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error;
+
+		if (internal->is_alternate)
+			continue;
+
+		error = git_odb_backend__pack_bitmap(out, internal->backend);
+		if (error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+int git_odb__write_pack_bitmap(git_odb *odb, git_repository *repo)
+{
+	size_t i;
+	backend_internal *internal;
+
+	assert(odb && repo);
+
+	git_vector_foreach(&odb->backends, i, internal) {
+		int error;
+
+		if (internal->is_alternate)
+			continue;
+
+		error = git_odb_backend__pack_write_bitmap(internal->backend, repo);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return 0;
+}
+
 static int add_default_backends(
 	git_odb *db, const char *objects_dir,
 	bool as_alternates, int alternate_depth)
@@ -648,6 +813,81 @@ int git_odb_read_header(size_t *len_p, git_otype *type_p, git_odb *db, const git
 	return error;
 }
 
+int git_odb_read_header_many(
+	size_t *sizes, git_otype *types, git_odb *db,
+	const git_oid *ids, size_t count)
+{
+	size_t i, j;
+	int error;
+	bool read_objects = false;
+	git_odb_object *object;
+
+	assert(sizes && types && db && (ids || !count));
+
+	for (i = 0; i < count; i++) {
+		sizes[i] = 0;
+		types[i] = GIT_OBJ_BAD;
+
+		if ((object = git_cache_get_raw(odb_cache(db), &ids[i])) != NULL) {
+			sizes[i] = object->cached.size;
+			types[i] = object->cached.type;
+			git_odb_object_free(object);
+		}
+	}
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		error = git_odb_backend__pack_read_header_many(sizes, types, b, ids, count);
+		if (error != GIT_ENOTFOUND) {
+			if (error < 0)
+				return error;
+			continue;
+		}
+
+		giterr_clear();
+
+		if (b->read_header == NULL) {
+			read_objects = true;
+			continue;
+		}
+
+		for (j = 0; j < count; j++) {
+			if (types[j] != GIT_OBJ_BAD)
+				continue;
+
+			error = b->read_header(&sizes[j], &types[j], b, &ids[j]);
+
+			if (error == GIT_ENOTFOUND || error == GIT_PASSTHROUGH) {
+				giterr_clear();
+				types[j] = GIT_OBJ_BAD;
+			} else if (error < 0)
+				return error;
+		}
+	}
+
+	/* backends that can only read the whole object */
+	for (i = 0; read_objects && i < count; i++) {
+		if (types[i] != GIT_OBJ_BAD)
+			continue;
+
+		if ((error = git_odb_read(&object, db, &ids[i])) == GIT_ENOTFOUND) {
+			giterr_clear();
+			continue;
+		}
+
+		if (error < 0)
+			return error;
+
+		sizes[i] = object->cached.size;
+		types[i] = object->cached.type;
+		git_odb_object_free(object);
+	}
+
+	return 0;
+}
+
 int git_odb__read_header_or_object(
 	git_odb_object **out, size_t *len_p, git_otype *type_p,
 	git_odb *db, const git_oid *id)
@@ -806,6 +1046,62 @@ int git_odb_foreach(git_odb *db, git_odb_foreach_cb cb, void *payload)
 	return 0;
 }
 
+typedef struct {
+	git_odb_backend *backend;
+	git_odb_foreach_header_cb cb;
+	void *payload;
+} foreach_header_data;
+
+static int foreach_header_cb(const git_oid *id, void *payload)
+{
+	foreach_header_data *data = payload;
+	git_otype type;
+	size_t size;
+	int error;
+
+	if (data->backend->read_header != NULL)
+		error = data->backend->read_header(&size, &type, data->backend, id);
+	else {
+		void *raw;
+
+		if ((error = data->backend->read(&raw, &size, &type, data->backend, id)) == 0)
+			git__free(raw);
+	}
+
+	if (error < 0)
+		return error;
+
+	return data->cb(id, type, size, NULL, data->payload);
+}
+
+int git_odb_foreach_header(git_odb *db, git_odb_foreach_header_cb cb, void *payload)
+{
+	unsigned int i;
+	backend_internal *internal;
+	foreach_header_data data;
+
+	assert(db && cb);
+
+	data.cb = cb;
+	data.payload = payload;
+
+	git_vector_foreach(&db->backends, i, internal) {
+		git_odb_backend *b = internal->backend;
+		int error = git_odb_backend__pack_foreach_header(b, cb, payload);
+
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			data.backend = b;
+			error = b->foreach(b, foreach_header_cb, &data);
+		}
+
+		if (error != 0)
+			return error;
+	}
+
+	return 0;
+}
+
 int git_odb_write(
 	git_oid *oid, git_odb *db, const void *data, size_t len, git_otype type)
 {
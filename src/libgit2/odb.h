@@ -100,4 +100,68 @@ int git_odb__read_header_or_object(
 /* fully free the object; internal method, DO NOT EXPORT */
 void git_odb_object__free(void *object);
 
+/*
+ * Set the memory limit of the delta base caches, or add up their
+ * statistics, of a packfile backend. Returns GIT_ENOTFOUND when the
+ * backend does not read packfiles.
+ */
+int git_odb_backend__pack_set_cache_limit(git_odb_backend *backend, size_t limit);
+int git_odb_backend__pack_cache_stats(
+	git_odb_delta_base_cache_stats *stats, git_odb_backend *backend);
+
+/*
+ * Set the window size and mapped limit of the packfiles of a packfile
+ * backend, or get their mapping statistics. Returns GIT_ENOTFOUND when
+ * the backend does not read packfiles.
+ */
+int git_odb_backend__pack_set_mwindow_limits(
+	git_odb_backend *backend, size_t window_size, size_t mapped_limit);
+int git_odb_backend__pack_mwindow_stats(
+	git_odb_mwindow_stats *stats, git_odb_backend *backend);
+
+/*
+ * Tell the packfiles of an odb how they are about to be read, with one
+ * of the GIT_MADV_* values of map.h.
+ */
+void git_odb__advise(git_odb *odb, int advice);
+int git_odb_backend__pack_advise(git_odb_backend *backend, int advice);
+
+/*
+ * Write or verify the multi-pack-index of the pack folder of a packfile
+ * backend. Returns GIT_ENOTFOUND when the backend does not read packfiles.
+ */
+int git_odb_backend__pack_write_midx(git_odb_backend *backend);
+int git_odb_backend__pack_verify_midx(git_odb_backend *backend);
+
+/*
+ * Get the reachability bitmaps of the packs of an odb, or write them
+ * for its largest pack. Only one pack of an odb has bitmaps, as in git.
+ */
+struct git_pack_bitmap;
+
+int git_odb__pack_bitmap(struct git_pack_bitmap **out, git_odb *odb);
+int git_odb__write_pack_bitmap(git_odb *odb, git_repository *repo);
+
+int git_odb_backend__pack_bitmap(
+	struct git_pack_bitmap **out, git_odb_backend *backend);
+int git_odb_backend__pack_write_bitmap(
+	git_odb_backend *backend, git_repository *repo);
+
+/*
+ * List the type and size of the objects of the packs of a packfile
+ * backend from the pack headers. Returns GIT_ENOTFOUND when the
+ * backend does not read packfiles.
+ */
+int git_odb_backend__pack_foreach_header(
+	git_odb_backend *backend, git_odb_foreach_header_cb cb, void *payload);
+
+/*
+ * Read the type and size of the objects of `ids` found in the packs of
+ * a packfile backend, for the objects whose type is still GIT_OBJ_BAD.
+ * Returns GIT_ENOTFOUND when the backend does not read packfiles.
+ */
+int git_odb_backend__pack_read_header_many(
+	size_t *sizes, git_otype *types, git_odb_backend *backend,
+	const git_oid *ids, size_t count);
+
 #endif
@@ -17,14 +17,25 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "pack.h"
+#include "midx.h"
+#include "pack-bitmap.h"
 
 #include "git2/odb_backend.h"
 
+extern size_t git_mwindow__window_size;
+extern size_t git_mwindow__mapped_limit;
+
 struct pack_backend {
 	git_odb_backend parent;
 	git_vector packs;
 	struct git_pack_file *last_found;
 	char *pack_folder;
+	size_t cache_limit; /* memory limit of the delta base cache of each pack */
+	git_mwindow_budget mwindow_budget; /* mapping limits of the packs */
+
+	git_midx_file *midx;
+	git_vector midx_packs; /* the packs of the multi-pack-index, by pack id */
+	git_futils_filestamp midx_stamp;
 };
 
 struct pack_writepack {
@@ -218,13 +229,136 @@ static int packfile_load__cb(void *data, git_buf *path)
 		return 0;
 	}
 
-	if (!error)
+	if (!error) {
+		git_packfile__set_cache_limit(pack, backend->cache_limit);
+		pack->mwf.budget = &backend->mwindow_budget;
 		error = git_vector_insert(&backend->packs, pack);
+	}
 
 	return error;
 
 }
 
+/* Map the pack names of a multi-pack-index to the loaded packs */
+static int midx_packs_lookup(
+	git_vector *out, struct pack_backend *backend, git_midx_file *midx)
+{
+	const char *name;
+	size_t i, j;
+
+	if (git_vector_init(out, midx->num_packs, NULL) < 0)
+		return -1;
+
+	git_vector_foreach(&midx->packfile_names, i, name) {
+		size_t name_len = strlen(name) - strlen(".idx");
+		struct git_pack_file *p = NULL;
+
+		for (j = 0; j < backend->packs.length; ++j) {
+			struct git_pack_file *candidate = git_vector_get(&backend->packs, j);
+			size_t len = strlen(candidate->pack_name);
+
+			if (len > name_len + strlen(".pack") &&
+				candidate->pack_name[len - name_len - strlen(".pack") - 1] == '/' &&
+				!strncmp(candidate->pack_name + len - name_len - strlen(".pack"),
+					name, name_len)) {
+				p = candidate;
+				break;
+			}
+		}
+
+		if (p == NULL) {
+			giterr_set(GITERR_ODB,
+				"The packfile '%s' of the multi-pack-index is missing", name);
+			git_vector_free(out);
+			return -1;
+		}
+
+		if (git_vector_insert(out, p) < 0) {
+			git_vector_free(out);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void midx_unload(struct pack_backend *backend)
+{
+	struct git_pack_file *p;
+	size_t i;
+
+	git_vector_foreach(&backend->midx_packs, i, p)
+		p->in_midx = 0;
+
+	git_vector_free(&backend->midx_packs);
+	git_midx_free(backend->midx);
+	backend->midx = NULL;
+}
+
+/* Load the multi-pack-index of the pack folder when it changed */
+static int midx_refresh(struct pack_backend *backend)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_midx_file *midx;
+	git_vector packs;
+	struct git_pack_file *p;
+	size_t i;
+	int updated;
+
+	if (git_buf_joinpath(&path, backend->pack_folder, GIT_MIDX_FILE) < 0)
+		return -1;
+
+	updated = git_futils_filestamp_check(&backend->midx_stamp, path.ptr);
+
+	if (updated == GIT_ENOTFOUND) {
+		giterr_clear();
+		git_futils_filestamp_set(&backend->midx_stamp, NULL);
+		midx_unload(backend);
+	} else if (updated > 0) {
+		midx_unload(backend);
+
+		/*
+		 * An invalid multi-pack-index, or one that names a pack that is
+		 * gone, is ignored and the packs are searched one by one
+		 */
+		if (git_midx_open(&midx, path.ptr) < 0)
+			giterr_clear();
+		else if (midx_packs_lookup(&packs, backend, midx) < 0) {
+			giterr_clear();
+			git_midx_free(midx);
+		} else {
+			backend->midx = midx;
+			backend->midx_packs = packs;
+
+			git_vector_foreach(&packs, i, p)
+				p->in_midx = 1;
+		}
+	}
+
+	git_buf_free(&path);
+	return updated < 0 && updated != GIT_ENOTFOUND ? updated : 0;
+}
+
+static int pack_entry_find_midx(
+	struct git_pack_entry *e,
+	struct pack_backend *backend,
+	const git_oid *short_oid,
+	size_t len)
+{
+	git_midx_entry entry;
+	int error;
+
+	if (backend->midx == NULL)
+		return GIT_ENOTFOUND;
+
+	if ((error = git_midx_entry_find(&entry, backend->midx, short_oid, len)) < 0)
+		return error;
+
+	return git_pack_entry_at(e,
+		git_vector_get(&backend->midx_packs, entry.pack_index),
+		&entry.sha1, entry.offset);
+}
+
 static int pack_entry_find_inner(
 	struct git_pack_entry *e,
 	struct pack_backend *backend,
@@ -237,11 +371,17 @@ static int pack_entry_find_inner(
 		git_pack_entry_find(e, last_found, oid, GIT_OID_HEXSZ) == 0)
 		return 0;
 
+	if (!pack_entry_find_midx(e, backend, oid, GIT_OID_HEXSZ)) {
+		backend->last_found = e->p;
+		return 0;
+	}
+
+	/* only the packs that came after the multi-pack-index are left */
 	for (i = 0; i < backend->packs.length; ++i) {
 		struct git_pack_file *p;
 
 		p = git_vector_get(&backend->packs, i);
-		if (p == last_found)
+		if (p == last_found || p->in_midx)
 			continue;
 
 		if (git_pack_entry_find(e, p, oid, GIT_OID_HEXSZ) == 0) {
@@ -279,7 +419,7 @@ static int pack_entry_find_prefix(
 	bool found = false;
 	struct git_pack_file *last_found = backend->last_found;
 
-	if (last_found) {
+	if (last_found && !last_found->in_midx) {
 		error = git_pack_entry_find(e, last_found, short_oid, len);
 		if (error == GIT_EAMBIGUOUS)
 			return error;
@@ -289,11 +429,21 @@ static int pack_entry_find_prefix(
 		}
 	}
 
+	error = pack_entry_find_midx(e, backend, short_oid, len);
+	if (error == GIT_EAMBIGUOUS)
+		return error;
+	if (!error) {
+		if (found && git_oid_cmp(&e->sha1, &found_full_oid))
+			return git_odb__error_ambiguous("found multiple pack entries");
+		git_oid_cpy(&found_full_oid, &e->sha1);
+		found = true;
+	}
+
 	for (i = 0; i < backend->packs.length; ++i) {
 		struct git_pack_file *p;
 
 		p = git_vector_get(&backend->packs, i);
-		if (p == last_found)
+		if (p == last_found || p->in_midx)
 			continue;
 
 		error = git_pack_entry_find(e, p, short_oid, len);
@@ -343,6 +493,9 @@ static int pack_backend__refresh(git_odb_backend *backend_)
 	git_buf_free(&path);
 	git_vector_sort(&backend->packs);
 
+	if (!error)
+		error = midx_refresh(backend);
+
 	return error;
 }
 
@@ -592,6 +745,8 @@ static void pack_backend__free(git_odb_backend *_backend)
 	}
 
 	git_vector_free(&backend->packs);
+	git_vector_free(&backend->midx_packs);
+	git_midx_free(backend->midx);
 	git__free(backend->pack_folder);
 	git__free(backend);
 }
@@ -607,6 +762,7 @@ static int pack_backend__alloc(struct pack_backend **out, size_t initial_size)
 	}
 
 	backend->parent.version = GIT_ODB_BACKEND_VERSION;
+	backend->cache_limit = git_pack__cache_memory_limit;
 
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
@@ -621,6 +777,233 @@ static int pack_backend__alloc(struct pack_backend **out, size_t initial_size)
 	return 0;
 }
 
+int git_odb_backend__pack_set_cache_limit(git_odb_backend *_backend, size_t limit)
+{
+	struct pack_backend *backend;
+	size_t i;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	backend->cache_limit = limit;
+
+	for (i = 0; i < backend->packs.length; ++i)
+		git_packfile__set_cache_limit(git_vector_get(&backend->packs, i), limit);
+
+	return 0;
+}
+
+int git_odb_backend__pack_cache_stats(
+	git_odb_delta_base_cache_stats *stats, git_odb_backend *_backend)
+{
+	struct pack_backend *backend;
+	size_t i;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	if (backend->cache_limit > stats->memory_limit)
+		stats->memory_limit = backend->cache_limit;
+
+	for (i = 0; i < backend->packs.length; ++i)
+		git_packfile__cache_stats(stats, git_vector_get(&backend->packs, i));
+
+	return 0;
+}
+
+int git_odb_backend__pack_set_mwindow_limits(
+	git_odb_backend *_backend, size_t window_size, size_t mapped_limit)
+{
+	struct pack_backend *backend;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	return git_mwindow_budget_set(
+		&backend->mwindow_budget, window_size, mapped_limit);
+}
+
+int git_odb_backend__pack_mwindow_stats(
+	git_odb_mwindow_stats *stats, git_odb_backend *_backend)
+{
+	struct pack_backend *backend;
+	git_mwindow_budget budget;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	if ((error = git_mwindow_budget_stats(&budget, &backend->mwindow_budget)) < 0)
+		return error;
+
+	if (!budget.window_size)
+		budget.window_size = git_mwindow__window_size;
+	if (!budget.mapped_limit)
+		budget.mapped_limit = git_mwindow__mapped_limit;
+
+	if (budget.window_size > stats->window_size)
+		stats->window_size = budget.window_size;
+	if (budget.mapped_limit > stats->mapped_limit)
+		stats->mapped_limit = budget.mapped_limit;
+
+	stats->mapped += budget.mapped;
+	stats->peak_mapped += budget.peak_mapped;
+	stats->open_windows += budget.open_windows;
+	stats->mmap_calls += budget.mmap_calls;
+
+	return 0;
+}
+
+int git_odb_backend__pack_advise(git_odb_backend *_backend, int advice)
+{
+	struct pack_backend *backend;
+	size_t i;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+
+	for (i = 0; i < backend->packs.length; ++i) {
+		struct git_pack_file *p = git_vector_get(&backend->packs, i);
+		git_mwindow_file_advise(&p->mwf, advice);
+	}
+
+	return 0;
+}
+
+int git_odb_backend__pack_write_midx(git_odb_backend *_backend)
+{
+	struct pack_backend *backend;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	if (backend->pack_folder == NULL)
+		return 0;
+
+	if ((error = pack_backend__refresh(_backend)) < 0)
+		return error;
+
+	if (backend->packs.length == 0)
+		return 0;
+
+	if ((error = git_midx_write(backend->pack_folder, &backend->packs)) < 0)
+		return error;
+
+	return midx_refresh(backend);
+}
+
+int git_odb_backend__pack_verify_midx(git_odb_backend *_backend)
+{
+	struct pack_backend *backend;
+	git_buf path = GIT_BUF_INIT;
+	git_midx_file *midx = NULL;
+	git_vector packs = GIT_VECTOR_INIT;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	if (backend->pack_folder == NULL)
+		return 0;
+
+	if ((error = pack_backend__refresh(_backend)) < 0 ||
+		(error = git_buf_joinpath(&path, backend->pack_folder, GIT_MIDX_FILE)) < 0)
+		goto done;
+
+	/* a missing multi-pack-index is valid, unlike an unreadable one */
+	if ((error = git_midx_open(&midx, path.ptr)) == GIT_ENOTFOUND) {
+		error = 0;
+		goto done;
+	}
+
+	if (error < 0 ||
+		(error = midx_packs_lookup(&packs, backend, midx)) < 0)
+		goto done;
+
+	error = git_midx_verify(midx, &packs);
+
+done:
+	git_vector_free(&packs);
+	git_midx_free(midx);
+	git_buf_free(&path);
+	return error;
+}
+
+int git_odb_backend__pack_bitmap(
+	git_pack_bitmap **out, git_odb_backend *_backend)
+{
+	struct pack_backend *backend;
+	struct git_pack_file *p;
+	size_t i;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+
+	if ((error = pack_backend__refresh(_backend)) < 0)
+		return error;
+
+	git_vector_foreach(&backend->packs, i, p) {
+		if ((error = git_pack_bitmap_load(out, p)) != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+int git_odb_backend__pack_write_bitmap(
+	git_odb_backend *_backend, git_repository *repo)
+{
+	struct pack_backend *backend;
+	struct git_pack_file *p, *largest = NULL;
+	size_t i;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+	if (backend->pack_folder == NULL)
+		return 0;
+
+	if ((error = pack_backend__refresh(_backend)) < 0)
+		return error;
+
+	git_vector_foreach(&backend->packs, i, p) {
+		if ((error = git_pack_index_load(p)) < 0)
+			return error;
+
+		if (!largest || p->num_objects > largest->num_objects)
+			largest = p;
+	}
+
+	if (largest == NULL)
+		return 0;
+
+	if ((error = git_pack_bitmap_write(largest, repo)) < 0)
+		return error;
+
+	/* git only reads the bitmaps of one pack */
+	git_vector_foreach(&backend->packs, i, p) {
+		if (p != largest && (error = git_pack_bitmap_remove(p)) < 0)
+			return error;
+	}
+
+	git_pack_bitmap_reset(largest);
+	return 0;
+}
+
 int git_odb_backend_one_pack(git_odb_backend **backend_out, const char *idx)
 {
 	struct pack_backend *backend = NULL;
@@ -636,6 +1019,8 @@ int git_odb_backend_one_pack(git_odb_backend **backend_out, const char *idx)
 		return -1;
 	}
 
+	packfile->mwf.budget = &backend->mwindow_budget;
+
 	*backend_out = (git_odb_backend *)backend;
 	return 0;
 }
@@ -668,3 +1053,149 @@ int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir)
 
 	return error;
 }
+
+typedef struct {
+	git_odb_foreach_header_cb cb;
+	void *payload;
+	const char *pack_name;
+} pack_foreach_header_data;
+
+static int pack_foreach_header_cb(
+	const git_oid *id, git_otype type, size_t size,
+	git_off_t offset, void *payload)
+{
+	pack_foreach_header_data *data = payload;
+
+	GIT_UNUSED(offset);
+	return data->cb(id, type, size, data->pack_name, data->payload);
+}
+
+int git_odb_backend__pack_foreach_header(
+	git_odb_backend *_backend, git_odb_foreach_header_cb cb, void *payload)
+{
+	struct pack_backend *backend;
+	struct git_pack_file *p;
+	pack_foreach_header_data data;
+	size_t i;
+	int error;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+
+	if ((error = pack_backend__refresh(_backend)) < 0)
+		return error;
+
+	data.cb = cb;
+	data.payload = payload;
+
+	git_vector_foreach(&backend->packs, i, p) {
+		data.pack_name = p->pack_name;
+
+		if ((error = git_pack_foreach_header(p, pack_foreach_header_cb, &data)) != 0)
+			return error;
+	}
+
+	return 0;
+}
+
+struct read_header_entry {
+	struct git_pack_file *p;
+	git_off_t offset;
+	size_t n;
+};
+
+static int read_header_entry_cmp(const void *a_, const void *b_)
+{
+	const struct read_header_entry *a = a_, *b = b_;
+
+	if (a->p != b->p)
+		return (uintptr_t)a->p < (uintptr_t)b->p ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+int git_odb_backend__pack_read_header_many(
+	size_t *sizes, git_otype *types, git_odb_backend *_backend,
+	const git_oid *ids, size_t count)
+{
+	struct pack_backend *backend;
+	struct read_header_entry *entries;
+	struct git_pack_file *p = NULL;
+	git_offmap *bases = NULL;
+	bool refreshed = false;
+	size_t i, nentries = 0;
+	int error = 0;
+
+	if (_backend->free != &pack_backend__free)
+		return GIT_ENOTFOUND;
+
+	backend = (struct pack_backend *)_backend;
+
+	if (!count)
+		return 0;
+
+	entries = git__malloc(count * sizeof(*entries));
+	GITERR_CHECK_ALLOC(entries);
+
+	for (i = 0; i < count; i++) {
+		struct git_pack_entry e;
+
+		if (types[i] != GIT_OBJ_BAD)
+			continue;
+
+		error = pack_entry_find(&e, backend, &ids[i]);
+
+		if (error == GIT_ENOTFOUND && !refreshed) {
+			refreshed = true;
+			if ((error = pack_backend__refresh(_backend)) < 0)
+				goto done;
+			error = pack_entry_find(&e, backend, &ids[i]);
+		}
+
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			error = 0;
+			continue;
+		}
+
+		if (error < 0)
+			goto done;
+
+		entries[nentries].p = e.p;
+		entries[nentries].offset = e.offset;
+		entries[nentries].n = i;
+		nentries++;
+	}
+
+	/* read the headers pack by pack, in the order of the pack, and
+	 * follow each delta chain once */
+	qsort(entries, nentries, sizeof(*entries), read_header_entry_cmp);
+
+	for (i = 0; i < nentries; i++) {
+		struct read_header_entry *entry = &entries[i];
+
+		if (entry->p != p) {
+			if (bases)
+				git_offmap_clear(bases);
+			else if ((bases = git_offmap_alloc()) == NULL) {
+				giterr_set_oom();
+				error = -1;
+				goto done;
+			}
+			p = entry->p;
+		}
+
+		if ((error = git_packfile_resolve_header_shared(&sizes[entry->n],
+				&types[entry->n], entry->p, entry->offset, bases)) < 0)
+			goto done;
+	}
+
+done:
+	if (bases)
+		git_offmap_free(bases);
+	git__free(entries);
+	return error;
+}
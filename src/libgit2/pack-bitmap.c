@@ -0,0 +1,1207 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "pack-bitmap.h"
+#include "array.h"
+#include "ewah.h"
+#include "filebuf.h"
+#include "fileops.h"
+#include "odb.h"
+#include "oid.h"
+#include "pack.h"
+#include "repository.h"
+#include "tree.h"
+
+#include "git2/commit.h"
+#include "git2/graph.h"
+#include "git2/refs.h"
+#include "git2/revwalk.h"
+#include "git2/tag.h"
+
+#define BITMAP_SIGNATURE "BITM"
+#define BITMAP_VERSION 1
+#define BITMAP_HEADER_SIZE (4 + 2 + 2 + 4 + GIT_OID_RAWSZ)
+
+#define BITMAP_OPT_FULL_DAG 0x1
+#define BITMAP_OPT_HASH_CACHE 0x4
+
+/* git does not xor a bitmap with one more than 160 entries before it */
+#define BITMAP_MAX_XOR_OFFSET 160
+
+static uint32_t get_be32(const unsigned char *buffer)
+{
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) |
+		((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+static void put_be32(unsigned char *buffer, uint32_t value)
+{
+	buffer[0] = (unsigned char)(value >> 24);
+	buffer[1] = (unsigned char)(value >> 16);
+	buffer[2] = (unsigned char)(value >> 8);
+	buffer[3] = (unsigned char)value;
+}
+
+#define bitvec_words(bv) ((bv)->length ? (bv)->u.words : &(bv)->u.bits)
+#define bitvec_nwords(bv) ((bv)->length ? (bv)->length : 1)
+
+static size_t popcount64(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (size_t)((x * 0x0101010101010101ull) >> 56);
+}
+
+/* The name hash of git, sorting the last sixteen characters of a path */
+static uint32_t name_hash_append(uint32_t hash, const char *name)
+{
+	uint32_t c;
+
+	while ((c = *name++) != 0) {
+		if (git__isspace(c))
+			continue;
+
+		hash = (hash >> 2) + (c << 24);
+	}
+
+	return hash;
+}
+
+static int type_index(git_otype type)
+{
+	switch (type) {
+	case GIT_OBJ_COMMIT: return 0;
+	case GIT_OBJ_TREE: return 1;
+	case GIT_OBJ_BLOB: return 2;
+	case GIT_OBJ_TAG: return 3;
+	default: return -1;
+	}
+}
+
+static const git_otype index_types[4] = {
+	GIT_OBJ_COMMIT, GIT_OBJ_TREE, GIT_OBJ_BLOB, GIT_OBJ_TAG
+};
+
+static int bitmap_path(git_buf *out, struct git_pack_file *p)
+{
+	size_t base_len = strlen(p->pack_name) - strlen(".pack");
+
+	git_buf_clear(out);
+	git_buf_put(out, p->pack_name, base_len);
+	git_buf_puts(out, GIT_PACK_BITMAP_EXT);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+/*
+ * Loading a bitmap
+ */
+
+typedef struct {
+	git_off_t offset;
+	uint32_t index_pos;
+} pack_order_entry;
+
+static int pack_order_cmp(const void *a_, const void *b_)
+{
+	const pack_order_entry *a = a_, *b = b_;
+
+	if (a->offset < b->offset)
+		return -1;
+	return a->offset > b->offset;
+}
+
+/* A bitmap for a pack, with the objects in pack order and no entries */
+static int bitmap_alloc(git_pack_bitmap **out, struct git_pack_file *p)
+{
+	git_pack_bitmap *bitmap;
+	pack_order_entry *order = NULL;
+	uint32_t i;
+	int t;
+
+	if (git_pack_index_load(p) < 0)
+		return -1;
+
+	bitmap = git__calloc(1, sizeof(git_pack_bitmap));
+	GITERR_CHECK_ALLOC(bitmap);
+
+	bitmap->pack = p;
+	bitmap->num_objects = p->num_objects;
+
+	if (git_vector_init(&bitmap->entries, 0, NULL) < 0 ||
+		(bitmap->commits = git_oidmap_alloc()) == NULL)
+		goto on_error;
+
+	for (t = 0; t < 4; t++)
+		if (git_bitvec_init(&bitmap->types[t], bitmap->num_objects) < 0)
+			goto on_error;
+
+	order = git__malloc((p->num_objects + 1) * sizeof(pack_order_entry));
+	bitmap->pack_order = git__malloc((p->num_objects + 1) * sizeof(uint32_t));
+	bitmap->pack_pos = git__malloc((p->num_objects + 1) * sizeof(uint32_t));
+	if (!order || !bitmap->pack_order || !bitmap->pack_pos)
+		goto on_error;
+
+	for (i = 0; i < p->num_objects; i++) {
+		order[i].offset = git_pack_nth_offset(p, i);
+		order[i].index_pos = i;
+	}
+
+	qsort(order, p->num_objects, sizeof(pack_order_entry), pack_order_cmp);
+
+	for (i = 0; i < p->num_objects; i++) {
+		bitmap->pack_order[i] = order[i].index_pos;
+		bitmap->pack_pos[order[i].index_pos] = i;
+	}
+
+	git__free(order);
+
+	GIT_REFCOUNT_INC(bitmap);
+	*out = bitmap;
+	return 0;
+
+on_error:
+	git__free(order);
+	git_pack_bitmap_free(bitmap);
+	return -1;
+}
+
+static int bitmap_error(const char *path, const char *message)
+{
+	giterr_set(GITERR_ODB, "Invalid pack bitmap '%s': %s", path, message);
+	return -1;
+}
+
+static int bitmap_parse(git_pack_bitmap *bitmap, const char *path)
+{
+	const unsigned char *data = bitmap->map.data;
+	const unsigned char *index = bitmap->pack->index_map.data;
+	size_t size = bitmap->map.len, pos, count, i;
+	unsigned int flags;
+	int t, n;
+
+	if (size < BITMAP_HEADER_SIZE + GIT_OID_RAWSZ)
+		return bitmap_error(path, "file too short");
+
+	if (memcmp(data, BITMAP_SIGNATURE, 4) != 0)
+		return bitmap_error(path, "bad signature");
+
+	if (((data[4] << 8) | data[5]) != BITMAP_VERSION)
+		return bitmap_error(path, "unsupported version");
+
+	flags = (data[6] << 8) | data[7];
+	if (!(flags & BITMAP_OPT_FULL_DAG))
+		return bitmap_error(path, "not a full DAG");
+
+	count = get_be32(data + 8);
+
+	/* the checksum of the pack is recorded before the one of the index */
+	if (memcmp(data + 12, index + bitmap->pack->index_map.len - 2 * GIT_OID_RAWSZ,
+			GIT_OID_RAWSZ) != 0)
+		return bitmap_error(path, "the packfile does not match");
+
+	pos = BITMAP_HEADER_SIZE;
+	size -= GIT_OID_RAWSZ;
+
+	for (t = 0; t < 4; t++) {
+		if ((n = git_ewah_read(&bitmap->types[t], bitmap->num_objects,
+				(const char *)data + pos, size - pos)) < 0)
+			return -1;
+		pos += n;
+	}
+
+	for (i = 0; i < count; i++) {
+		git_pack_bitmap_entry *entry;
+		khiter_t k;
+		int ret;
+
+		if (size - pos < 6)
+			return bitmap_error(path, "truncated entry");
+
+		entry = git__calloc(1, sizeof(git_pack_bitmap_entry));
+		GITERR_CHECK_ALLOC(entry);
+
+		if (git_vector_insert(&bitmap->entries, entry) < 0) {
+			git__free(entry);
+			return -1;
+		}
+
+		entry->n = i;
+		entry->index_pos = get_be32(data + pos);
+		entry->xor_offset = data[pos + 4];
+		entry->flags = data[pos + 5];
+		pos += 6;
+
+		if (entry->index_pos >= bitmap->num_objects)
+			return bitmap_error(path, "entry out of the pack");
+
+		if (entry->xor_offset > BITMAP_MAX_XOR_OFFSET || entry->xor_offset > i)
+			return bitmap_error(path, "invalid xor offset");
+
+		if ((n = git_ewah_size((const char *)data + pos, size - pos)) < 0)
+			return -1;
+
+		entry->ewah = (const char *)data + pos;
+		entry->ewah_size = n;
+		pos += n;
+
+		git_oid_cpy(&entry->oid,
+			git_pack_nth_oid(bitmap->pack, entry->index_pos));
+
+		k = kh_put(oid, bitmap->commits, &entry->oid, &ret);
+		if (ret < 0) {
+			giterr_set_oom();
+			return -1;
+		}
+		kh_val(bitmap->commits, k) = entry;
+	}
+
+	if (flags & BITMAP_OPT_HASH_CACHE) {
+		if ((size - pos) / 4 < bitmap->num_objects)
+			return bitmap_error(path, "truncated name hashes");
+
+		bitmap->name_hashes = data + pos;
+	}
+
+	return 0;
+}
+
+int git_pack_bitmap_open(
+	git_pack_bitmap **out, struct git_pack_file *p, const char *path)
+{
+	git_pack_bitmap *bitmap;
+
+	if (bitmap_alloc(&bitmap, p) < 0)
+		return -1;
+
+	if (git_futils_mmap_ro_file(&bitmap->map, path) < 0 ||
+		bitmap_parse(bitmap, path) < 0) {
+		git_pack_bitmap_free(bitmap);
+		return -1;
+	}
+
+	*out = bitmap;
+	return 0;
+}
+
+static void pack_bitmap_free(git_pack_bitmap *bitmap)
+{
+	git_pack_bitmap_entry *entry;
+	size_t i;
+	int t;
+
+	git_vector_foreach(&bitmap->entries, i, entry)
+		git__free(entry);
+	git_vector_free(&bitmap->entries);
+
+	if (bitmap->commits)
+		git_oidmap_free(bitmap->commits);
+
+	for (t = 0; t < 4; t++)
+		git_bitvec_free(&bitmap->types[t]);
+
+	if (bitmap->map.data)
+		p_munmap(&bitmap->map);
+
+	git__free(bitmap->pack_order);
+	git__free(bitmap->pack_pos);
+	git__free(bitmap->write_hashes);
+	git__free(bitmap);
+}
+
+void git_pack_bitmap_free(git_pack_bitmap *bitmap)
+{
+	if (bitmap == NULL)
+		return;
+
+	GIT_REFCOUNT_DEC(bitmap, pack_bitmap_free);
+}
+
+int git_pack_bitmap_load(git_pack_bitmap **out, struct git_pack_file *p)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	*out = NULL;
+
+	/* the index is loaded under the lock of the pack */
+	if (git_pack_index_load(p) < 0)
+		return -1;
+
+	if (git_mutex_lock(&p->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock packfile mutex");
+		return -1;
+	}
+
+	if (!p->bitmap_loaded) {
+		p->bitmap_loaded = 1;
+
+		/* An invalid bitmap is ignored */
+		if (bitmap_path(&path, p) == 0 && git_path_isfile(path.ptr) &&
+			git_pack_bitmap_open(&p->bitmap, p, path.ptr) < 0) {
+			giterr_clear();
+			p->bitmap = NULL;
+		}
+	}
+
+	if ((*out = p->bitmap) != NULL)
+		GIT_REFCOUNT_INC(*out);
+
+	git_mutex_unlock(&p->lock);
+	git_buf_free(&path);
+
+	return *out ? 0 : GIT_ENOTFOUND;
+}
+
+void git_pack_bitmap_reset(struct git_pack_file *p)
+{
+	git_pack_bitmap *old;
+
+	if (git_mutex_lock(&p->lock) < 0)
+		return;
+
+	old = p->bitmap;
+	p->bitmap = NULL;
+	p->bitmap_loaded = 0;
+
+	git_mutex_unlock(&p->lock);
+
+	git_pack_bitmap_free(old);
+}
+
+int git_pack_bitmap_remove(struct git_pack_file *p)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error = 0;
+
+	if (bitmap_path(&path, p) < 0)
+		return -1;
+
+	if (git_path_isfile(path.ptr) && (error = p_unlink(path.ptr)) < 0)
+		giterr_set(GITERR_OS, "Failed to remove pack bitmap '%s'", path.ptr);
+
+	git_buf_free(&path);
+	git_pack_bitmap_reset(p);
+	return error;
+}
+
+/*
+ * Sets of objects
+ */
+
+int git_pack_bitmap_set_init(git_pack_bitmap_set *set, git_pack_bitmap *bitmap)
+{
+	memset(set, 0, sizeof(*set));
+
+	set->bitmap = bitmap;
+
+	if (git_bitvec_init(&set->bits, bitmap ? bitmap->num_objects : 0) < 0)
+		return -1;
+
+	set->extended = git_oidmap_alloc();
+	GITERR_CHECK_ALLOC(set->extended);
+
+	return 0;
+}
+
+void git_pack_bitmap_set_free(git_pack_bitmap_set *set)
+{
+	git_pack_bitmap_object *obj;
+
+	git_bitvec_free(&set->bits);
+
+	if (set->extended) {
+		kh_foreach_value(set->extended, obj, git__free(obj));
+		git_oidmap_free(set->extended);
+	}
+}
+
+/* The position of an object in the pack of the bitmap */
+static int bitmap_position(
+	uint32_t *pos, const git_pack_bitmap *bitmap, const git_oid *oid)
+{
+	uint32_t index_pos;
+	int error;
+
+	if (bitmap == NULL)
+		return GIT_ENOTFOUND;
+
+	if ((error = git_pack_find_position(&index_pos, bitmap->pack, oid)) < 0)
+		return error;
+
+	*pos = bitmap->pack_pos[index_pos];
+	return 0;
+}
+
+static bool set_contains(
+	const git_pack_bitmap_set *set,
+	bool in_pack,
+	uint32_t pos,
+	const git_oid *oid)
+{
+	if (in_pack)
+		return git_bitvec_get((git_bitvec *)&set->bits, pos);
+
+	return kh_get(oid, set->extended, oid) != kh_end(set->extended);
+}
+
+static int set_insert(
+	git_pack_bitmap_set *set,
+	bool in_pack,
+	uint32_t pos,
+	const git_pack_bitmap_object *object)
+{
+	git_pack_bitmap_object *copy;
+	khiter_t k;
+	int ret;
+
+	if (in_pack) {
+		uint32_t *hashes = set->bitmap->write_hashes;
+		uint32_t index_pos = set->bitmap->pack_order[pos];
+
+		git_bitvec_set(&set->bits, pos, true);
+
+		if (hashes && !hashes[index_pos])
+			hashes[index_pos] = object->name_hash;
+
+		return 0;
+	}
+
+	copy = git__malloc(sizeof(git_pack_bitmap_object));
+	GITERR_CHECK_ALLOC(copy);
+	memcpy(copy, object, sizeof(git_pack_bitmap_object));
+
+	k = kh_put(oid, set->extended, &copy->oid, &ret);
+	if (ret < 0) {
+		git__free(copy);
+		giterr_set_oom();
+		return -1;
+	}
+	kh_val(set->extended, k) = copy;
+
+	return 0;
+}
+
+/* Or the bitmap of an entry into a set, resolving the xor-ed bitmaps */
+static int set_or_entry(
+	git_pack_bitmap_set *set, const git_pack_bitmap_entry *entry)
+{
+	git_pack_bitmap *bitmap = set->bitmap;
+	git_bitvec tmp;
+	uint64_t *dst, *src;
+	size_t i;
+	int error = 0;
+
+	if (!entry->xor_offset)
+		return git_ewah_read(&set->bits, bitmap->num_objects,
+			entry->ewah, entry->ewah_size) < 0 ? -1 : 0;
+
+	if (git_bitvec_init(&tmp, bitmap->num_objects) < 0)
+		return -1;
+
+	for (;;) {
+		if (git_ewah_read_xor(&tmp, bitmap->num_objects,
+				entry->ewah, entry->ewah_size) < 0) {
+			error = -1;
+			break;
+		}
+
+		if (!entry->xor_offset)
+			break;
+
+		entry = git_vector_get(&bitmap->entries, entry->n - entry->xor_offset);
+	}
+
+	if (!error) {
+		dst = bitvec_words(&set->bits);
+		src = bitvec_words(&tmp);
+
+		for (i = 0; i < bitvec_nwords(&tmp); i++)
+			dst[i] |= src[i];
+	}
+
+	git_bitvec_free(&tmp);
+	return error;
+}
+
+static git_otype bitmap_type(const git_pack_bitmap *bitmap, uint32_t pos)
+{
+	int t;
+
+	for (t = 0; t < 4; t++)
+		if (git_bitvec_get((git_bitvec *)&bitmap->types[t], pos))
+			return index_types[t];
+
+	return GIT_OBJ_BAD;
+}
+
+/*
+ * Walking the objects
+ */
+
+typedef git_array_t(git_pack_bitmap_object) bitmap_stack;
+
+static int stack_push(
+	bitmap_stack *stack, const git_oid *oid, git_otype type, uint32_t name_hash)
+{
+	git_pack_bitmap_object *item = git_array_alloc(*stack);
+	GITERR_CHECK_ALLOC(item);
+
+	git_oid_cpy(&item->oid, oid);
+	item->type = type;
+	item->name_hash = name_hash;
+
+	return 0;
+}
+
+static int walk_commit(
+	bitmap_stack *stack,
+	git_repository *repo,
+	const git_oid *oid,
+	unsigned int flags)
+{
+	git_commit *commit;
+	unsigned int i;
+	int error = 0;
+
+	if (git_commit_lookup(&commit, repo, oid) < 0)
+		return -1;
+
+	/* the parents are popped first, their bitmaps cover most of the tree */
+	if (!(flags & GIT_PACK_BITMAP_COMMITS_ONLY))
+		error = stack_push(stack, git_commit_tree_id(commit), GIT_OBJ_TREE, 0);
+
+	for (i = git_commit_parentcount(commit); i > 0 && !error; i--)
+		error = stack_push(stack,
+			git_commit_parent_id(commit, i - 1), GIT_OBJ_COMMIT, 0);
+
+	git_commit_free(commit);
+	return error;
+}
+
+static int walk_tree(
+	bitmap_stack *stack,
+	git_repository *repo,
+	const git_pack_bitmap_object *item)
+{
+	git_tree *tree;
+	uint32_t prefix_hash;
+	size_t i;
+	int error = 0;
+
+	if (git_tree_lookup(&tree, repo, &item->oid) < 0)
+		return -1;
+
+	/* the entries of the root tree have no prefix */
+	prefix_hash = item->name_hash ?
+		name_hash_append(item->name_hash, "/") : 0;
+
+	for (i = 0; i < git_tree_entrycount(tree) && !error; i++) {
+		const git_tree_entry *entry = git_tree_entry_byindex(tree, i);
+
+		/* submodules are not in the repository */
+		if (S_ISGITLINK(entry->attr))
+			continue;
+
+		error = stack_push(stack, &entry->oid,
+			git_tree_entry__is_tree(entry) ? GIT_OBJ_TREE : GIT_OBJ_BLOB,
+			name_hash_append(prefix_hash, entry->filename));
+	}
+
+	git_tree_free(tree);
+	return error;
+}
+
+static int walk_tag(
+	bitmap_stack *stack, git_repository *repo, const git_oid *oid)
+{
+	git_tag *tag;
+	int error;
+
+	if (git_tag_lookup(&tag, repo, oid) < 0)
+		return -1;
+
+	error = stack_push(stack,
+		git_tag_target_id(tag), git_tag_target_type(tag), 0);
+
+	git_tag_free(tag);
+	return error;
+}
+
+int git_pack_bitmap_walk(
+	git_pack_bitmap_set *set,
+	git_repository *repo,
+	const git_oid *tips,
+	size_t ntips,
+	const git_pack_bitmap_set *stop,
+	unsigned int flags)
+{
+	bitmap_stack stack = GIT_ARRAY_INIT;
+	git_pack_bitmap_object *top;
+	git_odb *odb;
+	size_t i;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		return error;
+
+	for (i = ntips; i > 0 && !error; i--)
+		error = stack_push(&stack, &tips[i - 1], GIT_OBJ_ANY, 0);
+
+	while (!error && (top = git_array_pop(stack)) != NULL) {
+		git_pack_bitmap_object item = *top;
+		uint32_t pos = 0;
+		bool in_pack;
+
+		error = bitmap_position(&pos, set->bitmap, &item.oid);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			break;
+
+		in_pack = (error == 0);
+		error = 0;
+
+		if (set_contains(set, in_pack, pos, &item.oid) ||
+			(stop && set_contains(stop, in_pack, pos, &item.oid)))
+			continue;
+
+		if (in_pack && item.type == GIT_OBJ_ANY)
+			item.type = bitmap_type(set->bitmap, pos);
+
+		if (item.type == GIT_OBJ_ANY || item.type == GIT_OBJ_BAD) {
+			size_t size;
+
+			if ((error = git_odb_read_header(&size, &item.type, odb, &item.oid)) < 0)
+				break;
+		}
+
+		if (item.type == GIT_OBJ_COMMIT && set->bitmap) {
+			khiter_t k = kh_get(oid, set->bitmap->commits, &item.oid);
+
+			if (k != kh_end(set->bitmap->commits)) {
+				error = set_or_entry(set, kh_val(set->bitmap->commits, k));
+				continue;
+			}
+		}
+
+		if ((error = set_insert(set, in_pack, pos, &item)) < 0)
+			break;
+
+		switch (item.type) {
+		case GIT_OBJ_COMMIT:
+			error = walk_commit(&stack, repo, &item.oid, flags);
+			break;
+		case GIT_OBJ_TREE:
+			error = walk_tree(&stack, repo, &item);
+			break;
+		case GIT_OBJ_TAG:
+			error = walk_tag(&stack, repo, &item.oid);
+			break;
+		default:
+			break;
+		}
+	}
+
+	git_array_clear(stack);
+	return error;
+}
+
+size_t git_pack_bitmap_set_count(
+	const git_pack_bitmap_set *set,
+	const git_pack_bitmap_set *exclude,
+	git_otype type)
+{
+	const git_pack_bitmap_object *obj;
+	size_t count = 0, i;
+	int t = type_index(type);
+
+	if (set->bitmap && t >= 0) {
+		const uint64_t *words = bitvec_words(&set->bits);
+		const uint64_t *types = bitvec_words(&set->bitmap->types[t]);
+		const uint64_t *excluded = exclude ? bitvec_words(&exclude->bits) : NULL;
+
+		for (i = 0; i < bitvec_nwords(&set->bits); i++)
+			count += popcount64(words[i] & types[i] &
+				(excluded ? ~excluded[i] : ~(uint64_t)0));
+	}
+
+	kh_foreach_value(set->extended, obj, {
+		if (obj->type == type &&
+			(!exclude || kh_get(oid, exclude->extended, &obj->oid) ==
+				kh_end(exclude->extended)))
+			count++;
+	});
+
+	return count;
+}
+
+int git_pack_bitmap_set_foreach(
+	const git_pack_bitmap_set *set,
+	const git_pack_bitmap_set *exclude,
+	git_pack_bitmap_foreach_cb cb,
+	void *payload)
+{
+	const git_pack_bitmap *bitmap = set->bitmap;
+	const git_pack_bitmap_object *obj;
+	size_t w;
+	int error;
+
+	if (bitmap) {
+		const uint64_t *words = bitvec_words(&set->bits);
+		const uint64_t *excluded = exclude ? bitvec_words(&exclude->bits) : NULL;
+
+		for (w = 0; w < bitvec_nwords(&set->bits); w++) {
+			uint64_t word = words[w] & (excluded ? ~excluded[w] : ~(uint64_t)0);
+			uint32_t bit;
+
+			for (bit = 0; word; bit++, word >>= 1) {
+				uint32_t pos = (uint32_t)(w * 64 + bit), index_pos;
+				uint32_t name_hash = 0;
+
+				if (!(word & 1) || pos >= bitmap->num_objects)
+					continue;
+
+				index_pos = bitmap->pack_order[pos];
+				if (bitmap->name_hashes)
+					name_hash = get_be32(bitmap->name_hashes + 4 * index_pos);
+
+				if ((error = cb(git_pack_nth_oid(bitmap->pack, index_pos),
+						bitmap_type(bitmap, pos), name_hash, payload)) != 0)
+					return giterr_set_after_callback(error);
+			}
+		}
+	}
+
+	kh_foreach_value(set->extended, obj, {
+		if (exclude && kh_get(oid, exclude->extended, &obj->oid) !=
+				kh_end(exclude->extended))
+			continue;
+
+		if ((error = cb(&obj->oid, obj->type, obj->name_hash, payload)) != 0)
+			return giterr_set_after_callback(error);
+	});
+
+	return 0;
+}
+
+/*
+ * Writing a bitmap
+ */
+
+/* The type of an object of the pack, without inflating its delta */
+static int pack_object_type(
+	git_otype *out, struct git_pack_file *p, git_off_t offset)
+{
+	git_mwindow *w_curs = NULL;
+	git_off_t curpos;
+	size_t size;
+	git_otype type;
+
+	for (;;) {
+		curpos = offset;
+
+		if (git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos) < 0) {
+			git_mwindow_close(&w_curs);
+			return -1;
+		}
+
+		if (type != GIT_OBJ_OFS_DELTA && type != GIT_OBJ_REF_DELTA)
+			break;
+
+		offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+		git_mwindow_close(&w_curs);
+
+		if (offset <= 0) {
+			giterr_set(GITERR_ODB, "Delta base not found in packfile");
+			return -1;
+		}
+	}
+
+	git_mwindow_close(&w_curs);
+	*out = type;
+	return 0;
+}
+
+static int bitmap_writer_init(git_pack_bitmap **out, struct git_pack_file *p)
+{
+	git_pack_bitmap *bitmap;
+	struct git_pack_entry e;
+	uint32_t pos;
+
+	if (bitmap_alloc(&bitmap, p) < 0)
+		return -1;
+
+	bitmap->write_hashes = git__calloc(p->num_objects + 1, sizeof(uint32_t));
+	if (!bitmap->write_hashes)
+		goto on_error;
+
+	/* open the pack to read the object headers */
+	if (p->num_objects > 0 &&
+		git_pack_entry_at(&e, p, git_pack_nth_oid(p, 0), git_pack_nth_offset(p, 0)) < 0)
+		goto on_error;
+
+	for (pos = 0; pos < p->num_objects; pos++) {
+		uint32_t index_pos = bitmap->pack_order[pos];
+		git_otype type;
+		int t;
+
+		if (pack_object_type(&type, p, git_pack_nth_offset(p, index_pos)) < 0)
+			goto on_error;
+
+		if ((t = type_index(type)) < 0) {
+			giterr_set(GITERR_ODB, "Invalid object type in packfile");
+			goto on_error;
+		}
+
+		git_bitvec_set(&bitmap->types[t], pos, true);
+	}
+
+	*out = bitmap;
+	return 0;
+
+on_error:
+	git_pack_bitmap_free(bitmap);
+	return -1;
+}
+
+static int tips_insert(git_oidmap *tips, const git_oid *oid)
+{
+	git_oid *copy;
+	int ret;
+
+	if (kh_get(oid, tips, oid) != kh_end(tips))
+		return 0;
+
+	copy = git__malloc(sizeof(git_oid));
+	GITERR_CHECK_ALLOC(copy);
+	git_oid_cpy(copy, oid);
+
+	kh_put(oid, tips, copy, &ret);
+	if (ret < 0) {
+		git__free(copy);
+		giterr_set_oom();
+		return -1;
+	}
+
+	return 0;
+}
+
+static void tips_free(git_oidmap *tips)
+{
+	khiter_t k;
+
+	if (tips == NULL)
+		return;
+
+	for (k = kh_begin(tips); k != kh_end(tips); k++)
+		if (kh_exist(tips, k))
+			git__free((git_oid *)kh_key(tips, k));
+
+	git_oidmap_free(tips);
+}
+
+/* Push the commits of the references to the walk, and remember them */
+static int push_tips(git_revwalk *walk, git_oidmap *tips, git_repository *repo)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	git_object *obj;
+	git_oid head;
+	int error;
+
+	if ((error = git_reference_iterator_new(&iter, repo)) < 0)
+		return error;
+
+	while ((error = git_reference_next(&ref, iter)) == 0) {
+		/* References that don't point to commits are skipped */
+		if (git_reference_peel(&obj, ref, GIT_OBJ_COMMIT) == 0) {
+			if ((error = git_revwalk_push(walk, git_object_id(obj))) == 0)
+				error = tips_insert(tips, git_object_id(obj));
+			git_object_free(obj);
+		} else {
+			giterr_clear();
+		}
+
+		git_reference_free(ref);
+		if (error < 0)
+			break;
+	}
+
+	git_reference_iterator_free(iter);
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	/* A detached HEAD is not one of the references */
+	if (!error) {
+		if (git_reference_name_to_id(&head, repo, GIT_HEAD_FILE) == 0 &&
+			git_revwalk_push(walk, &head) == 0)
+			error = tips_insert(tips, &head);
+		else
+			giterr_clear();
+	}
+
+	return error;
+}
+
+/* Compute the bitmap of one commit, if all its objects are in the pack */
+static int bitmap_select(
+	git_pack_bitmap *bitmap,
+	git_vector *buffers,
+	git_repository *repo,
+	const git_oid *oid)
+{
+	git_pack_bitmap_set set;
+	git_pack_bitmap_entry *entry;
+	git_buf *buf;
+	uint32_t index_pos;
+	khiter_t k;
+	int error, ret;
+
+	if ((error = git_pack_find_position(&index_pos, bitmap->pack, oid)) < 0)
+		return error == GIT_ENOTFOUND ? 0 : error;
+
+	if ((error = git_pack_bitmap_set_init(&set, bitmap)) < 0)
+		return error;
+
+	if ((error = git_pack_bitmap_walk(&set, repo, oid, 1, NULL, 0)) < 0 ||
+		kh_size(set.extended) > 0)
+		goto done;
+
+	if ((buf = git__malloc(sizeof(git_buf))) == NULL ||
+		git_vector_insert(buffers, buf) < 0) {
+		git__free(buf);
+		error = -1;
+		goto done;
+	}
+	git_buf_init(buf, 0);
+
+	if ((error = git_ewah_write(buf, &set.bits, bitmap->num_objects)) < 0)
+		goto done;
+
+	entry = git__calloc(1, sizeof(git_pack_bitmap_entry));
+	if (entry == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	git_oid_cpy(&entry->oid, oid);
+	entry->n = bitmap->entries.length;
+	entry->index_pos = index_pos;
+	entry->ewah = buf->ptr;
+	entry->ewah_size = buf->size;
+
+	if ((error = git_vector_insert(&bitmap->entries, entry)) < 0) {
+		git__free(entry);
+		goto done;
+	}
+
+	k = kh_put(oid, bitmap->commits, &entry->oid, &ret);
+	if (ret < 0) {
+		giterr_set_oom();
+		error = -1;
+	} else
+		kh_val(bitmap->commits, k) = entry;
+
+done:
+	git_pack_bitmap_set_free(&set);
+	return error;
+}
+
+static int bitmap_write_file(git_pack_bitmap *bitmap, const char *path)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf buf = GIT_BUF_INIT;
+	git_pack_bitmap_entry *entry;
+	const unsigned char *index = bitmap->pack->index_map.data;
+	unsigned char header[BITMAP_HEADER_SIZE];
+	git_oid checksum;
+	size_t i;
+	int t, error;
+
+	memcpy(header, BITMAP_SIGNATURE, 4);
+	header[4] = 0;
+	header[5] = BITMAP_VERSION;
+	header[6] = 0;
+	header[7] = BITMAP_OPT_FULL_DAG | BITMAP_OPT_HASH_CACHE;
+	put_be32(header + 8, (uint32_t)bitmap->entries.length);
+	memcpy(header + 12, index + bitmap->pack->index_map.len - 2 * GIT_OID_RAWSZ,
+		GIT_OID_RAWSZ);
+
+	git_buf_put(&buf, (const char *)header, sizeof(header));
+
+	for (t = 0; t < 4; t++)
+		if (git_ewah_write(&buf, &bitmap->types[t], bitmap->num_objects) < 0)
+			goto on_error;
+
+	git_vector_foreach(&bitmap->entries, i, entry) {
+		unsigned char entry_header[6];
+
+		put_be32(entry_header, entry->index_pos);
+		entry_header[4] = 0; /* not xor-ed */
+		entry_header[5] = 0;
+
+		git_buf_put(&buf, (const char *)entry_header, sizeof(entry_header));
+		git_buf_put(&buf, entry->ewah, entry->ewah_size);
+	}
+
+	for (i = 0; i < bitmap->num_objects; i++) {
+		unsigned char hash[4];
+
+		put_be32(hash, bitmap->write_hashes[i]);
+		git_buf_put(&buf, (const char *)hash, sizeof(hash));
+	}
+
+	if (git_buf_oom(&buf))
+		goto on_error;
+
+	if ((error = git_filebuf_open(&file, path,
+			GIT_FILEBUF_HASH_CONTENTS, GIT_PACK_FILE_MODE)) < 0) {
+		git_buf_free(&buf);
+		return error;
+	}
+
+	if (git_filebuf_write(&file, buf.ptr, buf.size) < 0 ||
+		git_filebuf_hash(&checksum, &file) < 0 ||
+		git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ) < 0) {
+		git_filebuf_cleanup(&file);
+		goto on_error;
+	}
+
+	git_buf_free(&buf);
+	return git_filebuf_commit(&file);
+
+on_error:
+	git_buf_free(&buf);
+	return -1;
+}
+
+int git_pack_bitmap_write(struct git_pack_file *p, git_repository *repo)
+{
+	git_pack_bitmap *bitmap = NULL;
+	git_revwalk *walk = NULL;
+	git_oidmap *tips = NULL;
+	git_vector buffers = GIT_VECTOR_INIT;
+	git_buf path = GIT_BUF_INIT, *buf;
+	git_oid oid;
+	size_t count = 0, i;
+	int error;
+
+	if ((error = bitmap_writer_init(&bitmap, p)) < 0)
+		return error;
+
+	if ((tips = git_oidmap_alloc()) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_revwalk_new(&walk, repo)) < 0)
+		goto done;
+
+	/* parents come first, so that their bitmaps are reused */
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+
+	if ((error = push_tips(walk, tips, repo)) < 0)
+		goto done;
+
+	while ((error = git_revwalk_next(&oid, walk)) == 0) {
+		if (++count % GIT_PACK_BITMAP_INTERVAL != 0 &&
+			kh_get(oid, tips, &oid) == kh_end(tips))
+			continue;
+
+		if ((error = bitmap_select(bitmap, &buffers, repo, &oid)) < 0)
+			goto done;
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	if ((error = bitmap_path(&path, p)) < 0)
+		goto done;
+
+	error = bitmap_write_file(bitmap, path.ptr);
+
+done:
+	git_vector_foreach(&buffers, i, buf) {
+		git_buf_free(buf);
+		git__free(buf);
+	}
+	git_vector_free(&buffers);
+	git_buf_free(&path);
+	tips_free(tips);
+	git_revwalk_free(walk);
+	git_pack_bitmap_free(bitmap);
+	return error;
+}
+
+/*
+ * Public API
+ */
+
+int git_graph_write_bitmap(git_repository *repo)
+{
+	git_odb *odb;
+
+	assert(repo);
+
+	if (git_repository_odb__weakptr(&odb, repo) < 0)
+		return -1;
+
+	return git_odb__write_pack_bitmap(odb, repo);
+}
+
+int git_graph_count_reachable(
+	git_graph_object_counts *out,
+	git_repository *repo,
+	const git_oid *include,
+	size_t include_count,
+	const git_oid *exclude,
+	size_t exclude_count)
+{
+	git_pack_bitmap *bitmap = NULL;
+	git_pack_bitmap_set wants, haves;
+	git_odb *odb;
+	int error;
+
+	assert(out && repo && (include || !include_count) &&
+		(exclude || !exclude_count));
+
+	memset(out, 0, sizeof(*out));
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		return error;
+
+	/* without a bitmap, all the objects are walked */
+	if ((error = git_odb__pack_bitmap(&bitmap, odb)) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+		giterr_clear();
+	}
+
+	if ((error = git_pack_bitmap_set_init(&wants, bitmap)) < 0)
+		goto done_bitmap;
+	if ((error = git_pack_bitmap_set_init(&haves, bitmap)) < 0)
+		goto done_wants;
+
+	if ((error = git_pack_bitmap_walk(
+			&haves, repo, exclude, exclude_count, NULL, 0)) < 0 ||
+		(error = git_pack_bitmap_walk(
+			&wants, repo, include, include_count, &haves, 0)) < 0)
+		goto done;
+
+	out->commits = git_pack_bitmap_set_count(&wants, &haves, GIT_OBJ_COMMIT);
+	out->trees = git_pack_bitmap_set_count(&wants, &haves, GIT_OBJ_TREE);
+	out->blobs = git_pack_bitmap_set_count(&wants, &haves, GIT_OBJ_BLOB);
+	out->tags = git_pack_bitmap_set_count(&wants, &haves, GIT_OBJ_TAG);
+
+done:
+	git_pack_bitmap_set_free(&haves);
+done_wants:
+	git_pack_bitmap_set_free(&wants);
+done_bitmap:
+	git_pack_bitmap_free(bitmap);
+	return error;
+}
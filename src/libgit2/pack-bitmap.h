@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_pack_bitmap_h__
+#define INCLUDE_pack_bitmap_h__
+
+#include "common.h"
+#include "bitvec.h"
+#include "map.h"
+#include "oidmap.h"
+#include "vector.h"
+
+struct git_pack_file;
+
+#define GIT_PACK_BITMAP_EXT ".bitmap"
+
+/*
+ * Reachability bitmaps of a packfile, in the format written by
+ * `git repack -b`.
+ *
+ * The `.bitmap` file next to a pack stores, for a selection of commits,
+ * the set of objects reachable from the commit as an EWAH compressed
+ * bitmap with one bit per object of the pack, in pack order (sorted by
+ * offset). It also stores one bitmap of the objects of each type and
+ * the name hash of each object, for the delta search of the
+ * packbuilder. A commit is only selected when all the objects that it
+ * reaches are in the pack.
+ *
+ * A bitmap entry may be stored xor-ed with the bitmap of an entry
+ * before it, which must be decoded first.
+ */
+
+typedef struct {
+	git_oid oid;
+	size_t n; /* position in the entries */
+	uint32_t index_pos;
+	uint8_t xor_offset;
+	uint8_t flags;
+	const char *ewah;
+	size_t ewah_size;
+} git_pack_bitmap_entry;
+
+typedef struct git_pack_bitmap {
+	git_refcount rc;
+	git_map map;
+	struct git_pack_file *pack;
+
+	uint32_t num_objects;
+	uint32_t *pack_order; /* index position of the n:th object of the pack */
+	uint32_t *pack_pos; /* pack position of the n:th object of the index */
+	git_bitvec types[4]; /* commits, trees, blobs and tags */
+
+	git_vector entries;
+	git_oidmap *commits; /* commit oid -> git_pack_bitmap_entry */
+
+	const unsigned char *name_hashes; /* big-endian, in index order */
+	uint32_t *write_hashes; /* name hashes found while writing */
+} git_pack_bitmap;
+
+/*
+ * A set of objects found by a walk: the objects of the pack of the
+ * bitmap as bits, and the other objects in a map. Without a bitmap,
+ * all the objects are in the map.
+ */
+typedef struct {
+	git_oid oid;
+	git_otype type;
+	uint32_t name_hash;
+} git_pack_bitmap_object;
+
+typedef struct {
+	git_pack_bitmap *bitmap;
+	git_bitvec bits;
+	git_oidmap *extended; /* oid -> git_pack_bitmap_object */
+} git_pack_bitmap_set;
+
+/* Only walk the commits, and not their trees */
+#define GIT_PACK_BITMAP_COMMITS_ONLY (1u << 0)
+
+extern int git_pack_bitmap_open(
+	git_pack_bitmap **out, struct git_pack_file *p, const char *path);
+extern void git_pack_bitmap_free(git_pack_bitmap *bitmap);
+
+/*
+ * Get the bitmap of a packfile, loaded once and kept with the pack.
+ * Returns GIT_ENOTFOUND when the pack has no valid bitmap. The bitmap
+ * must be freed with git_pack_bitmap_free.
+ */
+extern int git_pack_bitmap_load(git_pack_bitmap **out, struct git_pack_file *p);
+
+/* Forget the bitmap of a packfile, to reload it from disk */
+extern void git_pack_bitmap_reset(struct git_pack_file *p);
+
+/* Delete the bitmap file of a packfile, if it has one */
+extern int git_pack_bitmap_remove(struct git_pack_file *p);
+
+/*
+ * Write the bitmap of a packfile, for the commits reachable from the
+ * references of `repo`: all the tips, and one commit in every
+ * GIT_PACK_BITMAP_INTERVAL of the history.
+ */
+#define GIT_PACK_BITMAP_INTERVAL 100
+
+extern int git_pack_bitmap_write(
+	struct git_pack_file *p, git_repository *repo);
+
+extern int git_pack_bitmap_set_init(
+	git_pack_bitmap_set *set, git_pack_bitmap *bitmap);
+extern void git_pack_bitmap_set_free(git_pack_bitmap_set *set);
+
+/*
+ * Add the objects reachable from `tips` to `set`. The walk stops at the
+ * objects already in the set or in `stop`, and uses the bitmaps of the
+ * commits that have one.
+ */
+extern int git_pack_bitmap_walk(
+	git_pack_bitmap_set *set,
+	git_repository *repo,
+	const git_oid *tips,
+	size_t ntips,
+	const git_pack_bitmap_set *stop,
+	unsigned int flags);
+
+/* Count the objects of a type in `set` that are not in `exclude` */
+extern size_t git_pack_bitmap_set_count(
+	const git_pack_bitmap_set *set,
+	const git_pack_bitmap_set *exclude,
+	git_otype type);
+
+typedef int (*git_pack_bitmap_foreach_cb)(
+	const git_oid *oid, git_otype type, uint32_t name_hash, void *payload);
+
+/* Call `cb` for each object in `set` that is not in `exclude` */
+extern int git_pack_bitmap_set_foreach(
+	const git_pack_bitmap_set *set,
+	const git_pack_bitmap_set *exclude,
+	git_pack_bitmap_foreach_cb cb,
+	void *payload);
+
+#endif
@@ -12,6 +12,7 @@
 #include "iterator.h"
 #include "netops.h"
 #include "pack.h"
+#include "pack-bitmap.h"
 #include "thread-utils.h"
 #include "tree.h"
 #include "util.h"
@@ -22,6 +23,12 @@
 #include "git2/indexer.h"
 #include "git2/config.h"
 
+/*
+ * Number of threads used by new packbuilders when the repository has
+ * no pack.threads config, set with GIT_OPT_SET_PACK_THREADS
+ */
+unsigned int git_packbuilder__default_threads = 1;
+
 struct unpacked {
 	git_pobject *object;
 	void *data;
@@ -103,6 +110,9 @@ static int packbuilder_config(git_packbuilder *pb)
 	config_get("pack.deltaCacheSize", pb->big_file_threshold,
 		   GIT_PACK_BIG_FILE_THRESHOLD);
 	config_get("pack.windowMemory", pb->window_memory_limit, 0);
+#ifdef GIT_THREADS
+	config_get("pack.threads", pb->nr_threads, git_packbuilder__default_threads);
+#endif
 
 #undef config_get
 
@@ -179,15 +189,13 @@ static void rehash(git_packbuilder *pb)
 	}
 }
 
-int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
-			   const char *name)
+static int insert_object(git_packbuilder *pb, const git_oid *oid,
+			 unsigned int hash)
 {
 	git_pobject *po;
 	khiter_t pos;
 	int ret;
 
-	assert(pb && oid);
-
 	/* If the object already exists in the hash table, then we don't
 	 * have any work to do */
 	pos = kh_get(oid, pb->object_ix, oid);
@@ -210,7 +218,7 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 
 	pb->nr_objects++;
 	git_oid_cpy(&po->id, oid);
-	po->hash = name_hash(name);
+	po->hash = hash;
 
 	pos = kh_put(oid, pb->object_ix, &po->id, &ret);
 	if (ret < 0) {
@@ -241,6 +249,14 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 	return 0;
 }
 
+int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
+			   const char *name)
+{
+	assert(pb && oid);
+
+	return insert_object(pb, oid, name_hash(name));
+}
+
 static int get_delta(void **out, git_odb *odb, git_pobject *po)
 {
 	git_odb_object *src = NULL, *trg = NULL;
@@ -1011,19 +1027,36 @@ struct thread_params {
 	int depth;
 	int working;
 	int data_ready;
+
+	/* The first error of the thread, errors are thread-local */
+	int error;
+	char *error_msg;
 };
 
+static void thread_error(struct thread_params *me)
+{
+	const git_error *e = giterr_last();
+
+	if (me->error)
+		return;
+
+	me->error = -1;
+	me->error_msg = git__strdup(e ? e->message : "unknown error");
+}
+
 static void *threaded_find_deltas(void *arg)
 {
 	struct thread_params *me = arg;
 
 	while (me->remaining) {
 		if (find_deltas(me->pb, me->list, &me->remaining,
-				me->window, me->depth) < 0) {
-			; /* TODO */
-		}
+				me->window, me->depth) < 0)
+			thread_error(me);
 
 		git_packbuilder__progress_lock(me->pb);
+		/* Give up the rest of the segment after an error */
+		if (me->error)
+			me->remaining = 0;
 		me->working = 0;
 		git_cond_signal(&me->pb->progress_cond);
 		git_packbuilder__progress_unlock(me->pb);
@@ -1056,17 +1089,15 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 			  int depth)
 {
 	struct thread_params *p;
-	int i, ret, active_threads = 0;
+	int i, ret, error = 0, active_threads = 0;
 
 	if (!pb->nr_threads)
 		pb->nr_threads = git_online_cpus();
 
-	if (pb->nr_threads <= 1) {
-		find_deltas(pb, list, &list_size, window, depth);
-		return 0;
-	}
+	if (pb->nr_threads <= 1)
+		return find_deltas(pb, list, &list_size, window, depth);
 
-	p = git__malloc(pb->nr_threads * sizeof(*p));
+	p = git__calloc(pb->nr_threads, sizeof(*p));
 	GITERR_CHECK_ALLOC(p);
 
 	/* Partition the work among the threads */
@@ -1108,8 +1139,20 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 		ret = git_thread_create(&p[i].thread, NULL,
 					threaded_find_deltas, &p[i]);
 		if (ret) {
-			giterr_set(GITERR_THREAD, "unable to create thread");
-			return -1;
+			/*
+			 * Search the segment on this thread instead, the
+			 * threads that are already running keep stealing
+			 * work from each other
+			 */
+			git_cond_free(&p[i].cond);
+			git_mutex_free(&p[i].mutex);
+
+			if (find_deltas(pb, p[i].list, &p[i].remaining,
+					window, depth) < 0 && !error)
+				error = -1;
+
+			p[i].list_size = 0;
+			continue;
 		}
 		active_threads++;
 	}
@@ -1144,7 +1187,7 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 		/* At this point we hold the progress lock and have located
 		 * a thread to receive more work. We still need to locate a
 		 * thread from which to steal work (the victim). */
-		for (i = 0; i < pb->nr_threads; i++)
+		for (i = 0; !target->error && i < pb->nr_threads; i++)
 			if (p[i].remaining > 2*window &&
 			    (!victim || victim->remaining < p[i].remaining))
 				victim = &p[i];
@@ -1194,8 +1237,18 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 		}
 	}
 
+	/* Report the first error of the threads on the calling thread */
+	for (i = 0; i < pb->nr_threads; i++) {
+		if (p[i].error && !error) {
+			giterr_set(GITERR_THREAD, "%s",
+				p[i].error_msg ? p[i].error_msg : "delta search failed");
+			error = p[i].error;
+		}
+		git__free(p[i].error_msg);
+	}
+
 	git__free(p);
-	return 0;
+	return error;
 }
 
 #else
@@ -1231,10 +1284,18 @@ static int prepare_pack(git_packbuilder *pb)
 	}
 
 	if (n > 1) {
+		int error;
+
 		git__tsort((void **)delta_list, n, type_size_sort);
-		if (ll_find_deltas(pb, delta_list, n,
+
+		/* The objects are read by type and size, not in pack order */
+		git_odb__advise(pb->odb, GIT_MADV_WILLNEED);
+		error = ll_find_deltas(pb, delta_list, n,
 				   GIT_PACK_WINDOW + 1,
-				   GIT_PACK_DEPTH) < 0) {
+				   GIT_PACK_DEPTH);
+		git_odb__advise(pb->odb, GIT_MADV_NORMAL);
+
+		if (error < 0) {
 			git__free(delta_list);
 			return -1;
 		}
@@ -1352,6 +1413,47 @@ int git_packbuilder_insert_tree(git_packbuilder *pb, const git_oid *oid)
 	return error;
 }
 
+static int cb_insert_reachable(
+	const git_oid *oid, git_otype type, uint32_t hash, void *payload)
+{
+	GIT_UNUSED(type);
+	return insert_object(payload, oid, hash);
+}
+
+int git_packbuilder__insert_reachable(
+	git_packbuilder *pb,
+	const git_oid *wants, size_t nwants,
+	const git_oid *haves, size_t nhaves)
+{
+	git_pack_bitmap *bitmap;
+	git_pack_bitmap_set want_set, have_set;
+	int error;
+
+	assert(pb && wants);
+
+	if ((error = git_odb__pack_bitmap(&bitmap, pb->odb)) < 0)
+		return error;
+
+	if ((error = git_pack_bitmap_set_init(&want_set, bitmap)) < 0)
+		goto done_bitmap;
+	if ((error = git_pack_bitmap_set_init(&have_set, bitmap)) < 0)
+		goto done_wants;
+
+	if (!(error = git_pack_bitmap_walk(
+			&have_set, pb->repo, haves, nhaves, NULL, 0)) &&
+		!(error = git_pack_bitmap_walk(
+			&want_set, pb->repo, wants, nwants, &have_set, 0)))
+		error = git_pack_bitmap_set_foreach(
+			&want_set, &have_set, cb_insert_reachable, pb);
+
+	git_pack_bitmap_set_free(&have_set);
+done_wants:
+	git_pack_bitmap_set_free(&want_set);
+done_bitmap:
+	git_pack_bitmap_free(bitmap);
+	return error;
+}
+
 uint32_t git_packbuilder_object_count(git_packbuilder *pb)
 {
 	return pb->nr_objects;
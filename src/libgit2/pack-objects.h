@@ -89,4 +89,17 @@ struct git_packbuilder {
 
 int git_packbuilder_write_buf(git_buf *buf, git_packbuilder *pb);
 
+/*
+ * Insert the objects reachable from `wants` and not from `haves`,
+ * found with the reachability bitmaps of the repository. Returns
+ * GIT_ENOTFOUND when the repository has no bitmaps, to let the caller
+ * walk the history instead.
+ */
+int git_packbuilder__insert_reachable(
+	git_packbuilder *pb,
+	const git_oid *wants, size_t nwants,
+	const git_oid *haves, size_t nhaves);
+
+extern unsigned int git_packbuilder__default_threads;
+
 #endif /* INCLUDE_pack_objects_h__ */
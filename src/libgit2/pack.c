@@ -13,10 +13,18 @@
 #include "mwindow.h"
 #include "fileops.h"
 #include "oid.h"
+#include "array.h"
+#include "pack-bitmap.h"
 
 #include <zlib.h>
 
 static int packfile_open(struct git_pack_file *p);
+static int packfile_delta_result_size(
+		size_t *size_p,
+		struct git_pack_file *p,
+		git_mwindow **w_curs,
+		git_off_t curpos,
+		size_t delta_size);
 static git_off_t nth_packed_object_offset(const struct git_pack_file *p, uint32_t n);
 int packfile_unpack_compressed(
 		git_rawobj *obj,
@@ -50,12 +58,15 @@ static int packfile_error(const char *message)
  * Delta base cache
  ********************/
 
-static git_pack_cache_entry *new_cache_object(git_rawobj *source)
+size_t git_pack__cache_memory_limit = GIT_PACK_CACHE_MEMORY_LIMIT;
+
+static git_pack_cache_entry *new_cache_object(git_rawobj *source, git_off_t offset)
 {
 	git_pack_cache_entry *e = git__calloc(1, sizeof(git_pack_cache_entry));
 	if (!e)
 		return NULL;
 
+	e->offset = offset;
 	memcpy(&e->raw, source, sizeof(git_rawobj));
 
 	return e;
@@ -96,7 +107,7 @@ static int cache_init(git_pack_cache *cache)
 	cache->entries = git_offmap_alloc();
 	GITERR_CHECK_ALLOC(cache->entries);
 
-	cache->memory_limit = GIT_PACK_CACHE_MEMORY_LIMIT;
+	cache->memory_limit = git_pack__cache_memory_limit;
 
 	if (git_mutex_init(&cache->lock)) {
 		giterr_set(GITERR_OS, "Failed to initialize pack cache mutex");
@@ -110,6 +121,36 @@ static int cache_init(git_pack_cache *cache)
 	return 0;
 }
 
+/* Run with the cache lock held */
+static void lru_unlink(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->lru_head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->lru_tail = entry->prev;
+
+	entry->prev = entry->next = NULL;
+}
+
+/* Run with the cache lock held */
+static void lru_push_head(git_pack_cache *cache, git_pack_cache_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->lru_head;
+
+	if (cache->lru_head)
+		cache->lru_head->prev = entry;
+	else
+		cache->lru_tail = entry;
+
+	cache->lru_head = entry;
+}
+
 static git_pack_cache_entry *cache_get(git_pack_cache *cache, git_off_t offset)
 {
 	khiter_t k;
@@ -122,62 +163,81 @@ static git_pack_cache_entry *cache_get(git_pack_cache *cache, git_off_t offset)
 	if (k != kh_end(cache->entries)) { /* found it */
 		entry = kh_value(cache->entries, k);
 		git_atomic_inc(&entry->refcount);
-		entry->last_usage = cache->use_ctr++;
+		lru_unlink(cache, entry);
+		lru_push_head(cache, entry);
+		cache->hits++;
+	} else {
+		cache->misses++;
 	}
 	git_mutex_unlock(&cache->lock);
 
 	return entry;
 }
 
-/* Run with the cache lock held */
-static void free_lowest_entry(git_pack_cache *cache)
+/*
+ * Free the least recently used entry that nobody is using. Returns
+ * -1 when every entry is in use. Run with the cache lock held.
+ */
+static int free_lowest_entry(git_pack_cache *cache)
 {
 	git_pack_cache_entry *entry;
 	khiter_t k;
 
-	for (k = kh_begin(cache->entries); k != kh_end(cache->entries); k++) {
-		if (!kh_exist(cache->entries, k))
-			continue;
+	for (entry = cache->lru_tail; entry; entry = entry->prev) {
+		if (git_atomic_get(&entry->refcount) == 0)
+			break;
+	}
 
-		entry = kh_value(cache->entries, k);
+	if (!entry)
+		return -1;
 
-		if (entry && entry->refcount.val == 0) {
-			cache->memory_used -= entry->raw.len;
-			kh_del(off, cache->entries, k);
-			free_cache_object(entry);
-		}
-	}
+	k = kh_get(off, cache->entries, entry->offset);
+	assert(k != kh_end(cache->entries));
+	kh_del(off, cache->entries, k);
+
+	lru_unlink(cache, entry);
+	cache->memory_used -= entry->raw.len;
+	cache->evictions++;
+	free_cache_object(entry);
+
+	return 0;
 }
 
 static int cache_add(git_pack_cache *cache, git_rawobj *base, git_off_t offset)
 {
 	git_pack_cache_entry *entry;
-	int error, exists = 0;
+	int error, exists = 0, full = 0;
 	khiter_t k;
 
-	if (base->len > GIT_PACK_CACHE_SIZE_LIMIT)
+	if (base->len > (cache->memory_limit >> GIT_PACK_CACHE_SIZE_SHIFT))
 		return -1;
 
-	entry = new_cache_object(base);
+	entry = new_cache_object(base, offset);
 	if (entry) {
 		if (git_mutex_lock(&cache->lock) < 0) {
 			giterr_set(GITERR_OS, "failed to lock cache");
+			git__free(entry);
 			return -1;
 		}
 		/* Add it to the cache if nobody else has */
 		exists = kh_get(off, cache->entries, offset) != kh_end(cache->entries);
 		if (!exists) {
-			while (cache->memory_used + base->len > cache->memory_limit)
-				free_lowest_entry(cache);
-
+			while (!full && cache->memory_used + base->len > cache->memory_limit)
+				full = free_lowest_entry(cache) < 0;
+		}
+		if (!exists && !full) {
 			k = kh_put(off, cache->entries, offset, &error);
 			assert(error != 0);
 			kh_value(cache->entries, k) = entry;
+			lru_push_head(cache, entry);
 			cache->memory_used += entry->raw.len;
 		}
 		git_mutex_unlock(&cache->lock);
-		/* Somebody beat us to adding it into the cache */
-		if (exists) {
+		/*
+		 * Somebody beat us to adding it into the cache, or every
+		 * cached base is in use by another thread
+		 */
+		if (exists || full) {
 			git__free(entry);
 			return -1;
 		}
@@ -186,6 +246,38 @@ static int cache_add(git_pack_cache *cache, git_rawobj *base, git_off_t offset)
 	return 0;
 }
 
+void git_packfile__set_cache_limit(struct git_pack_file *p, size_t limit)
+{
+	git_pack_cache *cache = &p->bases;
+
+	if (git_mutex_lock(&cache->lock) < 0)
+		return;
+
+	cache->memory_limit = limit;
+	while (cache->memory_used > cache->memory_limit &&
+		free_lowest_entry(cache) == 0)
+		/* nothing */;
+
+	git_mutex_unlock(&cache->lock);
+}
+
+void git_packfile__cache_stats(
+	git_odb_delta_base_cache_stats *stats, struct git_pack_file *p)
+{
+	git_pack_cache *cache = &p->bases;
+
+	if (git_mutex_lock(&cache->lock) < 0)
+		return;
+
+	stats->memory_used += cache->memory_used;
+	stats->entries += kh_size(cache->entries);
+	stats->hits += cache->hits;
+	stats->misses += cache->misses;
+	stats->evictions += cache->evictions;
+
+	git_mutex_unlock(&cache->lock);
+}
+
 /***********************************************************
  *
  * PACK INDEX METHODS
@@ -470,11 +562,22 @@ int git_packfile_resolve_header(
 		struct git_pack_file *p,
 		git_off_t offset)
 {
+	return git_packfile_resolve_header_shared(size_p, type_p, p, offset, NULL);
+}
+
+int git_packfile_resolve_header_shared(
+		size_t *size_p,
+		git_otype *type_p,
+		struct git_pack_file *p,
+		git_off_t offset,
+		git_offmap *types)
+{
+	git_array_t(git_off_t) chain = GIT_ARRAY_INIT;
 	git_mwindow *w_curs = NULL;
-	git_off_t curpos = offset;
-	size_t size;
+	git_off_t curpos = offset, *entry;
+	git_off_t obj_offset = offset, base_offset = 0;
+	size_t size, i;
 	git_otype type;
-	git_off_t base_offset;
 	int error;
 
 	error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
@@ -482,36 +585,69 @@ int git_packfile_resolve_header(
 	if (error < 0)
 		return error;
 
-	if (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
-		size_t base_size;
-		git_rawobj delta;
-		base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
-		git_mwindow_close(&w_curs);
-		error = packfile_unpack_compressed(&delta, p, &w_curs, &curpos, size, type);
-		git_mwindow_close(&w_curs);
-		if (error < 0)
-			return error;
-		error = git__delta_read_header(delta.data, delta.len, &base_size, size_p);
-		git__free(delta.data);
-		if (error < 0)
-			return error;
-	} else
-		*size_p = size;
+	*size_p = size;
 
 	while (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
-		curpos = base_offset;
+		khiter_t k;
+
+		base_offset = get_delta_base(p, &w_curs, &curpos, type, obj_offset);
+		git_mwindow_close(&w_curs);
+
+		if (base_offset <= 0) {
+			error = base_offset < 0 ? (int)base_offset :
+				packfile_error("delta base is out of bounds");
+			goto cleanup;
+		}
+
+		/* the size is the size of the result of the first delta */
+		if (obj_offset == offset &&
+			(error = packfile_delta_result_size(size_p, p, &w_curs, curpos, size)) < 0)
+			goto cleanup;
+
+		if (types) {
+			if ((entry = git_array_alloc(chain)) == NULL)
+				goto oom;
+			*entry = obj_offset;
+
+			/* the rest of the chain was resolved for another object */
+			k = git_offmap_lookup_index(types, base_offset);
+			if (git_offmap_valid_index(types, k)) {
+				type = (git_otype)(intptr_t)git_offmap_value_at(types, k);
+				break;
+			}
+		}
+
+		obj_offset = curpos = base_offset;
 		error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
 		git_mwindow_close(&w_curs);
 		if (error < 0)
-			return error;
-		if (type != GIT_OBJ_OFS_DELTA && type != GIT_OBJ_REF_DELTA)
-			break;
-		base_offset = get_delta_base(p, &w_curs, &curpos, type, base_offset);
-		git_mwindow_close(&w_curs);
+			goto cleanup;
 	}
+
 	*type_p = type;
 
+	if (types) {
+		int ret;
+
+		git_offmap_insert(types, obj_offset, (void *)(intptr_t)type, ret);
+		if (ret < 0)
+			goto oom;
+
+		for (i = 0; i < git_array_size(chain); i++) {
+			git_offmap_insert(types, *git_array_get(chain, i), (void *)(intptr_t)type, ret);
+			if (ret < 0)
+				goto oom;
+		}
+	}
+
+cleanup:
+	git_array_clear(chain);
 	return error;
+
+oom:
+	git_array_clear(chain);
+	giterr_set_oom();
+	return -1;
 }
 
 static int packfile_unpack_delta(
@@ -535,9 +671,6 @@ static int packfile_unpack_delta(
 	if (base_offset < 0) /* must actually be an error code */
 		return (int)base_offset;
 
-	if (!p->bases.entries && (cache_init(&p->bases) < 0))
-		return -1;
-
 	base_key = base_offset; /* git_packfile_unpack modifies base_offset */
 	if ((cached = cache_get(&p->bases, base_offset)) != NULL) {
 		memcpy(&base, &cached->raw, sizeof(git_rawobj));
@@ -561,22 +694,21 @@ static int packfile_unpack_delta(
 	git_mwindow_close(w_curs);
 
 	if (error < 0) {
-		if (!found_base)
+		if (found_base)
+			git_atomic_dec(&cached->refcount);
+		else
 			git__free(base.data);
 		return error;
 	}
 
 	obj->type = base.type;
 	error = git__delta_apply(obj, base.data, base.len, delta.data, delta.len);
-	if (error < 0)
-		goto on_error;
 
 	if (found_base)
 		git_atomic_dec(&cached->refcount);
-	else if (cache_add(&p->bases, &base, base_key) < 0)
+	else if (error < 0 || cache_add(&p->bases, &base, base_key) < 0)
 		git__free(base.data);
 
-on_error:
 	git__free(delta.data);
 
 	return error; /* error set by git__delta_apply */
@@ -712,6 +844,58 @@ void git_packfile_stream_free(git_packfile_stream *obj)
 	inflateEnd(&obj->zstream);
 }
 
+/*
+ * Read the size of the object that a delta produces from the header of
+ * the delta, inflating only the first bytes of it
+ */
+static int packfile_delta_result_size(
+		size_t *size_p,
+		struct git_pack_file *p,
+		git_mwindow **w_curs,
+		git_off_t curpos,
+		size_t delta_size)
+{
+	/* the header is the sizes of the base and of the result, as two
+	 * varints of at most 10 bytes each */
+	unsigned char buffer[20], *in;
+	size_t base_size;
+	z_stream stream;
+	int st;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.next_out = buffer;
+	stream.avail_out = (uInt)min(sizeof(buffer), delta_size);
+	stream.zalloc = use_git_alloc;
+	stream.zfree = use_git_free;
+
+	if (inflateInit(&stream) != Z_OK) {
+		giterr_set(GITERR_ZLIB, "Failed to inflate packfile");
+		return -1;
+	}
+
+	do {
+		in = pack_window_open(p, w_curs, curpos, &stream.avail_in);
+		stream.next_in = in;
+		st = inflate(&stream, Z_SYNC_FLUSH);
+		git_mwindow_close(w_curs);
+
+		if (in == NULL)
+			break;
+
+		curpos += stream.next_in - in;
+	} while (st == Z_OK && stream.avail_out > 0);
+
+	inflateEnd(&stream);
+
+	if ((st != Z_OK && st != Z_STREAM_END) ||
+		git__delta_read_header(buffer, stream.total_out, &base_size, size_p) < 0) {
+		giterr_set(GITERR_ZLIB, "Failed to inflate packfile");
+		return -1;
+	}
+
+	return 0;
+}
+
 int packfile_unpack_compressed(
 	git_rawobj *obj,
 	struct git_pack_file *p,
@@ -859,6 +1043,8 @@ void git_packfile_free(struct git_pack_file *p)
 
 	pack_index_free(p);
 
+	git_pack_bitmap_free(p->bitmap);
+
 	git__free(p->bad_object_sha1);
 
 	git_mutex_free(&p->lock);
@@ -997,6 +1183,12 @@ int git_packfile_alloc(struct git_pack_file **pack_out, const char *path)
 		return -1;
 	}
 
+	if (cache_init(&p->bases) < 0) {
+		git_mutex_free(&p->lock);
+		git__free(p);
+		return -1;
+	}
+
 	/* see if we can parse the sha1 oid in the packfile name */
 	if (path_len < 40 ||
 		git_oid_fromstr(&p->sha1, path + path_len - GIT_OID_HEXSZ) < 0)
@@ -1094,6 +1286,226 @@ int git_pack_foreach_entry(
 	return error;
 }
 
+int git_pack_foreach_entry_offset(
+	struct git_pack_file *p,
+	git_pack_foreach_entry_offset_cb cb,
+	void *data)
+{
+	const unsigned char *index;
+	uint32_t i;
+	int error;
+
+	if (p->index_version == -1 && (error = pack_index_open(p)) < 0)
+		return error;
+
+	index = p->index_map.data;
+	index += 4 * 256;
+
+	/* the oids follow the fanout table, in version 1 after each offset */
+	if (p->index_version > 1)
+		index += 8;
+	else
+		index += 4;
+
+	for (i = 0; i < p->num_objects; i++) {
+		const git_oid *oid = (const git_oid *)
+			(index + i * (p->index_version > 1 ? 20 : 24));
+
+		if ((error = cb(oid, nth_packed_object_offset(p, i), data)) != 0)
+			return giterr_set_after_callback(error);
+	}
+
+	return 0;
+}
+
+int git_pack_index_load(struct git_pack_file *p)
+{
+	return pack_index_open(p);
+}
+
+const git_oid *git_pack_nth_oid(const struct git_pack_file *p, uint32_t n)
+{
+	const unsigned char *index = p->index_map.data;
+
+	index += 4 * 256;
+
+	if (p->index_version > 1)
+		return (const git_oid *)(index + 8 + 20 * n);
+	else
+		return (const git_oid *)(index + 24 * n + 4);
+}
+
+git_off_t git_pack_nth_offset(const struct git_pack_file *p, uint32_t n)
+{
+	return nth_packed_object_offset(p, n);
+}
+
+struct pack_header_entry {
+	git_off_t offset;
+	uint32_t n;
+};
+
+static int pack_header_entry_cmp(const void *a, const void *b)
+{
+	const struct pack_header_entry *ea = a, *eb = b;
+
+	if (ea->offset < eb->offset)
+		return -1;
+	return ea->offset > eb->offset;
+}
+
+static int pack_header_entry_find(
+	uint32_t *n,
+	const struct pack_header_entry *entries,
+	uint32_t count,
+	git_off_t offset)
+{
+	uint32_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (entries[mid].offset == offset) {
+			*n = entries[mid].n;
+			return 0;
+		}
+
+		if (entries[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return packfile_error("delta base is not an object of the pack");
+}
+
+int git_pack_foreach_header(
+	struct git_pack_file *p,
+	git_pack_foreach_header_cb cb,
+	void *data)
+{
+	struct pack_header_entry *entries = NULL;
+	unsigned char *types = NULL;
+	git_mwindow *w_curs = NULL;
+	uint32_t i;
+	int error;
+
+	if ((error = pack_index_open(p)) < 0)
+		return error;
+
+	if (!p->num_objects)
+		return 0;
+
+	if (p->mwf.fd == -1 && (error = packfile_open(p)) < 0)
+		return error;
+
+	entries = git__malloc(p->num_objects * sizeof(*entries));
+	GITERR_CHECK_ALLOC(entries);
+
+	/* the types found so far, by position in the index */
+	types = git__calloc(p->num_objects, sizeof(*types));
+	if (!types) {
+		git__free(entries);
+		return -1;
+	}
+
+	for (i = 0; i < p->num_objects; i++) {
+		entries[i].offset = nth_packed_object_offset(p, i);
+		entries[i].n = i;
+	}
+
+	/* read the headers in pack order, so the mapped windows are used
+	 * in sequence and the base of an offset delta is always read
+	 * before the delta */
+	qsort(entries, p->num_objects, sizeof(*entries), pack_header_entry_cmp);
+
+	git_mwindow_file_advise(&p->mwf, GIT_MADV_SEQUENTIAL);
+
+	for (i = 0; i < p->num_objects; i++) {
+		git_off_t curpos = entries[i].offset, base_offset;
+		git_otype type;
+		size_t size;
+		uint32_t base = 0;
+
+		error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
+		git_mwindow_close(&w_curs);
+		if (error < 0)
+			break;
+
+		if (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
+			base_offset = get_delta_base(p, &w_curs, &curpos, type, entries[i].offset);
+			git_mwindow_close(&w_curs);
+
+			if (base_offset <= 0) {
+				error = base_offset < 0 ? (int)base_offset :
+					packfile_error("delta base is out of bounds");
+				break;
+			}
+
+			if ((error = packfile_delta_result_size(
+					&size, p, &w_curs, curpos, size)) < 0 ||
+				(error = pack_header_entry_find(
+					&base, entries, p->num_objects, base_offset)) < 0)
+				break;
+
+			/* the base of a reference delta may come later */
+			if (types[base])
+				type = (git_otype)types[base];
+			else {
+				size_t base_size;
+
+				if ((error = git_packfile_resolve_header(
+						&base_size, &type, p, base_offset)) < 0)
+					break;
+			}
+		}
+
+		types[entries[i].n] = (unsigned char)type;
+
+		if ((error = cb(git_pack_nth_oid(p, entries[i].n),
+				type, size, entries[i].offset, data)) != 0) {
+			error = giterr_set_after_callback(error);
+			break;
+		}
+	}
+
+	git_mwindow_file_advise(&p->mwf, GIT_MADV_NORMAL);
+
+	git__free(types);
+	git__free(entries);
+	return error;
+}
+
+int git_pack_find_position(
+	uint32_t *pos, struct git_pack_file *p, const git_oid *oid)
+{
+	const uint32_t *level1_ofs;
+	const unsigned char *index;
+	unsigned hi, lo;
+	int found;
+
+	if (p->index_version == -1 && pack_index_open(p) < 0)
+		return -1;
+
+	level1_ofs = p->index_map.data;
+	index = (const unsigned char *)git_pack_nth_oid(p, 0);
+
+	if (p->index_version > 1)
+		level1_ofs += 2;
+
+	hi = ntohl(level1_ofs[(int)oid->id[0]]);
+	lo = ((oid->id[0] == 0x0) ? 0 : ntohl(level1_ofs[(int)oid->id[0] - 1]));
+
+	found = sha1_position(index,
+		p->index_version > 1 ? 20 : 24, lo, hi, oid->id);
+
+	if (found < 0)
+		return GIT_ENOTFOUND;
+
+	*pos = (uint32_t)found;
+	return 0;
+}
+
 static int pack_entry_find_offset(
 	git_off_t *offset_out,
 	git_oid *found_oid,
@@ -1227,3 +1639,27 @@ int git_pack_entry_find(
 	git_oid_cpy(&e->sha1, &found_oid);
 	return 0;
 }
+
+int git_pack_entry_at(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		const git_oid *oid,
+		git_off_t offset)
+{
+	unsigned i;
+	int error;
+
+	for (i = 0; i < p->num_bad_objects; i++)
+		if (git_oid__cmp(oid, &p->bad_object_sha1[i]) == 0)
+			return packfile_error("bad object found in packfile");
+
+	/* the index is opened with the pack, to check that they match */
+	if (p->mwf.fd == -1 && (error = packfile_open(p)) < 0)
+		return error;
+
+	e->offset = offset;
+	e->p = p;
+
+	git_oid_cpy(&e->sha1, oid);
+	return 0;
+}
@@ -55,7 +55,9 @@ struct git_pack_idx_header {
 };
 
 typedef struct git_pack_cache_entry {
-	size_t last_usage; /* enough? */
+	git_off_t offset;
+	/* LRU list, the most recently used entry first */
+	struct git_pack_cache_entry *prev, *next;
 	git_atomic refcount;
 	git_rawobj raw;
 } git_pack_cache_entry;
@@ -66,12 +68,17 @@ GIT__USE_OFFMAP;
 GIT__USE_OIDMAP;
 
 #define GIT_PACK_CACHE_MEMORY_LIMIT 16 * 1024 * 1024
-#define GIT_PACK_CACHE_SIZE_LIMIT 1024 * 1024 /* don't bother caching anything over 1MB */
+/* don't bother caching anything over 1/16 of the cache (1MB by default) */
+#define GIT_PACK_CACHE_SIZE_SHIFT 4
+
+/* Default memory limit of the delta base cache of a new packfile */
+extern size_t git_pack__cache_memory_limit;
 
 typedef struct {
 	size_t memory_used;
 	size_t memory_limit;
-	size_t use_ctr;
+	git_pack_cache_entry *lru_head, *lru_tail;
+	size_t hits, misses, evictions;
 	git_mutex lock;
 	git_offmap *entries;
 } git_pack_cache;
@@ -88,6 +95,9 @@ struct git_pack_file {
 	int index_version;
 	git_time_t mtime;
 	unsigned pack_local:1, pack_keep:1, has_cache:1;
+	unsigned in_midx:1; /* found through the multi-pack-index */
+	unsigned bitmap_loaded:1;
+	struct git_pack_bitmap *bitmap; /* reachability bitmaps, if any */
 	git_oid sha1;
 	git_oidmap *idx_cache;
 	git_oid **oids;
@@ -127,6 +137,19 @@ int git_packfile_resolve_header(
 		struct git_pack_file *p,
 		git_off_t offset);
 
+/*
+ * Like git_packfile_resolve_header, for many objects of a packfile:
+ * `types` maps the offsets of the objects and delta bases already
+ * resolved to their type, and is filled with the ones resolved here,
+ * so a delta chain is only followed once.
+ */
+int git_packfile_resolve_header_shared(
+		size_t *size_p,
+		git_otype *type_p,
+		struct git_pack_file *p,
+		git_off_t offset,
+		git_offmap *types);
+
 int git_packfile_unpack(git_rawobj *obj, struct git_pack_file *p, git_off_t *obj_offset);
 int packfile_unpack_compressed(
 	git_rawobj *obj,
@@ -147,6 +170,10 @@ git_off_t get_delta_base(struct git_pack_file *p, git_mwindow **w_curs,
 void git_packfile_free(struct git_pack_file *p);
 int git_packfile_alloc(struct git_pack_file **pack_out, const char *path);
 
+void git_packfile__set_cache_limit(struct git_pack_file *p, size_t limit);
+void git_packfile__cache_stats(
+		git_odb_delta_base_cache_stats *stats, struct git_pack_file *p);
+
 int git_pack_entry_find(
 		struct git_pack_entry *e,
 		struct git_pack_file *p,
@@ -157,4 +184,46 @@ int git_pack_foreach_entry(
 		git_odb_foreach_cb cb,
 		void *data);
 
+typedef int (*git_pack_foreach_entry_offset_cb)(
+		const git_oid *id, git_off_t offset, void *payload);
+
+/* Call `cb` with the oid and offset of each object, in oid order */
+int git_pack_foreach_entry_offset(
+		struct git_pack_file *p,
+		git_pack_foreach_entry_offset_cb cb,
+		void *data);
+
+/* Fill `e` for an object whose offset is already known, as found in a
+ * multi-pack-index; the packfile is opened if needed */
+int git_pack_entry_at(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		const git_oid *oid,
+		git_off_t offset);
+
+/* Load the index of a packfile, if it is not loaded yet */
+int git_pack_index_load(struct git_pack_file *p);
+
+/* The oid and the offset of the n:th object of a loaded index */
+const git_oid *git_pack_nth_oid(const struct git_pack_file *p, uint32_t n);
+git_off_t git_pack_nth_offset(const struct git_pack_file *p, uint32_t n);
+
+typedef int (*git_pack_foreach_header_cb)(
+		const git_oid *id, git_otype type, size_t size,
+		git_off_t offset, void *payload);
+
+/* Call `cb` with the type and the size of each object, in pack order.
+ * Only the object headers and the headers of the deltas are read, a
+ * delta has the type of its base. */
+int git_pack_foreach_header(
+		struct git_pack_file *p,
+		git_pack_foreach_header_cb cb,
+		void *data);
+
+/* The position of an object in the index, sorted by oid, or GIT_ENOTFOUND */
+int git_pack_find_position(
+		uint32_t *pos,
+		struct git_pack_file *p,
+		const git_oid *oid);
+
 #endif
@@ -996,6 +996,20 @@ int git_path_dirload_with_stat(
 	const char *start_stat,
 	const char *end_stat,
 	git_vector *contents)
+{
+	return git_path_dirload_with_stat_ext(
+		path, prefix_len, flags, start_stat, end_stat, NULL, NULL, contents);
+}
+
+int git_path_dirload_with_stat_ext(
+	const char *path,
+	size_t prefix_len,
+	unsigned int flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_path_stat_cb stat_cb,
+	void *stat_payload,
+	git_vector *contents)
 {
 	int error;
 	unsigned int i;
@@ -1037,7 +1051,8 @@ int git_path_dirload_with_stat(
 		git_buf_truncate(&full, prefix_len);
 
 		if ((error = git_buf_joinpath(&full, full.ptr, ps->path)) < 0 ||
-			(error = git_path_lstat(full.ptr, &ps->st)) < 0) {
+			((!stat_cb || stat_cb(&ps->st, ps->path, stat_payload) != 0) &&
+			 (error = git_path_lstat(full.ptr, &ps->st)) < 0)) {
 			if (error == GIT_ENOTFOUND) {
 				giterr_clear();
 				error = 0;
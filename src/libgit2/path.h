@@ -359,6 +359,28 @@ extern int git_path_dirload_with_stat(
 	const char *end_stat,
 	git_vector *contents);
 
+/**
+ * Callback to get stat data that is already known, e.g. from a preload
+ * of the index; `path` is relative to the prefix.  Return 0 when `st`
+ * was filled, non-zero to let the caller lstat the path.
+ */
+typedef int (*git_path_stat_cb)(
+	struct stat *st, const char *path, void *payload);
+
+/**
+ * Same as `git_path_dirload_with_stat`, but asks `stat_cb` for the stat
+ * data of each entry before calling lstat.
+ */
+extern int git_path_dirload_with_stat_ext(
+	const char *path,
+	size_t prefix_len,
+	uint32_t flags,
+	const char *start_stat,
+	const char *end_stat,
+	git_path_stat_cb stat_cb,
+	void *stat_payload,
+	git_vector *contents);
+
 enum { GIT_PATH_NOTEQUAL = 0, GIT_PATH_EQUAL = 1, GIT_PATH_PREFIX = 2 };
 
 /*
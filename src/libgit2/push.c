@@ -8,6 +8,7 @@
 #include "git2.h"
 
 #include "common.h"
+#include "array.h"
 #include "pack.h"
 #include "pack-objects.h"
 #include "remote.h"
@@ -41,7 +42,7 @@ int git_push_new(git_push **out, git_remote *remote)
 	p->repo = remote->repo;
 	p->remote = remote;
 	p->report_status = 1;
-	p->pb_parallelism = 1;
+	p->pb_parallelism = git_packbuilder__default_threads;
 
 	if (git_vector_init(&p->specs, 0, push_spec_rref_cmp) < 0) {
 		git__free(p);
@@ -337,8 +338,6 @@ static int revwalk(git_vector *commits, git_push *push)
 			goto on_error;
 
 		if (!spec->force) {
-			git_oid base;
-
 			if (git_oid_iszero(&spec->roid))
 				continue;
 
@@ -348,11 +347,13 @@ static int revwalk(git_vector *commits, git_push *push)
 				goto on_error;
 			}
 
-			error = git_merge_base(&base, push->repo,
+			if (git_oid_equal(&spec->loid, &spec->roid))
+				continue;
+
+			error = git_graph_descendant_of(push->repo,
 					       &spec->loid, &spec->roid);
 
-			if (error == GIT_ENOTFOUND ||
-				(!error && !git_oid_equal(&base, &spec->roid))) {
+			if (error == 0) {
 				giterr_set(GITERR_REFERENCE,
 					"Cannot push non-fastforwardable reference");
 				error = GIT_ENONFASTFORWARD;
@@ -472,6 +473,45 @@ on_error:
 	return error;
 }
 
+/*
+ * Queue the objects of the commits that the remote does not have, with
+ * the reachability bitmaps of the repository.
+ */
+static int queue_reachable(git_push *push, git_vector *commits)
+{
+	git_array_t(git_oid) wants = GIT_ARRAY_INIT;
+	git_array_t(git_oid) haves = GIT_ARRAY_INIT;
+	git_remote_head *head;
+	git_oid *oid;
+	size_t i;
+	int error;
+
+	git_vector_foreach(commits, i, oid) {
+		git_oid *want = git_array_alloc(wants);
+		GITERR_CHECK_ALLOC(want);
+		git_oid_cpy(want, oid);
+	}
+
+	git_vector_foreach(&push->remote->refs, i, head) {
+		git_oid *have;
+
+		if (git_oid_iszero(&head->oid) ||
+			!git_odb_exists(push->repo->_odb, &head->oid))
+			continue;
+
+		have = git_array_alloc(haves);
+		GITERR_CHECK_ALLOC(have);
+		git_oid_cpy(have, &head->oid);
+	}
+
+	error = git_packbuilder__insert_reachable(push->pb,
+		wants.ptr, wants.size, haves.ptr, haves.size);
+
+	git_array_clear(wants);
+	git_array_clear(haves);
+	return error;
+}
+
 static int queue_objects(git_push *push)
 {
 	git_vector commits = GIT_VECTOR_INIT;
@@ -483,6 +523,12 @@ static int queue_objects(git_push *push)
 	if ((error = revwalk(&commits, push)) < 0)
 		goto on_error;
 
+	if (commits.length > 0 &&
+		(error = queue_reachable(push, &commits)) != GIT_ENOTFOUND)
+		goto on_error;
+
+	giterr_clear();
+
 	git_vector_foreach(&commits, i, oid) {
 		git_commit *parent = NULL, *commit;
 		git_tree *tree = NULL, *ptree = NULL;
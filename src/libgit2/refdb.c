@@ -8,6 +8,7 @@
 #include "common.h"
 #include "posix.h"
 
+#include "git2/config.h"
 #include "git2/object.h"
 #include "git2/refs.h"
 #include "git2/refdb.h"
@@ -17,6 +18,7 @@
 #include "refdb.h"
 #include "refs.h"
 #include "reflog.h"
+#include "repository.h"
 
 int git_refdb_new(git_refdb **out, git_repository *repo)
 {
@@ -34,6 +36,35 @@ int git_refdb_new(git_refdb **out, git_repository *repo)
 	return 0;
 }
 
+/* The backend of the reference storage in the configuration */
+static int refdb_open_backend(git_refdb_backend **out, git_repository *repo)
+{
+	git_config *config;
+	const char *storage = "files";
+	int error;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0)
+		return error;
+
+	error = git_config_get_string(&storage, config, "extensions.refstorage");
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		storage = "files";
+	} else if (error < 0) {
+		return error;
+	}
+
+	if (!strcmp(storage, "files"))
+		return git_refdb_backend_fs(out, repo);
+
+	if (!strcmp(storage, "table"))
+		return git_refdb_backend_table(out, repo);
+
+	giterr_set(GITERR_REFERENCE,
+		"Unsupported reference storage '%s'", storage);
+	return -1;
+}
+
 int git_refdb_open(git_refdb **out, git_repository *repo)
 {
 	git_refdb *db;
@@ -46,8 +77,7 @@ int git_refdb_open(git_refdb **out, git_repository *repo)
 	if (git_refdb_new(&db, repo) < 0)
 		return -1;
 
-	/* Add the default (filesystem) backend */
-	if (git_refdb_backend_fs(&dir, repo) < 0) {
+	if (refdb_open_backend(&dir, repo) < 0) {
 		git_refdb_free(db);
 		return -1;
 	}
@@ -207,6 +237,41 @@ int git_refdb_delete(struct git_refdb *db, const char *ref_name)
 	return db->backend->del(db->backend, ref_name);
 }
 
+int git_refdb_transaction(
+	git_refdb *db, const git_refdb_update **updates, size_t count)
+{
+	assert(db && db->backend);
+
+	if (!db->backend->transaction) {
+		giterr_set(GITERR_REFERENCE,
+			"The reference backend does not support transactions");
+		return -1;
+	}
+
+	return db->backend->transaction(db->backend, updates, count);
+}
+
+int git_refdb_update_check(
+	const git_refdb_update *update, const git_reference *current)
+{
+	if (!update->ref && !current) {
+		giterr_set(GITERR_REFERENCE, "Reference '%s' not found", update->name);
+		return GIT_ENOTFOUND;
+	}
+
+	if (!update->old_id)
+		return 0;
+
+	if (git_oid_iszero(update->old_id) ? current == NULL :
+		(current != NULL && current->type == GIT_REF_OID &&
+		 git_oid_equal(&current->target.oid, update->old_id)))
+		return 0;
+
+	giterr_set(GITERR_REFERENCE,
+		"Reference '%s' does not have the expected value", update->name);
+	return GIT_EMODIFIED;
+}
+
 int git_refdb_reflog_read(git_reflog **out, git_refdb *db,  const char *name)
 {
 	int error;
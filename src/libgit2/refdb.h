@@ -8,6 +8,7 @@
 #define INCLUDE_refdb_h__
 
 #include "git2/refdb.h"
+#include "git2/sys/refdb_backend.h"
 #include "repository.h"
 
 struct git_refdb {
@@ -44,6 +45,15 @@ void git_refdb_iterator_free(git_reference_iterator *iter);
 
 int git_refdb_write(git_refdb *refdb, git_reference *ref, int force, const git_signature *who, const char *message);
 int git_refdb_delete(git_refdb *refdb, const char *ref_name);
+int git_refdb_transaction(
+	git_refdb *db, const git_refdb_update **updates, size_t count);
+
+/*
+ * Check the current value of a reference, or NULL if it does not
+ * exist, against an update of a transaction; for backends.
+ */
+int git_refdb_update_check(
+	const git_refdb_update *update, const git_reference *current);
 
 int git_refdb_reflog_read(git_reflog **out, git_refdb *db,  const char *name);
 int git_refdb_reflog_write(git_reflog *reflog);
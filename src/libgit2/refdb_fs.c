@@ -34,7 +34,6 @@ enum {
 	PACKREF_HAS_PEEL = 1,
 	PACKREF_WAS_LOOSE = 2,
 	PACKREF_CANNOT_PEEL = 4,
-	PACKREF_SHADOWED = 8,
 };
 
 enum {
@@ -50,6 +49,24 @@ struct packref {
 	char name[GIT_FLEX_ARRAY];
 };
 
+/*
+ * The packed-refs file, mapped to look up single references with a
+ * binary search instead of parsing the whole file into the refcache.
+ * Only files with the "sorted" trait are searched.
+ */
+typedef struct {
+	git_futils_filestamp stamp;
+#ifdef GIT_WIN32
+	git_buf buf; /* a mapped file cannot be replaced on Windows */
+#else
+	git_map map;
+#endif
+	const char *refs; /* the first reference, after the header */
+	const char *end;
+	int sorted;
+	unsigned int generation; /* incremented each time the file is mapped */
+} packed_map;
+
 typedef struct refdb_fs_backend {
 	git_refdb_backend parent;
 
@@ -60,6 +77,9 @@ typedef struct refdb_fs_backend {
 	int peeling_mode;
 	git_iterator_flag_t iterator_flags;
 	uint32_t direach_flags;
+
+	git_mutex packed_lock; /* protects packed */
+	packed_map packed;
 } refdb_fs_backend;
 
 static int packref_cmp(const void *a_, const void *b_)
@@ -191,6 +211,317 @@ parse_failed:
 	return -1;
 }
 
+static int packed_map_corrupted(void)
+{
+	giterr_set(GITERR_REFERENCE, "Corrupted packed references file");
+	return -1;
+}
+
+static void packed_map_free(packed_map *map)
+{
+#ifdef GIT_WIN32
+	git_buf_free(&map->buf);
+#else
+	if (map->map.data)
+		git_futils_mmap_free(&map->map);
+	memset(&map->map, 0, sizeof(map->map));
+#endif
+	map->refs = map->end = NULL;
+	map->sorted = 0;
+}
+
+/* Check for a trait in the traits of the "# pack-refs with:" header */
+static int packed_map_has_trait(
+	const char *traits, const char *eol, const char *trait)
+{
+	size_t len = strlen(trait);
+	const char *p;
+
+	for (p = traits; p + len + 1 <= eol; p++) {
+		if (p[0] == ' ' && !memcmp(p + 1, trait, len) &&
+			(p + len + 1 == eol || p[len + 1] == ' '))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Find the references after the header and the comments of the file */
+static int packed_map_parse_header(packed_map *map, const char *data, size_t len)
+{
+	static const char *traits_header = "# pack-refs with:";
+	const char *scan = data, *eof = data + len, *eol;
+
+	if (len > strlen(traits_header) &&
+		!memcmp(scan, traits_header, strlen(traits_header))) {
+		scan += strlen(traits_header);
+
+		if (!(eol = memchr(scan, '\n', eof - scan)))
+			return packed_map_corrupted();
+
+		map->sorted = packed_map_has_trait(scan, eol, "sorted");
+		scan = eol + 1;
+	}
+
+	while (scan < eof && *scan == '#') {
+		if (!(eol = memchr(scan, '\n', eof - scan)))
+			return packed_map_corrupted();
+		scan = eol + 1;
+	}
+
+	map->refs = scan;
+	map->end = eof;
+	return 0;
+}
+
+/*
+ * Map the packed-refs file again if it changed. Called with the
+ * packed_lock held.
+ */
+static int packed_map_refresh(refdb_fs_backend *backend)
+{
+	packed_map *map = &backend->packed;
+	const char *path = git_sortedcache_path(backend->refcache);
+	const char *data = NULL;
+	git_file fd;
+	git_off_t len;
+	int error;
+
+	if ((error = git_futils_filestamp_check(&map->stamp, path)) <= 0) {
+		/* no packed-refs file, no packed references */
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			packed_map_free(map);
+			git_futils_filestamp_set(&map->stamp, NULL);
+			error = 0;
+		}
+		return error;
+	}
+
+	packed_map_free(map);
+	map->generation++;
+
+	if ((fd = git_futils_open_ro(path)) < 0) {
+		git_futils_filestamp_set(&map->stamp, NULL);
+
+		if (fd == GIT_ENOTFOUND) {
+			giterr_clear();
+			return 0;
+		}
+		return fd;
+	}
+
+	len = git_futils_filesize(fd);
+
+	if (!git__is_sizet(len)) {
+		giterr_set(GITERR_OS, "File `%s` too large to mmap", path);
+		error = -1;
+	} else if (len > 0) {
+#ifdef GIT_WIN32
+		if (!(error = git_futils_readbuffer_fd(&map->buf, fd, (size_t)len)))
+			data = map->buf.ptr;
+#else
+		if (!(error = git_futils_mmap_ro(&map->map, fd, 0, (size_t)len)))
+			data = map->map.data;
+#endif
+	}
+
+	p_close(fd);
+
+	if (!error && data)
+		error = packed_map_parse_header(map, data, (size_t)len);
+
+	if (error < 0) {
+		packed_map_free(map);
+		git_futils_filestamp_set(&map->stamp, NULL);
+	}
+
+	return error;
+}
+
+/* The start of the record around `p`; a peel line belongs to the
+ * record before it */
+static const char *packed_record_start(const char *start, const char *p)
+{
+	while (p > start && p[-1] != '\n')
+		p--;
+
+	if (p > start && *p == '^') {
+		p--;
+		while (p > start && p[-1] != '\n')
+			p--;
+	}
+
+	return p;
+}
+
+/* The start of the record after the one at `rec` */
+static const char *packed_record_next(const char *rec, const char *end)
+{
+	const char *eol = memchr(rec, '\n', end - rec);
+
+	rec = eol ? eol + 1 : end;
+
+	if (rec < end && *rec == '^') {
+		eol = memchr(rec, '\n', end - rec);
+		rec = eol ? eol + 1 : end;
+	}
+
+	return rec;
+}
+
+/* The name of the reference of the record "<OID> <refname>\n" at `rec` */
+static int packed_record_name(
+	const char **name, size_t *len, const char *rec, const char *end)
+{
+	const char *eol;
+
+	if (end - rec < GIT_OID_HEXSZ + 2 || rec[GIT_OID_HEXSZ] != ' ')
+		return packed_map_corrupted();
+
+	*name = rec + GIT_OID_HEXSZ + 1;
+
+	if (!(eol = memchr(*name, '\n', end - *name)))
+		return packed_map_corrupted();
+	if (eol > *name && eol[-1] == '\r')
+		eol--;
+
+	*len = eol - *name;
+	return 0;
+}
+
+/* Parse the oid, and the optional "^<OID>\n" peel, of the record at
+ * `rec`, whose name has been checked */
+static int packed_record_parse(
+	git_oid *oid, git_oid *peel, const char *rec, const char *end)
+{
+	const char *eol = memchr(rec, '\n', end - rec);
+
+	if (git_oid_fromstr(oid, rec) < 0)
+		return packed_map_corrupted();
+
+	memset(peel, 0, sizeof(*peel));
+
+	if (eol + 1 < end && eol[1] == '^' &&
+		(end - (eol + 2) < GIT_OID_HEXSZ || git_oid_fromstr(peel, eol + 2) < 0))
+		return packed_map_corrupted();
+
+	return 0;
+}
+
+static int packed_name_cmp(
+	const char *name, size_t len, const char *ref, size_t ref_len)
+{
+	int cmp = memcmp(name, ref, len < ref_len ? len : ref_len);
+
+	if (cmp)
+		return cmp;
+
+	return len < ref_len ? -1 : (len > ref_len);
+}
+
+/* Find the first record whose name does not sort before `ref` */
+static int packed_map_seek(
+	const char **out, packed_map *map, const char *ref, size_t ref_len)
+{
+	const char *lo = map->refs, *hi = map->end;
+
+	while (lo < hi) {
+		const char *mid = packed_record_start(lo, lo + (hi - lo) / 2);
+		const char *name;
+		size_t len;
+
+		if (packed_record_name(&name, &len, mid, map->end) < 0)
+			return -1;
+
+		if (packed_name_cmp(name, len, ref, ref_len) < 0)
+			lo = packed_record_next(mid, map->end);
+		else
+			hi = mid;
+	}
+
+	*out = lo;
+	return 0;
+}
+
+/* Find the record of `ref`, or set `out` to NULL. Called with the
+ * packed_lock held. */
+static int packed_map_find(
+	const char **out, packed_map *map, const char *ref, size_t ref_len)
+{
+	const char *name;
+	size_t len;
+
+	*out = NULL;
+
+	if (packed_map_seek(out, map, ref, ref_len) < 0)
+		return -1;
+
+	if (*out == map->end)
+		*out = NULL;
+	else if (packed_record_name(&name, &len, *out, map->end) < 0)
+		return -1;
+	else if (packed_name_cmp(name, len, ref, ref_len) != 0)
+		*out = NULL;
+
+	return 0;
+}
+
+/*
+ * Look up a reference in the mapped packed-refs file. Returns
+ * GIT_PASSTHROUGH when the file is not sorted, and the references must
+ * be looked up in the refcache.
+ */
+static int packed_map_lookup(
+	git_reference **out,
+	int *found,
+	refdb_fs_backend *backend,
+	const char *ref_name)
+{
+	packed_map *map = &backend->packed;
+	const char *rec = NULL;
+	git_oid oid, peel;
+	int error;
+
+	*found = 0;
+
+	if (!backend->path)
+		return 0;
+
+	if (git_mutex_lock(&backend->packed_lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock packed-refs mutex");
+		return -1;
+	}
+
+	if ((error = packed_map_refresh(backend)) < 0)
+		goto done;
+
+	if (map->refs && !map->sorted) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	if (!map->refs ||
+		(error = packed_map_find(&rec, map, ref_name, strlen(ref_name))) < 0 ||
+		!rec)
+		goto done;
+
+	*found = 1;
+
+	if (out) {
+		if ((error = packed_record_parse(&oid, &peel, rec, map->end)) < 0)
+			goto done;
+
+		*out = git_reference__alloc(ref_name, &oid, &peel);
+		if (!*out)
+			error = -1;
+	}
+
+done:
+	git_mutex_unlock(&backend->packed_lock);
+	return error;
+}
+
 static int loose_parse_oid(
 	git_oid *oid, const char *filename, git_buf *file_content)
 {
@@ -248,7 +579,8 @@ static int loose_lookup_to_packfile(refdb_fs_backend *backend, const char *name)
 	if ((error = loose_parse_oid(&oid, name, &ref_file)) < 0)
 		goto done;
 
-	git_sortedcache_wlock(backend->refcache);
+	if ((error = git_sortedcache_wlock(backend->refcache)) < 0)
+		goto done;
 
 	if (!(error = git_sortedcache_upsert(
 			(void **)&ref, backend->refcache, name))) {
@@ -308,6 +640,24 @@ static int packed_loadloose(refdb_fs_backend *backend)
 	return error;
 }
 
+static int packed_exists(
+	int *exists, refdb_fs_backend *backend, const char *ref_name)
+{
+	int error = packed_map_lookup(NULL, exists, backend, ref_name);
+
+	if (error != GIT_PASSTHROUGH)
+		return error;
+
+	if (packed_reload(backend) < 0 ||
+		git_sortedcache_rlock(backend->refcache) < 0)
+		return -1;
+
+	*exists = (git_sortedcache_lookup(backend->refcache, ref_name) != NULL);
+
+	git_sortedcache_runlock(backend->refcache);
+	return 0;
+}
+
 static int refdb_fs_backend__exists(
 	int *exists,
 	git_refdb_backend *_backend,
@@ -318,15 +668,13 @@ static int refdb_fs_backend__exists(
 
 	assert(backend);
 
-	if (packed_reload(backend) < 0 ||
-		git_buf_joinpath(&ref_path, backend->path, ref_name) < 0)
+	if (git_buf_joinpath(&ref_path, backend->path, ref_name) < 0)
 		return -1;
 
-	*exists = git_path_isfile(ref_path.ptr) ||
-		(git_sortedcache_lookup(backend->refcache, ref_name) != NULL);
-
+	*exists = git_path_isfile(ref_path.ptr);
 	git_buf_free(&ref_path);
-	return 0;
+
+	return *exists ? 0 : packed_exists(exists, backend, ref_name);
 }
 
 static const char *loose_parse_symbolic(git_buf *file_content)
@@ -395,9 +743,16 @@ static int packed_lookup(
 	refdb_fs_backend *backend,
 	const char *ref_name)
 {
-	int error = 0;
+	int found, error;
 	struct packref *entry;
 
+	error = packed_map_lookup(out, &found, backend, ref_name);
+
+	if (error != GIT_PASSTHROUGH)
+		return (error < 0 || found) ? error : ref_error_notfound(ref_name);
+
+	error = 0;
+
 	if (packed_reload(backend) < 0)
 		return -1;
 
@@ -445,12 +800,23 @@ typedef struct {
 	git_reference_iterator parent;
 
 	char *glob;
+	char *prefix; /* the start of the glob, without wildcards */
 
 	git_pool pool;
 	git_vector loose;
-
 	size_t loose_pos;
+
+	/*
+	 * The packed references are read from the mapped packed-refs
+	 * file from the first one that starts with the prefix, or from
+	 * the refcache when the file is not sorted. `packed_pos` is an
+	 * offset in the mapped file, or an index in the refcache.
+	 */
+	int packed_from_map;
+	int packed_seeked;
+	unsigned int packed_generation;
 	size_t packed_pos;
+	git_buf packed_name; /* the last reference read from the map */
 } refdb_fs_iter;
 
 static void refdb_fs_backend__iterator_free(git_reference_iterator *_iter)
@@ -459,47 +825,66 @@ static void refdb_fs_backend__iterator_free(git_reference_iterator *_iter)
 
 	git_vector_free(&iter->loose);
 	git_pool_clear(&iter->pool);
+	git_buf_free(&iter->packed_name);
 	git__free(iter);
 }
 
+static bool iter_matches(refdb_fs_iter *iter, const char *ref_name)
+{
+	return !iter->glob || p_fnmatch(iter->glob, ref_name, 0) == 0;
+}
+
+/* Whether a loose reference hides the packed one */
+static bool iter_is_shadowed(refdb_fs_iter *iter, const char *ref_name)
+{
+	return git_vector_bsearch(NULL, &iter->loose, ref_name) == 0;
+}
+
+/*
+ * Load the names of the loose references that may match the glob,
+ * from the deepest directory of the refs folder that holds them all.
+ */
 static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 {
 	int error = 0;
-	git_buf path = GIT_BUF_INIT;
+	git_buf path = GIT_BUF_INIT, dir = GIT_BUF_INIT;
 	git_iterator *fsit = NULL;
 	const git_index_entry *entry = NULL;
+	const char *slash;
 
 	if (!backend->path) /* do nothing if no path for loose refs */
 		return 0;
 
-	if ((error = git_buf_printf(&path, "%s/refs", backend->path)) < 0 ||
-		(error = git_iterator_for_filesystem(
-			&fsit, path.ptr, backend->iterator_flags, NULL, NULL)) < 0) {
-		git_buf_free(&path);
-		return error;
-	}
+	if (!git__prefixcmp(iter->prefix, GIT_REFS_DIR) &&
+		(slash = strrchr(iter->prefix, '/')) != NULL)
+		error = git_buf_set(&dir, iter->prefix, slash - iter->prefix + 1);
+	else
+		error = git_buf_sets(&dir, GIT_REFS_DIR);
 
-	error = git_buf_sets(&path, GIT_REFS_DIR);
+	if (error < 0 ||
+		(error = git_buf_joinpath(&path, backend->path, dir.ptr)) < 0)
+		goto done;
+
+	if (!git_path_isdir(path.ptr))
+		goto done;
+
+	if ((error = git_iterator_for_filesystem(
+			&fsit, path.ptr, backend->iterator_flags, NULL, NULL)) < 0)
+		goto done;
 
 	while (!error && !git_iterator_advance(&entry, fsit)) {
 		const char *ref_name;
-		struct packref *ref;
 		char *ref_dup;
 
-		git_buf_truncate(&path, strlen(GIT_REFS_DIR));
+		git_buf_set(&path, dir.ptr, dir.size);
 		git_buf_puts(&path, entry->path);
 		ref_name = git_buf_cstr(&path);
 
 		if (git__suffixcmp(ref_name, ".lock") == 0 ||
-			(iter->glob && p_fnmatch(iter->glob, ref_name, 0) != 0))
+			git__prefixcmp(ref_name, iter->prefix) != 0 ||
+			!iter_matches(iter, ref_name))
 			continue;
 
-		git_sortedcache_rlock(backend->refcache);
-		ref = git_sortedcache_lookup(backend->refcache, ref_name);
-		if (ref)
-			ref->flags |= PACKREF_SHADOWED;
-		git_sortedcache_runlock(backend->refcache);
-
 		ref_dup = git_pool_strdup(&iter->pool, ref_name);
 		if (!ref_dup)
 			error = -1;
@@ -507,12 +892,128 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 			error = git_vector_insert(&iter->loose, ref_dup);
 	}
 
+	git_vector_sort(&iter->loose);
+
+done:
 	git_iterator_free(fsit);
 	git_buf_free(&path);
+	git_buf_free(&dir);
 
 	return error;
 }
 
+/*
+ * Find the next packed reference of the iterator in the mapped file.
+ * The name of the last record read is kept to find the position again
+ * if the file is mapped again between two calls.
+ */
+static int iter_packed_map_next(
+	git_oid *oid, git_oid *peel, refdb_fs_iter *iter, refdb_fs_backend *backend)
+{
+	packed_map *map = &backend->packed;
+	size_t prefix_len = strlen(iter->prefix), len;
+	const char *rec, *name;
+	int error;
+
+	if (!backend->path)
+		return GIT_ITEROVER;
+
+	if (git_mutex_lock(&backend->packed_lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock packed-refs mutex");
+		return -1;
+	}
+
+	/* the file was mapped when the iterator was created, and is only
+	 * mapped again by the lookups in between */
+	if (!map->refs) {
+		error = GIT_ITEROVER;
+		goto done;
+	}
+
+	if (!map->sorted) {
+		giterr_set(GITERR_REFERENCE,
+			"The packed references file changed during the iteration");
+		error = -1;
+		goto done;
+	}
+
+	if (!iter->packed_seeked || iter->packed_generation != map->generation) {
+		if (!iter->packed_seeked)
+			error = packed_map_seek(&rec, map, iter->prefix, prefix_len);
+		else
+			error = packed_map_seek(&rec, map,
+				iter->packed_name.ptr, iter->packed_name.size);
+		if (error < 0)
+			goto done;
+
+		/* skip the record we stopped at */
+		if (iter->packed_seeked && rec < map->end) {
+			if ((error = packed_record_name(&name, &len, rec, map->end)) < 0)
+				goto done;
+			if (!packed_name_cmp(name, len,
+					iter->packed_name.ptr, iter->packed_name.size))
+				rec = packed_record_next(rec, map->end);
+		}
+
+		iter->packed_seeked = 1;
+		iter->packed_generation = map->generation;
+	} else {
+		rec = map->refs + iter->packed_pos;
+	}
+
+	for (error = GIT_ITEROVER; rec < map->end;
+		rec = packed_record_next(rec, map->end)) {
+		if (packed_record_name(&name, &len, rec, map->end) < 0) {
+			error = -1;
+			break;
+		}
+
+		if (len < prefix_len || memcmp(name, iter->prefix, prefix_len) != 0)
+			break;
+
+		if (git_buf_set(&iter->packed_name, name, len) < 0) {
+			error = -1;
+			break;
+		}
+
+		if (!iter_matches(iter, iter->packed_name.ptr) ||
+			iter_is_shadowed(iter, iter->packed_name.ptr))
+			continue;
+
+		if ((error = packed_record_parse(oid, peel, rec, map->end)) == 0)
+			rec = packed_record_next(rec, map->end);
+		break;
+	}
+
+	iter->packed_pos = rec - map->refs;
+
+done:
+	git_mutex_unlock(&backend->packed_lock);
+	return error;
+}
+
+/* Find the next packed reference of the iterator in the refcache;
+ * called with the refcache locked */
+static struct packref *iter_packed_cache_next(refdb_fs_iter *iter, refdb_fs_backend *backend)
+{
+	struct packref *ref;
+
+	while (iter->packed_pos < git_sortedcache_entrycount(backend->refcache)) {
+		ref = git_sortedcache_entry(backend->refcache, iter->packed_pos++);
+		if (!ref) /* stop now if another thread deleted refs and we past end */
+			break;
+
+		if (git__prefixcmp(ref->name, iter->prefix) != 0 ||
+			!iter_matches(iter, ref->name) ||
+			iter_is_shadowed(iter, ref->name))
+			continue;
+
+		return ref;
+	}
+
+	return NULL;
+}
+
 static int refdb_fs_backend__iterator_next(
 	git_reference **out, git_reference_iterator *_iter)
 {
@@ -520,6 +1021,7 @@ static int refdb_fs_backend__iterator_next(
 	refdb_fs_iter *iter = (refdb_fs_iter *)_iter;
 	refdb_fs_backend *backend = (refdb_fs_backend *)iter->parent.db->backend;
 	struct packref *ref;
+	git_oid oid, peel;
 
 	while (iter->loose_pos < iter->loose.length) {
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
@@ -530,21 +1032,19 @@ static int refdb_fs_backend__iterator_next(
 		giterr_clear();
 	}
 
-	git_sortedcache_rlock(backend->refcache);
-
-	while (iter->packed_pos < git_sortedcache_entrycount(backend->refcache)) {
-		ref = git_sortedcache_entry(backend->refcache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
+	if (iter->packed_from_map) {
+		if ((error = iter_packed_map_next(&oid, &peel, iter, backend)) == 0) {
+			*out = git_reference__alloc(iter->packed_name.ptr, &oid, &peel);
+			error = (*out != NULL) ? 0 : -1;
+		}
+		return error;
+	}
 
-		if (ref->flags & PACKREF_SHADOWED)
-			continue;
-		if (iter->glob && p_fnmatch(iter->glob, ref->name, 0) != 0)
-			continue;
+	git_sortedcache_rlock(backend->refcache);
 
+	if ((ref = iter_packed_cache_next(iter, backend)) != NULL) {
 		*out = git_reference__alloc(ref->name, &ref->oid, &ref->peel);
 		error = (*out != NULL) ? 0 : -1;
-		break;
 	}
 
 	git_sortedcache_runlock(backend->refcache);
@@ -558,6 +1058,7 @@ static int refdb_fs_backend__iterator_next_name(
 	refdb_fs_iter *iter = (refdb_fs_iter *)_iter;
 	refdb_fs_backend *backend = (refdb_fs_backend *)iter->parent.db->backend;
 	struct packref *ref;
+	git_oid oid, peel;
 
 	while (iter->loose_pos < iter->loose.length) {
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
@@ -568,55 +1069,81 @@ static int refdb_fs_backend__iterator_next_name(
 		}
 
 		giterr_clear();
-	}
-
-	git_sortedcache_rlock(backend->refcache);
-
-	while (iter->packed_pos < git_sortedcache_entrycount(backend->refcache)) {
-		ref = git_sortedcache_entry(backend->refcache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
+	}
 
-		if (ref->flags & PACKREF_SHADOWED)
-			continue;
-		if (iter->glob && p_fnmatch(iter->glob, ref->name, 0) != 0)
-			continue;
+	if (iter->packed_from_map) {
+		if ((error = iter_packed_map_next(&oid, &peel, iter, backend)) == 0)
+			*out = iter->packed_name.ptr;
+		return error;
+	}
+
+	git_sortedcache_rlock(backend->refcache);
 
+	if ((ref = iter_packed_cache_next(iter, backend)) != NULL) {
 		*out = ref->name;
 		error = 0;
-		break;
 	}
 
 	git_sortedcache_runlock(backend->refcache);
 	return error;
 }
 
+/* The start of the glob, up to its first wildcard */
+static char *iter_glob_prefix(git_pool *pool, const char *glob)
+{
+	if (!glob)
+		return git_pool_strdup(pool, "");
+
+	return git_pool_strndup(pool, glob, strcspn(glob, "*?[\\"));
+}
+
 static int refdb_fs_backend__iterator(
 	git_reference_iterator **out, git_refdb_backend *_backend, const char *glob)
 {
 	refdb_fs_iter *iter;
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
+	int error = 0;
 
 	assert(backend);
 
-	if (packed_reload(backend) < 0)
-		return -1;
-
 	iter = git__calloc(1, sizeof(refdb_fs_iter));
 	GITERR_CHECK_ALLOC(iter);
 
 	if (git_pool_init(&iter->pool, 1, 0) < 0 ||
-		git_vector_init(&iter->loose, 8, NULL) < 0)
+		git_vector_init(&iter->loose, 8, git__strcmp_cb) < 0)
 		goto fail;
 
 	if (glob != NULL &&
 		(iter->glob = git_pool_strdup(&iter->pool, glob)) == NULL)
 		goto fail;
 
+	if ((iter->prefix = iter_glob_prefix(&iter->pool, glob)) == NULL)
+		goto fail;
+
 	iter->parent.next = refdb_fs_backend__iterator_next;
 	iter->parent.next_name = refdb_fs_backend__iterator_next_name;
 	iter->parent.free = refdb_fs_backend__iterator_free;
 
+	/* a sorted packed-refs file is read where the prefix starts */
+	if (backend->path) {
+		if (git_mutex_lock(&backend->packed_lock) < 0) {
+			giterr_set(GITERR_THREAD, "unable to lock packed-refs mutex");
+			goto fail;
+		}
+
+		if (!(error = packed_map_refresh(backend)))
+			iter->packed_from_map =
+				!backend->packed.refs || backend->packed.sorted;
+
+		git_mutex_unlock(&backend->packed_lock);
+
+		if (error < 0)
+			goto fail;
+	}
+
+	if (!iter->packed_from_map && packed_reload(backend) < 0)
+		goto fail;
+
 	if (iter_load_loose_paths(backend, iter) < 0)
 		goto fail;
 
@@ -645,17 +1172,114 @@ static bool ref_is_available(
 	return true;
 }
 
-static int reference_path_available(
+/*
+ * Check that no packed reference is named like a directory of
+ * `new_ref`, or is in the directory `new_ref/`, with a binary search
+ * for each. Returns GIT_PASSTHROUGH when the file is not sorted.
+ */
+static int packed_map_available(
+	int *available,
 	refdb_fs_backend *backend,
 	const char *new_ref,
-	const char* old_ref,
-	int force)
+	const char *old_ref)
+{
+	packed_map *map = &backend->packed;
+	git_buf dir = GIT_BUF_INIT;
+	const char *rec, *name, *slash;
+	size_t len, old_len = old_ref ? strlen(old_ref) : 0;
+	int error;
+
+	*available = 1;
+
+	if (!backend->path)
+		return 0;
+
+	if (git_mutex_lock(&backend->packed_lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock packed-refs mutex");
+		return -1;
+	}
+
+	if ((error = packed_map_refresh(backend)) < 0 || !map->refs)
+		goto done;
+
+	if (!map->sorted) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	/* a reference named like a directory of the new one */
+	for (slash = strchr(new_ref, '/'); slash; slash = strchr(slash + 1, '/')) {
+		len = slash - new_ref;
+
+		if ((error = packed_map_find(&rec, map, new_ref, len)) < 0)
+			goto done;
+
+		if (rec && (len != old_len || memcmp(new_ref, old_ref, len))) {
+			*available = 0;
+			goto done;
+		}
+	}
+
+	/* a reference in the directory of the new one */
+	if ((error = git_buf_printf(&dir, "%s/", new_ref)) < 0 ||
+		(error = packed_map_seek(&rec, map, dir.ptr, dir.size)) < 0)
+		goto done;
+
+	for (; rec < map->end; rec = packed_record_next(rec, map->end)) {
+		if ((error = packed_record_name(&name, &len, rec, map->end)) < 0)
+			goto done;
+
+		if (len < dir.size || memcmp(name, dir.ptr, dir.size))
+			break;
+
+		if (len != old_len || memcmp(name, old_ref, len)) {
+			*available = 0;
+			break;
+		}
+	}
+
+done:
+	git_mutex_unlock(&backend->packed_lock);
+	git_buf_free(&dir);
+	return error;
+}
+
+static int packed_refcache_available(
+	int *available,
+	refdb_fs_backend *backend,
+	const char *new_ref,
+	const char *old_ref)
 {
 	size_t i;
 
+	*available = 1;
+
 	if (packed_reload(backend) < 0)
 		return -1;
 
+	git_sortedcache_rlock(backend->refcache);
+
+	for (i = 0; i < git_sortedcache_entrycount(backend->refcache); ++i) {
+		struct packref *ref = git_sortedcache_entry(backend->refcache, i);
+
+		if (ref && !ref_is_available(old_ref, new_ref, ref->name)) {
+			*available = 0;
+			break;
+		}
+	}
+
+	git_sortedcache_runlock(backend->refcache);
+	return 0;
+}
+
+static int reference_path_available(
+	refdb_fs_backend *backend,
+	const char *new_ref,
+	const char* old_ref,
+	int force)
+{
+	int available, error;
+
 	if (!force) {
 		int exists;
 
@@ -671,20 +1295,19 @@ static int reference_path_available(
 		}
 	}
 
-	git_sortedcache_rlock(backend->refcache);
+	error = packed_map_available(&available, backend, new_ref, old_ref);
+	if (error == GIT_PASSTHROUGH)
+		error = packed_refcache_available(&available, backend, new_ref, old_ref);
 
-	for (i = 0; i < git_sortedcache_entrycount(backend->refcache); ++i) {
-		struct packref *ref = git_sortedcache_entry(backend->refcache, i);
+	if (error < 0)
+		return error;
 
-		if (ref && !ref_is_available(old_ref, new_ref, ref->name)) {
-			git_sortedcache_runlock(backend->refcache);
-			giterr_set(GITERR_REFERENCE,
-				"Path to reference '%s' collides with existing one", new_ref);
-			return -1;
-		}
+	if (!available) {
+		giterr_set(GITERR_REFERENCE,
+			"Path to reference '%s' collides with existing one", new_ref);
+		return -1;
 	}
 
-	git_sortedcache_runlock(backend->refcache);
 	return 0;
 }
 
@@ -855,49 +1478,63 @@ static int packed_remove_loose(refdb_fs_backend *backend)
 }
 
 /*
- * Write all the contents in the in-memory packfile to disk.
+ * Write all the contents in the in-memory packfile to the locked
+ * `pack_file`; the cache must be locked for writing.
  */
-static int packed_write(refdb_fs_backend *backend)
+static int packed_write_file(refdb_fs_backend *backend, git_filebuf *pack_file)
 {
 	git_sortedcache *refcache = backend->refcache;
-	git_filebuf pack_file = GIT_FILEBUF_INIT;
 	size_t i;
 
-	/* lock the cache to updates while we do this */
-	if (git_sortedcache_wlock(refcache) < 0)
-		return -1;
-
-	/* Open the file! */
-	if (git_filebuf_open(&pack_file, git_sortedcache_path(refcache), 0, GIT_PACKEDREFS_FILE_MODE) < 0)
-		goto fail;
-
 	/* Packfiles have a header... apparently
 	 * This is in fact not required, but we might as well print it
 	 * just for kicks */
-	if (git_filebuf_printf(&pack_file, "%s\n", GIT_PACKEDREFS_HEADER) < 0)
-		goto fail;
+	if (git_filebuf_printf(pack_file, "%s\n", GIT_PACKEDREFS_HEADER) < 0)
+		return -1;
 
 	for (i = 0; i < git_sortedcache_entrycount(refcache); ++i) {
 		struct packref *ref = git_sortedcache_entry(refcache, i);
 
 		if (packed_find_peel(backend, ref) < 0)
-			goto fail;
+			return -1;
 
-		if (packed_write_ref(ref, &pack_file) < 0)
-			goto fail;
+		if (packed_write_ref(ref, pack_file) < 0)
+			return -1;
 	}
 
 	/* if we've written all the references properly, we can commit
 	 * the packfile to make the changes effective */
-	if (git_filebuf_commit(&pack_file) < 0)
-		goto fail;
+	if (git_filebuf_commit(pack_file) < 0)
+		return -1;
 
 	/* when and only when the packfile has been properly written,
 	 * we can go ahead and remove the loose refs */
 	if (packed_remove_loose(backend) < 0)
-		goto fail;
+		return -1;
 
 	git_sortedcache_updated(refcache);
+	return 0;
+}
+
+/*
+ * Write all the contents in the in-memory packfile to disk.
+ */
+static int packed_write(refdb_fs_backend *backend)
+{
+	git_sortedcache *refcache = backend->refcache;
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+
+	/* lock the cache to updates while we do this */
+	if (git_sortedcache_wlock(refcache) < 0)
+		return -1;
+
+	/* Open the file! */
+	if (git_filebuf_open(&pack_file, git_sortedcache_path(refcache), 0, GIT_PACKEDREFS_FILE_MODE) < 0)
+		goto fail;
+
+	if (packed_write_file(backend, &pack_file) < 0)
+		goto fail;
+
 	git_sortedcache_wunlock(refcache);
 
 	/* we're good now */
@@ -1081,6 +1718,237 @@ static int refdb_fs_backend__compress(git_refdb_backend *_backend)
 	return 0;
 }
 
+/*
+ * A transaction writes its new references to packed-refs instead of
+ * loose files when it updates at least this many of them, and the
+ * packfile is small enough to rewrite for each of them.
+ */
+#define TRANSACTION_PACK_MIN 8
+#define TRANSACTION_PACK_BYTES 1024
+
+typedef struct {
+	const git_refdb_update *update;
+	git_filebuf file;
+	int loose;
+	int packed;
+	int in_pack;
+} transaction_entry;
+
+/*
+ * Lock a loose reference without stealing the lock of another
+ * writer, unlike `loose_lock()`.
+ */
+static int transaction_lock(
+	git_filebuf *file, refdb_fs_backend *backend, const char *name)
+{
+	git_buf ref_path = GIT_BUF_INIT;
+	int error;
+
+	if (git_futils_rmdir_r(name, backend->path, GIT_RMDIR_SKIP_NONEMPTY) < 0 ||
+		git_buf_joinpath(&ref_path, backend->path, name) < 0)
+		return -1;
+
+	if (!(error = git_futils_mkpath2file(ref_path.ptr, GIT_REFS_DIR_MODE)))
+		error = git_filebuf_open(file, ref_path.ptr, 0, GIT_REFS_FILE_MODE);
+
+	git_buf_free(&ref_path);
+	return error;
+}
+
+/* Check the current value of every locked reference */
+static int transaction_check(
+	size_t *pack_candidates,
+	refdb_fs_backend *backend,
+	transaction_entry *entries,
+	size_t count)
+{
+	git_buf ref_path = GIT_BUF_INIT;
+	git_reference *current;
+	size_t i;
+	int error = 0;
+
+	*pack_candidates = 0;
+
+	for (i = 0; i < count && !error; ++i) {
+		transaction_entry *entry = &entries[i];
+		const git_refdb_update *update = entry->update;
+
+		git_buf_clear(&ref_path);
+		if (git_buf_joinpath(&ref_path, backend->path, update->name) < 0 ||
+			packed_exists(&entry->packed, backend, update->name) < 0) {
+			error = -1;
+			break;
+		}
+		entry->loose = git_path_isfile(ref_path.ptr);
+
+		current = NULL;
+		error = refdb_fs_backend__lookup(
+			&current, (git_refdb_backend *)backend, update->name);
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			current = NULL;
+			error = 0;
+		}
+
+		if (!error)
+			error = git_refdb_update_check(update, current);
+		git_reference_free(current);
+
+		if (update->ref && update->ref->type == GIT_REF_OID && !entry->loose)
+			(*pack_candidates)++;
+	}
+
+	git_buf_free(&ref_path);
+	return error;
+}
+
+/* Apply the deletions and the packed updates to the packfile */
+static int transaction_pack(
+	refdb_fs_backend *backend,
+	git_filebuf *pack_file,
+	transaction_entry *entries,
+	size_t count)
+{
+	git_sortedcache *refcache = backend->refcache;
+	struct packref *ref;
+	size_t i, pos;
+	int error = 0;
+
+	if (packed_reload(backend) < 0 || git_sortedcache_wlock(refcache) < 0)
+		return -1;
+
+	for (i = 0; i < count && !error; ++i) {
+		const git_refdb_update *update = entries[i].update;
+
+		if (!update->ref) {
+			if (!git_sortedcache_lookup_index(&pos, refcache, update->name))
+				error = git_sortedcache_remove(refcache, pos);
+		} else if (update->ref->type == GIT_REF_OID && !entries[i].loose) {
+			if (!(error = git_sortedcache_upsert((void **)&ref, refcache, update->name))) {
+				git_oid_cpy(&ref->oid, &update->ref->target.oid);
+				memset(&ref->peel, 0, sizeof(ref->peel));
+				ref->flags = 0;
+				entries[i].in_pack = 1;
+			}
+		}
+	}
+
+	if (!error)
+		error = packed_write_file(backend, pack_file);
+
+	/* make the next reader load the packfile again */
+	if (error < 0)
+		git_futils_filestamp_set(&refcache->stamp, NULL);
+
+	git_sortedcache_wunlock(refcache);
+	return error;
+}
+
+/* Append the reflog entry of an update that has been written */
+static int transaction_reflog(
+	refdb_fs_backend *backend, const git_refdb_update *update)
+{
+	if (!update->ref || !should_write_reflog(backend->repo, update->name))
+		return 0;
+
+	return reflog_append(backend, update->ref, update->who, update->message);
+}
+
+static int refdb_fs_backend__transaction(
+	git_refdb_backend *_backend,
+	const git_refdb_update **updates,
+	size_t count)
+{
+	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
+	transaction_entry *entries;
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	git_buf ref_path = GIT_BUF_INIT;
+	struct stat st;
+	size_t i, pack_candidates;
+	int error = 0, rewrite = 0;
+
+	assert(backend && updates);
+
+	entries = git__calloc(count, sizeof(transaction_entry));
+	GITERR_CHECK_ALLOC(entries);
+
+	/* lock every reference before looking at any of them */
+	for (i = 0; i < count; ++i) {
+		entries[i].update = updates[i];
+
+		if ((updates[i]->ref && (error = reference_path_available(
+				backend, updates[i]->name, NULL, 1)) < 0) ||
+			(error = transaction_lock(
+				&entries[i].file, backend, updates[i]->name)) < 0)
+			goto cleanup;
+	}
+
+	if ((error = transaction_check(&pack_candidates, backend, entries, count)) < 0)
+		goto cleanup;
+
+	for (i = 0; i < count; ++i)
+		if (!updates[i]->ref && entries[i].packed)
+			rewrite = 1;
+
+	if (!rewrite && pack_candidates >= TRANSACTION_PACK_MIN)
+		rewrite = p_stat(git_sortedcache_path(backend->refcache), &st) < 0 ||
+			(size_t)st.st_size <= pack_candidates * TRANSACTION_PACK_BYTES;
+
+	if (rewrite && (error = git_filebuf_open(&pack_file,
+			git_sortedcache_path(backend->refcache), 0,
+			GIT_PACKEDREFS_FILE_MODE)) < 0)
+		goto cleanup;
+
+	/*
+	 * every reference is locked and checked; from here on we write.
+	 * The reflog of a reference is only appended once the reference
+	 * itself is written, so a failed update leaves no reflog entry.
+	 */
+	if (rewrite) {
+		if ((error = transaction_pack(backend, &pack_file, entries, count)) < 0)
+			goto cleanup;
+
+		for (i = 0; i < count; ++i)
+			if (entries[i].in_pack &&
+				(error = transaction_reflog(backend, updates[i])) < 0)
+				goto cleanup;
+	}
+
+	for (i = 0; i < count; ++i) {
+		const git_refdb_update *update = updates[i];
+
+		if (update->ref && !entries[i].in_pack) {
+			if ((error = loose_commit(&entries[i].file, update->ref)) < 0 ||
+				(error = transaction_reflog(backend, update)) < 0)
+				goto cleanup;
+			continue;
+		}
+
+		if (!entries[i].loose)
+			continue;
+
+		git_buf_clear(&ref_path);
+		if ((error = git_buf_joinpath(&ref_path, backend->path, update->name)) < 0)
+			goto cleanup;
+
+		if (p_unlink(ref_path.ptr) < 0) {
+			giterr_set(GITERR_OS,
+				"Failed to remove loose reference '%s'", ref_path.ptr);
+			error = -1;
+			goto cleanup;
+		}
+	}
+
+cleanup:
+	git_filebuf_cleanup(&pack_file);
+	for (i = 0; i < count; ++i)
+		git_filebuf_cleanup(&entries[i].file);
+	git__free(entries);
+	git_buf_free(&ref_path);
+
+	return error;
+}
+
 static void refdb_fs_backend__free(git_refdb_backend *_backend)
 {
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
@@ -1088,6 +1956,8 @@ static void refdb_fs_backend__free(git_refdb_backend *_backend)
 	assert(backend);
 
 	git_sortedcache_free(backend->refcache);
+	packed_map_free(&backend->packed);
+	git_mutex_free(&backend->packed_lock);
 	git__free(backend->path);
 	git__free(backend);
 }
@@ -1590,6 +2460,12 @@ int git_refdb_backend_fs(
 
 	backend->repo = repository;
 
+	if (git_mutex_init(&backend->packed_lock)) {
+		giterr_set(GITERR_OS, "Failed to initialize packed-refs mutex");
+		git__free(backend);
+		return -1;
+	}
+
 	if (setup_namespace(&path, repository) < 0)
 		goto fail;
 
@@ -1626,11 +2502,13 @@ int git_refdb_backend_fs(
 	backend->parent.reflog_write = &refdb_reflog_fs__write;
 	backend->parent.reflog_rename = &refdb_reflog_fs__rename;
 	backend->parent.reflog_delete = &refdb_reflog_fs__delete;
+	backend->parent.transaction = &refdb_fs_backend__transaction;
 
 	*backend_out = (git_refdb_backend *)backend;
 	return 0;
 
 fail:
+	git_mutex_free(&backend->packed_lock);
 	git_buf_free(&path);
 	git__free(backend->path);
 	git__free(backend);
@@ -0,0 +1,1897 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "refs.h"
+#include "repository.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "pool.h"
+#include "reflog.h"
+#include "refdb.h"
+#include "reftable.h"
+#include "vector.h"
+
+#include <git2/tag.h>
+#include <git2/object.h>
+#include <git2/refdb.h>
+#include <git2/sys/refdb_backend.h>
+#include <git2/sys/refs.h>
+#include <git2/sys/reflog.h>
+
+/*
+ * A refdb backend that keeps the references under "refs/" and all the
+ * reflogs in a stack of reference tables (see reftable.h), listed from
+ * the oldest to the newest in "reftable/tables.list". HEAD and the
+ * other pseudo references at the top of the repository stay files.
+ *
+ * Every update of the refdb writes a table of its own and publishes it
+ * by replacing the list under its lock, which makes each update atomic.
+ * After an update, the newest tables are merged while they are not
+ * much bigger than the tables above them, which keeps the stack
+ * logarithmic in the number of updates.
+ */
+
+#define TABLE_LOAD_RETRIES 8
+
+/* A snapshot of the stack, shared with the iterators that read it */
+typedef struct {
+	git_atomic refcount;
+	size_t count;
+	uint64_t max_index;
+	git_reftable *tables[GIT_FLEX_ARRAY];
+} table_stack;
+
+typedef struct refdb_table_backend {
+	git_refdb_backend parent;
+
+	git_repository *repo;
+	char *path;
+	char *dir;
+	char *list_path;
+
+	git_mutex lock; /* protects stack and stamp */
+	table_stack *stack;
+	git_futils_filestamp stamp;
+} refdb_table_backend;
+
+/* The records of one update, written as one table */
+typedef struct {
+	git_pool pool;
+	git_vector refs;
+	git_vector logs;
+	uint64_t min_index;
+	uint64_t max_index;
+} table_update;
+
+/* The lock on the list of tables, and the stack as of the lock */
+typedef struct {
+	git_filebuf list;
+	table_stack *stack;
+} table_lock;
+
+static int ref_error_notfound(const char *name)
+{
+	giterr_set(GITERR_REFERENCE, "Reference '%s' not found", name);
+	return GIT_ENOTFOUND;
+}
+
+GIT_INLINE(bool) is_pseudo_ref(const char *name)
+{
+	return git__prefixcmp(name, GIT_REFS_DIR) != 0;
+}
+
+/*
+ * The stack of tables
+ */
+
+static void stack_free(table_stack *stack)
+{
+	size_t i;
+
+	if (!stack || git_atomic_dec(&stack->refcount) > 0)
+		return;
+
+	for (i = 0; i < stack->count; i++)
+		git_reftable_free(stack->tables[i]);
+
+	git__free(stack);
+}
+
+static table_stack *stack_alloc(size_t count)
+{
+	table_stack *stack;
+
+	stack = git__calloc(1, sizeof(table_stack) + count * sizeof(git_reftable *));
+	if (stack)
+		stack->refcount.val = 1;
+
+	return stack;
+}
+
+/* A new stack of the `keep` oldest tables of `base` and `table` */
+static table_stack *stack_push(
+	table_stack *base, size_t keep, git_reftable *table)
+{
+	table_stack *stack;
+	size_t i;
+
+	if ((stack = stack_alloc(keep + 1)) == NULL)
+		return NULL;
+
+	for (i = 0; i < keep; i++) {
+		stack->tables[i] = base->tables[i];
+		git_atomic_inc(&stack->tables[i]->refcount);
+	}
+
+	stack->tables[keep] = table;
+	stack->count = keep + 1;
+	stack->max_index = table->max_index;
+	return stack;
+}
+
+static git_reftable *stack_find(table_stack *stack, const char *name)
+{
+	size_t i;
+
+	for (i = 0; stack && i < stack->count; i++) {
+		if (!strcmp(stack->tables[i]->name, name))
+			return stack->tables[i];
+	}
+
+	return NULL;
+}
+
+/* Read the list of tables, reusing the tables that are already open */
+static int stack_load(table_stack **out, refdb_table_backend *backend)
+{
+	git_buf list = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	table_stack *stack = NULL;
+	git_reftable *table;
+	char *line, *scan;
+	size_t count = 0;
+	int error;
+
+	error = git_futils_readbuffer(&list, backend->list_path);
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+
+	if (error < 0)
+		goto done;
+
+	for (scan = list.ptr; *scan; scan++)
+		count += (*scan == '\n');
+
+	if ((stack = stack_alloc(count)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	scan = list.ptr;
+
+	while ((line = git__strsep(&scan, "\n")) != NULL) {
+		if (!*line)
+			continue;
+
+		if (strchr(line, '/') != NULL || stack->count == count) {
+			giterr_set(GITERR_REFERENCE,
+				"Corrupted list of reference tables '%s'", backend->list_path);
+			error = -1;
+			goto done;
+		}
+
+		if ((table = stack_find(backend->stack, line)) != NULL) {
+			git_atomic_inc(&table->refcount);
+		} else if ((error = git_buf_joinpath(&path, backend->dir, line)) < 0 ||
+			(error = git_reftable_open(&table, path.ptr, line)) < 0) {
+			goto done;
+		}
+
+		stack->tables[stack->count++] = table;
+	}
+
+	if (stack->count)
+		stack->max_index = stack->tables[stack->count - 1]->max_index;
+
+	*out = stack;
+	stack = NULL;
+
+done:
+	stack_free(stack);
+	git_buf_free(&list);
+	git_buf_free(&path);
+	return error;
+}
+
+/* Load the stack again if the list changed. Called with the lock held. */
+static int stack_refresh(refdb_table_backend *backend)
+{
+	table_stack *stack = NULL, *old;
+	int error, retries = 0;
+
+	error = git_futils_filestamp_check(&backend->stamp, backend->list_path);
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = (backend->stack == NULL || backend->stack->count > 0);
+	} else if (error == 0 && backend->stack == NULL) {
+		error = 1;
+	}
+
+	if (error <= 0)
+		return error;
+
+	/* a table that went away was merged by another writer: the list
+	 * has changed again */
+	while ((error = stack_load(&stack, backend)) == GIT_ENOTFOUND &&
+		++retries < TABLE_LOAD_RETRIES)
+		giterr_clear();
+
+	if (error < 0) {
+		git_futils_filestamp_set(&backend->stamp, NULL);
+		return error;
+	}
+
+	old = backend->stack;
+	backend->stack = stack;
+	stack_free(old);
+
+	return 0;
+}
+
+static int backend_lock(refdb_table_backend *backend)
+{
+	if (git_mutex_lock(&backend->lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock reference table mutex");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The current stack, to release with stack_free */
+static int stack_snapshot(table_stack **out, refdb_table_backend *backend)
+{
+	int error;
+
+	if (backend_lock(backend) < 0)
+		return -1;
+
+	if ((error = stack_refresh(backend)) == 0) {
+		*out = backend->stack;
+		git_atomic_inc(&(*out)->refcount);
+	}
+
+	git_mutex_unlock(&backend->lock);
+	return error;
+}
+
+/*
+ * Another writer holds tables.list.lock only while it writes a small
+ * table, so wait for it with a doubling backoff before giving up with
+ * GIT_ELOCKED, like git does with core.filesRefLockTimeout.
+ */
+#define TABLE_LOCK_TIMEOUT_MS 100
+
+static int stack_lock(table_lock *lock, refdb_table_backend *backend)
+{
+	int error, waited = 0, delay = 1;
+
+	memset(lock, 0, sizeof(*lock));
+
+	if ((error = git_futils_mkdir(backend->dir, NULL,
+			GIT_REFS_DIR_MODE, GIT_MKDIR_PATH)) < 0)
+		return error;
+
+	while ((error = git_filebuf_open(&lock->list,
+			backend->list_path, 0, GIT_REFS_FILE_MODE)) == GIT_ELOCKED &&
+		waited < TABLE_LOCK_TIMEOUT_MS) {
+		p_msleep(delay);
+		waited += delay;
+		delay = min(delay * 2, TABLE_LOCK_TIMEOUT_MS - waited);
+	}
+
+	if (error < 0)
+		return error;
+
+	if ((error = stack_snapshot(&lock->stack, backend)) < 0)
+		git_filebuf_cleanup(&lock->list);
+
+	return error;
+}
+
+static void stack_unlock(table_lock *lock)
+{
+	git_filebuf_cleanup(&lock->list);
+	stack_free(lock->stack);
+	lock->stack = NULL;
+}
+
+/* Write the list of `stack` and make it the current stack */
+static int stack_publish(
+	refdb_table_backend *backend, table_lock *lock, table_stack *stack)
+{
+	table_stack *old;
+	size_t i;
+	int error;
+
+	for (i = 0; i < stack->count; i++)
+		git_filebuf_printf(&lock->list, "%s\n", stack->tables[i]->name);
+
+	if ((error = git_filebuf_commit(&lock->list)) < 0)
+		return error;
+
+	if (backend_lock(backend) < 0)
+		return -1;
+
+	old = backend->stack;
+	backend->stack = stack;
+	git_atomic_inc(&stack->refcount);
+
+	if (git_futils_filestamp_check(&backend->stamp, backend->list_path) < 0) {
+		giterr_clear();
+		git_futils_filestamp_set(&backend->stamp, NULL);
+	}
+
+	git_mutex_unlock(&backend->lock);
+
+	stack_free(old);
+	return 0;
+}
+
+static void stack_unlink(
+	refdb_table_backend *backend, table_stack *stack, size_t first, size_t count)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	/* readers that still use them keep them open or mapped */
+	for (i = first; i < first + count; i++) {
+		if (git_buf_joinpath(&path, backend->dir, stack->tables[i]->name) < 0 ||
+			p_unlink(path.ptr) < 0)
+			giterr_clear();
+	}
+
+	git_buf_free(&path);
+}
+
+typedef int (*table_fill_cb)(git_reftable_writer *writer, void *payload);
+
+static int table_write(
+	git_reftable **out,
+	refdb_table_backend *backend,
+	uint64_t min_index,
+	uint64_t max_index,
+	table_fill_cb fill,
+	void *payload)
+{
+	git_buf name = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_reftable_writer *writer = NULL;
+	int error;
+
+	if ((error = git_buf_printf(&name, "%016" PRIx64 "-%016" PRIx64 ".ref",
+			min_index, max_index)) < 0 ||
+		(error = git_buf_joinpath(&path, backend->dir, name.ptr)) < 0 ||
+		(error = git_filebuf_open(&file, path.ptr, 0, GIT_REFTABLE_FILE_MODE)) < 0)
+		goto done;
+
+	if ((error = git_reftable_writer_new(
+			&writer, &file, min_index, max_index)) < 0 ||
+		(error = fill(writer, payload)) < 0 ||
+		(error = git_reftable_writer_finish(writer)) < 0 ||
+		(error = git_filebuf_commit(&file)) < 0)
+		goto done;
+
+	if ((error = git_reftable_open(out, path.ptr, name.ptr)) < 0)
+		p_unlink(path.ptr);
+
+done:
+	git_reftable_writer_free(writer);
+	git_filebuf_cleanup(&file);
+	git_buf_free(&name);
+	git_buf_free(&path);
+	return error;
+}
+
+typedef struct {
+	table_stack *stack;
+	size_t first;
+} table_compaction;
+
+static int compaction_fill(git_reftable_writer *writer, void *payload)
+{
+	table_compaction *compaction = payload;
+	table_stack *stack = compaction->stack;
+	git_reftable_merged merged;
+	const git_reftable_ref *ref;
+	const git_reftable_log *log;
+	/* nothing is left to delete below the oldest table */
+	int keep_deletions = compaction->first > 0;
+	int error;
+
+	if ((error = git_reftable_merged_init(&merged,
+			stack->tables + compaction->first,
+			stack->count - compaction->first, 'r')) < 0)
+		return error;
+
+	while ((error = git_reftable_merged_next_ref(&ref, &merged)) == 0) {
+		if (ref->type == GIT_REFTABLE_REF_DELETION && !keep_deletions)
+			continue;
+		if ((error = git_reftable_writer_add_ref(writer, ref)) < 0)
+			break;
+	}
+
+	git_reftable_merged_free(&merged);
+
+	if (error != GIT_ITEROVER)
+		return error;
+
+	if ((error = git_reftable_merged_init(&merged,
+			stack->tables + compaction->first,
+			stack->count - compaction->first, 'g')) < 0)
+		return error;
+
+	while ((error = git_reftable_merged_next_log(&log, &merged)) == 0) {
+		if (log->type == GIT_REFTABLE_LOG_DELETION && !keep_deletions)
+			continue;
+		if ((error = git_reftable_writer_add_log(writer, log)) < 0)
+			break;
+	}
+
+	git_reftable_merged_free(&merged);
+
+	return (error == GIT_ITEROVER) ? 0 : error;
+}
+
+/* Merge the tables from `first` to the newest one */
+static int stack_compact(
+	table_stack **out,
+	refdb_table_backend *backend,
+	table_stack *stack,
+	size_t first)
+{
+	table_compaction compaction;
+	git_reftable *table;
+	int error;
+
+	compaction.stack = stack;
+	compaction.first = first;
+
+	if ((error = table_write(&table, backend,
+			stack->tables[first]->min_index,
+			stack->tables[stack->count - 1]->max_index,
+			compaction_fill, &compaction)) < 0)
+		return error;
+
+	if ((*out = stack_push(stack, first, table)) == NULL) {
+		git_reftable_free(table);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The oldest table to merge, so that each table is more than twice as
+ * big as the tables above it */
+static size_t compaction_start(table_stack *stack)
+{
+	size_t first = stack->count - 1, size = stack->tables[first]->size;
+
+	while (first > 0 && stack->tables[first - 1]->size <= 2 * size)
+		size += stack->tables[--first]->size;
+
+	return first;
+}
+
+/*
+ * Updates
+ */
+
+static int ref_record_cmp(const void *a, const void *b)
+{
+	const git_reftable_ref *ref_a = a, *ref_b = b;
+	return strcmp(ref_a->name, ref_b->name);
+}
+
+static int log_record_cmp(const void *a, const void *b)
+{
+	const git_reftable_log *log_a = a, *log_b = b;
+	int cmp = strcmp(log_a->name, log_b->name);
+
+	if (cmp)
+		return cmp;
+
+	/* the newest entry comes first */
+	return (log_a->update_index < log_b->update_index) -
+		(log_a->update_index > log_b->update_index);
+}
+
+static int update_init(table_update *update, uint64_t min_index)
+{
+	memset(update, 0, sizeof(*update));
+
+	update->min_index = update->max_index = min_index;
+
+	if (git_pool_init(&update->pool, 1, 0) < 0 ||
+		git_vector_init(&update->refs, 8, ref_record_cmp) < 0 ||
+		git_vector_init(&update->logs, 8, log_record_cmp) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void update_free(table_update *update)
+{
+	size_t i;
+	void *record;
+
+	git_vector_foreach(&update->refs, i, record)
+		git__free(record);
+	git_vector_foreach(&update->logs, i, record)
+		git__free(record);
+
+	git_vector_free(&update->refs);
+	git_vector_free(&update->logs);
+	git_pool_clear(&update->pool);
+}
+
+static git_reftable_ref *update_ref(
+	table_update *update, const char *name, int type)
+{
+	git_reftable_ref *ref = git__calloc(1, sizeof(git_reftable_ref));
+
+	if (!ref)
+		return NULL;
+
+	ref->type = type;
+	ref->update_index = update->min_index;
+
+	if ((ref->name = git_pool_strdup(&update->pool, name)) == NULL ||
+		git_vector_insert(&update->refs, ref) < 0) {
+		git__free(ref);
+		return NULL;
+	}
+
+	return ref;
+}
+
+static git_reftable_log *update_log(
+	table_update *update, const char *name, uint64_t update_index, int type)
+{
+	git_reftable_log *log = git__calloc(1, sizeof(git_reftable_log));
+
+	if (!log)
+		return NULL;
+
+	log->type = type;
+	log->update_index = update_index;
+
+	if ((log->name = git_pool_strdup(&update->pool, name)) == NULL ||
+		git_vector_insert(&update->logs, log) < 0) {
+		git__free(log);
+		return NULL;
+	}
+
+	return log;
+}
+
+static int update_add_log_entry(
+	table_update *update,
+	const char *name,
+	uint64_t update_index,
+	const git_oid *old_id,
+	const git_oid *new_id,
+	const git_signature *who,
+	const char *message)
+{
+	git_reftable_log *log;
+
+	log = update_log(update, name, update_index, GIT_REFTABLE_LOG_UPDATE);
+	GITERR_CHECK_ALLOC(log);
+
+	git_oid_cpy(&log->old_id, old_id);
+	git_oid_cpy(&log->new_id, new_id);
+	log->who_name = git_pool_strdup_safe(&update->pool, who->name);
+	log->who_email = git_pool_strdup_safe(&update->pool, who->email);
+	log->time = who->when.time;
+	log->offset = who->when.offset;
+	log->message = git_pool_strdup_safe(&update->pool, message);
+
+	if ((who->name && !log->who_name) || (who->email && !log->who_email) ||
+		(message && !log->message))
+		return -1;
+
+	if (update_index > update->max_index)
+		update->max_index = update_index;
+
+	return 0;
+}
+
+/* Sort the records and keep the last one added of each key */
+static void update_sort(git_vector *records)
+{
+	size_t i, kept = 0;
+
+	git_vector_sort(records);
+
+	for (i = 0; i < records->length; i++) {
+		if (i + 1 < records->length &&
+			!records->_cmp(records->contents[i], records->contents[i + 1])) {
+			git__free(records->contents[i]);
+			continue;
+		}
+
+		records->contents[kept++] = records->contents[i];
+	}
+
+	records->length = kept;
+}
+
+static int update_fill(git_reftable_writer *writer, void *payload)
+{
+	table_update *update = payload;
+	size_t i;
+	int error;
+
+	for (i = 0; i < update->refs.length; i++) {
+		if ((error = git_reftable_writer_add_ref(
+				writer, git_vector_get(&update->refs, i))) < 0)
+			return error;
+	}
+
+	for (i = 0; i < update->logs.length; i++) {
+		if ((error = git_reftable_writer_add_log(
+				writer, git_vector_get(&update->logs, i))) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+/* Write the update as a new table on top of the locked stack, merge
+ * the newest tables, and publish the result. Releases the lock. */
+static int stack_commit(
+	refdb_table_backend *backend, table_lock *lock, table_update *update)
+{
+	table_stack *stack = NULL, *compacted = NULL;
+	git_reftable *table = NULL;
+	size_t first;
+	int error;
+
+	update_sort(&update->refs);
+	update_sort(&update->logs);
+
+	if (!update->refs.length && !update->logs.length) {
+		stack_unlock(lock);
+		return 0;
+	}
+
+	if ((error = table_write(&table, backend, update->min_index,
+			update->max_index, update_fill, update)) < 0)
+		goto done;
+
+	if ((stack = stack_push(lock->stack, lock->stack->count, table)) == NULL) {
+		git_reftable_free(table);
+		error = -1;
+		goto done;
+	}
+
+	first = compaction_start(stack);
+
+	/* merging is an optimization; the update stands without it */
+	if (first + 1 < stack->count &&
+		stack_compact(&compacted, backend, stack, first) < 0)
+		giterr_clear();
+
+	if ((error = stack_publish(backend, lock,
+			compacted ? compacted : stack)) < 0) {
+		stack_unlink(backend, stack, stack->count - 1, 1);
+		if (compacted)
+			stack_unlink(backend, compacted, compacted->count - 1, 1);
+		goto done;
+	}
+
+	if (compacted)
+		stack_unlink(backend, stack, first, stack->count - first);
+
+done:
+	stack_free(compacted);
+	stack_free(stack);
+	stack_unlock(lock);
+	return error;
+}
+
+/*
+ * Reading references
+ */
+
+static int stack_lookup(
+	git_reference **out, table_stack *stack, const char *name)
+{
+	git_reftable_iter iter;
+	const git_reftable_ref *ref;
+	size_t i = stack->count;
+	int error = GIT_ENOTFOUND;
+
+	if (out)
+		*out = NULL;
+
+	/* the newest table with a record of the reference has its value */
+	while (i-- > 0 && error == GIT_ENOTFOUND) {
+		git_reftable_iter_init(&iter, stack->tables[i], 'r');
+
+		if ((error = git_reftable_iter_seek(&iter, name, strlen(name))) == 0 &&
+			(error = git_reftable_iter_next_ref(&ref, &iter)) == 0 &&
+			strcmp(ref->name, name) != 0)
+			error = GIT_ITEROVER;
+
+		if (error == GIT_ITEROVER) {
+			error = GIT_ENOTFOUND;
+		} else if (error == 0 && ref->type == GIT_REFTABLE_REF_DELETION) {
+			i = 0;
+			error = GIT_ENOTFOUND;
+		} else if (error == 0 && out) {
+			if (ref->type == GIT_REFTABLE_REF_SYMREF)
+				*out = git_reference__alloc_symbolic(name, ref->target);
+			else
+				*out = git_reference__alloc(name, &ref->oid,
+					ref->type == GIT_REFTABLE_REF_VAL2 ? &ref->peel : NULL);
+
+			if (*out == NULL)
+				error = -1;
+		}
+
+		git_reftable_iter_free(&iter);
+	}
+
+	if (error == GIT_ENOTFOUND)
+		return ref_error_notfound(name);
+
+	return error;
+}
+
+static int pseudo_path(
+	git_buf *path, refdb_table_backend *backend, const char *name)
+{
+	return git_buf_joinpath(path, backend->path, name);
+}
+
+static int pseudo_lookup(
+	git_reference **out, refdb_table_backend *backend, const char *name)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_oid oid;
+	int error;
+
+	if ((error = pseudo_path(&path, backend, name)) < 0 ||
+		(error = git_futils_readbuffer(&content, path.ptr)) < 0) {
+		if (error == GIT_ENOTFOUND)
+			error = ref_error_notfound(name);
+		goto done;
+	}
+
+	git_buf_rtrim(&content);
+
+	if (!git__prefixcmp(content.ptr, GIT_SYMREF) &&
+		content.size > strlen(GIT_SYMREF)) {
+		if ((*out = git_reference__alloc_symbolic(
+				name, content.ptr + strlen(GIT_SYMREF))) == NULL)
+			error = -1;
+	} else if (content.size >= GIT_OID_HEXSZ &&
+		!git_oid_fromstrn(&oid, content.ptr, GIT_OID_HEXSZ) &&
+		(content.size == GIT_OID_HEXSZ ||
+		 git__isspace(content.ptr[GIT_OID_HEXSZ]))) {
+		if ((*out = git_reference__alloc(name, &oid, NULL)) == NULL)
+			error = -1;
+	} else {
+		giterr_set(GITERR_REFERENCE,
+			"Corrupted loose reference file: %s", name);
+		error = -1;
+	}
+
+done:
+	git_buf_free(&path);
+	git_buf_free(&content);
+	return error;
+}
+
+static int refdb_table_backend__exists(
+	int *exists,
+	git_refdb_backend *_backend,
+	const char *ref_name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_buf path = GIT_BUF_INIT;
+	table_stack *stack;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudo_ref(ref_name)) {
+		if (pseudo_path(&path, backend, ref_name) < 0)
+			return -1;
+
+		*exists = git_path_isfile(path.ptr);
+		git_buf_free(&path);
+		return 0;
+	}
+
+	if (stack_snapshot(&stack, backend) < 0)
+		return -1;
+
+	error = stack_lookup(NULL, stack, ref_name);
+	stack_free(stack);
+
+	*exists = (error == 0);
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+static int refdb_table_backend__lookup(
+	git_reference **out,
+	git_refdb_backend *_backend,
+	const char *ref_name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_stack *stack;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudo_ref(ref_name))
+		return pseudo_lookup(out, backend, ref_name);
+
+	if (stack_snapshot(&stack, backend) < 0)
+		return -1;
+
+	error = stack_lookup(out, stack, ref_name);
+	stack_free(stack);
+
+	return error;
+}
+
+typedef struct {
+	git_reference_iterator parent;
+
+	table_stack *stack;
+	git_reftable_merged merged;
+	char *glob;
+	git_buf prefix;
+} refdb_table_iter;
+
+static void refdb_table_backend__iterator_free(git_reference_iterator *_iter)
+{
+	refdb_table_iter *iter = (refdb_table_iter *)_iter;
+
+	git_reftable_merged_free(&iter->merged);
+	stack_free(iter->stack);
+	git__free(iter->glob);
+	git_buf_free(&iter->prefix);
+	git__free(iter);
+}
+
+/* The next live reference in the range of the glob that matches it */
+static int iterator_advance(
+	const git_reftable_ref **out, refdb_table_iter *iter)
+{
+	const git_reftable_ref *ref;
+	int error;
+
+	while ((error = git_reftable_merged_next_ref(&ref, &iter->merged)) == 0) {
+		if (git__prefixcmp(ref->name, iter->prefix.ptr) != 0)
+			return GIT_ITEROVER;
+
+		if (ref->type == GIT_REFTABLE_REF_DELETION ||
+			(iter->glob && p_fnmatch(iter->glob, ref->name, 0) != 0))
+			continue;
+
+		*out = ref;
+		return 0;
+	}
+
+	return error;
+}
+
+static int refdb_table_backend__iterator_next(
+	git_reference **out, git_reference_iterator *_iter)
+{
+	refdb_table_iter *iter = (refdb_table_iter *)_iter;
+	const git_reftable_ref *ref;
+	int error;
+
+	if ((error = iterator_advance(&ref, iter)) < 0)
+		return error;
+
+	if (ref->type == GIT_REFTABLE_REF_SYMREF)
+		*out = git_reference__alloc_symbolic(ref->name, ref->target);
+	else
+		*out = git_reference__alloc(ref->name, &ref->oid,
+			ref->type == GIT_REFTABLE_REF_VAL2 ? &ref->peel : NULL);
+
+	return (*out != NULL) ? 0 : -1;
+}
+
+static int refdb_table_backend__iterator_next_name(
+	const char **out, git_reference_iterator *_iter)
+{
+	refdb_table_iter *iter = (refdb_table_iter *)_iter;
+	const git_reftable_ref *ref;
+	int error;
+
+	if ((error = iterator_advance(&ref, iter)) == 0)
+		*out = ref->name;
+
+	return error;
+}
+
+static int refdb_table_backend__iterator(
+	git_reference_iterator **out, git_refdb_backend *_backend, const char *glob)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	refdb_table_iter *iter;
+
+	assert(backend);
+
+	iter = git__calloc(1, sizeof(refdb_table_iter));
+	GITERR_CHECK_ALLOC(iter);
+
+	git_buf_init(&iter->prefix, 0);
+
+	iter->parent.next = refdb_table_backend__iterator_next;
+	iter->parent.next_name = refdb_table_backend__iterator_next_name;
+	iter->parent.free = refdb_table_backend__iterator_free;
+
+	/* only the references that start like the glob can match it */
+	if (glob != NULL) {
+		iter->glob = git__strdup(glob);
+		GITERR_CHECK_ALLOC(iter->glob);
+
+		git_buf_put(&iter->prefix, glob, strcspn(glob, "*?[\\"));
+	}
+
+	if (git_buf_oom(&iter->prefix) ||
+		stack_snapshot(&iter->stack, backend) < 0 ||
+		git_reftable_merged_init(&iter->merged, iter->stack->tables,
+			iter->stack->count, 'r') < 0 ||
+		git_reftable_merged_seek(&iter->merged,
+			iter->prefix.ptr, iter->prefix.size) < 0) {
+		refdb_table_backend__iterator_free((git_reference_iterator *)iter);
+		return -1;
+	}
+
+	*out = (git_reference_iterator *)iter;
+	return 0;
+}
+
+/*
+ * Reading reflogs
+ */
+
+typedef int (*log_foreach_cb)(const git_reftable_log *log, void *payload);
+
+/* Call `cb` on the entries of the log of `name`, newest first, until
+ * it returns non-zero */
+static int stack_foreach_log(
+	table_stack *stack, const char *name, log_foreach_cb cb, void *payload)
+{
+	git_reftable_merged merged;
+	const git_reftable_log *log;
+	git_buf key = GIT_BUF_INIT;
+	int error;
+
+	if ((error = git_reftable_log_key(&key, name, UINT64_MAX)) < 0 ||
+		(error = git_reftable_merged_init(&merged,
+			stack->tables, stack->count, 'g')) < 0)
+		goto done;
+
+	if ((error = git_reftable_merged_seek(&merged, key.ptr, key.size)) == 0) {
+		while ((error = git_reftable_merged_next_log(&log, &merged)) == 0 &&
+			!strcmp(log->name, name)) {
+			if (log->type != GIT_REFTABLE_LOG_DELETION &&
+				(error = cb(log, payload)) != 0)
+				break;
+		}
+	}
+
+	if (error == GIT_ITEROVER || (error == 0 && strcmp(log->name, name)))
+		error = 0;
+
+	git_reftable_merged_free(&merged);
+
+done:
+	git_buf_free(&key);
+	return error;
+}
+
+static int has_log_cb(const git_reftable_log *log, void *payload)
+{
+	GIT_UNUSED(log);
+
+	*(int *)payload = 1;
+	return 1;
+}
+
+static int stack_has_log(table_stack *stack, const char *name)
+{
+	int found = 0, error;
+
+	if ((error = stack_foreach_log(stack, name, has_log_cb, &found)) < 0)
+		return error;
+
+	return found;
+}
+
+typedef struct {
+	table_update *update;
+	const char *name;
+	int type;
+} log_copy;
+
+/* Add a copy of the log entry to the update, under another name or as
+ * a deletion */
+static int log_copy_cb(const git_reftable_log *log, void *payload)
+{
+	log_copy *copy = payload;
+	git_reftable_log *added;
+	git_signature who;
+
+	if (copy->type == GIT_REFTABLE_LOG_DELETION ||
+		log->type == GIT_REFTABLE_LOG_EXISTS) {
+		added = update_log(copy->update, copy->name ? copy->name : log->name,
+			log->update_index, copy->type ? log->type : copy->type);
+		return added ? 0 : -1;
+	}
+
+	who.name = (char *)log->who_name;
+	who.email = (char *)log->who_email;
+	who.when.time = log->time;
+	who.when.offset = log->offset;
+
+	return update_add_log_entry(copy->update, copy->name,
+		log->update_index, &log->old_id, &log->new_id, &who, log->message);
+}
+
+/* Delete the log of `name` in the update */
+static int update_delete_log(
+	table_update *update, table_stack *stack, const char *name)
+{
+	log_copy copy;
+
+	copy.update = update;
+	copy.name = NULL;
+	copy.type = GIT_REFTABLE_LOG_DELETION;
+
+	return stack_foreach_log(stack, name, log_copy_cb, &copy);
+}
+
+/* Move the log of `old_name` to `new_name` in the update */
+static int update_rename_log(
+	table_update *update,
+	table_stack *stack,
+	const char *old_name,
+	const char *new_name)
+{
+	log_copy copy;
+	int error;
+
+	if ((error = update_delete_log(update, stack, new_name)) < 0 ||
+		(error = update_delete_log(update, stack, old_name)) < 0)
+		return error;
+
+	copy.update = update;
+	copy.name = new_name;
+	copy.type = GIT_REFTABLE_LOG_UPDATE;
+
+	return stack_foreach_log(stack, old_name, log_copy_cb, &copy);
+}
+
+/*
+ * Writing references
+ */
+
+/* We only log references under heads/, remotes/ or notes/, HEAD, or
+ * references that already have a log, under `log_name` */
+static int should_write_reflog(
+	table_stack *stack, const char *name, const char *log_name)
+{
+	if (!git__prefixcmp(name, GIT_REFS_HEADS_DIR) ||
+	    !git__strcmp(name, GIT_HEAD_FILE) ||
+	    !git__prefixcmp(name, GIT_REFS_REMOTES_DIR) ||
+	    !git__prefixcmp(name, GIT_REFS_NOTES_DIR))
+		return 1;
+
+	return stack_has_log(stack, log_name);
+}
+
+/* Add the log entry of an update of `ref`, from its current target */
+static int update_reflog_append(
+	table_update *update,
+	refdb_table_backend *backend,
+	table_stack *stack,
+	const git_reference *ref,
+	const char *log_name,
+	const git_signature *who,
+	const char *message)
+{
+	git_oid old_id;
+	int error;
+
+	/* Creation of symbolic references doesn't get a reflog entry */
+	if (ref->type == GIT_REF_SYMBOLIC)
+		return 0;
+
+	if ((error = should_write_reflog(stack, ref->name, log_name)) <= 0)
+		return error;
+
+	error = git_reference_name_to_id(&old_id, backend->repo, ref->name);
+	if (error == GIT_ENOTFOUND) {
+		memset(&old_id, 0, sizeof(git_oid));
+		giterr_clear();
+		error = 0;
+	}
+	if (error < 0)
+		return error;
+
+	return update_add_log_entry(update, ref->name, update->min_index,
+		&old_id, &ref->target.oid, who, message);
+}
+
+/* The peeled target of an annotated tag, to store with the reference */
+static void reference_peel(
+	git_oid *peel, refdb_table_backend *backend, const git_reference *ref)
+{
+	git_object *object = NULL, *target = NULL;
+
+	git_oid_cpy(peel, &ref->peel);
+
+	if (!git_oid_iszero(peel) || git__prefixcmp(ref->name, GIT_REFS_TAGS_DIR))
+		return;
+
+	if (!git_object_lookup(&object, backend->repo,
+			&ref->target.oid, GIT_OBJ_ANY) &&
+		git_object_type(object) == GIT_OBJ_TAG &&
+		!git_tag_peel(&target, (git_tag *)object))
+		git_oid_cpy(peel, git_object_id(target));
+
+	giterr_clear();
+	git_object_free(target);
+	git_object_free(object);
+}
+
+static int update_add_ref(
+	table_update *update,
+	refdb_table_backend *backend,
+	const git_reference *ref)
+{
+	git_reftable_ref *record;
+	git_oid peel;
+
+	if (ref->type == GIT_REF_SYMBOLIC) {
+		record = update_ref(update, ref->name, GIT_REFTABLE_REF_SYMREF);
+		GITERR_CHECK_ALLOC(record);
+
+		record->target = git_pool_strdup(&update->pool, ref->target.symbolic);
+		GITERR_CHECK_ALLOC(record->target);
+		return 0;
+	}
+
+	reference_peel(&peel, backend, ref);
+
+	record = update_ref(update, ref->name, git_oid_iszero(&peel) ?
+		GIT_REFTABLE_REF_VAL1 : GIT_REFTABLE_REF_VAL2);
+	GITERR_CHECK_ALLOC(record);
+
+	git_oid_cpy(&record->oid, &ref->target.oid);
+	git_oid_cpy(&record->peel, &peel);
+	return 0;
+}
+
+/* Whether a live reference other than `old_ref` is in `prefix` */
+static int stack_has_refs_in(
+	table_stack *stack, const char *prefix, const char *old_ref)
+{
+	git_reftable_merged merged;
+	const git_reftable_ref *ref;
+	int error;
+
+	if ((error = git_reftable_merged_init(&merged,
+			stack->tables, stack->count, 'r')) < 0)
+		return error;
+
+	if ((error = git_reftable_merged_seek(&merged, prefix, strlen(prefix))) == 0) {
+		while ((error = git_reftable_merged_next_ref(&ref, &merged)) == 0) {
+			if (git__prefixcmp(ref->name, prefix) != 0) {
+				error = GIT_ITEROVER;
+				break;
+			}
+
+			if (ref->type != GIT_REFTABLE_REF_DELETION &&
+				(!old_ref || strcmp(ref->name, old_ref))) {
+				error = 1;
+				break;
+			}
+		}
+	}
+
+	git_reftable_merged_free(&merged);
+
+	return (error == GIT_ITEROVER) ? 0 : error;
+}
+
+/*
+ * Check that the name is free, and that no reference is named like a
+ * directory of it or lives in its directory: the loose references that
+ * a repository may go back to are files.
+ */
+static int reference_path_available(
+	table_stack *stack,
+	const char *new_ref,
+	const char *old_ref,
+	int force)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const char *slash;
+	int error = 0;
+
+	if (!force) {
+		if ((error = stack_lookup(NULL, stack, new_ref)) == 0) {
+			giterr_set(GITERR_REFERENCE,
+				"Failed to write reference '%s': a reference with "
+				"that name already exists.", new_ref);
+			return GIT_EEXISTS;
+		}
+
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		giterr_clear();
+	}
+
+	for (slash = strchr(new_ref, '/'); slash; slash = strchr(slash + 1, '/')) {
+		if ((error = git_buf_set(&dir, new_ref, slash - new_ref)) < 0)
+			goto done;
+
+		if (old_ref && !strcmp(dir.ptr, old_ref))
+			continue;
+
+		if ((error = stack_lookup(NULL, stack, dir.ptr)) != GIT_ENOTFOUND) {
+			if (error == 0)
+				error = 1;
+			goto done;
+		}
+
+		giterr_clear();
+	}
+
+	git_buf_clear(&dir);
+
+	if ((error = git_buf_printf(&dir, "%s/", new_ref)) == 0)
+		error = stack_has_refs_in(stack, dir.ptr, old_ref);
+
+done:
+	git_buf_free(&dir);
+
+	if (error > 0) {
+		giterr_set(GITERR_REFERENCE,
+			"Path to reference '%s' collides with existing one", new_ref);
+		return -1;
+	}
+
+	return error;
+}
+
+static int pseudo_write(
+	refdb_table_backend *backend,
+	const git_reference *ref,
+	const git_signature *who,
+	const char *message)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	table_update update;
+	table_lock lock;
+	char oid[GIT_OID_HEXSZ + 1];
+	int error;
+
+	if ((error = pseudo_path(&path, backend, ref->name)) < 0 ||
+		(error = git_filebuf_open(&file, path.ptr,
+			GIT_FILEBUF_FORCE, GIT_REFS_FILE_MODE)) < 0)
+		goto done;
+
+	/* We need to perform the reflog append under the ref's lock */
+	if (ref->type == GIT_REF_OID) {
+		if ((error = stack_lock(&lock, backend)) < 0)
+			goto done;
+
+		if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+			(error = update_reflog_append(&update, backend,
+				lock.stack, ref, ref->name, who, message)) < 0)
+			stack_unlock(&lock);
+		else
+			error = stack_commit(backend, &lock, &update);
+
+		update_free(&update);
+
+		if (error < 0)
+			goto done;
+
+		git_oid_nfmt(oid, sizeof(oid), &ref->target.oid);
+		git_filebuf_printf(&file, "%s\n", oid);
+	} else {
+		git_filebuf_printf(&file, GIT_SYMREF "%s\n", ref->target.symbolic);
+	}
+
+	error = git_filebuf_commit(&file);
+
+done:
+	git_filebuf_cleanup(&file);
+	git_buf_free(&path);
+	return error;
+}
+
+static int refdb_table_backend__write(
+	git_refdb_backend *_backend,
+	const git_reference *ref,
+	int force,
+	const git_signature *who,
+	const char *message)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudo_ref(ref->name))
+		return pseudo_write(backend, ref, who, message);
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = reference_path_available(
+			lock.stack, ref->name, NULL, force)) < 0 ||
+		(error = update_reflog_append(&update, backend,
+			lock.stack, ref, ref->name, who, message)) < 0 ||
+		(error = update_add_ref(&update, backend, ref)) < 0)
+		stack_unlock(&lock);
+	else
+		error = stack_commit(backend, &lock, &update);
+
+	update_free(&update);
+	return error;
+}
+
+static int refdb_table_backend__delete(
+	git_refdb_backend *_backend,
+	const char *ref_name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_buf path = GIT_BUF_INIT;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend && ref_name);
+
+	if (is_pseudo_ref(ref_name)) {
+		if ((error = pseudo_path(&path, backend, ref_name)) == 0) {
+			if (!git_path_isfile(path.ptr))
+				error = ref_error_notfound(ref_name);
+			else
+				error = p_unlink(path.ptr);
+		}
+
+		git_buf_free(&path);
+		return error;
+	}
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = stack_lookup(NULL, lock.stack, ref_name)) < 0 ||
+		update_ref(&update, ref_name, GIT_REFTABLE_REF_DELETION) == NULL)
+		stack_unlock(&lock);
+	else
+		error = stack_commit(backend, &lock, &update);
+
+	update_free(&update);
+	return error < 0 ? error : 0;
+}
+
+static int refdb_table_backend__rename(
+	git_reference **out,
+	git_refdb_backend *_backend,
+	const char *old_name,
+	const char *new_name,
+	int force,
+	const git_signature *who,
+	const char *message)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_reference *old = NULL, *new = NULL;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudo_ref(old_name) || is_pseudo_ref(new_name)) {
+		giterr_set(GITERR_REFERENCE,
+			"Cannot rename '%s' to '%s' in a reference table",
+			old_name, new_name);
+		return -1;
+	}
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = stack_lookup(&old, lock.stack, old_name)) < 0 ||
+		(error = reference_path_available(
+			lock.stack, new_name, old_name, force)) < 0)
+		goto fail;
+
+	if ((new = git_reference__set_name(old, new_name)) == NULL) {
+		error = -1;
+		goto fail;
+	}
+	old = NULL;
+
+	/* The whole rename, with the reflog, is a single table */
+	if (update_ref(&update, old_name, GIT_REFTABLE_REF_DELETION) == NULL) {
+		error = -1;
+		goto fail;
+	}
+
+	if ((error = update_add_ref(&update, backend, new)) < 0 ||
+		(error = update_rename_log(&update,
+			lock.stack, old_name, new_name)) < 0 ||
+		(error = update_reflog_append(&update, backend,
+			lock.stack, new, old_name, who, message)) < 0)
+		goto fail;
+
+	if ((error = stack_commit(backend, &lock, &update)) < 0)
+		goto done;
+
+	if (out) {
+		*out = new;
+		new = NULL;
+	}
+	goto done;
+
+fail:
+	stack_unlock(&lock);
+
+done:
+	git_reference_free(old);
+	git_reference_free(new);
+	update_free(&update);
+	return error;
+}
+
+static int refdb_table_backend__compress(git_refdb_backend *_backend)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_stack *compacted = NULL;
+	table_lock lock;
+	int error;
+
+	assert(backend);
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if (lock.stack->count > 1 &&
+		(error = stack_compact(&compacted, backend, lock.stack, 0)) == 0) {
+		if ((error = stack_publish(backend, &lock, compacted)) < 0)
+			stack_unlink(backend, compacted, 0, 1);
+		else
+			stack_unlink(backend, lock.stack, 0, lock.stack->count);
+	}
+
+	stack_free(compacted);
+	stack_unlock(&lock);
+	return error;
+}
+
+/*
+ * All the updates of a transaction go to a single new table, which is
+ * published with the table list: the transaction is atomic for free.
+ */
+static int refdb_table_backend__transaction(
+	git_refdb_backend *_backend,
+	const git_refdb_update **updates,
+	size_t count)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_reference *current;
+	table_update update;
+	table_lock lock;
+	size_t i;
+	int error;
+
+	assert(backend && updates);
+
+	/* pseudo references are loose files, outside of the tables */
+	for (i = 0; i < count; ++i) {
+		if (is_pseudo_ref(updates[i]->name)) {
+			giterr_set(GITERR_REFERENCE,
+				"Cannot update '%s' in a transaction", updates[i]->name);
+			return -1;
+		}
+	}
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0)
+		goto fail;
+
+	for (i = 0; i < count; ++i) {
+		const git_refdb_update *u = updates[i];
+
+		error = stack_lookup(&current, lock.stack, u->name);
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			error = 0;
+		}
+
+		if (!error)
+			error = git_refdb_update_check(u, current);
+		git_reference_free(current);
+
+		if (error < 0)
+			goto fail;
+
+		if (!u->ref) {
+			if (update_ref(&update, u->name, GIT_REFTABLE_REF_DELETION) == NULL) {
+				error = -1;
+				goto fail;
+			}
+			continue;
+		}
+
+		if ((error = reference_path_available(
+				lock.stack, u->name, NULL, 1)) < 0 ||
+			(error = update_reflog_append(&update, backend,
+				lock.stack, u->ref, u->name, u->who, u->message)) < 0 ||
+			(error = update_add_ref(&update, backend, u->ref)) < 0)
+			goto fail;
+	}
+
+	error = stack_commit(backend, &lock, &update);
+	update_free(&update);
+	return error;
+
+fail:
+	stack_unlock(&lock);
+	update_free(&update);
+	return error;
+}
+
+static void refdb_table_backend__free(git_refdb_backend *_backend)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+
+	assert(backend);
+
+	stack_free(backend->stack);
+	git_mutex_free(&backend->lock);
+	git__free(backend->list_path);
+	git__free(backend->dir);
+	git__free(backend->path);
+	git__free(backend);
+}
+
+/*
+ * Reflogs
+ */
+
+static int reflog_alloc(git_reflog **reflog, const char *name)
+{
+	git_reflog *log;
+
+	*reflog = NULL;
+
+	log = git__calloc(1, sizeof(git_reflog));
+	GITERR_CHECK_ALLOC(log);
+
+	log->ref_name = git__strdup(name);
+	GITERR_CHECK_ALLOC(log->ref_name);
+
+	if (git_vector_init(&log->entries, 0, NULL) < 0) {
+		git__free(log->ref_name);
+		git__free(log);
+		return -1;
+	}
+
+	*reflog = log;
+
+	return 0;
+}
+
+static int reflog_read_cb(const git_reftable_log *log, void *payload)
+{
+	git_reflog *reflog = payload;
+	git_reflog_entry *entry;
+
+	if (log->type != GIT_REFTABLE_LOG_UPDATE)
+		return 0;
+
+	entry = git__calloc(1, sizeof(git_reflog_entry));
+	GITERR_CHECK_ALLOC(entry);
+
+	git_oid_cpy(&entry->oid_old, &log->old_id);
+	git_oid_cpy(&entry->oid_cur, &log->new_id);
+
+	if ((entry->committer = git__calloc(1, sizeof(git_signature))) == NULL ||
+		(entry->committer->name = git__strdup(log->who_name)) == NULL ||
+		(entry->committer->email = git__strdup(log->who_email)) == NULL ||
+		(*log->message &&
+		 (entry->msg = git__strdup(log->message)) == NULL) ||
+		git_vector_insert(&reflog->entries, entry) < 0) {
+		git_reflog_entry__free(entry);
+		return -1;
+	}
+
+	entry->committer->when.time = log->time;
+	entry->committer->when.offset = log->offset;
+	return 0;
+}
+
+static int refdb_table_reflog__read(
+	git_reflog **out, git_refdb_backend *_backend, const char *name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_stack *stack = NULL;
+	git_reflog *log = NULL;
+	size_t i, count;
+	int error;
+
+	assert(out && backend && name);
+
+	if ((error = reflog_alloc(&log, name)) < 0 ||
+		(error = stack_snapshot(&stack, backend)) < 0 ||
+		(error = stack_foreach_log(stack, name, reflog_read_cb, log)) < 0) {
+		git_reflog_free(log);
+		goto done;
+	}
+
+	/* the entries of a reflog go from the oldest to the newest */
+	count = log->entries.length;
+	for (i = 0; i < count / 2; i++) {
+		void *entry = log->entries.contents[i];
+		log->entries.contents[i] = log->entries.contents[count - 1 - i];
+		log->entries.contents[count - 1 - i] = entry;
+	}
+
+	*out = log;
+
+done:
+	stack_free(stack);
+	return error;
+}
+
+static int refdb_table_reflog__write(git_refdb_backend *_backend, git_reflog *reflog)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_reflog_entry *entry;
+	table_update update;
+	table_lock lock;
+	size_t i;
+	int error;
+
+	assert(backend && reflog);
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	/* the entries replace the log; each has an update index of its own */
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = update_delete_log(&update,
+			lock.stack, reflog->ref_name)) < 0)
+		goto fail;
+
+	git_vector_foreach(&reflog->entries, i, entry) {
+		if ((error = update_add_log_entry(&update, reflog->ref_name,
+				update.min_index + i, &entry->oid_old, &entry->oid_cur,
+				entry->committer, entry->msg)) < 0)
+			goto fail;
+	}
+
+	if (!reflog->entries.length && update_log(&update,
+			reflog->ref_name, 0, GIT_REFTABLE_LOG_EXISTS) == NULL) {
+		error = -1;
+		goto fail;
+	}
+
+	error = stack_commit(backend, &lock, &update);
+	update_free(&update);
+	return error;
+
+fail:
+	stack_unlock(&lock);
+	update_free(&update);
+	return error;
+}
+
+static int refdb_table_reflog__has_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_stack *stack;
+	int error;
+
+	assert(backend && name);
+
+	if (stack_snapshot(&stack, backend) < 0)
+		return -1;
+
+	error = stack_has_log(stack, name);
+	stack_free(stack);
+
+	return error;
+}
+
+static int refdb_table_reflog__ensure_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend && name);
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	/* an empty log is a marker that sorts after the entries */
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = stack_has_log(lock.stack, name)) != 0 ||
+		update_log(&update, name, 0, GIT_REFTABLE_LOG_EXISTS) == NULL)
+		stack_unlock(&lock);
+	else
+		error = stack_commit(backend, &lock, &update);
+
+	update_free(&update);
+	return error < 0 ? error : 0;
+}
+
+static int refdb_table_reflog__rename(
+	git_refdb_backend *_backend, const char *old_name, const char *new_name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	git_buf normalized = GIT_BUF_INIT;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend && old_name && new_name);
+
+	if ((error = git_reference__normalize_name(
+			&normalized, new_name, GIT_REF_FORMAT_ALLOW_ONELEVEL)) < 0)
+		return error;
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		goto done;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = stack_has_log(lock.stack, old_name)) <= 0 ||
+		(error = update_rename_log(&update,
+			lock.stack, old_name, normalized.ptr)) < 0) {
+		stack_unlock(&lock);
+		if (error == 0)
+			error = GIT_ENOTFOUND;
+	} else {
+		error = stack_commit(backend, &lock, &update);
+	}
+
+	update_free(&update);
+
+done:
+	git_buf_free(&normalized);
+	return error;
+}
+
+static int refdb_table_reflog__delete(git_refdb_backend *_backend, const char *name)
+{
+	refdb_table_backend *backend = (refdb_table_backend *)_backend;
+	table_update update;
+	table_lock lock;
+	int error;
+
+	assert(backend && name);
+
+	if ((error = stack_lock(&lock, backend)) < 0)
+		return error;
+
+	if ((error = update_init(&update, lock.stack->max_index + 1)) < 0 ||
+		(error = update_delete_log(&update, lock.stack, name)) < 0)
+		stack_unlock(&lock);
+	else
+		error = stack_commit(backend, &lock, &update);
+
+	update_free(&update);
+	return error;
+}
+
+int git_refdb_backend_table(
+	git_refdb_backend **backend_out,
+	git_repository *repository)
+{
+	refdb_table_backend *backend;
+	git_buf path = GIT_BUF_INIT;
+
+	if (repository->namespace != NULL) {
+		giterr_set(GITERR_REFERENCE,
+			"Namespaces are not supported with reference tables");
+		return -1;
+	}
+
+	if (repository->path_repository == NULL) {
+		giterr_set(GITERR_REFERENCE,
+			"Reference tables need a repository directory");
+		return -1;
+	}
+
+	backend = git__calloc(1, sizeof(refdb_table_backend));
+	GITERR_CHECK_ALLOC(backend);
+
+	backend->repo = repository;
+
+	if (git_mutex_init(&backend->lock)) {
+		giterr_set(GITERR_OS, "Failed to initialize reference table mutex");
+		git__free(backend);
+		return -1;
+	}
+
+	if ((backend->path = git__strdup(repository->path_repository)) == NULL ||
+		git_buf_joinpath(&path, backend->path, GIT_REFTABLE_DIR) < 0)
+		goto fail;
+
+	backend->dir = git_buf_detach(&path);
+
+	if (git_buf_joinpath(&path, backend->dir, GIT_REFTABLE_LIST_FILE) < 0)
+		goto fail;
+
+	backend->list_path = git_buf_detach(&path);
+
+	backend->parent.exists = &refdb_table_backend__exists;
+	backend->parent.lookup = &refdb_table_backend__lookup;
+	backend->parent.iterator = &refdb_table_backend__iterator;
+	backend->parent.write = &refdb_table_backend__write;
+	backend->parent.del = &refdb_table_backend__delete;
+	backend->parent.rename = &refdb_table_backend__rename;
+	backend->parent.compress = &refdb_table_backend__compress;
+	backend->parent.has_log = &refdb_table_reflog__has_log;
+	backend->parent.ensure_log = &refdb_table_reflog__ensure_log;
+	backend->parent.free = &refdb_table_backend__free;
+	backend->parent.reflog_read = &refdb_table_reflog__read;
+	backend->parent.reflog_write = &refdb_table_reflog__write;
+	backend->parent.reflog_rename = &refdb_table_reflog__rename;
+	backend->parent.reflog_delete = &refdb_table_reflog__delete;
+	backend->parent.transaction = &refdb_table_backend__transaction;
+
+	*backend_out = (git_refdb_backend *)backend;
+	return 0;
+
+fail:
+	git_mutex_free(&backend->lock);
+	git_buf_free(&path);
+	git__free(backend->dir);
+	git__free(backend->path);
+	git__free(backend);
+	return -1;
+}
@@ -0,0 +1,1250 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "reftable.h"
+#include "array.h"
+#include "compress.h"
+#include "fileops.h"
+
+#include <zlib.h>
+
+#define REFTABLE_MAGIC "REFT"
+#define REFTABLE_VERSION 1
+#define REFTABLE_HEADER_SIZE 24
+#define REFTABLE_FOOTER_SIZE 68
+
+#define REFTABLE_BLOCK_MAX ((1u << 24) - 1)
+
+static int reftable_corrupted(void)
+{
+	giterr_set(GITERR_REFERENCE, "Corrupted reference table");
+	return -1;
+}
+
+GIT_INLINE(uint16_t) get_be16(const unsigned char *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+GIT_INLINE(uint32_t) get_be24(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | get_be24(p + 1);
+}
+
+GIT_INLINE(uint64_t) get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+GIT_INLINE(void) put_be(unsigned char *p, uint64_t value, size_t bytes)
+{
+	while (bytes--) {
+		p[bytes] = (unsigned char)(value & 0xff);
+		value >>= 8;
+	}
+}
+
+/* The offset encoding of git: each continuation adds one before the
+ * shift, so that every value has a single encoding */
+static size_t varint_encode(unsigned char *out, uint64_t value)
+{
+	unsigned char varint[16];
+	size_t pos = sizeof(varint) - 1;
+
+	varint[pos] = value & 127;
+	while (value >>= 7)
+		varint[--pos] = 128 | (--value & 127);
+
+	memcpy(out, varint + pos, sizeof(varint) - pos);
+	return sizeof(varint) - pos;
+}
+
+static int varint_decode(
+	uint64_t *out, const unsigned char **buf, const unsigned char *end)
+{
+	const unsigned char *p = *buf;
+	uint64_t value;
+
+	if (p >= end)
+		return reftable_corrupted();
+
+	value = *p & 127;
+	while (*p++ & 128) {
+		if (p >= end || value + 1 > (UINT64_MAX >> 7))
+			return reftable_corrupted();
+		value = ((value + 1) << 7) | (*p & 127);
+	}
+
+	*out = value;
+	*buf = p;
+	return 0;
+}
+
+static int buf_put_varint(git_buf *buf, uint64_t value)
+{
+	unsigned char varint[16];
+	return git_buf_put(buf, (char *)varint, varint_encode(varint, value));
+}
+
+static int buf_put_be(git_buf *buf, uint64_t value, size_t bytes)
+{
+	unsigned char be[8];
+	put_be(be, value, bytes);
+	return git_buf_put(buf, (char *)be, bytes);
+}
+
+static int buf_put_string(git_buf *buf, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	if (buf_put_varint(buf, len) < 0)
+		return -1;
+
+	return len ? git_buf_put(buf, str, len) : 0;
+}
+
+static int key_cmp(const git_buf *a, const char *b, size_t b_len)
+{
+	size_t len = a->size < b_len ? a->size : b_len;
+	int cmp = len ? memcmp(a->ptr, b, len) : 0;
+
+	if (cmp)
+		return cmp;
+
+	return (a->size < b_len) ? -1 : (a->size > b_len);
+}
+
+int git_reftable_log_key(git_buf *key, const char *name, uint64_t update_index)
+{
+	git_buf_clear(key);
+	git_buf_puts(key, name);
+	git_buf_putc(key, '\0');
+	buf_put_be(key, UINT64_MAX - update_index, 8);
+
+	return git_buf_oom(key) ? -1 : 0;
+}
+
+/*
+ * Tables
+ */
+
+static int reftable_parse(git_reftable *table)
+{
+	const unsigned char *data = table->data, *footer;
+	size_t footer_off;
+	uint64_t ref_index, log_start, log_index;
+
+	if (table->size < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE ||
+		memcmp(data, REFTABLE_MAGIC, 4) != 0 ||
+		data[4] != REFTABLE_VERSION)
+		return reftable_corrupted();
+
+	footer_off = table->size - REFTABLE_FOOTER_SIZE;
+	footer = data + footer_off;
+
+	if (memcmp(footer, data, REFTABLE_HEADER_SIZE) != 0 ||
+		crc32(0, footer, REFTABLE_FOOTER_SIZE - 4) !=
+		get_be32(footer + REFTABLE_FOOTER_SIZE - 4))
+		return reftable_corrupted();
+
+	table->block_size = get_be24(data + 5);
+	table->min_index = get_be64(data + 8);
+	table->max_index = get_be64(data + 16);
+
+	ref_index = get_be64(footer + 24);
+	log_start = get_be64(footer + 48);
+	log_index = get_be64(footer + 56);
+
+	if (table->block_size == 0 ||
+		table->min_index > table->max_index ||
+		ref_index >= footer_off || log_start >= footer_off ||
+		log_index >= footer_off ||
+		(ref_index && ref_index < REFTABLE_HEADER_SIZE) ||
+		(log_start && log_start < REFTABLE_HEADER_SIZE) ||
+		(log_index && log_index <= log_start))
+		return reftable_corrupted();
+
+	table->ref_index = (size_t)ref_index;
+	table->log_start = (size_t)log_start;
+	table->log_index = (size_t)log_index;
+
+	table->ref_end = ref_index ? (size_t)ref_index :
+		log_start ? (size_t)log_start : footer_off;
+	table->log_end = log_index ? (size_t)log_index : footer_off;
+
+	return 0;
+}
+
+int git_reftable_open(git_reftable **out, const char *path, const char *name)
+{
+	git_reftable *table;
+	git_file fd;
+	git_off_t len;
+	int error;
+
+	*out = NULL;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	table = git__calloc(1, sizeof(git_reftable));
+	GITERR_CHECK_ALLOC(table);
+
+	table->name = git__strdup(name);
+	GITERR_CHECK_ALLOC(table->name);
+
+	len = git_futils_filesize(fd);
+
+	if (!git__is_sizet(len)) {
+		giterr_set(GITERR_OS, "File `%s` too large to mmap", path);
+		error = -1;
+	} else if (len < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE) {
+		error = reftable_corrupted();
+	} else {
+#ifdef GIT_WIN32
+		if (!(error = git_futils_readbuffer_fd(&table->buf, fd, (size_t)len)))
+			table->data = (const unsigned char *)table->buf.ptr;
+#else
+		if (!(error = git_futils_mmap_ro(&table->map, fd, 0, (size_t)len)))
+			table->data = table->map.data;
+#endif
+	}
+
+	p_close(fd);
+
+	table->size = (size_t)len;
+
+	if (!error)
+		error = reftable_parse(table);
+
+	if (error < 0) {
+		git_reftable_free(table);
+		return error;
+	}
+
+	table->refcount.val = 1;
+
+	*out = table;
+	return 0;
+}
+
+void git_reftable_free(git_reftable *table)
+{
+	if (!table || git_atomic_dec(&table->refcount) > 0)
+		return;
+
+#ifdef GIT_WIN32
+	git_buf_free(&table->buf);
+#else
+	if (table->data)
+		git_futils_mmap_free(&table->map);
+#endif
+	git__free(table->name);
+	git__free(table);
+}
+
+/*
+ * Reading blocks
+ */
+
+void git_reftable_iter_init(
+	git_reftable_iter *iter, const git_reftable *table, char section)
+{
+	memset(iter, 0, sizeof(*iter));
+
+	iter->table = table;
+	iter->section = section;
+
+	git_buf_init(&iter->inflated, 0);
+	git_buf_init(&iter->key, 0);
+	git_buf_init(&iter->value, 0);
+}
+
+void git_reftable_iter_free(git_reftable_iter *iter)
+{
+	git_buf_free(&iter->inflated);
+	git_buf_free(&iter->key);
+	git_buf_free(&iter->value);
+}
+
+/* The first block of the section and the offset where it ends */
+static void iter_section(size_t *start, size_t *end, git_reftable_iter *iter)
+{
+	const git_reftable *table = iter->table;
+
+	if (iter->section == 'g') {
+		*start = table->log_start;
+		*end = table->log_start ? table->log_end : 0;
+	} else {
+		*start = 0;
+		*end = table->ref_end;
+	}
+}
+
+static int block_inflate(
+	git_buf *out,
+	size_t *consumed,
+	const unsigned char *in,
+	size_t in_len,
+	size_t out_len)
+{
+	z_stream zs;
+	int status;
+
+	git_buf_clear(out);
+	if (git_buf_grow(out, out_len + 1) < 0)
+		return -1;
+
+	/* keep the block header in front, for the restart offsets */
+	memcpy(out->ptr, in, 4);
+
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit(&zs) != Z_OK) {
+		giterr_set(GITERR_ZLIB, "Failed to inflate reference table");
+		return -1;
+	}
+
+	zs.next_in = (Bytef *)in + 4;
+	zs.avail_in = (uInt)min(in_len - 4, UINT_MAX);
+	zs.next_out = (Bytef *)out->ptr + 4;
+	zs.avail_out = (uInt)(out_len - 4);
+
+	status = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+
+	if (status != Z_STREAM_END || zs.total_out != out_len - 4)
+		return reftable_corrupted();
+
+	out->size = out_len;
+	out->ptr[out_len] = '\0';
+	*consumed = 4 + zs.total_in;
+	return 0;
+}
+
+/* Load the block of type `type` at `off` that must end before `limit` */
+static int iter_load_block(
+	git_reftable_iter *iter, size_t off, size_t limit, char type)
+{
+	const git_reftable *table = iter->table;
+	const unsigned char *block = table->data + off;
+	size_t header = off ? 0 : REFTABLE_HEADER_SIZE, len, count, next = 0;
+
+	if (off + header + 4 > limit || block[header] != type)
+		return reftable_corrupted();
+
+	len = get_be24(block + header + 1);
+
+	if (type == 'g') {
+		if (header || len < 6 ||
+			block_inflate(&iter->inflated, &next, block, limit - off, len) < 0)
+			return reftable_corrupted();
+
+		block = (const unsigned char *)iter->inflated.ptr;
+		next += off;
+	} else {
+		if (len < header + 6 || len > limit - off)
+			return reftable_corrupted();
+
+		next = (type == 'r') ? off + table->block_size : limit;
+	}
+
+	count = get_be16(block + len - 2);
+	if (header + 4 + 3 * count + 2 > len)
+		return reftable_corrupted();
+
+	iter->block_off = off;
+	iter->next_off = next;
+	iter->block = block;
+	iter->records = block + header + 4;
+	iter->restarts = block + len - 2 - 3 * count;
+	iter->restart_count = count;
+	iter->pos = iter->records;
+	iter->end = iter->restarts;
+
+	git_buf_clear(&iter->key);
+	return 0;
+}
+
+static int iter_decode_key(git_reftable_iter *iter)
+{
+	uint64_t prefix, suffix;
+
+	if (varint_decode(&prefix, &iter->pos, iter->end) < 0 ||
+		varint_decode(&suffix, &iter->pos, iter->end) < 0)
+		return -1;
+
+	iter->type = (int)(suffix & 7);
+	suffix >>= 3;
+
+	if (prefix > iter->key.size || suffix > (size_t)(iter->end - iter->pos))
+		return reftable_corrupted();
+
+	git_buf_truncate(&iter->key, (size_t)prefix);
+	if (git_buf_put(&iter->key, (const char *)iter->pos, (size_t)suffix) < 0)
+		return -1;
+
+	iter->pos += suffix;
+	return 0;
+}
+
+static int iter_decode_oid(git_oid *oid, git_reftable_iter *iter)
+{
+	if (iter->end - iter->pos < GIT_OID_RAWSZ)
+		return reftable_corrupted();
+
+	git_oid_fromraw(oid, iter->pos);
+	iter->pos += GIT_OID_RAWSZ;
+	return 0;
+}
+
+/* Append a string of the record to the value buffer, NUL terminated */
+static int iter_decode_string(size_t *out, git_reftable_iter *iter)
+{
+	uint64_t len;
+
+	if (varint_decode(&len, &iter->pos, iter->end) < 0)
+		return -1;
+
+	if (len > (size_t)(iter->end - iter->pos))
+		return reftable_corrupted();
+
+	*out = iter->value.size;
+
+	if (git_buf_put(&iter->value, (const char *)iter->pos, (size_t)len) < 0 ||
+		git_buf_putc(&iter->value, '\0') < 0)
+		return -1;
+
+	iter->pos += len;
+	return 0;
+}
+
+static int iter_decode_ref(git_reftable_iter *iter)
+{
+	git_reftable_ref *ref = &iter->ref;
+	uint64_t delta;
+	size_t target;
+
+	memset(ref, 0, sizeof(*ref));
+
+	if (varint_decode(&delta, &iter->pos, iter->end) < 0)
+		return -1;
+
+	ref->name = iter->key.ptr;
+	ref->update_index = iter->table->min_index + delta;
+	ref->type = iter->type;
+
+	switch (iter->type) {
+	case GIT_REFTABLE_REF_DELETION:
+		return 0;
+	case GIT_REFTABLE_REF_VAL1:
+		return iter_decode_oid(&ref->oid, iter);
+	case GIT_REFTABLE_REF_VAL2:
+		if (iter_decode_oid(&ref->oid, iter) < 0)
+			return -1;
+		return iter_decode_oid(&ref->peel, iter);
+	case GIT_REFTABLE_REF_SYMREF:
+		git_buf_clear(&iter->value);
+		if (iter_decode_string(&target, iter) < 0)
+			return -1;
+		ref->target = iter->value.ptr + target;
+		return 0;
+	default:
+		return reftable_corrupted();
+	}
+}
+
+static int iter_decode_log(git_reftable_iter *iter)
+{
+	git_reftable_log *log = &iter->log;
+	size_t name, email, message;
+	uint64_t time;
+	uint16_t offset;
+
+	memset(log, 0, sizeof(*log));
+
+	if (iter->key.size < 9 || iter->key.ptr[iter->key.size - 9] != '\0')
+		return reftable_corrupted();
+
+	log->name = iter->key.ptr;
+	log->update_index = UINT64_MAX -
+		get_be64((const unsigned char *)iter->key.ptr + iter->key.size - 8);
+	log->type = iter->type;
+
+	if (iter->type == GIT_REFTABLE_LOG_DELETION ||
+		iter->type == GIT_REFTABLE_LOG_EXISTS)
+		return 0;
+
+	if (iter->type != GIT_REFTABLE_LOG_UPDATE)
+		return reftable_corrupted();
+
+	git_buf_clear(&iter->value);
+
+	if (iter_decode_oid(&log->old_id, iter) < 0 ||
+		iter_decode_oid(&log->new_id, iter) < 0 ||
+		iter_decode_string(&name, iter) < 0 ||
+		iter_decode_string(&email, iter) < 0 ||
+		varint_decode(&time, &iter->pos, iter->end) < 0)
+		return -1;
+
+	if (iter->end - iter->pos < 2)
+		return reftable_corrupted();
+
+	offset = get_be16(iter->pos);
+	iter->pos += 2;
+
+	if (iter_decode_string(&message, iter) < 0)
+		return -1;
+
+	log->who_name = iter->value.ptr + name;
+	log->who_email = iter->value.ptr + email;
+	log->time = (git_time_t)time;
+	log->offset = (int16_t)offset;
+	log->message = iter->value.ptr + message;
+	return 0;
+}
+
+static int iter_decode(git_reftable_iter *iter)
+{
+	if (iter_decode_key(iter) < 0)
+		return -1;
+
+	switch (iter->section) {
+	case 'r':
+		return iter_decode_ref(iter);
+	case 'g':
+		return iter_decode_log(iter);
+	default:
+		return varint_decode(&iter->child, &iter->pos, iter->end);
+	}
+}
+
+/* Decode the next record, moving to the next block of the section at
+ * the end of a block */
+static int iter_next(git_reftable_iter *iter)
+{
+	size_t start, end;
+	int error;
+
+	if (iter->pending) {
+		iter->pending = 0;
+		return 0;
+	}
+
+	while (!iter->done && (!iter->block || iter->pos >= iter->end)) {
+		iter_section(&start, &end, iter);
+
+		if (iter->block)
+			start = iter->next_off;
+
+		if (start + (start ? 0 : REFTABLE_HEADER_SIZE) >= end) {
+			iter->done = 1;
+			break;
+		}
+
+		if ((error = iter_load_block(iter, start, end, iter->section)) < 0)
+			return error;
+	}
+
+	if (iter->done)
+		return GIT_ITEROVER;
+
+	return iter_decode(iter);
+}
+
+/* Position the iterator on the first record of its block whose key is
+ * not smaller than `key`, or at the end of the block */
+static int block_seek(git_reftable_iter *iter, const char *key, size_t key_len)
+{
+	size_t lo = 0, hi = iter->restart_count, mid, off;
+	int error;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		off = get_be24(iter->restarts + 3 * mid);
+
+		if (iter->block + off < iter->records || iter->block + off >= iter->end)
+			return reftable_corrupted();
+
+		iter->pos = iter->block + off;
+		git_buf_clear(&iter->key);
+
+		if ((error = iter_decode_key(iter)) < 0)
+			return error;
+
+		if (key_cmp(&iter->key, key, key_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	iter->pos = lo ? iter->block + get_be24(iter->restarts + 3 * (lo - 1)) :
+		iter->records;
+	git_buf_clear(&iter->key);
+
+	while (iter->pos < iter->end) {
+		if ((error = iter_decode(iter)) < 0)
+			return error;
+
+		if (key_cmp(&iter->key, key, key_len) >= 0) {
+			iter->pending = 1;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Find the block that holds `key` with the index of the section */
+static int index_lookup(
+	size_t *out, git_reftable_iter *iter, const char *key, size_t key_len)
+{
+	git_reftable_iter index;
+	size_t index_off, start, end;
+	int error;
+
+	iter_section(&start, &end, iter);
+	index_off = (iter->section == 'g') ?
+		iter->table->log_index : iter->table->ref_index;
+
+	git_reftable_iter_init(&index, iter->table, 'i');
+
+	if ((error = iter_load_block(&index, index_off,
+			iter->table->size - REFTABLE_FOOTER_SIZE, 'i')) < 0 ||
+		(error = block_seek(&index, key, key_len)) < 0)
+		goto done;
+
+	if (!index.pending)
+		error = GIT_ENOTFOUND;
+	else if (index.child < start || index.child >= end)
+		error = reftable_corrupted();
+	else
+		*out = (size_t)index.child;
+
+done:
+	git_reftable_iter_free(&index);
+	return error;
+}
+
+int git_reftable_iter_seek(
+	git_reftable_iter *iter, const char *key, size_t key_len)
+{
+	size_t start, end;
+	int error;
+
+	iter->block = NULL;
+	iter->pending = 0;
+	iter->done = 0;
+
+	iter_section(&start, &end, iter);
+
+	if (start + (start ? 0 : REFTABLE_HEADER_SIZE) >= end) {
+		iter->done = 1;
+		return 0;
+	}
+
+	if ((iter->section == 'g' ? iter->table->log_index :
+			iter->table->ref_index) != 0 &&
+		(error = index_lookup(&start, iter, key, key_len)) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			iter->done = 1;
+			error = 0;
+		}
+		return error;
+	}
+
+	if ((error = iter_load_block(iter, start, end, iter->section)) < 0)
+		return error;
+
+	return block_seek(iter, key, key_len);
+}
+
+int git_reftable_iter_next_ref(
+	const git_reftable_ref **out, git_reftable_iter *iter)
+{
+	int error;
+
+	assert(iter->section == 'r');
+
+	if ((error = iter_next(iter)) == 0)
+		*out = &iter->ref;
+
+	return error;
+}
+
+int git_reftable_iter_next_log(
+	const git_reftable_log **out, git_reftable_iter *iter)
+{
+	int error;
+
+	assert(iter->section == 'g');
+
+	if ((error = iter_next(iter)) == 0)
+		*out = &iter->log;
+
+	return error;
+}
+
+/*
+ * Merging the tables of a stack
+ */
+
+enum {
+	MERGED_ADVANCE = 0,
+	MERGED_READY,
+	MERGED_DONE,
+};
+
+int git_reftable_merged_init(
+	git_reftable_merged *merged,
+	git_reftable **tables,
+	size_t count,
+	char section)
+{
+	size_t i;
+
+	memset(merged, 0, sizeof(*merged));
+
+	if (!count)
+		return 0;
+
+	merged->iters = git__calloc(count, sizeof(git_reftable_iter));
+	GITERR_CHECK_ALLOC(merged->iters);
+
+	merged->state = git__calloc(count, sizeof(int));
+	GITERR_CHECK_ALLOC(merged->state);
+
+	for (i = 0; i < count; i++)
+		git_reftable_iter_init(&merged->iters[i], tables[i], section);
+
+	merged->count = count;
+	merged->section = section;
+	return 0;
+}
+
+void git_reftable_merged_free(git_reftable_merged *merged)
+{
+	size_t i;
+
+	for (i = 0; i < merged->count; i++)
+		git_reftable_iter_free(&merged->iters[i]);
+
+	git__free(merged->iters);
+	git__free(merged->state);
+	memset(merged, 0, sizeof(*merged));
+}
+
+int git_reftable_merged_seek(
+	git_reftable_merged *merged, const char *key, size_t key_len)
+{
+	size_t i;
+	int error;
+
+	for (i = 0; i < merged->count; i++) {
+		if ((error = git_reftable_iter_seek(&merged->iters[i], key, key_len)) < 0)
+			return error;
+
+		merged->state[i] = MERGED_ADVANCE;
+	}
+
+	return 0;
+}
+
+/* The iterator of the newest record with the smallest key. The records
+ * with that key are consumed, but stay valid until the next call. */
+static int merged_next(git_reftable_iter **out, git_reftable_merged *merged)
+{
+	git_reftable_iter *best = NULL;
+	size_t i;
+	int error;
+
+	for (i = 0; i < merged->count; i++) {
+		if (merged->state[i] != MERGED_ADVANCE)
+			continue;
+
+		error = iter_next(&merged->iters[i]);
+
+		if (error == GIT_ITEROVER)
+			merged->state[i] = MERGED_DONE;
+		else if (error < 0)
+			return error;
+		else
+			merged->state[i] = MERGED_READY;
+	}
+
+	for (i = 0; i < merged->count; i++) {
+		git_reftable_iter *iter = &merged->iters[i];
+
+		if (merged->state[i] == MERGED_READY && (!best ||
+			key_cmp(&iter->key, best->key.ptr, best->key.size) <= 0))
+			best = iter;
+	}
+
+	if (!best)
+		return GIT_ITEROVER;
+
+	for (i = 0; i < merged->count; i++) {
+		git_reftable_iter *iter = &merged->iters[i];
+
+		if (merged->state[i] == MERGED_READY &&
+			!key_cmp(&iter->key, best->key.ptr, best->key.size))
+			merged->state[i] = MERGED_ADVANCE;
+	}
+
+	*out = best;
+	return 0;
+}
+
+int git_reftable_merged_next_ref(
+	const git_reftable_ref **out, git_reftable_merged *merged)
+{
+	git_reftable_iter *iter;
+	int error;
+
+	assert(merged->section == 'r' || !merged->count);
+
+	if ((error = merged_next(&iter, merged)) == 0)
+		*out = &iter->ref;
+
+	return error;
+}
+
+int git_reftable_merged_next_log(
+	const git_reftable_log **out, git_reftable_merged *merged)
+{
+	git_reftable_iter *iter;
+	int error;
+
+	assert(merged->section == 'g' || !merged->count);
+
+	if ((error = merged_next(&iter, merged)) == 0)
+		*out = &iter->log;
+
+	return error;
+}
+
+/*
+ * Writing tables
+ */
+
+typedef struct {
+	git_buf buf;
+	size_t header;
+	git_array_t(uint32_t) restarts;
+	git_buf last_key;
+	size_t entries;
+} block_writer;
+
+struct git_reftable_writer {
+	git_filebuf *file;
+	size_t offset;
+	uint64_t min_index;
+	uint64_t max_index;
+	unsigned char header[REFTABLE_HEADER_SIZE];
+
+	char section;
+	block_writer block;
+	block_writer index;
+	size_t blocks;
+	size_t padding;
+	git_buf last_key;
+	git_buf record;
+	git_buf index_record;
+	git_buf deflated;
+
+	size_t ref_index;
+	size_t log_start;
+	size_t log_index;
+};
+
+static int block_writer_start(
+	block_writer *block, char type, const unsigned char *header, size_t len)
+{
+	git_buf_clear(&block->buf);
+	git_buf_clear(&block->last_key);
+	git_array_clear(block->restarts);
+	block->entries = 0;
+	block->header = len;
+
+	if (len > 0)
+		git_buf_put(&block->buf, (const char *)header, len);
+	git_buf_putc(&block->buf, type);
+	git_buf_put(&block->buf, "\0\0\0", 3);
+
+	return git_buf_oom(&block->buf) ? -1 : 0;
+}
+
+static void block_writer_free(block_writer *block)
+{
+	git_buf_free(&block->buf);
+	git_buf_free(&block->last_key);
+	git_array_clear(block->restarts);
+}
+
+static size_t common_prefix(const git_buf *a, const char *b, size_t b_len)
+{
+	size_t i, len = a->size < b_len ? a->size : b_len;
+
+	for (i = 0; i < len && a->ptr[i] == b[i]; i++)
+		/* nop */;
+
+	return i;
+}
+
+/*
+ * Add a record to the block. Returns 1 without adding it when the
+ * block, with its restart points, would grow past `limit`.
+ */
+static int block_writer_add(
+	block_writer *block,
+	const char *key,
+	size_t key_len,
+	int type,
+	const git_buf *value,
+	size_t limit)
+{
+	unsigned char prefix_varint[16], suffix_varint[16];
+	size_t prefix = 0, prefix_len, suffix_len, size, restarts;
+	int restart = (block->entries % GIT_REFTABLE_RESTART_INTERVAL) == 0;
+	uint32_t *offset;
+
+	if (!restart)
+		prefix = common_prefix(&block->last_key, key, key_len);
+
+	prefix_len = varint_encode(prefix_varint, prefix);
+	suffix_len = varint_encode(suffix_varint,
+		((uint64_t)(key_len - prefix) << 3) | (uint64_t)type);
+
+	size = prefix_len + suffix_len + key_len - prefix + value->size;
+	restarts = block->restarts.size + restart;
+
+	if (limit && block->buf.size + size + 3 * restarts + 2 > limit) {
+		if (block->entries)
+			return 1;
+
+		giterr_set(GITERR_REFERENCE,
+			"Record '%s' is too large for a reference table block", key);
+		return -1;
+	}
+
+	if (restart) {
+		if (block->buf.size > REFTABLE_BLOCK_MAX || restarts > UINT16_MAX) {
+			giterr_set(GITERR_REFERENCE, "Reference table block too large");
+			return -1;
+		}
+
+		offset = git_array_alloc(block->restarts);
+		GITERR_CHECK_ALLOC(offset);
+		*offset = (uint32_t)block->buf.size;
+	}
+
+	git_buf_put(&block->buf, (char *)prefix_varint, prefix_len);
+	git_buf_put(&block->buf, (char *)suffix_varint, suffix_len);
+	git_buf_put(&block->buf, key + prefix, key_len - prefix);
+	git_buf_put(&block->buf, value->ptr, value->size);
+	git_buf_set(&block->last_key, key, key_len);
+
+	if (git_buf_oom(&block->buf) || git_buf_oom(&block->last_key))
+		return -1;
+
+	block->entries++;
+	return 0;
+}
+
+/* Append the restart points and fill in the length of the block */
+static int block_writer_finish(block_writer *block)
+{
+	uint32_t i;
+
+	for (i = 0; i < block->restarts.size; i++)
+		buf_put_be(&block->buf, block->restarts.ptr[i], 3);
+	buf_put_be(&block->buf, block->restarts.size, 2);
+
+	if (git_buf_oom(&block->buf))
+		return -1;
+
+	if (block->buf.size > REFTABLE_BLOCK_MAX) {
+		giterr_set(GITERR_REFERENCE, "Reference table block too large");
+		return -1;
+	}
+
+	put_be((unsigned char *)block->buf.ptr + block->header + 1,
+		block->buf.size, 3);
+	return 0;
+}
+
+static int writer_write(git_reftable_writer *writer, const void *data, size_t len)
+{
+	if (git_filebuf_write(writer->file, data, len) < 0)
+		return -1;
+
+	writer->offset += len;
+	return 0;
+}
+
+static int writer_flush_block(git_reftable_writer *writer)
+{
+	block_writer *block = &writer->block;
+	static const char zeros[GIT_REFTABLE_BLOCK_SIZE];
+	size_t block_off;
+	int error;
+
+	if (!block->entries)
+		return 0;
+
+	/* pad the previous ref block, now that this one follows it */
+	if (writer->padding &&
+		(error = writer_write(writer, zeros, writer->padding)) < 0)
+		return error;
+
+	writer->padding = 0;
+	block_off = writer->offset;
+
+	if ((error = block_writer_finish(block)) < 0)
+		return error;
+
+	git_buf_clear(&writer->deflated);
+
+	if (writer->section == 'r') {
+		error = writer_write(writer, block->buf.ptr, block->buf.size);
+		writer->padding = GIT_REFTABLE_BLOCK_SIZE - block->buf.size;
+	} else if ((error = git__compress(&writer->deflated,
+			block->buf.ptr + 4, block->buf.size - 4)) == 0 &&
+		(error = writer_write(writer, block->buf.ptr, 4)) == 0) {
+		error = writer_write(writer,
+			writer->deflated.ptr, writer->deflated.size);
+	}
+
+	if (error < 0)
+		return error;
+
+	/* index the block by its last key; the record of the caller may
+	 * still be waiting for the next block */
+	git_buf_clear(&writer->index_record);
+	if (buf_put_varint(&writer->index_record, block_off) < 0 ||
+		(error = block_writer_add(&writer->index, block->last_key.ptr,
+			block->last_key.size, 0, &writer->index_record, 0)) < 0)
+		return -1;
+
+	writer->blocks++;
+
+	return block_writer_start(block, writer->section, NULL, 0);
+}
+
+static int writer_add(
+	git_reftable_writer *writer, const char *key, size_t key_len, int type)
+{
+	int error;
+
+	if (writer->last_key.size &&
+		key_cmp(&writer->last_key, key, key_len) >= 0) {
+		giterr_set(GITERR_REFERENCE,
+			"Reference table records out of order at '%s'", key);
+		return -1;
+	}
+
+	if (git_buf_set(&writer->last_key, key, key_len) < 0)
+		return -1;
+
+	error = block_writer_add(&writer->block,
+		key, key_len, type, &writer->record, GIT_REFTABLE_BLOCK_SIZE);
+
+	if (error == 1 && (error = writer_flush_block(writer)) == 0)
+		error = block_writer_add(&writer->block,
+			key, key_len, type, &writer->record, GIT_REFTABLE_BLOCK_SIZE);
+
+	return error;
+}
+
+/* Write the last block of the section and its index */
+static int writer_end_section(git_reftable_writer *writer, size_t *index_off)
+{
+	int error;
+
+	if ((error = writer_flush_block(writer)) < 0)
+		return error;
+
+	writer->padding = 0;
+
+	/* no ref block carried the header */
+	if (writer->offset == 0 &&
+		(error = writer_write(writer, writer->header, REFTABLE_HEADER_SIZE)) < 0)
+		return error;
+
+	if (writer->blocks > 1) {
+		*index_off = writer->offset;
+
+		if ((error = block_writer_finish(&writer->index)) < 0 ||
+			(error = writer_write(writer,
+				writer->index.buf.ptr, writer->index.buf.size)) < 0)
+			return error;
+	}
+
+	writer->blocks = 0;
+	return block_writer_start(&writer->index, 'i', NULL, 0);
+}
+
+int git_reftable_writer_new(
+	git_reftable_writer **out,
+	git_filebuf *file,
+	uint64_t min_index,
+	uint64_t max_index)
+{
+	git_reftable_writer *writer;
+
+	assert(out && file && min_index <= max_index);
+
+	writer = git__calloc(1, sizeof(git_reftable_writer));
+	GITERR_CHECK_ALLOC(writer);
+
+	writer->file = file;
+	writer->min_index = min_index;
+	writer->max_index = max_index;
+	writer->section = 'r';
+
+	memcpy(writer->header, REFTABLE_MAGIC, 4);
+	writer->header[4] = REFTABLE_VERSION;
+	put_be(writer->header + 5, GIT_REFTABLE_BLOCK_SIZE, 3);
+	put_be(writer->header + 8, min_index, 8);
+	put_be(writer->header + 16, max_index, 8);
+
+	if (block_writer_start(&writer->block, 'r',
+			writer->header, REFTABLE_HEADER_SIZE) < 0 ||
+		block_writer_start(&writer->index, 'i', NULL, 0) < 0) {
+		git_reftable_writer_free(writer);
+		return -1;
+	}
+
+	*out = writer;
+	return 0;
+}
+
+int git_reftable_writer_add_ref(
+	git_reftable_writer *writer, const git_reftable_ref *ref)
+{
+	git_buf *value = &writer->record;
+
+	if (writer->section != 'r') {
+		giterr_set(GITERR_REFERENCE,
+			"References must be written before logs in a reference table");
+		return -1;
+	}
+
+	if (ref->update_index < writer->min_index ||
+		ref->update_index > writer->max_index) {
+		giterr_set(GITERR_REFERENCE,
+			"Update index of '%s' out of the range of the table", ref->name);
+		return -1;
+	}
+
+	git_buf_clear(value);
+	buf_put_varint(value, ref->update_index - writer->min_index);
+
+	switch (ref->type) {
+	case GIT_REFTABLE_REF_DELETION:
+		break;
+	case GIT_REFTABLE_REF_VAL2:
+		git_buf_put(value, (const char *)ref->oid.id, GIT_OID_RAWSZ);
+		git_buf_put(value, (const char *)ref->peel.id, GIT_OID_RAWSZ);
+		break;
+	case GIT_REFTABLE_REF_VAL1:
+		git_buf_put(value, (const char *)ref->oid.id, GIT_OID_RAWSZ);
+		break;
+	case GIT_REFTABLE_REF_SYMREF:
+		buf_put_string(value, ref->target);
+		break;
+	default:
+		assert(0);
+	}
+
+	if (git_buf_oom(value))
+		return -1;
+
+	return writer_add(writer, ref->name, strlen(ref->name), ref->type);
+}
+
+int git_reftable_writer_add_log(
+	git_reftable_writer *writer, const git_reftable_log *log)
+{
+	git_buf key = GIT_BUF_INIT, *value = &writer->record;
+	int error;
+
+	if (writer->section == 'r') {
+		if ((error = writer_end_section(writer, &writer->ref_index)) < 0)
+			return error;
+
+		writer->section = 'g';
+		writer->log_start = writer->offset;
+
+		git_buf_clear(&writer->last_key);
+		if ((error = block_writer_start(&writer->block, 'g', NULL, 0)) < 0)
+			return error;
+	}
+
+	assert(writer->section == 'g');
+
+	git_buf_clear(value);
+
+	if (log->type == GIT_REFTABLE_LOG_UPDATE) {
+		git_buf_put(value, (const char *)log->old_id.id, GIT_OID_RAWSZ);
+		git_buf_put(value, (const char *)log->new_id.id, GIT_OID_RAWSZ);
+		buf_put_string(value, log->who_name);
+		buf_put_string(value, log->who_email);
+		buf_put_varint(value, (uint64_t)log->time);
+		buf_put_be(value, (uint16_t)log->offset, 2);
+		buf_put_string(value, log->message);
+	}
+
+	if (git_buf_oom(value) ||
+		git_reftable_log_key(&key, log->name, log->update_index) < 0)
+		return -1;
+
+	error = writer_add(writer, key.ptr, key.size, log->type);
+
+	git_buf_free(&key);
+	return error;
+}
+
+int git_reftable_writer_finish(git_reftable_writer *writer)
+{
+	unsigned char footer[REFTABLE_FOOTER_SIZE];
+	int error;
+
+	assert(writer->section);
+
+	if ((error = writer_end_section(writer, writer->section == 'r' ?
+			&writer->ref_index : &writer->log_index)) < 0)
+		return error;
+
+	memset(footer, 0, sizeof(footer));
+	memcpy(footer, writer->header, REFTABLE_HEADER_SIZE);
+	put_be(footer + 24, writer->ref_index, 8);
+	put_be(footer + 48, writer->log_start, 8);
+	put_be(footer + 56, writer->log_index, 8);
+	put_be(footer + 64, crc32(0, footer, REFTABLE_FOOTER_SIZE - 4), 4);
+
+	writer->section = 0;
+	return writer_write(writer, footer, sizeof(footer));
+}
+
+void git_reftable_writer_free(git_reftable_writer *writer)
+{
+	if (!writer)
+		return;
+
+	block_writer_free(&writer->block);
+	block_writer_free(&writer->index);
+	git_buf_free(&writer->last_key);
+	git_buf_free(&writer->record);
+	git_buf_free(&writer->index_record);
+	git_buf_free(&writer->deflated);
+	git__free(writer);
+}
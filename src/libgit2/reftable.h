@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_reftable_h__
+#define INCLUDE_reftable_h__
+
+#include "common.h"
+#include "buffer.h"
+#include "filebuf.h"
+#include "map.h"
+
+#include "git2/oid.h"
+
+/*
+ * A reference table is an immutable file of sorted references and
+ * reflog entries, modelled on the reftable format:
+ *
+ *   header  "REFT" version(1) block_size(24) min_update_index(64)
+ *           max_update_index(64)
+ *   ref blocks, each padded to block_size; the first one starts at
+ *           offset 0 and includes the header
+ *   ref index, when there is more than one ref block
+ *   log blocks, deflated after their 4 byte block header
+ *   log index, when there is more than one log block
+ *   footer  header ref_index(64) obj(64) obj_index(64) log(64)
+ *           log_index(64) crc32(32)
+ *
+ * A block is its type, its length (24 bits), its records, the offsets
+ * of its restart points (24 bits each) and their count (16 bits).
+ * The key of a record shares a prefix with the key of the previous
+ * record, except at restart points, which makes the restart points a
+ * binary searchable sample of the block:
+ *
+ *   varint(prefix_length) varint(suffix_length << 3 | type) suffix value
+ *
+ * The key of a ref record is the name of the reference and its value
+ * the offset of its update index from the minimum of the table, then
+ * the object id, the object id and its peeled id, or the target of a
+ * symbolic reference. The key of a log record is the name of the
+ * reference, a NUL and the inverted update index, so that the newest
+ * entry of a reference comes first. Index records map the last key of
+ * a block to the offset of the block.
+ *
+ * Tables form a stack in which newer tables shadow the records of
+ * older ones, including deletions, which are records of their own.
+ */
+
+#define GIT_REFTABLE_DIR "reftable/"
+#define GIT_REFTABLE_LIST_FILE "tables.list"
+#define GIT_REFTABLE_FILE_MODE 0444
+
+#define GIT_REFTABLE_BLOCK_SIZE 4096
+#define GIT_REFTABLE_RESTART_INTERVAL 16
+
+enum {
+	GIT_REFTABLE_REF_DELETION = 0,
+	GIT_REFTABLE_REF_VAL1 = 1, /* an object id */
+	GIT_REFTABLE_REF_VAL2 = 2, /* an object id and its peeled id */
+	GIT_REFTABLE_REF_SYMREF = 3,
+};
+
+enum {
+	GIT_REFTABLE_LOG_DELETION = 0,
+	GIT_REFTABLE_LOG_UPDATE = 1,
+	GIT_REFTABLE_LOG_EXISTS = 2, /* the reference has a (maybe empty) log */
+};
+
+/* The strings of records read from a table are valid until the
+ * iterator that returned them advances */
+typedef struct {
+	const char *name;
+	uint64_t update_index;
+	int type;
+	git_oid oid;
+	git_oid peel;
+	const char *target;
+} git_reftable_ref;
+
+typedef struct {
+	const char *name;
+	uint64_t update_index;
+	int type;
+	git_oid old_id;
+	git_oid new_id;
+	const char *who_name;
+	const char *who_email;
+	git_time_t time;
+	int offset;
+	const char *message;
+} git_reftable_log;
+
+typedef struct git_reftable {
+	git_atomic refcount;
+	char *name;
+#ifdef GIT_WIN32
+	git_buf buf; /* a mapped file cannot be deleted on Windows */
+#else
+	git_map map;
+#endif
+	const unsigned char *data;
+	size_t size;
+
+	uint32_t block_size;
+	uint64_t min_index;
+	uint64_t max_index;
+
+	size_t ref_end;
+	size_t ref_index;
+	size_t log_start;
+	size_t log_end;
+	size_t log_index;
+} git_reftable;
+
+int git_reftable_open(git_reftable **out, const char *path, const char *name);
+void git_reftable_free(git_reftable *table);
+
+/* Iterator over the ref ('r') or log ('g') records of one table */
+typedef struct {
+	const git_reftable *table;
+	char section;
+
+	size_t block_off;
+	size_t next_off;
+	const unsigned char *block;
+	const unsigned char *restarts;
+	size_t restart_count;
+	const unsigned char *records;
+	const unsigned char *pos;
+	const unsigned char *end;
+	git_buf inflated;
+	int done;
+
+	git_buf key;
+	git_buf value;
+	int type;
+	int pending;
+	uint64_t child; /* block offset of an index record */
+
+	git_reftable_ref ref;
+	git_reftable_log log;
+} git_reftable_iter;
+
+void git_reftable_iter_init(
+	git_reftable_iter *iter, const git_reftable *table, char section);
+void git_reftable_iter_free(git_reftable_iter *iter);
+
+/* Position the iterator before the first record whose key is not
+ * smaller than `key` */
+int git_reftable_iter_seek(
+	git_reftable_iter *iter, const char *key, size_t key_len);
+
+/* Return 0 and the next record, or GIT_ITEROVER */
+int git_reftable_iter_next_ref(
+	const git_reftable_ref **out, git_reftable_iter *iter);
+int git_reftable_iter_next_log(
+	const git_reftable_log **out, git_reftable_iter *iter);
+
+/*
+ * Iterator over the records of a stack of tables, oldest first: of the
+ * records with the same key, it returns the one of the newest table.
+ * Deletions are returned as well, for the caller to skip or keep.
+ */
+typedef struct {
+	git_reftable_iter *iters;
+	int *state;
+	size_t count;
+	char section;
+} git_reftable_merged;
+
+int git_reftable_merged_init(
+	git_reftable_merged *merged,
+	git_reftable **tables,
+	size_t count,
+	char section);
+void git_reftable_merged_free(git_reftable_merged *merged);
+
+int git_reftable_merged_seek(
+	git_reftable_merged *merged, const char *key, size_t key_len);
+int git_reftable_merged_next_ref(
+	const git_reftable_ref **out, git_reftable_merged *merged);
+int git_reftable_merged_next_log(
+	const git_reftable_log **out, git_reftable_merged *merged);
+
+/* The key of the log entry of `name` at `update_index` */
+int git_reftable_log_key(git_buf *key, const char *name, uint64_t update_index);
+
+/*
+ * Writer of a table into a locked file. Refs must be added in the
+ * order of their names, then logs in the order of their keys.
+ */
+typedef struct git_reftable_writer git_reftable_writer;
+
+int git_reftable_writer_new(
+	git_reftable_writer **out,
+	git_filebuf *file,
+	uint64_t min_index,
+	uint64_t max_index);
+int git_reftable_writer_add_ref(
+	git_reftable_writer *writer, const git_reftable_ref *ref);
+int git_reftable_writer_add_log(
+	git_reftable_writer *writer, const git_reftable_log *log);
+int git_reftable_writer_finish(git_reftable_writer *writer);
+void git_reftable_writer_free(git_reftable_writer *writer);
+
+#endif
@@ -9,6 +9,7 @@
 #include "git2/types.h"
 #include "git2/oid.h"
 #include "git2/net.h"
+#include "git2/transaction.h"
 
 #include "common.h"
 #include "config.h"
@@ -922,6 +923,12 @@ cleanup:
 	return error;
 }
 
+typedef struct {
+	git_oid old;
+	const git_oid *new;
+	char name[GIT_FLEX_ARRAY];
+} update_tip;
+
 static int update_tips_for_spec(git_remote *remote, git_refspec *spec, git_vector *refs)
 {
 	int error = 0, autotag;
@@ -930,9 +937,10 @@ static int update_tips_for_spec(git_remote *remote, git_refspec *spec, git_vecto
 	git_oid old;
 	git_odb *odb;
 	git_remote_head *head;
-	git_reference *ref;
 	git_refspec tagspec;
-	git_vector update_heads;
+	git_vector update_heads, tips = GIT_VECTOR_INIT;
+	git_transaction *tx = NULL;
+	update_tip *tip;
 
 	assert(remote);
 
@@ -946,6 +954,10 @@ static int update_tips_for_spec(git_remote *remote, git_refspec *spec, git_vecto
 	if (git_vector_init(&update_heads, 16, NULL) < 0)
 		return -1;
 
+	/* All the tips are updated at once, or none of them */
+	if (git_transaction_new(&tx, remote->repo) < 0)
+		goto on_error;
+
 	for (; i < refs->length; ++i) {
 		head = git_vector_get(refs, i);
 		autotag = 0;
@@ -989,14 +1001,35 @@ static int update_tips_for_spec(git_remote *remote, git_refspec *spec, git_vecto
 			continue;
 
 		/* In autotag mode, don't overwrite any locally-existing tags */
-		error = git_reference_create(&ref, remote->repo, refname.ptr, &head->oid, !autotag);
-		if (error < 0 && error != GIT_EEXISTS)
+		if (autotag && !git_oid_iszero(&old))
+			continue;
+
+		/* The tip must still be where we saw it when we commit */
+		error = git_transaction_set_target(tx, refname.ptr, &head->oid, &old, NULL, NULL);
+		if (error == GIT_EEXISTS)
+			continue;
+		if (error < 0)
 			goto on_error;
 
-		git_reference_free(ref);
+		if ((tip = git__malloc(sizeof(update_tip) + refname.size + 1)) == NULL)
+			goto on_error;
+		git_oid_cpy(&tip->old, &old);
+		tip->new = &head->oid;
+		memcpy(tip->name, refname.ptr, refname.size + 1);
 
-		if (remote->callbacks.update_tips != NULL) {
-			if (remote->callbacks.update_tips(refname.ptr, &old, &head->oid, remote->callbacks.payload) < 0)
+		if (git_vector_insert(&tips, tip) < 0) {
+			git__free(tip);
+			goto on_error;
+		}
+	}
+
+	/* keep the error code, e.g. GIT_ELOCKED or GIT_EMODIFIED */
+	if ((error = git_transaction_commit(tx)) < 0)
+		goto cleanup;
+
+	if (remote->callbacks.update_tips != NULL) {
+		git_vector_foreach(&tips, i, tip) {
+			if (remote->callbacks.update_tips(tip->name, &tip->old, tip->new, remote->callbacks.payload) < 0)
 				goto on_error;
 		}
 	}
@@ -1005,16 +1038,22 @@ static int update_tips_for_spec(git_remote *remote, git_refspec *spec, git_vecto
 	    (error = git_remote_write_fetchhead(remote, spec, &update_heads)) < 0)
 		goto on_error;
 
+	git_transaction_free(tx);
+	git_vector_free_deep(&tips);
 	git_vector_free(&update_heads);
 	git_refspec__free(&tagspec);
 	git_buf_free(&refname);
 	return 0;
 
 on_error:
+	error = -1;
+cleanup:
+	git_transaction_free(tx);
+	git_vector_free_deep(&tips);
 	git_vector_free(&update_heads);
 	git_refspec__free(&tagspec);
 	git_buf_free(&refname);
-	return -1;
+	return error;
 
 }
 
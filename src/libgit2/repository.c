@@ -26,12 +26,14 @@
 #include "remote.h"
 #include "merge.h"
 #include "diff_driver.h"
+#include "commit_graph.h"
 
 #define GIT_FILE_CONTENT_PREFIX "gitdir:"
 
 #define GIT_BRANCH_MASTER "master"
 
 #define GIT_REPO_VERSION 0
+#define GIT_REPO_MAX_VERSION 1
 
 static void set_odb(git_repository *repo, git_odb *odb)
 {
@@ -98,6 +100,10 @@ void git_repository__cleanup(git_repository *repo)
 	set_index(repo, NULL);
 	set_odb(repo, NULL);
 	set_refdb(repo, NULL);
+
+	git_commit_graph_free(repo->_commit_graph);
+	repo->_commit_graph = NULL;
+	git_futils_filestamp_set(&repo->commit_graph_stamp, NULL);
 }
 
 void git_repository_free(git_repository *repo)
@@ -108,6 +114,7 @@ void git_repository_free(git_repository *repo)
 	git_repository__cleanup(repo);
 
 	git_cache_free(&repo->objects);
+	git_mutex_free(&repo->commit_graph_lock);
 	git_submodule_config_free(repo);
 
 	git_diff_driver_registry_free(repo->diff_drivers);
@@ -153,6 +160,13 @@ static git_repository *repository_alloc(void)
 		return NULL;
 	}
 
+	if (git_mutex_init(&repo->commit_graph_lock)) {
+		giterr_set(GITERR_OS, "Failed to initialize commit-graph mutex");
+		git_cache_free(&repo->objects);
+		git__free(repo);
+		return NULL;
+	}
+
 	/* set all the entries in the cvar cache to `unset` */
 	git_repository__cvar_cache_clear(repo);
 
@@ -641,6 +655,80 @@ void git_repository_set_config(git_repository *repo, git_config *config)
 	set_config(repo, config);
 }
 
+/* Apply core.deltaBaseCacheLimit to the packfiles of the odb */
+static int load_delta_base_cache_limit(git_odb *odb, git_repository *repo)
+{
+	git_config *config;
+	int64_t limit;
+	int error;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0)
+		return error;
+
+	error = git_config_get_int64(&limit, config, "core.deltaBaseCacheLimit");
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		return 0;
+	}
+
+	if (!error && limit < 0) {
+		giterr_set(GITERR_CONFIG,
+			"Invalid value for 'core.deltaBaseCacheLimit'");
+		error = -1;
+	}
+
+	if (!error)
+		error = git_odb_set_delta_base_cache_limit(odb, (size_t)limit);
+
+	return error;
+}
+
+static int config_get_size(
+	size_t *out, git_config *config, const char *name)
+{
+	int64_t value;
+	int error;
+
+	*out = 0;
+
+	error = git_config_get_int64(&value, config, name);
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		return 0;
+	}
+
+	if (!error && value < 0) {
+		giterr_set(GITERR_CONFIG, "Invalid value for '%s'", name);
+		error = -1;
+	}
+
+	if (!error)
+		*out = (size_t)value;
+
+	return error;
+}
+
+/*
+ * Apply core.packedGitWindowSize and core.packedGitLimit to the
+ * packfiles of the odb, so each repository has its own mapping budget
+ */
+static int load_mwindow_limits(git_odb *odb, git_repository *repo)
+{
+	git_config *config;
+	size_t window_size, mapped_limit;
+	int error;
+
+	if ((error = git_repository_config__weakptr(&config, repo)) < 0 ||
+		(error = config_get_size(&window_size, config, "core.packedGitWindowSize")) < 0 ||
+		(error = config_get_size(&mapped_limit, config, "core.packedGitLimit")) < 0)
+		return error;
+
+	if (!window_size && !mapped_limit)
+		return 0;
+
+	return git_odb_set_mwindow_limits(odb, window_size, mapped_limit);
+}
+
 int git_repository_odb__weakptr(git_odb **out, git_repository *repo)
 {
 	int error = 0;
@@ -654,6 +742,10 @@ int git_repository_odb__weakptr(git_odb **out, git_repository *repo)
 		git_buf_joinpath(&odb_path, repo->path_repository, GIT_OBJECTS_DIR);
 
 		error = git_odb_open(&odb, odb_path.ptr);
+		if (!error && ((error = load_delta_base_cache_limit(odb, repo)) < 0 ||
+			(error = load_mwindow_limits(odb, repo)) < 0))
+			git_odb_free(odb);
+
 		if (!error) {
 			GIT_REFCOUNT_OWN(odb, repo);
 
@@ -797,10 +889,10 @@ static int check_repositoryformatversion(git_config *config)
 	if (git_config_get_int32(&version, config, "core.repositoryformatversion") < 0)
 		return -1;
 
-	if (GIT_REPO_VERSION < version) {
+	if (GIT_REPO_MAX_VERSION < version) {
 		giterr_set(GITERR_REPOSITORY,
 			"Unsupported repository version %d. Only versions up to %d are supported.",
-			version, GIT_REPO_VERSION);
+			version, GIT_REPO_MAX_VERSION);
 		return -1;
 	}
 
@@ -1039,6 +1131,41 @@ static int repo_init_fs_configs(
 	return 0;
 }
 
+/* Whether the references go to a reference table, which a reinit
+ * cannot change */
+static int repo_init_ref_storage(
+	bool *is_table, git_config *config, uint32_t flags, bool is_reinit)
+{
+	const char *storage;
+	bool was_table = false;
+	int error;
+
+	*is_table = ((flags & GIT_REPOSITORY_INIT_REF_TABLE) != 0);
+
+	if (!is_reinit)
+		return 0;
+
+	error = git_config_get_string(&storage, config, "extensions.refstorage");
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	} else if (error == 0) {
+		was_table = !strcmp(storage, "table");
+	}
+
+	if (error < 0)
+		return error;
+
+	if (*is_table && !was_table) {
+		giterr_set(GITERR_REPOSITORY,
+			"Cannot change the reference storage of an existing repository");
+		return -1;
+	}
+
+	*is_table = was_table;
+	return 0;
+}
+
 static int repo_init_config(
 	const char *repo_dir,
 	const char *work_dir,
@@ -1050,6 +1177,7 @@ static int repo_init_config(
 	git_config *config = NULL;
 	bool is_bare = ((flags & GIT_REPOSITORY_INIT_BARE) != 0);
 	bool is_reinit = ((flags & GIT_REPOSITORY_INIT__IS_REINIT) != 0);
+	bool is_table;
 
 	if ((error = repo_local_config(&config, &cfg_path, NULL, repo_dir)) < 0)
 		goto cleanup;
@@ -1057,12 +1185,21 @@ static int repo_init_config(
 	if (is_reinit && (error = check_repositoryformatversion(config)) < 0)
 		goto cleanup;
 
+	if ((error = repo_init_ref_storage(
+			&is_table, config, flags, is_reinit)) < 0)
+		goto cleanup;
+
 #define SET_REPO_CONFIG(TYPE, NAME, VAL) do { \
 	if ((error = git_config_set_##TYPE(config, NAME, VAL)) < 0) \
 		goto cleanup; } while (0)
 
 	SET_REPO_CONFIG(bool, "core.bare", is_bare);
-	SET_REPO_CONFIG(int32, "core.repositoryformatversion", GIT_REPO_VERSION);
+	SET_REPO_CONFIG(int32, "core.repositoryformatversion",
+		is_table ? GIT_REPO_MAX_VERSION : GIT_REPO_VERSION);
+
+	/* git versions that do not know the extension refuse the repository */
+	if (is_table)
+		SET_REPO_CONFIG(string, "extensions.refstorage", "table");
 
 	if ((error = repo_init_fs_configs(
 			config, cfg_path.ptr, repo_dir, work_dir, !is_reinit)) < 0)
@@ -2014,3 +2151,11 @@ int git_repository_is_shallow(git_repository *repo)
 		return -1;
 	return st.st_size == 0 ? 0 : 1;
 }
+
+int git_repository_get_object_cache_stats(
+	git_repository_object_cache_stats *out, git_repository *repo)
+{
+	assert(out && repo);
+
+	return git_cache_get_stats(out, &repo->objects);
+}
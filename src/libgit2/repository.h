@@ -21,6 +21,7 @@
 #include "attrcache.h"
 #include "strmap.h"
 #include "diff_driver.h"
+#include "fileops.h"
 
 #define DOT_GIT ".git"
 #define GIT_DIR DOT_GIT "/"
@@ -106,6 +107,11 @@ struct git_repository {
 	git_config *_config;
 	git_index *_index;
 
+	/* Protects the commit-graph and its stamp */
+	git_mutex commit_graph_lock;
+	struct git_commit_graph *_commit_graph;
+	git_futils_filestamp commit_graph_stamp;
+
 	git_cache objects;
 	git_attr_cache attrcache;
 	git_strmap *submodules;
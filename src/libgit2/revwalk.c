@@ -450,7 +450,8 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 
 	walk->repo = repo;
 
-	if (git_repository_odb(&walk->odb, repo) < 0) {
+	if (git_repository_odb(&walk->odb, repo) < 0 ||
+		git_repository__commit_graph(&walk->commit_graph, repo) < 0) {
 		git_revwalk_free(walk);
 		return -1;
 	}
@@ -466,6 +467,7 @@ void git_revwalk_free(git_revwalk *walk)
 
 	git_revwalk_reset(walk);
 	git_odb_free(walk->odb);
+	git_commit_graph_free(walk->commit_graph);
 
 	git_oidmap_free(walk->commits);
 	git_pool_clear(&walk->commit_pool);
@@ -13,6 +13,7 @@
 #include "pqueue.h"
 #include "pool.h"
 #include "vector.h"
+#include "commit_graph.h"
 
 GIT__USE_OIDMAP;
 
@@ -23,6 +24,9 @@ struct git_revwalk {
 	git_oidmap *commits;
 	git_pool commit_pool;
 
+	/* commit-graph of the repository, may be NULL */
+	git_commit_graph *commit_graph;
+
 	git_commit_list *iterator_topo;
 	git_commit_list *iterator_rand;
 	git_commit_list *iterator_reverse;
@@ -148,6 +148,9 @@ int git_sortedcache_copy(
 		git_sortedcache_runlock(src);
 	if (error)
 		git_sortedcache_free(tgt);
+	else
+		/* readers must find the items sorted; see wunlock */
+		git_vector_sort(&tgt->items);
 
 	*out = !error ? tgt : NULL;
 
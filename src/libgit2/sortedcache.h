@@ -150,6 +150,11 @@ int git_sortedcache_remove(git_sortedcache *sc, size_t pos);
  * results from being invalidated before they can be used, you should be
  * holding either a read lock or a write lock when using these functions.
  *
+ * The items are sorted whenever the write lock is not held: unlocking
+ * the write lock and copying a cache both sort them.  So the lazy sort
+ * in `git_sortedcache_entry` and `git_sortedcache_lookup_index` does
+ * nothing under a read lock, and readers never modify the cache.
+ *
  */
 
 /* Lock sortedcache for read */
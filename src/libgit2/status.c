@@ -225,6 +225,57 @@ static git_status_list *git_status_list_alloc(git_index *index)
 	return status;
 }
 
+/*
+ * start the untracked cache of the index if libgit2.untrackedCache is
+ * set; git's own core.untrackedCache is not used since git does not
+ * know the index extension of the cache and would drop it
+ */
+static int status_untracked_cache_begin(git_repository *repo, git_index *index)
+{
+	git_config *cfg;
+	const char *hook = NULL;
+	int enabled = 0, value, error;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0)
+		return error;
+
+	if (git_config_get_bool(&enabled, cfg, "libgit2.untrackedcache") < 0) {
+		giterr_clear();
+		enabled = 0;
+	}
+
+	if (!enabled) {
+		/* the cache is not maintained anymore; drop it on the next write */
+		git_untracked_cache_free(index->untracked);
+		index->untracked = NULL;
+		return 0;
+	}
+
+	if (!index->untracked &&
+		(error = git_untracked_cache_new(&index->untracked)) < 0)
+		return error;
+
+	/* a boolean value is for the builtin monitor of git, not a hook */
+	if (git_config_get_string(&hook, cfg, "core.fsmonitor") < 0) {
+		giterr_clear();
+		hook = NULL;
+	} else if (!hook || !*hook || git__parse_bool(&value, hook) == 0)
+		hook = NULL;
+
+	return git_untracked_cache_begin(index->untracked, repo, hook);
+}
+
+static void status_untracked_cache_end(git_index *index, int error)
+{
+	if (!index->untracked || !index->untracked->active)
+		return;
+
+	git_untracked_cache_end(index->untracked);
+
+	if (!error)
+		git_index__write_untracked_cache(index);
+}
+
 int git_status_list_new(
 	git_status_list **out,
 	git_repository *repo,
@@ -305,8 +356,14 @@ int git_status_list_new(
 	}
 
 	if (show != GIT_STATUS_SHOW_INDEX_ONLY) {
-		if ((error = git_diff_index_to_workdir(
-				&status->idx2wd, repo, index, &diffopt)) < 0)
+		if ((error = status_untracked_cache_begin(repo, index)) < 0)
+			goto done;
+
+		error = git_diff_index_to_workdir(
+			&status->idx2wd, repo, index, &diffopt);
+
+		status_untracked_cache_end(index, error);
+		if (error < 0)
 			goto done;
 
 		if ((flags & GIT_STATUS_OPT_RENAMES_INDEX_TO_WORKDIR) != 0 &&
@@ -410,45 +410,51 @@ int git_tag_delete(git_repository *repo, const char *tag_name)
 	return error;
 }
 
-typedef struct {
-	git_repository *repo;
-	git_tag_foreach_cb cb;
-	void *cb_data;
-} tag_cb_data;
-
-static int tags_cb(const char *ref, void *data)
+/* Call `cb` with the tags whose reference name matches `glob` */
+static int tag_foreach_glob(
+	git_repository *repo, const char *glob, git_tag_foreach_cb cb, void *cb_data)
 {
-	int error;
+	git_reference_iterator *iter;
+	git_reference *ref = NULL, *resolved = NULL;
 	git_oid oid;
-	tag_cb_data *d = (tag_cb_data *)data;
+	int error;
 
-	if (git__prefixcmp(ref, GIT_REFS_TAGS_DIR) != 0)
-		return 0; /* no tag */
+	if ((error = git_reference_iterator_glob_new(&iter, repo, glob)) < 0)
+		return error;
 
-	if (!(error = git_reference_name_to_id(&oid, d->repo, ref))) {
-		if ((error = d->cb(ref, &oid, d->cb_data)) != 0)
+	while (!(error = git_reference_next(&ref, iter))) {
+		if (git_reference_type(ref) == GIT_REF_OID)
+			git_oid_cpy(&oid, git_reference_target(ref));
+		else if (!(error = git_reference_resolve(&resolved, ref)))
+			git_oid_cpy(&oid, git_reference_target(resolved));
+
+		if (!error && (error = cb(git_reference_name(ref), &oid, cb_data)) != 0)
 			giterr_set_after_callback_function(error, "git_tag_foreach");
+
+		git_reference_free(resolved);
+		git_reference_free(ref);
+		resolved = NULL;
+
+		if (error)
+			break;
 	}
 
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	git_reference_iterator_free(iter);
 	return error;
 }
 
 int git_tag_foreach(git_repository *repo, git_tag_foreach_cb cb, void *cb_data)
 {
-	tag_cb_data data;
-
 	assert(repo && cb);
 
-	data.cb = cb;
-	data.cb_data = cb_data;
-	data.repo = repo;
-
-	return git_reference_foreach_name(repo, &tags_cb, &data);
+	return tag_foreach_glob(repo, GIT_REFS_TAGS_DIR "*", cb, cb_data);
 }
 
 typedef struct {
 	git_vector *taglist;
-	const char *pattern;
 } tag_filter_data;
 
 #define GIT_REFS_TAGS_DIR_LEN strlen(GIT_REFS_TAGS_DIR)
@@ -456,18 +462,13 @@ typedef struct {
 static int tag_list_cb(const char *tag_name, git_oid *oid, void *data)
 {
 	tag_filter_data *filter = (tag_filter_data *)data;
+	char *matched;
 	GIT_UNUSED(oid);
 
-	if (!*filter->pattern ||
-		p_fnmatch(filter->pattern, tag_name + GIT_REFS_TAGS_DIR_LEN, 0) == 0)
-	{
-		char *matched = git__strdup(tag_name + GIT_REFS_TAGS_DIR_LEN);
-		GITERR_CHECK_ALLOC(matched);
-
-		return git_vector_insert(filter->taglist, matched);
-	}
+	matched = git__strdup(tag_name + GIT_REFS_TAGS_DIR_LEN);
+	GITERR_CHECK_ALLOC(matched);
 
-	return 0;
+	return git_vector_insert(filter->taglist, matched);
 }
 
 int git_tag_list_match(git_strarray *tag_names, const char *pattern, git_repository *repo)
@@ -475,16 +476,24 @@ int git_tag_list_match(git_strarray *tag_names, const char *pattern, git_reposit
 	int error;
 	tag_filter_data filter;
 	git_vector taglist;
+	git_buf glob = GIT_BUF_INIT;
 
 	assert(tag_names && repo && pattern);
 
-	if ((error = git_vector_init(&taglist, 8, NULL)) < 0)
+	/* the pattern is matched against the names of the tags, so it
+	 * becomes a glob of their references */
+	if (git_buf_join(&glob, 0, GIT_REFS_TAGS_DIR, *pattern ? pattern : "*") < 0)
+		return -1;
+
+	if ((error = git_vector_init(&taglist, 8, NULL)) < 0) {
+		git_buf_free(&glob);
 		return error;
+	}
 
 	filter.taglist = &taglist;
-	filter.pattern = pattern;
 
-	error = git_tag_foreach(repo, &tag_list_cb, (void *)&filter);
+	error = tag_foreach_glob(repo, glob.ptr, &tag_list_cb, (void *)&filter);
+	git_buf_free(&glob);
 
 	if (error < 0)
 		git_vector_free(&taglist);
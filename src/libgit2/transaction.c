@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+
+#include "git2/signature.h"
+#include "git2/transaction.h"
+#include "git2/sys/refdb_backend.h"
+#include "git2/sys/refs.h"
+
+#include "refdb.h"
+#include "refs.h"
+#include "repository.h"
+#include "strmap.h"
+#include "vector.h"
+
+GIT__USE_STRMAP;
+
+typedef struct {
+	git_refdb_update update;
+	git_reference *ref;
+	git_oid old_id;
+	git_signature *who;
+	char *message;
+	char name[GIT_FLEX_ARRAY];
+} transaction_update;
+
+struct git_transaction {
+	git_repository *repo;
+	git_refdb *db;
+	git_vector updates;
+	git_strmap *names;
+	git_signature *who;
+	int committed;
+};
+
+static int update_cmp(const void *a, const void *b)
+{
+	const transaction_update *ua = a, *ub = b;
+	return strcmp(ua->name, ub->name);
+}
+
+static void update_free(transaction_update *u)
+{
+	if (!u)
+		return;
+
+	git_reference_free(u->ref);
+	git_signature_free(u->who);
+	git__free(u->message);
+	git__free(u);
+}
+
+int git_transaction_new(git_transaction **out, git_repository *repo)
+{
+	git_transaction *tx;
+
+	assert(out && repo);
+
+	tx = git__calloc(1, sizeof(git_transaction));
+	GITERR_CHECK_ALLOC(tx);
+
+	tx->repo = repo;
+
+	if (git_repository_refdb(&tx->db, repo) < 0 ||
+		git_vector_init(&tx->updates, 0, update_cmp) < 0 ||
+		(tx->names = git_strmap_alloc()) == NULL) {
+		git_transaction_free(tx);
+		return -1;
+	}
+
+	*out = tx;
+	return 0;
+}
+
+/*
+ * Queue an update of the normalized `name`; `ref` is owned by the
+ * transaction from here on.
+ */
+static int transaction_add(
+	git_transaction *tx,
+	const char *name,
+	git_reference *ref,
+	const git_oid *old_id,
+	const git_signature *who,
+	const char *message)
+{
+	transaction_update *u = NULL;
+	size_t namelen;
+	int error;
+
+	if (tx->committed) {
+		giterr_set(GITERR_INVALID, "The transaction has already been committed");
+		error = -1;
+		goto fail;
+	}
+
+	if (git_strmap_exists(tx->names, name)) {
+		giterr_set(GITERR_REFERENCE,
+			"The reference '%s' is already updated in the transaction", name);
+		error = GIT_EEXISTS;
+		goto fail;
+	}
+
+	namelen = strlen(name);
+	u = git__calloc(1, sizeof(transaction_update) + namelen + 1);
+	if (!u) {
+		error = -1;
+		goto fail;
+	}
+	memcpy(u->name, name, namelen);
+
+	u->ref = ref;
+	ref = NULL;
+
+	if (old_id) {
+		git_oid_cpy(&u->old_id, old_id);
+		u->update.old_id = &u->old_id;
+	}
+
+	if ((who && (u->who = git_signature_dup(who)) == NULL) ||
+		(message && (u->message = git__strdup(message)) == NULL)) {
+		error = -1;
+		goto fail;
+	}
+
+	u->update.name = u->name;
+	u->update.ref = u->ref;
+	u->update.who = u->who;
+	u->update.message = u->message;
+
+	if ((error = git_vector_insert(&tx->updates, u)) < 0)
+		goto fail;
+
+	git_strmap_insert(tx->names, u->name, u, error);
+	if (error < 0) {
+		git_vector_pop(&tx->updates);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	git_reference_free(ref);
+	update_free(u);
+	return error < 0 ? error : -1;
+}
+
+int git_transaction_set_target(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *id,
+	const git_oid *old_id,
+	const git_signature *signature,
+	const char *log_message)
+{
+	char normalized[GIT_REFNAME_MAX];
+	git_odb *odb;
+	git_reference *ref;
+	int error;
+
+	assert(tx && refname && id);
+
+	if ((error = git_reference__normalize_name_lax(
+			normalized, sizeof(normalized), refname)) < 0)
+		return error;
+
+	/* Sanity check the reference being created - target must exist. */
+	if (git_repository_odb__weakptr(&odb, tx->repo) < 0)
+		return -1;
+
+	if (!git_odb_exists(odb, id)) {
+		giterr_set(GITERR_REFERENCE,
+			"Target OID for the reference doesn't exist on the repository");
+		return -1;
+	}
+
+	ref = git_reference__alloc(normalized, id, NULL);
+	GITERR_CHECK_ALLOC(ref);
+
+	return transaction_add(tx, normalized, ref, old_id, signature, log_message);
+}
+
+int git_transaction_set_symbolic_target(
+	git_transaction *tx,
+	const char *refname,
+	const char *target,
+	const git_oid *old_id)
+{
+	char normalized[GIT_REFNAME_MAX], normalized_target[GIT_REFNAME_MAX];
+	git_reference *ref;
+	int error;
+
+	assert(tx && refname && target);
+
+	if ((error = git_reference__normalize_name_lax(
+			normalized, sizeof(normalized), refname)) < 0 ||
+		(error = git_reference__normalize_name_lax(
+			normalized_target, sizeof(normalized_target), target)) < 0)
+		return error;
+
+	ref = git_reference__alloc_symbolic(normalized, normalized_target);
+	GITERR_CHECK_ALLOC(ref);
+
+	return transaction_add(tx, normalized, ref, old_id, NULL, NULL);
+}
+
+int git_transaction_remove(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *old_id)
+{
+	char normalized[GIT_REFNAME_MAX];
+	int error;
+
+	assert(tx && refname);
+
+	if ((error = git_reference__normalize_name_lax(
+			normalized, sizeof(normalized), refname)) < 0)
+		return error;
+
+	return transaction_add(tx, normalized, NULL, old_id, NULL, NULL);
+}
+
+/*
+ * A reference cannot be written in the same transaction as another
+ * reference whose name is one of its directories.
+ */
+static int transaction_check_paths(git_transaction *tx)
+{
+	char path[GIT_REFNAME_MAX];
+	transaction_update *u, *other;
+	khiter_t pos;
+	size_t i;
+	char *slash;
+
+	git_vector_foreach(&tx->updates, i, u) {
+		memcpy(path, u->name, strlen(u->name) + 1);
+
+		for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+			*slash = '\0';
+			pos = git_strmap_lookup_index(tx->names, path);
+			*slash = '/';
+
+			if (!git_strmap_valid_index(tx->names, pos))
+				continue;
+
+			other = git_strmap_value_at(tx->names, pos);
+			if (u->ref || other->ref) {
+				giterr_set(GITERR_REFERENCE,
+					"The reference '%s' conflicts with '%s' in the transaction",
+					u->name, other->name);
+				return GIT_EEXISTS;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int git_transaction_commit(git_transaction *tx)
+{
+	const git_refdb_update **updates = NULL;
+	transaction_update *u;
+	size_t i;
+	int error;
+
+	assert(tx);
+
+	if (tx->committed) {
+		giterr_set(GITERR_INVALID, "The transaction has already been committed");
+		return -1;
+	}
+
+	if (!tx->updates.length)
+		goto done;
+
+	git_vector_sort(&tx->updates);
+
+	if ((error = transaction_check_paths(tx)) < 0)
+		return error;
+
+	updates = git__calloc(tx->updates.length, sizeof(git_refdb_update *));
+	GITERR_CHECK_ALLOC(updates);
+
+	git_vector_foreach(&tx->updates, i, u) {
+		/* Should we return an error if there is no default? */
+		if (u->ref && !u->who) {
+			if (!tx->who &&
+				git_signature_default(&tx->who, tx->repo) < 0 &&
+				git_signature_now(&tx->who, "unknown", "unknown") < 0) {
+				git__free(updates);
+				return -1;
+			}
+			u->update.who = tx->who;
+		}
+
+		updates[i] = &u->update;
+	}
+
+	error = git_refdb_transaction(tx->db, updates, tx->updates.length);
+	git__free(updates);
+
+	if (error < 0)
+		return error;
+
+done:
+	tx->committed = 1;
+	return 0;
+}
+
+void git_transaction_free(git_transaction *tx)
+{
+	transaction_update *u;
+	size_t i;
+
+	if (!tx)
+		return;
+
+	git_vector_foreach(&tx->updates, i, u)
+		update_free(u);
+	git_vector_free(&tx->updates);
+
+	if (tx->names)
+		git_strmap_free(tx->names);
+
+	git_signature_free(tx->who);
+	git_refdb_free(tx->db);
+	git__free(tx);
+}
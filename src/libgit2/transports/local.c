@@ -24,6 +24,7 @@
 #include "buffer.h"
 #include "repository.h"
 #include "odb.h"
+#include "array.h"
 #include "push.h"
 #include "remote.h"
 
@@ -456,34 +457,87 @@ static int foreach_cb(void *buf, size_t len, void *payload)
 	return data->writepack->append(data->writepack, buf, len, data->stats);
 }
 
-static int local_download_pack(
-		git_transport *transport,
-		git_repository *repo,
-		git_transfer_progress *stats,
-		git_transfer_progress_callback progress_cb,
-		void *progress_payload)
+/*
+ * Insert the objects of the wanted references that the local repository
+ * does not have, with the reachability bitmaps of the remote repository.
+ * The tips of the local references that the remote has are the objects
+ * we have.
+ */
+static int local_insert_reachable(
+	git_packbuilder *pack, transport_local *t, git_repository *repo)
 {
-	transport_local *t = (transport_local*)transport;
-	git_revwalk *walk = NULL;
+	git_array_t(git_oid) wants = GIT_ARRAY_INIT;
+	git_array_t(git_oid) haves = GIT_ARRAY_INIT;
+	git_reference_iterator *iter = NULL;
 	git_remote_head *rhead;
+	const char *name;
+	git_odb *odb, *local_odb;
+	git_oid *oid, id;
 	unsigned int i;
-	int error = -1;
-	git_oid oid;
-	git_packbuilder *pack = NULL;
-	git_odb_writepack *writepack = NULL;
-	git_odb *odb = NULL;
+	int error;
 
-	if ((error = git_revwalk_new(&walk, t->repo)) < 0)
+	if ((error = git_repository_odb__weakptr(&odb, t->repo)) < 0 ||
+		(error = git_repository_odb__weakptr(&local_odb, repo)) < 0)
+		return error;
+
+	git_vector_foreach(&t->refs, i, rhead) {
+		if (git_odb_exists(local_odb, &rhead->oid))
+			continue;
+
+		if ((oid = git_array_alloc(wants)) == NULL) {
+			error = -1;
+			goto cleanup;
+		}
+		git_oid_cpy(oid, &rhead->oid);
+	}
+
+	if (wants.size == 0)
 		goto cleanup;
-	git_revwalk_sorting(walk, GIT_SORT_TIME);
 
-	if ((error = git_packbuilder_new(&pack, t->repo)) < 0)
+	if ((error = git_reference_iterator_new(&iter, repo)) < 0)
 		goto cleanup;
 
-	stats->total_objects = 0;
-	stats->indexed_objects = 0;
-	stats->received_objects = 0;
-	stats->received_bytes = 0;
+	while ((error = git_reference_next_name(&name, iter)) == 0) {
+		if (git_reference_name_to_id(&id, repo, name) < 0) {
+			giterr_clear();
+			continue;
+		}
+
+		if (!git_odb_exists(odb, &id))
+			continue;
+
+		if ((oid = git_array_alloc(haves)) == NULL) {
+			error = -1;
+			goto cleanup;
+		}
+		git_oid_cpy(oid, &id);
+	}
+
+	if (error != GIT_ITEROVER)
+		goto cleanup;
+
+	error = git_packbuilder__insert_reachable(pack,
+		wants.ptr, wants.size, haves.ptr, haves.size);
+
+cleanup:
+	git_reference_iterator_free(iter);
+	git_array_clear(wants);
+	git_array_clear(haves);
+	return error;
+}
+
+static int local_insert_walk(
+	git_packbuilder *pack, transport_local *t, git_odb *odb)
+{
+	git_revwalk *walk = NULL;
+	git_remote_head *rhead;
+	unsigned int i;
+	int error;
+	git_oid oid;
+
+	if ((error = git_revwalk_new(&walk, t->repo)) < 0)
+		return error;
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
 
 	git_vector_foreach(&t->refs, i, rhead) {
 		git_object *obj;
@@ -503,9 +557,6 @@ static int local_download_pack(
 	}
 
 	/* Walk the objects, building a packfile */
-	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
-		goto cleanup;
-
 	while ((error = git_revwalk_next(&oid, walk)) == 0) {
 		git_commit *commit;
 
@@ -526,6 +577,47 @@ static int local_download_pack(
 		}
 	}
 
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+cleanup:
+	git_revwalk_free(walk);
+	return error;
+}
+
+static int local_download_pack(
+		git_transport *transport,
+		git_repository *repo,
+		git_transfer_progress *stats,
+		git_transfer_progress_callback progress_cb,
+		void *progress_payload)
+{
+	transport_local *t = (transport_local*)transport;
+	int error = -1;
+	git_packbuilder *pack = NULL;
+	git_odb_writepack *writepack = NULL;
+	git_odb *odb = NULL;
+
+	if ((error = git_packbuilder_new(&pack, t->repo)) < 0)
+		goto cleanup;
+
+	stats->total_objects = 0;
+	stats->indexed_objects = 0;
+	stats->received_objects = 0;
+	stats->received_bytes = 0;
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		goto cleanup;
+
+	/* Without bitmaps, walk the history of the wanted commits */
+	if ((error = local_insert_reachable(pack, t, repo)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = local_insert_walk(pack, t, odb);
+	}
+
+	if (error < 0)
+		goto cleanup;
+
 	if ((error = git_odb_write_pack(&writepack, odb, progress_cb, progress_payload)) != 0)
 		goto cleanup;
 
@@ -545,7 +637,6 @@ static int local_download_pack(
 cleanup:
 	if (writepack) writepack->free(writepack);
 	git_packbuilder_free(pack);
-	git_revwalk_free(walk);
 	return error;
 }
 
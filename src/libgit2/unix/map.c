@@ -54,5 +54,19 @@ int p_munmap(git_map *map)
 	return 0;
 }
 
+int p_madvise(git_map *map, int advice)
+{
+	int madv = POSIX_MADV_NORMAL;
+
+	assert(map != NULL);
+
+	if (advice == GIT_MADV_SEQUENTIAL)
+		madv = POSIX_MADV_SEQUENTIAL;
+	else if (advice == GIT_MADV_WILLNEED)
+		madv = POSIX_MADV_WILLNEED;
+
+	return posix_madvise(map->data, map->len, madv) ? -1 : 0;
+}
+
 #endif
 
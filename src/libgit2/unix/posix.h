@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <sys/param.h>
+#include <utime.h>
 
 #define p_lstat(p,b) lstat(p,b)
 #define p_readlink(a, b, c) readlink(a, b, c)
@@ -17,6 +18,8 @@
 #define p_unlink(p) unlink(p)
 #define p_mkdir(p,m) mkdir(p, m)
 #define p_fsync(fd) fsync(fd)
+#define p_utime_now(p) utime(p, NULL)
+#define p_msleep(ms) usleep((ms) * 1000)
 
 /* The OpenBSD realpath function behaves differently */
 #if !defined(__OpenBSD__)
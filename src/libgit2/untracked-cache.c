@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "untracked-cache.h"
+#include "fsmonitor.h"
+#include "path.h"
+#include "posix.h"
+#include "git2/types.h"
+
+GIT__USE_STRMAP
+
+#define UNTRACKED_CACHE_VERSION 1
+
+/* bits of the directory records on disk */
+#define UNTRACKED_DIR_MTIME_VALID     (1u << 0)
+#define UNTRACKED_DIR_FSMONITOR_VALID (1u << 1)
+
+/* 7 words followed by the size in two words */
+#define UNTRACKED_STAT_SIZE (9 * sizeof(uint32_t))
+
+static void untracked_stat_from(git_untracked_stat *out, const struct stat *st)
+{
+	out->ctime = (uint32_t)st->st_ctime;
+	out->mtime = (uint32_t)st->st_mtime;
+	out->dev = (uint32_t)st->st_rdev;
+	out->ino = (uint32_t)st->st_ino;
+	out->mode = (uint32_t)st->st_mode;
+	out->uid = (uint32_t)st->st_uid;
+	out->gid = (uint32_t)st->st_gid;
+	out->size = (uint64_t)st->st_size;
+}
+
+static void untracked_stat_to(struct stat *out, const git_untracked_stat *st)
+{
+	memset(out, 0, sizeof(*out));
+	out->st_ctime = (time_t)st->ctime;
+	out->st_mtime = (time_t)st->mtime;
+	out->st_rdev = st->dev;
+	out->st_ino = st->ino;
+	out->st_mode = st->mode;
+	out->st_uid = st->uid;
+	out->st_gid = st->gid;
+	out->st_size = st->size;
+}
+
+static bool untracked_stat_equal(
+	const git_untracked_stat *a, const git_untracked_stat *b)
+{
+	return a->ctime == b->ctime && a->mtime == b->mtime &&
+		a->dev == b->dev && a->ino == b->ino && a->mode == b->mode &&
+		a->uid == b->uid && a->gid == b->gid && a->size == b->size;
+}
+
+static void untracked_dir_free(git_untracked_dir *dir)
+{
+	if (!dir)
+		return;
+
+	git_vector_free_deep(&dir->entries);
+	git__free(dir->path);
+	git__free(dir);
+}
+
+static git_untracked_dir *untracked_dir_alloc(const char *path)
+{
+	git_untracked_dir *dir = git__calloc(1, sizeof(git_untracked_dir));
+	if (!dir)
+		return NULL;
+
+	if ((dir->path = git__strdup(path)) == NULL ||
+		git_vector_init(&dir->entries, 0, NULL) < 0) {
+		untracked_dir_free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static git_untracked_entry *untracked_entry_alloc(
+	const char *name, size_t name_len)
+{
+	git_untracked_entry *entry =
+		git__calloc(1, sizeof(git_untracked_entry) + name_len + 1);
+
+	if (entry)
+		memcpy(entry->name, name, name_len);
+
+	return entry;
+}
+
+static git_untracked_dir *untracked_dir_lookup(
+	git_untracked_cache *cache, const char *path)
+{
+	khiter_t pos = git_strmap_lookup_index(cache->dirs, path);
+
+	if (!git_strmap_valid_index(cache->dirs, pos))
+		return NULL;
+
+	return git_strmap_value_at(cache->dirs, pos);
+}
+
+static void untracked_cache_clear_dirs(git_untracked_cache *cache)
+{
+	git_untracked_dir *dir;
+
+	git_strmap_foreach_value(cache->dirs, dir, {
+		untracked_dir_free(dir);
+	});
+	git_strmap_clear(cache->dirs);
+}
+
+/* drop the records of a directory and everything below it */
+static void untracked_cache_prune(git_untracked_cache *cache, const char *path)
+{
+	size_t path_len = strlen(path);
+	khiter_t pos;
+
+	for (pos = git_strmap_begin(cache->dirs);
+		pos != git_strmap_end(cache->dirs); ++pos) {
+		git_untracked_dir *dir;
+
+		if (!git_strmap_has_data(cache->dirs, pos))
+			continue;
+
+		dir = git_strmap_value_at(cache->dirs, pos);
+		if (strncmp(dir->path, path, path_len) != 0)
+			continue;
+
+		git_strmap_delete_at(cache->dirs, pos);
+		untracked_dir_free(dir);
+	}
+}
+
+static void untracked_cache_clear_bits(git_untracked_cache *cache)
+{
+	git_untracked_dir *dir;
+
+	git_strmap_foreach_value(cache->dirs, dir, {
+		dir->fsmonitor_valid = 0;
+	});
+}
+
+int git_untracked_cache_new(git_untracked_cache **out)
+{
+	git_untracked_cache *cache = git__calloc(1, sizeof(git_untracked_cache));
+	GITERR_CHECK_ALLOC(cache);
+
+	cache->dirs = git_strmap_alloc();
+	if (!cache->dirs) {
+		git__free(cache);
+		giterr_set_oom();
+		return -1;
+	}
+
+	*out = cache;
+	return 0;
+}
+
+void git_untracked_cache_free(git_untracked_cache *cache)
+{
+	if (!cache)
+		return;
+
+	untracked_cache_clear_dirs(cache);
+	git_strmap_free(cache->dirs);
+	git__free(cache->fsmonitor_token);
+	git__free(cache->fsmonitor_next_token);
+	git__free(cache);
+}
+
+/*
+ * On-disk format of the extension, all numbers in network byte order:
+ *
+ *   version, dirload flags, fsmonitor token (NUL terminated), nr of dirs
+ *   for each dir: path (NUL terminated), stat, bits, nr of entries
+ *     for each entry: stat, name (NUL terminated)
+ *
+ * A stat is ctime, mtime, dev, ino, mode, uid, gid and the size as
+ * two words, high word first.
+ */
+
+static int read_u32(uint32_t *out, const char **buffer, const char *buffer_end)
+{
+	uint32_t value;
+
+	if ((size_t)(buffer_end - *buffer) < sizeof(uint32_t))
+		return -1;
+
+	memcpy(&value, *buffer, sizeof(uint32_t));
+	*out = ntohl(value);
+	*buffer += sizeof(uint32_t);
+	return 0;
+}
+
+static int read_string(
+	const char **out, size_t *out_len,
+	const char **buffer, const char *buffer_end)
+{
+	const char *end = memchr(*buffer, '\0', buffer_end - *buffer);
+
+	if (end == NULL)
+		return -1;
+
+	*out = *buffer;
+	*out_len = end - *buffer;
+	*buffer = end + 1;
+	return 0;
+}
+
+static int read_stat(
+	git_untracked_stat *st, const char **buffer, const char *buffer_end)
+{
+	uint32_t size_hi, size_lo;
+
+	if (read_u32(&st->ctime, buffer, buffer_end) < 0 ||
+		read_u32(&st->mtime, buffer, buffer_end) < 0 ||
+		read_u32(&st->dev, buffer, buffer_end) < 0 ||
+		read_u32(&st->ino, buffer, buffer_end) < 0 ||
+		read_u32(&st->mode, buffer, buffer_end) < 0 ||
+		read_u32(&st->uid, buffer, buffer_end) < 0 ||
+		read_u32(&st->gid, buffer, buffer_end) < 0 ||
+		read_u32(&size_hi, buffer, buffer_end) < 0 ||
+		read_u32(&size_lo, buffer, buffer_end) < 0)
+		return -1;
+
+	st->size = ((uint64_t)size_hi << 32) | size_lo;
+	return 0;
+}
+
+static int read_dir(
+	git_untracked_cache *cache, const char **buffer, const char *buffer_end)
+{
+	git_untracked_dir *dir;
+	const char *path, *name;
+	size_t path_len, name_len;
+	uint32_t bits, nentries, i;
+	int error;
+
+	if (read_string(&path, &path_len, buffer, buffer_end) < 0 ||
+		(path_len > 0 && path[path_len - 1] != '/') ||
+		git_strmap_exists(cache->dirs, path))
+		return -1;
+
+	if ((dir = untracked_dir_alloc(path)) == NULL)
+		return -1;
+
+	if (read_stat(&dir->st, buffer, buffer_end) < 0 ||
+		read_u32(&bits, buffer, buffer_end) < 0 ||
+		read_u32(&nentries, buffer, buffer_end) < 0 ||
+		nentries > (size_t)(buffer_end - *buffer) / UNTRACKED_STAT_SIZE)
+		goto corrupt;
+
+	dir->mtime_valid = (bits & UNTRACKED_DIR_MTIME_VALID) != 0;
+	dir->fsmonitor_valid = (bits & UNTRACKED_DIR_FSMONITOR_VALID) != 0;
+
+	for (i = 0; i < nentries; ++i) {
+		git_untracked_stat st;
+		git_untracked_entry *entry;
+
+		if (read_stat(&st, buffer, buffer_end) < 0 ||
+			read_string(&name, &name_len, buffer, buffer_end) < 0 ||
+			name_len == 0)
+			goto corrupt;
+
+		if ((entry = untracked_entry_alloc(name, name_len)) == NULL ||
+			git_vector_insert(&dir->entries, entry) < 0) {
+			git__free(entry);
+			goto corrupt;
+		}
+
+		entry->st = st;
+	}
+
+	git_strmap_insert(cache->dirs, dir->path, dir, error);
+	if (error < 0)
+		goto corrupt;
+
+	return 0;
+
+corrupt:
+	untracked_dir_free(dir);
+	return -1;
+}
+
+int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size)
+{
+	git_untracked_cache *cache = NULL;
+	const char *buffer_end = buffer + buffer_size;
+	const char *token;
+	size_t token_len;
+	uint32_t version, flags, ndirs, i;
+
+	if (git_untracked_cache_new(&cache) < 0)
+		return -1;
+
+	if (read_u32(&version, &buffer, buffer_end) < 0 ||
+		version != UNTRACKED_CACHE_VERSION ||
+		read_u32(&flags, &buffer, buffer_end) < 0 ||
+		read_string(&token, &token_len, &buffer, buffer_end) < 0 ||
+		read_u32(&ndirs, &buffer, buffer_end) < 0)
+		goto corrupt;
+
+	cache->dirload_flags = flags;
+
+	if (token_len > 0 &&
+		(cache->fsmonitor_token = git__strndup(token, token_len)) == NULL)
+		goto corrupt;
+
+	for (i = 0; i < ndirs; ++i) {
+		if (read_dir(cache, &buffer, buffer_end) < 0)
+			goto corrupt;
+	}
+
+	if (buffer != buffer_end)
+		goto corrupt;
+
+	*out = cache;
+	return 0;
+
+corrupt:
+	git_untracked_cache_free(cache);
+	giterr_set(GITERR_INDEX, "Corrupted untracked cache");
+	return -1;
+}
+
+static int write_u32(git_buf *out, uint32_t value)
+{
+	value = htonl(value);
+	return git_buf_put(out, (const char *)&value, sizeof(value));
+}
+
+static int write_stat(git_buf *out, const git_untracked_stat *st)
+{
+	if (write_u32(out, st->ctime) < 0 ||
+		write_u32(out, st->mtime) < 0 ||
+		write_u32(out, st->dev) < 0 ||
+		write_u32(out, st->ino) < 0 ||
+		write_u32(out, st->mode) < 0 ||
+		write_u32(out, st->uid) < 0 ||
+		write_u32(out, st->gid) < 0 ||
+		write_u32(out, (uint32_t)(st->size >> 32)) < 0 ||
+		write_u32(out, (uint32_t)st->size) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int untracked_dir_cmp(const void *a, const void *b)
+{
+	const git_untracked_dir *dir_a = a, *dir_b = b;
+	return strcmp(dir_a->path, dir_b->path);
+}
+
+int git_untracked_cache_write(git_buf *out, git_untracked_cache *cache)
+{
+	git_vector dirs = GIT_VECTOR_INIT;
+	git_untracked_dir *dir;
+	git_untracked_entry *entry;
+	const char *token = cache->fsmonitor_token ? cache->fsmonitor_token : "";
+	size_t i, j;
+	int error = -1;
+
+	if (git_vector_init(&dirs,
+			git_strmap_num_entries(cache->dirs), untracked_dir_cmp) < 0)
+		return -1;
+
+	git_strmap_foreach_value(cache->dirs, dir, {
+		if (git_vector_insert(&dirs, dir) < 0)
+			goto done;
+	});
+
+	/* write the records in a stable order */
+	git_vector_sort(&dirs);
+
+	if (write_u32(out, UNTRACKED_CACHE_VERSION) < 0 ||
+		write_u32(out, cache->dirload_flags) < 0 ||
+		git_buf_put(out, token, strlen(token) + 1) < 0 ||
+		write_u32(out, (uint32_t)dirs.length) < 0)
+		goto done;
+
+	git_vector_foreach(&dirs, i, dir) {
+		uint32_t bits =
+			(dir->mtime_valid ? UNTRACKED_DIR_MTIME_VALID : 0) |
+			(dir->fsmonitor_valid ? UNTRACKED_DIR_FSMONITOR_VALID : 0);
+
+		if (git_buf_put(out, dir->path, strlen(dir->path) + 1) < 0 ||
+			write_stat(out, &dir->st) < 0 ||
+			write_u32(out, bits) < 0 ||
+			write_u32(out, (uint32_t)dir->entries.length) < 0)
+			goto done;
+
+		git_vector_foreach(&dir->entries, j, entry) {
+			if (write_stat(out, &entry->st) < 0 ||
+				git_buf_put(out, entry->name, strlen(entry->name) + 1) < 0)
+				goto done;
+		}
+	}
+
+	error = 0;
+
+done:
+	git_vector_free(&dirs);
+	return error;
+}
+
+/*
+ * Invalidate the records the fsmonitor hook reported: the parent of
+ * each changed path holds its stat data, and a changed directory may
+ * hide any change below it.
+ */
+static int untracked_cache_invalidate(
+	git_untracked_cache *cache, const git_vector *paths)
+{
+	git_strmap *parents = NULL, *trees = NULL;
+	git_buf buf = GIT_BUF_INIT;
+	git_untracked_dir *dir;
+	const char *path;
+	size_t i;
+	int error = -1;
+
+	if ((parents = git_strmap_alloc()) == NULL ||
+		(trees = git_strmap_alloc()) == NULL) {
+		giterr_set_oom();
+		goto done;
+	}
+
+	git_vector_foreach(paths, i, path) {
+		const char *slash = strrchr(path, '/');
+		size_t parent_len = slash ? (size_t)(slash - path) + 1 : 0;
+		char *key;
+
+		if ((key = git__strndup(path, parent_len)) == NULL)
+			goto done;
+		if (git_strmap_exists(parents, key))
+			git__free(key);
+		else {
+			git_strmap_insert(parents, key, NULL, error);
+			if (error < 0) {
+				git__free(key);
+				goto done;
+			}
+		}
+
+		git_buf_clear(&buf);
+		if (git_buf_sets(&buf, path) < 0 || git_path_to_dir(&buf) < 0)
+			goto done;
+		if (!git_strmap_exists(trees, buf.ptr)) {
+			key = git_buf_detach(&buf);
+			git_strmap_insert(trees, key, NULL, error);
+			if (error < 0) {
+				git__free(key);
+				goto done;
+			}
+		}
+	}
+
+	git_strmap_foreach_value(cache->dirs, dir, {
+		const char *scan;
+
+		if (!dir->fsmonitor_valid)
+			continue;
+
+		if (git_strmap_exists(parents, dir->path)) {
+			dir->fsmonitor_valid = 0;
+			continue;
+		}
+
+		/* look for a changed directory at or above this one */
+		for (scan = strchr(dir->path, '/'); scan; scan = strchr(scan + 1, '/')) {
+			git_buf_clear(&buf);
+			if (git_buf_put(&buf, dir->path, scan - dir->path + 1) < 0)
+				goto done;
+			if (git_strmap_exists(trees, buf.ptr)) {
+				dir->fsmonitor_valid = 0;
+				break;
+			}
+		}
+	});
+
+	error = 0;
+
+done:
+	if (parents) {
+		git_strmap_foreach(parents, path, dir, {
+			git__free((char *)path);
+		});
+		git_strmap_free(parents);
+	}
+	if (trees) {
+		git_strmap_foreach(trees, path, dir, {
+			git__free((char *)path);
+		});
+		git_strmap_free(trees);
+	}
+	git_buf_free(&buf);
+	return error;
+}
+
+int git_untracked_cache_begin(
+	git_untracked_cache *cache,
+	git_repository *repo,
+	const char *fsmonitor_hook)
+{
+	git_vector paths = GIT_VECTOR_INIT;
+	char *token = NULL;
+	bool everything = false;
+	int error = 0;
+
+	assert(cache && repo);
+
+	/* listings must be read after this time to trust their mtime */
+	cache->scan_time = time(NULL);
+	cache->fsmonitor_ok = 0;
+
+	git__free(cache->fsmonitor_next_token);
+	cache->fsmonitor_next_token = NULL;
+
+	if (fsmonitor_hook) {
+		error = git_fsmonitor_query(&token, &paths, &everything,
+			repo, fsmonitor_hook, cache->fsmonitor_token);
+
+		/* the hook is an optimization; scan everything when it fails */
+		if (error < 0) {
+			giterr_clear();
+			error = 0;
+			everything = true;
+		} else {
+			if (!cache->fsmonitor_token || everything)
+				untracked_cache_clear_bits(cache);
+			else
+				error = untracked_cache_invalidate(cache, &paths);
+
+			cache->fsmonitor_next_token = token;
+			cache->fsmonitor_ok = 1;
+			token = NULL;
+		}
+	}
+
+	if (!cache->fsmonitor_ok) {
+		/* any change may have been missed without the hook */
+		untracked_cache_clear_bits(cache);
+
+		if (cache->fsmonitor_token) {
+			git__free(cache->fsmonitor_token);
+			cache->fsmonitor_token = NULL;
+			cache->dirty = 1;
+		}
+	}
+
+	git__free(token);
+	git_vector_free_deep(&paths);
+
+	if (!error)
+		cache->active = 1;
+
+	return error;
+}
+
+void git_untracked_cache_end(git_untracked_cache *cache)
+{
+	if (!cache)
+		return;
+
+	/*
+	 * Keep the old token when nothing changed: what changed since it is
+	 * a superset of what changed since the new one, and the cache does
+	 * not need to be written again.
+	 */
+	if (cache->dirty && cache->fsmonitor_next_token) {
+		git__free(cache->fsmonitor_token);
+		cache->fsmonitor_token = cache->fsmonitor_next_token;
+		cache->fsmonitor_next_token = NULL;
+	}
+
+	git__free(cache->fsmonitor_next_token);
+	cache->fsmonitor_next_token = NULL;
+	cache->fsmonitor_ok = 0;
+	cache->active = 0;
+}
+
+static int untracked_dir_output(
+	git_vector *contents, const char *path, size_t path_len,
+	const char *name, const struct stat *st)
+{
+	size_t name_len = strlen(name);
+	git_path_with_stat *ps =
+		git__calloc(1, sizeof(git_path_with_stat) + path_len + name_len + 1);
+	GITERR_CHECK_ALLOC(ps);
+
+	memcpy(ps->path, path, path_len);
+	memcpy(ps->path + path_len, name, name_len);
+	ps->path_len = path_len + name_len;
+	memcpy(&ps->st, st, sizeof(struct stat));
+
+	if (git_vector_insert(contents, ps) < 0) {
+		git__free(ps);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the listing from the record, as it was read */
+static int untracked_dir_load(
+	git_vector *contents, const git_untracked_dir *dir)
+{
+	git_untracked_entry *entry;
+	struct stat st;
+	size_t i, path_len = strlen(dir->path);
+
+	git_vector_foreach(&dir->entries, i, entry) {
+		untracked_stat_to(&st, &entry->st);
+
+		if (untracked_dir_output(contents, dir->path, path_len,
+				entry->name, &st) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The listing from the names of the record, with fresh stat data; this
+ * returns GIT_ENOTFOUND if an entry disappeared or changed its kind.
+ */
+static int untracked_dir_restat(
+	git_vector *contents, bool *changed,
+	git_untracked_dir *dir, const char *path, size_t prefix_len,
+	git_path_stat_cb stat_cb, void *stat_payload)
+{
+	git_untracked_entry *entry;
+	git_untracked_stat snapshot;
+	git_buf full = GIT_BUF_INIT;
+	struct stat st;
+	size_t i, path_len = strlen(dir->path), name_len;
+	int error = 0;
+
+	if (git_buf_set(&full, path, prefix_len) < 0)
+		return -1;
+
+	git_vector_foreach(&dir->entries, i, entry) {
+		bool was_tree;
+
+		name_len = strlen(entry->name);
+		was_tree = (entry->name[name_len - 1] == '/');
+
+		git_buf_truncate(&full, prefix_len);
+		if ((error = git_buf_put(&full, dir->path, path_len)) < 0 ||
+			(error = git_buf_put(&full, entry->name,
+				was_tree ? name_len - 1 : name_len)) < 0)
+			break;
+
+		if ((!stat_cb || stat_cb(&st, full.ptr + prefix_len, stat_payload) != 0) &&
+			p_lstat(full.ptr, &st) < 0) {
+			error = GIT_ENOTFOUND;
+			break;
+		}
+
+		/* same rules as git_path_dirload_with_stat */
+		if (S_ISDIR(st.st_mode)) {
+			bool is_tree;
+
+			if ((error = git_buf_joinpath(&full, full.ptr, ".git")) < 0)
+				break;
+
+			is_tree = (p_access(full.ptr, F_OK) != 0);
+			if (!is_tree)
+				st.st_mode = GIT_FILEMODE_COMMIT;
+
+			if (is_tree != was_tree) {
+				error = GIT_ENOTFOUND;
+				break;
+			}
+		} else if (was_tree || entry->st.mode == GIT_FILEMODE_COMMIT) {
+			error = GIT_ENOTFOUND;
+			break;
+		}
+
+		untracked_stat_from(&snapshot, &st);
+		if (!untracked_stat_equal(&snapshot, &entry->st)) {
+			entry->st = snapshot;
+			*changed = true;
+		}
+
+		if ((error = untracked_dir_output(contents, dir->path, path_len,
+				entry->name, &st)) < 0)
+			break;
+	}
+
+	git_buf_free(&full);
+	return error;
+}
+
+/* forget about the subdirectories that are not in the new listing */
+static int untracked_dir_prune_subdirs(
+	git_untracked_cache *cache,
+	const git_untracked_dir *old, const git_untracked_dir *dir)
+{
+	git_strmap *names;
+	git_untracked_entry *entry;
+	git_buf sub = GIT_BUF_INIT;
+	size_t i;
+	int error = 0;
+
+	if ((names = git_strmap_alloc()) == NULL) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	git_vector_foreach(&dir->entries, i, entry) {
+		if (entry->name[strlen(entry->name) - 1] != '/')
+			continue;
+
+		git_strmap_insert(names, entry->name, entry, error);
+		if (error < 0)
+			goto done;
+	}
+	error = 0;
+
+	git_vector_foreach(&old->entries, i, entry) {
+		if (entry->name[strlen(entry->name) - 1] != '/' ||
+			git_strmap_exists(names, entry->name))
+			continue;
+
+		git_buf_clear(&sub);
+		if ((error = git_buf_join(&sub, '\0', old->path, entry->name)) < 0)
+			goto done;
+
+		untracked_cache_prune(cache, sub.ptr);
+	}
+
+done:
+	git_strmap_free(names);
+	git_buf_free(&sub);
+	return error;
+}
+
+/* remember a listing read from disk in place of the old record */
+static int untracked_dir_store(
+	git_untracked_cache *cache, const char *rel,
+	const git_untracked_stat *st, const git_vector *contents)
+{
+	git_untracked_dir *dir, *old;
+	git_untracked_entry *entry;
+	git_path_with_stat *ps;
+	size_t i, rel_len = strlen(rel);
+	int error;
+
+	if ((dir = untracked_dir_alloc(rel)) == NULL)
+		return -1;
+
+	dir->st = *st;
+	dir->mtime_valid = ((time_t)st->mtime < cache->scan_time);
+	dir->fsmonitor_valid = cache->fsmonitor_ok;
+
+	git_vector_foreach(contents, i, ps) {
+		if ((entry = untracked_entry_alloc(
+				ps->path + rel_len, ps->path_len - rel_len)) == NULL ||
+			git_vector_insert(&dir->entries, entry) < 0) {
+			git__free(entry);
+			goto on_error;
+		}
+
+		untracked_stat_from(&entry->st, &ps->st);
+	}
+
+	if ((old = untracked_dir_lookup(cache, rel)) != NULL &&
+		untracked_dir_prune_subdirs(cache, old, dir) < 0)
+		goto on_error;
+
+	git_strmap_insert2(cache->dirs, dir->path, dir, old, error);
+	if (error < 0)
+		goto on_error;
+
+	untracked_dir_free(old);
+	cache->dirty = 1;
+	return 0;
+
+on_error:
+	untracked_dir_free(dir);
+	return -1;
+}
+
+int git_untracked_cache_dirload(
+	git_untracked_cache *cache,
+	const char *path,
+	size_t prefix_len,
+	uint32_t flags,
+	git_path_stat_cb stat_cb,
+	void *stat_payload,
+	git_vector *contents)
+{
+	const char *rel = path + prefix_len;
+	git_untracked_dir *dir;
+	git_untracked_stat st;
+	struct stat dir_st;
+	int error;
+
+	/* directories would have been read differently */
+	if (cache->dirload_flags != flags) {
+		untracked_cache_clear_dirs(cache);
+		cache->dirload_flags = flags;
+		cache->dirty = 1;
+	}
+
+	dir = untracked_dir_lookup(cache, rel);
+
+	if (dir && dir->fsmonitor_valid && cache->fsmonitor_ok)
+		error = untracked_dir_load(contents, dir);
+	else
+		error = GIT_ENOTFOUND;
+
+	if (error != GIT_ENOTFOUND)
+		goto done;
+
+	if (p_lstat(path, &dir_st) < 0)
+		return git_path_dirload_with_stat_ext(path, prefix_len, flags,
+			NULL, NULL, stat_cb, stat_payload, contents);
+
+	untracked_stat_from(&st, &dir_st);
+
+	if (dir && dir->mtime_valid && untracked_stat_equal(&dir->st, &st)) {
+		bool changed = false;
+
+		error = untracked_dir_restat(contents, &changed, dir,
+			path, prefix_len, stat_cb, stat_payload);
+		if (error != GIT_ENOTFOUND) {
+			if (!error && (changed || dir->fsmonitor_valid != cache->fsmonitor_ok)) {
+				dir->fsmonitor_valid = cache->fsmonitor_ok;
+				cache->dirty = 1;
+			}
+			goto done;
+		}
+
+		git_vector_free_deep(contents);
+	}
+
+	if ((error = git_path_dirload_with_stat_ext(path, prefix_len, flags,
+			NULL, NULL, stat_cb, stat_payload, contents)) < 0)
+		return error;
+
+	error = untracked_dir_store(cache, rel, &st, contents);
+
+done:
+	if (!error)
+		git_vector_sort(contents);
+
+	return error;
+}
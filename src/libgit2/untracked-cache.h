@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_untracked_cache_h__
+#define INCLUDE_untracked_cache_h__
+
+#include "common.h"
+#include "buffer.h"
+#include "strmap.h"
+#include "vector.h"
+#include "path.h"
+
+/*
+ * The untracked cache remembers the listing of the directories of the
+ * working directory, with the stat data of each entry, so that status
+ * does not have to read directories that did not change.
+ *
+ * A listing is reused in two ways:
+ *
+ * - when the directory has the same stat data as when it was read,
+ *   and it was not modified in the second it was read, its names are
+ *   still valid and only the entries are stat'ed again;
+ *
+ * - when a filesystem monitor hook (core.fsmonitor) reports no change
+ *   in the directory since the token that was saved with the cache,
+ *   the whole listing is returned without any system call.
+ */
+
+typedef struct {
+	uint32_t ctime;
+	uint32_t mtime;
+	uint32_t dev;
+	uint32_t ino;
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	uint64_t size;
+} git_untracked_stat;
+
+typedef struct {
+	git_untracked_stat st;
+	char name[GIT_FLEX_ARRAY]; /* directories end with a slash */
+} git_untracked_entry;
+
+typedef struct {
+	char *path; /* relative to the workdir, with a trailing slash */
+	git_untracked_stat st;
+	git_vector entries;
+	unsigned int mtime_valid:1, /* read after the last change of mtime */
+		fsmonitor_valid:1; /* unchanged since the fsmonitor token */
+} git_untracked_dir;
+
+typedef struct {
+	git_strmap *dirs;
+	char *fsmonitor_token;
+	uint32_t dirload_flags;
+
+	/* state of a scan, between begin and end */
+	char *fsmonitor_next_token;
+	time_t scan_time;
+	unsigned int dirty:1,
+		active:1,
+		fsmonitor_ok:1;
+} git_untracked_cache;
+
+int git_untracked_cache_new(git_untracked_cache **out);
+int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size);
+int git_untracked_cache_write(git_buf *out, git_untracked_cache *cache);
+void git_untracked_cache_free(git_untracked_cache *cache);
+
+/*
+ * Start a scan of the working directory. The fsmonitor hook, if any,
+ * is queried here and the directories it reports are invalidated.
+ */
+int git_untracked_cache_begin(
+	git_untracked_cache *cache,
+	git_repository *repo,
+	const char *fsmonitor_hook);
+
+/* End a scan; the cache needs to be written if `cache->dirty` is set */
+void git_untracked_cache_end(git_untracked_cache *cache);
+
+/* Same as `git_path_dirload_with_stat_ext` without a start and end */
+int git_untracked_cache_dirload(
+	git_untracked_cache *cache,
+	const char *path,
+	size_t prefix_len,
+	uint32_t flags,
+	git_path_stat_cb stat_cb,
+	void *stat_payload,
+	git_vector *contents);
+
+#endif
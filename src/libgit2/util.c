@@ -42,6 +42,11 @@ int git_libgit2_capabilities()
 /* Declarations for tuneable settings */
 extern size_t git_mwindow__window_size;
 extern size_t git_mwindow__mapped_limit;
+extern unsigned int git_packbuilder__default_threads;
+extern unsigned int git_indexer__default_threads;
+extern size_t git_pack__cache_memory_limit;
+extern unsigned int git_index__add_threads;
+extern unsigned int git_index__preload_threads;
 
 static int config_level_to_futils_dir(int config_level)
 {
@@ -114,7 +119,7 @@ int git_libgit2_opts(int key, ...)
 		break;
 
 	case GIT_OPT_GET_CACHED_MEMORY:
-		*(va_arg(ap, ssize_t *)) = git_cache__current_storage.val;
+		*(va_arg(ap, ssize_t *)) = git_atomic_ssize_get(&git_cache__current_storage);
 		*(va_arg(ap, ssize_t *)) = git_cache__max_storage;
 		break;
 
@@ -130,6 +135,54 @@ int git_libgit2_opts(int key, ...)
 	case GIT_OPT_SET_TEMPLATE_PATH:
 		error = git_futils_dirs_set(GIT_FUTILS_DIR_TEMPLATE, va_arg(ap, const char *));
 		break;
+
+	case GIT_OPT_GET_PACK_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_packbuilder__default_threads;
+		break;
+
+	case GIT_OPT_SET_PACK_THREADS:
+		git_packbuilder__default_threads = va_arg(ap, unsigned int);
+		break;
+
+	case GIT_OPT_GET_INDEXER_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_indexer__default_threads;
+		break;
+
+	case GIT_OPT_SET_INDEXER_THREADS:
+		git_indexer__default_threads = va_arg(ap, unsigned int);
+		break;
+
+	case GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT:
+		*(va_arg(ap, size_t *)) = git_pack__cache_memory_limit;
+		break;
+
+	case GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT:
+		git_pack__cache_memory_limit = va_arg(ap, size_t);
+		break;
+
+	case GIT_OPT_GET_CACHE_OBJECT_LIMIT:
+		{
+			git_otype type = (git_otype)va_arg(ap, int);
+			size_t *size = va_arg(ap, size_t *);
+			error = git_cache_get_max_object_size(size, type);
+			break;
+		}
+
+	case GIT_OPT_GET_INDEX_ADD_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_index__add_threads;
+		break;
+
+	case GIT_OPT_SET_INDEX_ADD_THREADS:
+		git_index__add_threads = va_arg(ap, unsigned int);
+		break;
+
+	case GIT_OPT_GET_INDEX_PRELOAD_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_index__preload_threads;
+		break;
+
+	case GIT_OPT_SET_INDEX_PRELOAD_THREADS:
+		git_index__preload_threads = va_arg(ap, unsigned int);
+		break;
 	}
 
 	va_end(ap);
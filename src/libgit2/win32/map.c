@@ -113,4 +113,13 @@ int p_munmap(git_map *map)
 	return error;
 }
 
+/* The advice is a no-op, PrefetchVirtualMemory needs Windows 8 */
+int p_madvise(git_map *map, int advice)
+{
+	GIT_UNUSED(map);
+	GIT_UNUSED(advice);
+
+	return 0;
+}
+
 #endif
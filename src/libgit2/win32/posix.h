@@ -49,6 +49,8 @@ extern int p_stat(const char* path, struct stat* buf);
 extern int p_chdir(const char* path);
 extern int p_chmod(const char* path, mode_t mode);
 extern int p_rmdir(const char* path);
+extern int p_utime_now(const char* path);
+#define p_msleep(ms) Sleep(ms)
 extern int p_access(const char* path, mode_t mode);
 extern int p_fsync(int fd);
 extern int p_open(const char *path, int flags, ...);
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <io.h>
 #include <fcntl.h>
+#include <sys/utime.h>
 #include <ws2tcpip.h>
 
 int p_unlink(const char *path)
@@ -337,6 +338,13 @@ int p_chmod(const char* path, mode_t mode)
 	return _wchmod(buf, mode);
 }
 
+int p_utime_now(const char* path)
+{
+	git_win32_path buf;
+	git_win32_path_from_c(buf, path);
+	return _wutime(buf, NULL);
+}
+
 int p_rmdir(const char* path)
 {
 	int error;